@@ -0,0 +1,336 @@
+#!/bin/bash
+
+# Benchmark execution script for the gluster-coreutils project. It runs the
+# utilities against the same kind of temporary Gluster volume that
+# run-tests.sh sets up (or against the volume given by GLUSTER_VOLUME,
+# GLUSTER_BRICK_DIR and GLUSTER_MOUNT_DIR, as described there) and measures
+# the paths that matter in production: large file throughput for gfcat, gfput
+# and gfcp at several buffer sizes, the rate at which small files are created,
+# stat'ed and removed, gfls on large directories and gftail -n on large files.
+#
+# Every measurement is the best of BENCH_RUNS runs, each preceded by dropping
+# the page cache so that the bricks read from disk, and is appended as one
+# tab separated line to BENCH_RESULTS:
+#
+#   timestamp  coreutils  glusterfs  benchmark  parameters  runs  seconds  rate  unit
+#
+# where timestamp identifies the run of this script and the two versions
+# identify what was measured, so that the results of an upgrade can be set
+# against those of the release it replaces. If BENCH_BASELINE names a results
+# file from an earlier run, the rates of this run are printed next to the most
+# recent rates recorded there for the same benchmark and parameters.
+#
+# The following environment variables tune the benchmarks:
+#
+#   BENCH_ONLY          benchmarks to run (default: cat put cp small readdir tail)
+#   BENCH_RUNS          runs of each measurement (default: 3)
+#   BENCH_DROP_CACHES   drop the page cache before each run (default: 1)
+#   BENCH_FILE_SIZE     size of the large file in MiB (default: 1024)
+#   BENCH_BUFFER_SIZES  --buffer-size values (default: 64K 256K 1M 4M auto)
+#   BENCH_JOBS          jobs for gfcp -j and gfcli --batch -j (default: 8)
+#   BENCH_SMALL_FILES   number of small files (default: 10000)
+#   BENCH_DIR_SIZES     entries of the directories listed (default: 10000
+#                       100000 1000000)
+#   BENCH_TAIL_LINES    values of gftail -n (default: 10 10000 1000000)
+#   BENCH_RESULTS       results file (default: bench-results.tsv)
+#   BENCH_BASELINE      results file to compare against (default: none)
+
+# prevent unnecessary headaches
+set -u
+
+DIR=$(cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd)
+
+export BUILD_DIR="${BUILD_DIR:-$DIR/build}"
+export CLI="gluster --mode=script --wignore"
+export HOST="::1"
+
+BENCH_ONLY="${BENCH_ONLY:-cat put cp small readdir tail}"
+BENCH_RUNS="${BENCH_RUNS:-3}"
+BENCH_DROP_CACHES="${BENCH_DROP_CACHES:-1}"
+BENCH_FILE_SIZE="${BENCH_FILE_SIZE:-1024}"
+BENCH_BUFFER_SIZES="${BENCH_BUFFER_SIZES:-64K 256K 1M 4M auto}"
+BENCH_JOBS="${BENCH_JOBS:-8}"
+BENCH_SMALL_FILES="${BENCH_SMALL_FILES:-10000}"
+BENCH_DIR_SIZES="${BENCH_DIR_SIZES:-10000 100000 1000000}"
+BENCH_TAIL_LINES="${BENCH_TAIL_LINES:-10 10000 1000000}"
+BENCH_RESULTS="${BENCH_RESULTS:-$DIR/bench-results.tsv}"
+BENCH_BASELINE="${BENCH_BASELINE:-}"
+
+source "$DIR/tests/util/log.rc"
+source "$DIR/tests/util/env.rc"
+
+function drop_caches() {
+        if [[ $BENCH_DROP_CACHES -ne 0 ]]; then
+                sync
+                echo 3 > /proc/sys/vm/drop_caches
+        fi
+}
+
+# Runs the given command with its output discarded and prints the number of
+# seconds it took, or fails if the command did.
+function elapsed() {
+        local start end
+
+        start=$(date +%s%N)
+        "$@" > /dev/null || return 1
+        end=$(date +%s%N)
+
+        echo "$(( end - start ))" | awk '{printf "%.6f\n", $1 / 1e9}'
+}
+
+# Appends the result of a measurement to the results file and prints it.
+#
+# record BENCHMARK PARAMETERS SECONDS AMOUNT UNIT
+#
+# AMOUNT is the number of bytes or operations done in SECONDS, and UNIT the
+# unit of the resulting rate.
+function record() {
+        local rate
+
+        rate=$(awk -v amount="$4" -v seconds="$3" \
+                'BEGIN {printf "%.2f", (seconds > 0 ? amount / seconds : 0)}')
+
+        printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$TIMESTAMP" \
+                "$COREUTILS_VERSION" "$GLUSTER_VERSION" "$1" "$2" \
+                "$BENCH_RUNS" "$3" "$rate" "$5" >> "$BENCH_RESULTS"
+
+        if [[ $5 == "B/s" ]]; then
+                rate=$(awk -v rate="$rate" 'BEGIN {printf "%.2f MiB/s", rate / 1048576}')
+        else
+                rate="$rate $5"
+        fi
+
+        printf "* %-12s %-40s %10ss %16s\n" "$1" "$2" "$3" "$rate"
+}
+
+# Runs a command BENCH_RUNS times and records the fastest run.
+#
+# measure BENCHMARK PARAMETERS AMOUNT UNIT COMMAND...
+function measure() {
+        local name=$1 params=$2 amount=$3 unit=$4 best="" seconds run
+        shift 4
+
+        for (( run = 0; run < BENCH_RUNS; run++ )); do
+                drop_caches
+
+                seconds=$(elapsed "$@")
+                if [[ $? -ne 0 ]]; then
+                        error "$name $params failed\n"
+                        return 1
+                fi
+
+                best=$(awk -v a="$seconds" -v b="${best:-$seconds}" \
+                        'BEGIN {print a < b ? a : b}')
+        done
+
+        record "$name" "$params" "$best" "$amount" "$unit"
+}
+
+function generate_bench_data() {
+        info "Generating benchmark files and directories:\n"
+
+        BENCH_DIR=$(mktemp -d --tmpdir="$GLUSTER_MOUNT_DIR$ROOT_DIR" BENCHXXXXXX)
+        BENCH_DIR=$(basename "$BENCH_DIR")
+        BENCH_LOCAL_DIR=$(mktemp -d --tmpdir=/tmp BENCHXXXXXX)
+        printf "* $BENCH_DIR [directory]\n"
+
+        BENCH_URL="glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$BENCH_DIR"
+        BENCH_MOUNT="$GLUSTER_MOUNT_DIR$ROOT_DIR/$BENCH_DIR"
+        BENCH_BYTES=$(( BENCH_FILE_SIZE * 1024 * 1024 ))
+
+        dd if=/dev/urandom of="$BENCH_LOCAL_DIR/large" bs=1M \
+                count="$BENCH_FILE_SIZE" 2> /dev/null
+        cp "$BENCH_LOCAL_DIR/large" "$BENCH_MOUNT/large"
+        printf "* large: $BENCH_FILE_SIZE MiB\n"
+
+        base64 -w 100 /dev/urandom | head -c "$BENCH_BYTES" > "$BENCH_MOUNT/text"
+        printf "* text: $BENCH_FILE_SIZE MiB\n"
+
+        head -c 4096 /dev/urandom > "$BENCH_LOCAL_DIR/small"
+}
+
+function cleanup_bench_data() {
+        rm -rf "$BENCH_MOUNT" "$BENCH_LOCAL_DIR"
+}
+
+function bench_cat() {
+        for size in $BENCH_BUFFER_SIZES; do
+                measure cat "buffer-size=$size" "$BENCH_BYTES" B/s \
+                        "$BUILD_DIR/bin/gfcat" --buffer-size="$size" \
+                        "$BENCH_URL/large"
+        done
+}
+
+function put_large() {
+        "$BUILD_DIR/bin/gfput" --overwrite "$@" < "$BENCH_LOCAL_DIR/large"
+}
+
+function bench_put() {
+        for size in $BENCH_BUFFER_SIZES; do
+                measure put "buffer-size=$size" "$BENCH_BYTES" B/s \
+                        put_large --buffer-size="$size" "$BENCH_URL/put"
+        done
+}
+
+function bench_cp() {
+        local cp="$BUILD_DIR/bin/gfcp"
+
+        for size in $BENCH_BUFFER_SIZES; do
+                measure cp "local-remote buffer-size=$size" "$BENCH_BYTES" B/s \
+                        $cp --buffer-size="$size" "$BENCH_LOCAL_DIR/large" \
+                        "$BENCH_URL/cp"
+                measure cp "remote-local buffer-size=$size" "$BENCH_BYTES" B/s \
+                        $cp --buffer-size="$size" "$BENCH_URL/large" \
+                        "$BENCH_LOCAL_DIR/cp"
+                measure cp "remote-remote buffer-size=$size" "$BENCH_BYTES" B/s \
+                        $cp --buffer-size="$size" "$BENCH_URL/large" \
+                        "$BENCH_URL/cp"
+        done
+
+        measure cp "local-remote jobs=$BENCH_JOBS" "$BENCH_BYTES" B/s \
+                $cp -j "$BENCH_JOBS" "$BENCH_LOCAL_DIR/large" "$BENCH_URL/cp"
+        measure cp "remote-local jobs=$BENCH_JOBS" "$BENCH_BYTES" B/s \
+                $cp -j "$BENCH_JOBS" "$BENCH_URL/large" "$BENCH_LOCAL_DIR/cp"
+
+        rm -f "$BENCH_LOCAL_DIR/cp"
+}
+
+# Writes a gfcli batch file that runs COMMAND on each of the small files.
+function small_batch() {
+        for (( i = 0; i < BENCH_SMALL_FILES; i++ )); do
+                printf "$1\n" "$ROOT_DIR/$BENCH_DIR/small/$i"
+        done > "$BENCH_LOCAL_DIR/$2.batch"
+}
+
+function run_batch() {
+        "$BUILD_DIR/bin/gfcli" --batch="$BENCH_LOCAL_DIR/$1.batch" \
+                -j "$BENCH_JOBS" "glfs://$HOST/$GLUSTER_VOLUME"
+}
+
+function bench_small() {
+        local params="files=$BENCH_SMALL_FILES jobs=$BENCH_JOBS"
+        local -A best
+        local seconds run phase
+
+        small_batch "cp file://$BENCH_LOCAL_DIR/small %s" create
+        small_batch "stat %s" stat
+        small_batch "rm %s" unlink
+
+        mkdir -p "$BENCH_MOUNT/small"
+
+        # The phases depend on each other, so the fastest of each is kept
+        # across the runs instead of measuring them one at a time.
+        for (( run = 0; run < BENCH_RUNS; run++ )); do
+                for phase in create stat unlink; do
+                        drop_caches
+
+                        seconds=$(elapsed run_batch $phase)
+                        if [[ $? -ne 0 ]]; then
+                                error "small $phase failed\n"
+                                return 1
+                        fi
+
+                        best[$phase]=$(awk -v a="$seconds" -v b="${best[$phase]:-$seconds}" \
+                                'BEGIN {print a < b ? a : b}')
+                done
+        done
+
+        for phase in create stat unlink; do
+                record $phase "$params" "${best[$phase]}" "$BENCH_SMALL_FILES" ops/s
+        done
+
+        rmdir "$BENCH_MOUNT/small"
+}
+
+function bench_readdir() {
+        local entries
+
+        for entries in $BENCH_DIR_SIZES; do
+                # Creating the entries through the mount would take far longer
+                # than listing them, so they are created on the brick and
+                # looked up once through the mount to give them their gfids.
+                local brick="$GLUSTER_BRICK_DIR$ROOT_DIR/$BENCH_DIR/dir$entries"
+
+                mkdir "$brick"
+                (cd "$brick" && seq -f "file%.0f" 1 "$entries" | xargs touch)
+                ls -lU "$BENCH_MOUNT/dir$entries" > /dev/null
+
+                measure ls "entries=$entries" "$entries" entries/s \
+                        "$BUILD_DIR/bin/gfls" "$BENCH_URL/dir$entries"
+                measure ls "entries=$entries long" "$entries" entries/s \
+                        "$BUILD_DIR/bin/gfls" -l "$BENCH_URL/dir$entries"
+
+                rm -rf "$BENCH_MOUNT/dir$entries"
+        done
+}
+
+function bench_tail() {
+        for lines in $BENCH_TAIL_LINES; do
+                measure tail "lines=$lines" "$lines" lines/s \
+                        "$BUILD_DIR/bin/gftail" -n "$lines" "$BENCH_URL/text"
+        done
+}
+
+# Prints the rates of this run next to the latest ones recorded in the
+# baseline for the same benchmark and parameters. The baseline may be the
+# results file itself, in which case this run is compared with the last.
+function compare_results() {
+        highlight "==> Comparing against $BENCH_BASELINE\n"
+
+        awk -F '\t' -v timestamp="$TIMESTAMP" '
+                FNR == NR {
+                        if (FNR > 1 && $1 != timestamp) {
+                                baseline[$4 FS $5] = $8
+                                version[$4 FS $5] = $2
+                        }
+                        next
+                }
+                $1 == timestamp && ($4 FS $5) in baseline {
+                        old = baseline[$4 FS $5]
+                        printf "* %-12s %-40s %16s (%s) -> %16s %+7.1f%%\n", $4, $5,
+                                old, version[$4 FS $5], $8,
+                                (old > 0 ? ($8 - old) * 100 / old : 0)
+                }' "$BENCH_BASELINE" "$BENCH_RESULTS"
+}
+
+function run_benchmarks() {
+        highlight "==> Executing benchmarks\n"
+
+        TIMESTAMP=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+        COREUTILS_VERSION=$("$BUILD_DIR/bin/gfcli" --version | head -n 1 | awk '{print $NF}')
+        GLUSTER_VERSION=$(gluster --version | head -n 1 | awk '{print $2}')
+
+        if [[ ! -s $BENCH_RESULTS ]]; then
+                printf "timestamp\tcoreutils\tglusterfs\tbenchmark\tparameters\truns\tseconds\trate\tunit\n" \
+                        > "$BENCH_RESULTS"
+        fi
+
+        generate_bench_data
+
+        for bench in $BENCH_ONLY; do
+                bench_$bench
+        done
+
+        cleanup_bench_data
+
+        if [[ -n $BENCH_BASELINE ]]; then
+                compare_results
+        fi
+}
+
+function main() {
+        check_root
+        check_environment
+
+        if [[ -z ${GLUSTER_BRICK_DIR+x} || -z ${GLUSTER_MOUNT_DIR+x} || -z ${GLUSTER_VOLUME+x} ]]; then
+                setup_temporary_test_environment
+                run_benchmarks
+                cleanup_temporary_test_environment
+        else
+                setup_test_environment
+                run_benchmarks
+                cleanup_test_environment
+        fi
+}
+
+main
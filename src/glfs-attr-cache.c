@@ -0,0 +1,556 @@
+/**
+ * Keeps what lookups on a connection found for a short while, so that the
+ * commands run one after another in the shell do not each have to ask the
+ * volume again about the same paths.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-attr-cache.h"
+#include "glfs-handle.h"
+#include "glfs-stats.h"
+#include "glfs-util.h"
+
+#include <errno.h>
+#include <glusterfs/api/glfs.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define ATTR_CACHE_BUCKETS 4096
+#define ATTR_CACHE_MAX 65536
+
+/**
+ * A connection the cache is enabled for.
+ *
+ * fs: The connection.
+ * timeout: How long entries are kept, in nanoseconds.
+ */
+struct attr_cache_volume {
+        glfs_t *fs;
+        uint64_t timeout;
+        struct attr_cache_volume *next;
+};
+
+/**
+ * What a lookup of a path found, either following a symbolic link at its end
+ * or not.
+ *
+ * expires: When the answer goes stale, or 0 if there is none.
+ * error: The error the lookup failed with, or 0.
+ * statbuf: The attributes found, if error is 0.
+ * handle: A reference to the handle found, or NULL.
+ */
+struct attr_cache_answer {
+        uint64_t expires;
+        int error;
+        struct stat statbuf;
+        struct gluster_handle *handle;
+};
+
+/**
+ * The answers known for a path on a connection; answers[0] is that of
+ * lstat (), answers[1] that of stat ().
+ */
+struct attr_cache_entry {
+        glfs_t *fs;
+        char *path;
+        struct attr_cache_answer answers[2];
+        struct attr_cache_entry *next;
+};
+
+static struct {
+        pthread_mutex_t lock;
+        struct attr_cache_volume *volumes;
+        struct attr_cache_entry *buckets[ATTR_CACHE_BUCKETS];
+        size_t num_volumes;
+        size_t count;
+} attr_cache = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t
+now_ns ()
+{
+        struct timespec now;
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+
+        return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static size_t
+attr_cache_bucket (glfs_t *fs, const char *path)
+{
+        uint64_t hash = 14695981039346656037ULL ^ (uintptr_t) fs;
+
+        for (; *path; path++) {
+                hash = (hash ^ (unsigned char) *path) * 1099511628211ULL;
+        }
+
+        return hash % ATTR_CACHE_BUCKETS;
+}
+
+/**
+ * Returns the timeout of fs in nanoseconds, or 0 if the cache is not enabled
+ * for it. Must be called with the lock held.
+ */
+static uint64_t
+attr_cache_timeout (glfs_t *fs)
+{
+        struct attr_cache_volume *volume;
+
+        for (volume = attr_cache.volumes; volume; volume = volume->next) {
+                if (volume->fs == fs) {
+                        return volume->timeout;
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * Returns the key of path if the cache is enabled for fs, or NULL. It is the
+ * responsibility of the caller to free the return value.
+ */
+static char *
+attr_cache_key (glfs_t *fs, const char *path)
+{
+        // The cache is off unless asked for, so spare everyone else the key.
+        if (__atomic_load_n (&attr_cache.num_volumes, __ATOMIC_RELAXED) == 0 || fs == NULL) {
+                return NULL;
+        }
+
+        return canonical_path (path);
+}
+
+static struct attr_cache_entry *
+attr_cache_find (glfs_t *fs, const char *key, size_t bucket)
+{
+        struct attr_cache_entry *entry;
+
+        for (entry = attr_cache.buckets[bucket]; entry; entry = entry->next) {
+                if (entry->fs == fs && strcmp (entry->path, key) == 0) {
+                        return entry;
+                }
+        }
+
+        return NULL;
+}
+
+static void
+attr_cache_entry_free (struct attr_cache_entry *entry)
+{
+        gluster_handle_unref (entry->answers[0].handle);
+        gluster_handle_unref (entry->answers[1].handle);
+        free (entry->path);
+        free (entry);
+}
+
+/**
+ * Returns whether entry is that of path, of the given length, or of a path
+ * below it, or of the directory holding it, whose path is parent long. Paths
+ * match on every connection, since commands may well reach the volume of one
+ * through another of their own. A NULL path matches every entry of fs.
+ */
+static bool
+attr_cache_matches (const struct attr_cache_entry *entry, glfs_t *fs, const char *path,
+                    size_t length, size_t parent)
+{
+        if (path == NULL) {
+                return entry->fs == fs;
+        }
+
+        if (strcmp (path, "/") == 0) {
+                return true;
+        }
+
+        if (strncmp (entry->path, path, length) == 0
+                        && (entry->path[length] == '\0' || entry->path[length] == '/')) {
+                return true;
+        }
+
+        return strlen (entry->path) == parent && strncmp (entry->path, path, parent) == 0;
+}
+
+/**
+ * Removes the entries matching path on fs as attr_cache_matches () does, and
+ * also those that have expired when expired is set. Must be called with the
+ * lock held.
+ */
+static void
+attr_cache_remove (glfs_t *fs, const char *path, bool expired)
+{
+        struct attr_cache_entry **link;
+        struct attr_cache_entry *entry;
+        size_t length = path ? strlen (path) : 0;
+        size_t parent = 0;
+        uint64_t now = expired ? now_ns () : 0;
+
+        if (path) {
+                parent = strrchr (path, '/') - path;
+                // The parent of a path right below the root is the root.
+                if (parent == 0) {
+                        parent = 1;
+                }
+        }
+
+        for (size_t i = 0; attr_cache.count > 0 && i < ATTR_CACHE_BUCKETS; i++) {
+                link = &attr_cache.buckets[i];
+                while ((entry = *link) != NULL) {
+                        if (!attr_cache_matches (entry, fs, path, length, parent)
+                                        && !(expired && entry->answers[0].expires <= now
+                                                && entry->answers[1].expires <= now)) {
+                                link = &entry->next;
+                                continue;
+                        }
+
+                        *link = entry->next;
+                        __atomic_sub_fetch (&attr_cache.count, 1, __ATOMIC_RELAXED);
+                        attr_cache_entry_free (entry);
+                }
+        }
+}
+
+/**
+ * Enables the cache for fs, keeping what lookups find for timeout seconds. A
+ * timeout of 0 leaves it disabled.
+ */
+void
+gluster_attr_cache_enable (glfs_t *fs, unsigned int timeout)
+{
+        struct attr_cache_volume *volume;
+
+        if (timeout == 0) {
+                return;
+        }
+
+        pthread_mutex_lock (&attr_cache.lock);
+
+        if (attr_cache_timeout (fs) == 0) {
+                volume = malloc (sizeof (*volume));
+                if (volume) {
+                        volume->fs = fs;
+                        volume->timeout = (uint64_t) timeout * 1000000000;
+                        volume->next = attr_cache.volumes;
+                        attr_cache.volumes = volume;
+                        __atomic_add_fetch (&attr_cache.num_volumes, 1, __ATOMIC_RELAXED);
+                }
+        }
+
+        pthread_mutex_unlock (&attr_cache.lock);
+
+        gluster_attr_cache_upcalls (fs);
+}
+
+/**
+ * Disables the cache for fs and forgets all about it, which must be done
+ * before it is finalized.
+ */
+void
+gluster_attr_cache_disable (glfs_t *fs)
+{
+        struct attr_cache_volume **link;
+        struct attr_cache_volume *volume;
+
+        if (__atomic_load_n (&attr_cache.num_volumes, __ATOMIC_RELAXED) == 0) {
+                return;
+        }
+
+        pthread_mutex_lock (&attr_cache.lock);
+
+        for (link = &attr_cache.volumes; (volume = *link) != NULL; link = &volume->next) {
+                if (volume->fs == fs) {
+                        *link = volume->next;
+                        __atomic_sub_fetch (&attr_cache.num_volumes, 1, __ATOMIC_RELAXED);
+                        free (volume);
+                        break;
+                }
+        }
+
+        attr_cache_remove (fs, NULL, false);
+
+        pthread_mutex_unlock (&attr_cache.lock);
+}
+
+#ifdef HAVE_GLFS_UPCALL_REGISTER
+static void
+upcall_cbk (struct glfs_upcall *upcall, void *data)
+{
+        // Telling which path an invalidated inode was looked up by would take
+        // a reverse map, and upcalls are rare enough to forget it all instead.
+        if (glfs_upcall_get_reason (upcall) == GLFS_UPCALL_INODE_INVALIDATE) {
+                gluster_attr_cache_clear (glfs_upcall_get_fs (upcall));
+        }
+
+        glfs_free (upcall);
+}
+#endif
+
+/**
+ * Asks for the cache invalidation upcalls of fs if the cache is enabled for
+ * it. This has to be done again by anything else that registers upcalls of
+ * its own once it unregisters them, as there is only one registration for
+ * each connection.
+ */
+void
+gluster_attr_cache_upcalls (glfs_t *fs)
+{
+#ifdef HAVE_GLFS_UPCALL_REGISTER
+        uint64_t timeout;
+
+        if (__atomic_load_n (&attr_cache.num_volumes, __ATOMIC_RELAXED) == 0) {
+                return;
+        }
+
+        pthread_mutex_lock (&attr_cache.lock);
+        timeout = attr_cache_timeout (fs);
+        pthread_mutex_unlock (&attr_cache.lock);
+
+        if (timeout > 0) {
+                // Without upcalls, entries only go stale by their timeout.
+                glfs_upcall_register (fs, GLFS_EVENT_INODE_INVALIDATE, upcall_cbk, NULL);
+        }
+#endif
+}
+
+/**
+ * Forgets everything known about fs, keeping the cache enabled.
+ */
+void
+gluster_attr_cache_clear (glfs_t *fs)
+{
+        if (__atomic_load_n (&attr_cache.count, __ATOMIC_RELAXED) == 0) {
+                return;
+        }
+
+        pthread_mutex_lock (&attr_cache.lock);
+        attr_cache_remove (fs, NULL, false);
+        pthread_mutex_unlock (&attr_cache.lock);
+}
+
+/**
+ * Forgets what is known about path, about the paths below it and about the
+ * directory holding it, once it has been created, changed or removed through
+ * fs.
+ */
+void
+gluster_attr_cache_invalidate (glfs_t *fs, const char *path)
+{
+        char *key;
+
+        if (__atomic_load_n (&attr_cache.count, __ATOMIC_RELAXED) == 0) {
+                return;
+        }
+
+        key = canonical_path (path);
+
+        pthread_mutex_lock (&attr_cache.lock);
+        // Forgetting too much is always safe, even all of fs without a key.
+        attr_cache_remove (fs, key, false);
+        pthread_mutex_unlock (&attr_cache.lock);
+
+        free (key);
+}
+
+/**
+ * Looks up path on fs in the cache, following a symbolic link at its end if
+ * follow is set. On a hit, statbuf is filled if it is not NULL and, if handle
+ * is not NULL, a reference to the handle found is returned in it; when a
+ * handle is asked for, only answers that have one count.
+ *
+ * Returns 0 on a hit, -1 with errno set if the path is known not to exist,
+ * and 1 if nothing fresh is known.
+ */
+int
+gluster_attr_cache_get (glfs_t *fs, const char *path, bool follow,
+                        struct stat *statbuf, struct gluster_handle **handle)
+{
+        struct attr_cache_answer *answer;
+        struct attr_cache_entry *entry;
+        char *key = attr_cache_key (fs, path);
+        int error = 0;
+        int ret = 1;
+
+        if (key == NULL) {
+                return 1;
+        }
+
+        pthread_mutex_lock (&attr_cache.lock);
+
+        entry = attr_cache_find (fs, key, attr_cache_bucket (fs, key));
+        if (entry == NULL) {
+                goto out;
+        }
+
+        answer = &entry->answers[follow ? 1 : 0];
+        if (answer->expires <= now_ns ()) {
+                goto out;
+        }
+
+        if (answer->error) {
+                ret = -1;
+                error = answer->error;
+                goto out;
+        }
+
+        if (handle) {
+                if (answer->handle == NULL) {
+                        goto out;
+                }
+
+                *handle = gluster_handle_ref (answer->handle);
+        }
+
+        if (statbuf) {
+                *statbuf = answer->statbuf;
+        }
+
+        ret = 0;
+
+out:
+        pthread_mutex_unlock (&attr_cache.lock);
+        free (key);
+
+        if (ret == -1) {
+                errno = error;
+        }
+
+        return ret;
+}
+
+/**
+ * Records what a lookup of path on fs found, following a symbolic link at its
+ * end if follow is set: either the attributes in statbuf and the handle, which
+ * may be NULL, or the error it failed with. Only a missing path is worth
+ * remembering among failures. Nothing is recorded once the cache is full even
+ * after dropping what has expired, which only costs the round trips the cache
+ * would have saved.
+ */
+void
+gluster_attr_cache_put (glfs_t *fs, const char *path, bool follow,
+                        const struct stat *statbuf, struct gluster_handle *handle,
+                        int error)
+{
+        struct attr_cache_answer *answer;
+        struct attr_cache_entry *entry;
+        char *key;
+        uint64_t timeout;
+        size_t bucket;
+
+        if (error != 0 && error != ENOENT) {
+                return;
+        }
+
+        key = attr_cache_key (fs, path);
+        if (key == NULL) {
+                return;
+        }
+
+        bucket = attr_cache_bucket (fs, key);
+
+        pthread_mutex_lock (&attr_cache.lock);
+
+        timeout = attr_cache_timeout (fs);
+        if (timeout == 0) {
+                goto out;
+        }
+
+        entry = attr_cache_find (fs, key, bucket);
+        if (entry == NULL) {
+                if (attr_cache.count == ATTR_CACHE_MAX) {
+                        attr_cache_remove (NULL, NULL, true);
+                }
+
+                if (attr_cache.count == ATTR_CACHE_MAX) {
+                        goto out;
+                }
+
+                entry = calloc (1, sizeof (*entry));
+                if (entry == NULL) {
+                        goto out;
+                }
+
+                entry->path = key;
+                key = NULL;
+                entry->fs = fs;
+                entry->next = attr_cache.buckets[bucket];
+                attr_cache.buckets[bucket] = entry;
+                __atomic_add_fetch (&attr_cache.count, 1, __ATOMIC_RELAXED);
+        }
+
+        answer = &entry->answers[follow ? 1 : 0];
+        gluster_handle_unref (answer->handle);
+        answer->handle = error ? NULL : gluster_handle_ref (handle);
+        answer->error = error;
+        if (statbuf && error == 0) {
+                answer->statbuf = *statbuf;
+        }
+
+        answer->expires = now_ns () + timeout;
+
+out:
+        pthread_mutex_unlock (&attr_cache.lock);
+        free (key);
+}
+
+static int
+attr_cache_stat (glfs_t *fs, const char *path, struct stat *statbuf, bool follow)
+{
+        uint64_t start;
+        int saved_errno;
+        int ret;
+
+        ret = gluster_attr_cache_get (fs, path, follow, statbuf, NULL);
+        if (ret != 1) {
+                return ret;
+        }
+
+        start = stats_start ();
+        ret = follow ? glfs_stat (fs, path, statbuf) : glfs_lstat (fs, path, statbuf);
+        stats_end (STATS_STAT, start, ret);
+
+        saved_errno = errno;
+        gluster_attr_cache_put (fs, path, follow, statbuf, NULL, ret == -1 ? saved_errno : 0);
+        errno = saved_errno;
+
+        return ret;
+}
+
+/**
+ * Like glfs_stat (), but answered from the cache when it can be.
+ */
+int
+gluster_stat (glfs_t *fs, const char *path, struct stat *statbuf)
+{
+        return attr_cache_stat (fs, path, statbuf, true);
+}
+
+/**
+ * Like glfs_lstat (), but answered from the cache when it can be.
+ */
+int
+gluster_lstat (glfs_t *fs, const char *path, struct stat *statbuf)
+{
+        return attr_cache_stat (fs, path, statbuf, false);
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_ATTR_CACHE_H
+#define GLFS_ATTR_CACHE_H
+
+#include "glfs-handle.h"
+
+#include <glusterfs/api/glfs.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/**
+ * A cache of the attributes and handles of the paths looked up on a
+ * connection, and of those found not to exist, each kept for a timeout. It is
+ * off unless enabled for the connection, as the shell does for its own with
+ * --attr-timeout. Commands that change a path invalidate it, and so does any
+ * cache invalidation upcall the volume sends.
+ */
+void
+gluster_attr_cache_enable (glfs_t *fs, unsigned int timeout);
+
+void
+gluster_attr_cache_disable (glfs_t *fs);
+
+void
+gluster_attr_cache_upcalls (glfs_t *fs);
+
+void
+gluster_attr_cache_clear (glfs_t *fs);
+
+void
+gluster_attr_cache_invalidate (glfs_t *fs, const char *path);
+
+int
+gluster_attr_cache_get (glfs_t *fs, const char *path, bool follow,
+                        struct stat *statbuf, struct gluster_handle **handle);
+
+void
+gluster_attr_cache_put (glfs_t *fs, const char *path, bool follow,
+                        const struct stat *statbuf, struct gluster_handle *handle,
+                        int error);
+
+int
+gluster_stat (glfs_t *fs, const char *path, struct stat *statbuf);
+
+int
+gluster_lstat (glfs_t *fs, const char *path, struct stat *statbuf);
+
+#endif /* GLFS_ATTR_CACHE_H */
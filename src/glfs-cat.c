@@ -22,12 +22,14 @@
 #include <config.h>
 
 #include "glfs-cat.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <glusterfs/api/glfs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -36,63 +38,235 @@
 
 #define AUTHORS "Written by Craig Cabrey."
 
+// Number of files opened and locked at once ahead of being read, when many
+// are read from one volume.
+#define CAT_OPEN_BATCH 16
+
+/**
+ * A file supplied by the user.
+ *
+ * gluster_url: The parsed URL, or just the path with a connection.
+ * url: The path as supplied, for messages.
+ */
+struct cat_path {
+        struct gluster_url *gluster_url;
+        char *url;
+};
+
 /**
  * Used to store the state of the program, including user supplied options.
  *
- * gluster_url: Struct of the parsed url supplied by the user.
- * url: Full url used to find the remote file (supplied by user).
+ * paths: The files to read, in order.
+ * num_paths: Number of entries in paths.
  * debug: Whether to log additional debug information.
+ * lock: Whether each file is read under a shared lock, so that it is not
+ *       read while a writer such as gfput holds it.
+ * offset: Offset in the file to start reading at.
+ * length: Number of bytes to read, or -1 to read up to the end of the file.
+ * buffer_size: Size of the reads, BUFFER_SIZE_AUTO to size them from the
+ *              volume and the file, or 0 for the default.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
-        struct gluster_url *gluster_url;
         struct xlator_option *xlator_options;
-        char *url;
+        struct cat_path *paths;
+        int num_paths;
         bool debug;
+        bool lock;
+        off_t offset;
+        off_t length;
+        size_t buffer_size;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
+        {"buffer-size", required_argument, NULL, 'B'},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
+        {"length", required_argument, NULL, 'l'},
+        {"no-lock", no_argument, NULL, 'N'},
+        {"offset", required_argument, NULL, 'O'},
         {"port", required_argument, NULL, 'p'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"stats", optional_argument, NULL, 'S'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
 };
 
+/**
+ * A file being read, opened and locked ahead of time.
+ *
+ * path: The path on the volume.
+ * url: The path as supplied, for messages.
+ * fd: The open file, or NULL.
+ * error: errno of the failure to open or lock it, or 0.
+ */
+struct cat_file {
+        const char *path;
+        const char *url;
+        glfs_fd_t *fd;
+        int error;
+};
+
+/**
+ * Files to be opened concurrently by workers claiming the next index, as
+ * each open and lock is a round trip of its own.
+ *
+ * lock: Whether to lock the files, from state, which the workers cannot see.
+ * stats: Statistics of the command, for the workers to attach to.
+ */
+struct cat_batch {
+        glfs_t *fs;
+        struct cat_file *files;
+        size_t count;
+        size_t next;
+        bool lock;
+        struct stats *stats;
+};
+
+static void
+cat_file_open (glfs_t *fs, struct cat_file *file, bool lock)
+{
+        file->fd = glfs_open (fs, file->path, O_RDONLY);
+        if (file->fd == NULL) {
+                file->error = errno;
+                return;
+        }
+
+        // Readers share the lock; only writers are kept out.
+        if (lock && gluster_lock (file->fd, F_RDLCK, false) == -1) {
+                file->error = errno;
+                glfs_close (file->fd);
+                file->fd = NULL;
+        }
+}
+
+static void *
+cat_open_worker (void *arg)
+{
+        struct cat_batch *batch = arg;
+        size_t i;
+
+        stats_attach (batch->stats);
+
+        while ((i = __atomic_fetch_add (&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+                cat_file_open (batch->fs, &batch->files[i], batch->lock);
+        }
+
+        return NULL;
+}
+
+/**
+ * Opens, and unless --no-lock was given locks, count files with up to count
+ * threads, the calling one included.
+ */
+static void
+cat_open_batch (glfs_t *fs, struct cat_file *files, size_t count)
+{
+        struct cat_batch batch = {
+                .fs = fs,
+                .files = files,
+                .count = count,
+                .next = 0,
+                .lock = state->lock,
+                .stats = stats_current (),
+        };
+        pthread_t workers[CAT_OPEN_BATCH];
+        size_t num_workers = 0;
+
+        while (num_workers + 1 < count) {
+                if (pthread_create (&workers[num_workers], NULL, cat_open_worker, &batch) != 0) {
+                        break;
+                }
+
+                num_workers++;
+        }
+
+        cat_open_worker (&batch);
+
+        for (size_t i = 0; i < num_workers; i++) {
+                pthread_join (workers[i], NULL);
+        }
+}
+
+/**
+ * Writes an open file to standard output and closes it.
+ */
 static int
-gluster_get (glfs_t *fs, const char *filename) {
-        glfs_fd_t *fd = NULL;
-        int ret = -1;
+cat_file_read (glfs_t *fs, struct cat_file *file)
+{
+        struct stat statbuf;
+        bool have_stat = false;
+        uint64_t start;
+        int ret;
+
+        if (state->buffer_size == BUFFER_SIZE_AUTO) {
+                start = stats_start ();
+                ret = glfs_fstat (file->fd, &statbuf);
+                stats_end (STATS_STAT, start, ret);
+                have_stat = ret == 0;
+        }
 
-        fd = glfs_open (fs, filename, O_RDONLY);
-        if (fd == NULL) {
-                error (0, errno, "%s", state->url);
-                goto out;
+        gluster_apply_buffer_size (state->buffer_size, fs, have_stat ? &statbuf : NULL);
+
+        if (state->offset > 0 || state->length >= 0) {
+                ret = gluster_read_range (file->fd, STDOUT_FILENO, state->offset, state->length);
+        } else {
+                ret = gluster_read (file->fd, STDOUT_FILENO, NULL);
         }
 
-        // don't allow concurrent reads and writes.
-        ret = gluster_lock (fd, F_WRLCK, false);
         if (ret == -1) {
-                error (0, errno, "%s", state->url);
-                goto out;
+                error (0, errno, "write error");
         }
 
-        if ((ret = gluster_read (fd, STDOUT_FILENO)) == -1) {
-                error (0, errno, "write error");
-                goto out;
+        if (glfs_close (file->fd) == -1) {
+                ret = -1;
+                error (0, errno, "cannot close file %s", file->path);
         }
 
-        ret = 0;
+        file->fd = NULL;
 
-out:
-        if (fd) {
-                if (glfs_close (fd) == -1) {
-                        ret = -1;
-                        error (0, errno, "cannot close file %s",
-                                        state->gluster_url->path);
+        return ret;
+}
+
+/**
+ * Writes count of the files given, which are on the volume of fs, to standard
+ * output in turn. The files are opened and locked a batch at a time, so that
+ * reading many small files is not held up by a round trip for each.
+ */
+static int
+cat_with_fs (glfs_t *fs, struct cat_path *paths, int count)
+{
+        struct cat_file files[CAT_OPEN_BATCH];
+        size_t batch_size;
+        int ret = 0;
+
+        for (int first = 0; first < count; first += batch_size) {
+                batch_size = count - first < CAT_OPEN_BATCH ? (size_t) (count - first) : CAT_OPEN_BATCH;
+
+                for (size_t i = 0; i < batch_size; i++) {
+                        files[i].path = paths[first + i].gluster_url->path;
+                        files[i].url = paths[first + i].url;
+                        files[i].fd = NULL;
+                        files[i].error = 0;
+                }
+
+                cat_open_batch (fs, files, batch_size);
+
+                for (size_t i = 0; i < batch_size; i++) {
+                        if (files[i].error) {
+                                error (0, files[i].error, "%s", files[i].url);
+                                ret = -1;
+                                continue;
+                        }
+
+                        if (cat_file_read (fs, &files[i]) == -1) {
+                                ret = -1;
+                        }
                 }
         }
 
@@ -102,18 +276,33 @@ out:
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n"
-                "Read a file on a remote Gluster volume and write it to standard output.\n\n"
+        printf ("Usage: %s [OPTION]... URL...\n"
+                "Read files on a remote Gluster volume and write them to standard output.\n\n"
+                "      --buffer-size=SIZE       read the file in blocks of SIZE bytes; with\n"
+                "                               auto, size them from the volume and the file\n"
+                "      --length=SIZE            read no more than SIZE bytes of each file\n"
+                "      --no-lock                read without taking a shared lock on the file\n"
+                "      --offset=OFFSET          start reading OFFSET bytes into each file\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
+                "      --queue-depth=N          keep up to N reads in flight (default 4)\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
                 "  gfcat glfs://localhost/groot/path/to/file\n"
                 "        Write the contents of /path/to/file on the Gluster volume\n"
                 "        of groot on host localhost to standard output.\n"
+                "  gfcat --offset=1G --length=64M glfs://localhost/groot/file\n"
+                "        Write the 64 MiB of /file that start 1 GiB into it to\n"
+                "        standard output.\n"
+                "  gfcat --no-lock glfs://localhost/groot/part-{0..199}\n"
+                "        Write the 200 parts to standard output in turn, without\n"
+                "        locking them.\n"
                 "  gfcli (localhost/groot)> cat /file\n"
                 "        In the context of a shell with a connection established,\n"
                 "        cat the file on the root of the Gluster volume groot\n"
@@ -125,10 +314,14 @@ static int
 parse_options (int argc, char *argv[], bool has_connection)
 {
         uint16_t port = GLUSTER_DEFAULT_PORT;
+        unsigned int depth;
         int ret = -1;
         int opt = 0;
         int option_index = 0;
         struct xlator_option *option;
+        struct cat_path *path;
+
+        lock_getopt ();
 
         // Reset getopt since other utilities may have called it already.
         optind = 0;
@@ -141,8 +334,32 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
 
                 switch (opt) {
+                        case 'B':
+                                state->buffer_size = strtobuffersize (optarg);
+                                if (state->buffer_size == 0) {
+                                        goto err;
+                                }
+
+                                break;
                         case 'd':
                                 state->debug = true;
+                                break;
+                        case 'l':
+                                state->length = strtooffset (optarg);
+                                if (state->length == -1) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'N':
+                                state->lock = false;
+                                break;
+                        case 'O':
+                                state->offset = strtooffset (optarg);
+                                if (state->offset == -1) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'o':
                                 option = parse_xlator_option (optarg);
@@ -163,6 +380,21 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto out;
                                 }
 
+                                break;
+                        case 'q':
+                                depth = strtoqueuedepth (optarg);
+                                if (depth == 0) {
+                                        goto err;
+                                }
+
+                                gluster_set_queue_depth (depth);
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -183,47 +415,59 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
-        } else {
-                state->url = strdup (argv[argc - 1]);
-                if (state->url == NULL) {
+        }
+
+        // state->paths is free'd in do_cat()
+        state->paths = calloc (argc - optind, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
                         error (0, errno, "strdup");
                         goto out;
                 }
 
                 if (has_connection) {
-                        state->gluster_url = gluster_url_init ();
-                        if (state->gluster_url == NULL) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
                                 error (0, errno, "gluster_url_init");
                                 goto out;
                         }
 
-                        state->gluster_url->path = strdup (argv[argc - 1]);
-                        if (state->gluster_url->path == NULL) {
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
                                 error (0, errno, "strdup");
                                 goto out;
                         }
 
-                        ret = 0;
-                        goto out;
+                        continue;
                 }
 
-                ret = gluster_parse_url (argv[argc - 1], &(state->gluster_url));
-                if (ret == -1) {
-                        error (0, EINVAL, "%s", state->url);
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
                         goto err;
                 }
 
-                state->gluster_url->port = port;
+                path->gluster_url->port = port;
         }
 
+        ret = 0;
         goto out;
 
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -236,52 +480,61 @@ init_state ()
                 goto out;
         }
 
+        state->buffer_size = 0;
         state->debug = false;
-        state->gluster_url = NULL;
-        state->url = NULL;
+        state->length = -1;
+        state->lock = true;
+        state->num_paths = 0;
+        state->offset = 0;
+        state->paths = NULL;
+        state->stats = STATS_OFF;
         state->xlator_options = NULL;
 
+        // The queue depth and buffer size may have been changed by an
+        // earlier command.
+        gluster_set_queue_depth (DEFAULT_QUEUE_DEPTH);
+        gluster_set_buffer_size (0);
+
 out:
         return state;
 }
 
 static int
-cat_without_context ()
+cat_without_context (struct fs_cache *fs_cache)
 {
-        glfs_t *fs = NULL;
-        int ret = -1;
-
-        ret = gluster_getfs (&fs, state->gluster_url);
-        if (ret == -1) {
-                error (0, errno, "%s", state->url);
-                goto out;
-        }
-
-        ret = apply_xlator_options (fs, &state->xlator_options);
-        if (ret == -1) {
-                error (0, errno, "failed to apply translator options");
-                goto out;
-        }
-
-        if (state->debug) {
-                ret = glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG);
+        struct cat_path *paths = state->paths;
+        glfs_t *fs;
+        int next;
+        int ret = 0;
+
+        for (int i = 0; i < state->num_paths; i = next) {
+                next = i + 1;
+
+                fs = NULL;
+                if (gluster_getfs_cached (&fs, fs_cache, paths[i].gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "%s", paths[i].url);
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
+                }
 
-                if (ret == -1) {
+                if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
                         error (0, errno, "failed to set logging level");
-                        goto out;
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
                 }
-        }
 
-        ret = gluster_get (fs, state->gluster_url->path);
-        if (ret == -1) {
-                goto out;
-        }
+                // Later files on the same volume share the connection.
+                while (next < state->num_paths && gluster_same_volume (paths[i].gluster_url, paths[next].gluster_url)) {
+                        next++;
+                }
 
-        ret = 0;
+                if (cat_with_fs (fs, &paths[i], next - i) == -1) {
+                        ret = -1;
+                }
 
-out:
-        if (fs) {
-                glfs_fini (fs);
+                gluster_putfs (fs_cache, fs);
         }
 
         return ret;
@@ -306,7 +559,13 @@ do_cat (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = gluster_get (ctx->fs, state->gluster_url->path);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = cat_with_fs (ctx->fs, state->paths, state->num_paths);
         } else {
                 state->debug = ctx->options->debug;
                 ret = parse_options (argc, argv, false);
@@ -318,13 +577,25 @@ do_cat (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = cat_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = cat_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
-                gluster_url_free (state->gluster_url);
-                free (state->url);
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
         }
 
         free (state);
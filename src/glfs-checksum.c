@@ -0,0 +1,273 @@
+/**
+ * CRC-32C (Castagnoli) checksums, used to compare blocks of data on both
+ * ends of a transfer without shipping the data itself around, and to verify
+ * whole transfers as the data passes through. Where the CPU has a CRC-32C
+ * instruction (SSE4.2 on x86-64) it is used, otherwise tables are.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-checksum.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42 1
+#endif
+
+// Reversed Castagnoli polynomial.
+#define CRC32C_POLY 0x82f63b78
+
+// Buffers at least three times this long are checksummed as three
+// interleaved streams by the instruction, which can start one every cycle
+// but takes three to finish each.
+#define CRC32C_STRIDE 4096
+
+/**
+ * Lookup tables for processing eight bytes at a time: table[0] is the
+ * classic bytewise table and table[k][n] is the CRC of byte n followed by k
+ * zero bytes.
+ */
+static uint32_t table[8][256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * x2n[k] is x^(2^k) modulo the polynomial, from which the effect of any
+ * number of zero bits on a CRC can be worked out with a few products.
+ */
+static uint32_t x2n[32];
+
+// Register update for CRC32C_STRIDE zero bytes, to join the streams.
+static uint32_t stride_shift;
+
+static uint32_t
+update_table (uint32_t crc, const unsigned char *next, size_t length);
+
+/**
+ * Updates the raw (not inverted) CRC register with length bytes at next.
+ */
+static uint32_t (*update) (uint32_t crc, const unsigned char *next, size_t length) = update_table;
+
+/**
+ * Returns the product of a and b modulo the polynomial, both in the reflected
+ * bit order of the register.
+ */
+static uint32_t
+multiply (uint32_t a, uint32_t b)
+{
+        uint32_t m = (uint32_t) 1 << 31;
+        uint32_t p = 0;
+
+        while (true) {
+                if (a & m) {
+                        p ^= b;
+                        if ((a & (m - 1)) == 0) {
+                                break;
+                        }
+                }
+
+                m >>= 1;
+                b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+        }
+
+        return p;
+}
+
+/**
+ * Returns x^(8 * length) modulo the polynomial: multiplying a register by it
+ * has the same effect as feeding it length zero bytes.
+ */
+static uint32_t
+shift_for (uint64_t length)
+{
+        uint32_t p = (uint32_t) 1 << 31;
+
+        // Bytes are eight bits, so start from x^(2^3).
+        for (unsigned int k = 3; length; length >>= 1, k = (k + 1) % 32) {
+                if (length & 1) {
+                        p = multiply (x2n[k], p);
+                }
+        }
+
+        return p;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__ ((target ("sse4.2")))
+static uint32_t
+update_sse42 (uint32_t crc, const unsigned char *next, size_t length)
+{
+        uint64_t a = crc;
+        uint64_t b;
+        uint64_t c;
+        uint64_t word;
+
+        while (length && ((uintptr_t) next & 7)) {
+                a = _mm_crc32_u8 (a, *next++);
+                length--;
+        }
+
+        while (length >= 3 * CRC32C_STRIDE) {
+                b = 0;
+                c = 0;
+
+                for (size_t i = 0; i < CRC32C_STRIDE; i += 8) {
+                        memcpy (&word, next + i, sizeof (word));
+                        a = _mm_crc32_u64 (a, word);
+                        memcpy (&word, next + CRC32C_STRIDE + i, sizeof (word));
+                        b = _mm_crc32_u64 (b, word);
+                        memcpy (&word, next + 2 * CRC32C_STRIDE + i, sizeof (word));
+                        c = _mm_crc32_u64 (c, word);
+                }
+
+                a = multiply (stride_shift, a) ^ b;
+                a = multiply (stride_shift, a) ^ c;
+                next += 3 * CRC32C_STRIDE;
+                length -= 3 * CRC32C_STRIDE;
+        }
+
+        while (length >= 8) {
+                memcpy (&word, next, sizeof (word));
+                a = _mm_crc32_u64 (a, word);
+                next += 8;
+                length -= 8;
+        }
+
+        while (length--) {
+                a = _mm_crc32_u8 (a, *next++);
+        }
+
+        return a;
+}
+#endif
+
+static void
+init_table ()
+{
+        uint32_t crc;
+
+        for (unsigned int n = 0; n < 256; n++) {
+                crc = n;
+                for (int k = 0; k < 8; k++) {
+                        crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                }
+
+                table[0][n] = crc;
+        }
+
+        for (unsigned int n = 0; n < 256; n++) {
+                crc = table[0][n];
+                for (int k = 1; k < 8; k++) {
+                        crc = table[0][crc & 0xff] ^ (crc >> 8);
+                        table[k][n] = crc;
+                }
+        }
+
+        // x^1, then squared over and over.
+        x2n[0] = (uint32_t) 1 << 30;
+        for (int k = 1; k < 32; k++) {
+                x2n[k] = multiply (x2n[k - 1], x2n[k - 1]);
+        }
+
+        stride_shift = shift_for (CRC32C_STRIDE);
+
+#ifdef HAVE_CRC32C_SSE42
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("sse4.2")) {
+                update = update_sse42;
+        }
+#endif
+}
+
+static uint32_t
+update_table (uint32_t crc, const unsigned char *next, size_t length)
+{
+        uint64_t word;
+
+        while (length && ((uintptr_t) next & 7)) {
+                crc = table[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+                length--;
+        }
+
+        while (length >= 8) {
+                memcpy (&word, next, sizeof (word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                word = __builtin_bswap64 (word);
+#endif
+                word ^= crc;
+                crc = table[7][word & 0xff]
+                        ^ table[6][(word >> 8) & 0xff]
+                        ^ table[5][(word >> 16) & 0xff]
+                        ^ table[4][(word >> 24) & 0xff]
+                        ^ table[3][(word >> 32) & 0xff]
+                        ^ table[2][(word >> 40) & 0xff]
+                        ^ table[1][(word >> 48) & 0xff]
+                        ^ table[0][word >> 56];
+                next += 8;
+                length -= 8;
+        }
+
+        while (length--) {
+                crc = table[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+        }
+
+        return crc;
+}
+
+/**
+ * Extends crc, the checksum of the data so far (0 to start), with length
+ * bytes at buf.
+ */
+uint32_t
+crc32c (uint32_t crc, const void *buf, size_t length)
+{
+        pthread_once (&table_once, init_table);
+
+        return ~update (~crc, buf, length);
+}
+
+/**
+ * Extends crc, the checksum of the data so far, with length zero bytes,
+ * without going through them, e.g. for a hole in a sparse file.
+ */
+uint32_t
+crc32c_zeros (uint32_t crc, uint64_t length)
+{
+        pthread_once (&table_once, init_table);
+
+        return ~multiply (shift_for (length), ~crc);
+}
+
+/**
+ * Returns the checksum of two pieces of data one after the other, given the
+ * checksum of each and the length of the second. This lets pieces of a file
+ * be checksummed apart, in any order, and joined in file order at the end.
+ */
+uint32_t
+crc32c_combine (uint32_t crc1, uint32_t crc2, uint64_t length2)
+{
+        pthread_once (&table_once, init_table);
+
+        return multiply (shift_for (length2), crc1) ^ crc2;
+}
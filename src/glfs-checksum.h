@@ -0,0 +1,34 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_CHECKSUM_H
+#define GLFS_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t
+crc32c (uint32_t crc, const void *buf, size_t length);
+
+uint32_t
+crc32c_zeros (uint32_t crc, uint64_t length);
+
+uint32_t
+crc32c_combine (uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+#endif /* GLFS_CHECKSUM_H */
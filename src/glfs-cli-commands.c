@@ -26,8 +26,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "glfs-attr-cache.h"
 #include "glfs-cli-commands.h"
 #include "glfs-cli.h"
+#include "glfs-flock.h"
 #include "glfs-util.h"
 
 static struct option const connect_options[] =
@@ -112,6 +114,8 @@ cli_connect (struct cli_context *ctx)
         ctx->fs = fs;
         ctx->url = url;
 
+        gluster_attr_cache_enable (ctx->fs, ctx->options->attr_timeout);
+
         // TODO(craigcabrey): Look into using asprintf here.
         // 5 is the length of the string format: (%s/%s)
         size_t length = strlen (ctx->url->host) + strlen (ctx->url->volume) + 5;
@@ -141,33 +145,17 @@ int
 cli_disconnect (struct cli_context *ctx)
 {
         int ret = 0;
-        struct fd_list *cur, *ptr = NULL;
 
         free_xlator_options (&ctx->options->xlator_options);
 
-        /* Traverse fd_list and cleanup each entry.*/
-        ptr = ctx->flist;
-        while (ptr) {
-                if (ptr->fd) {
-                        glfs_close (ptr->fd);
-                        ptr->fd = NULL;
-                }
-
-                if (ptr->path) {
-                        free (ptr->path);
-                        ptr->path = NULL;
-                }
-
-                cur = ptr;
-                ptr = ptr->next;
-                free (cur);
-        }
+        fd_table_free (ctx->fds);
+        ctx->fds = NULL;
 
         if (ctx->fs) {
                 // FIXME: Memory leak occurs here in GFS >= 3.6. Test with 3.7
                 // and if fixed, remove the entry (xlator_mem_acct_init) from
                 // the valgrind suppression file.
-                ret = glfs_fini (ctx->fs);
+                ret = gluster_fini (ctx->fs);
                 ctx->fs = NULL;
         }
 
@@ -192,6 +180,7 @@ handle_quit (struct cli_context *ctx)
         }
 
         free (ctx->options);
+        fs_cache_free (ctx->fs_cache);
         free (ctx);
 
         exit (EXIT_SUCCESS);
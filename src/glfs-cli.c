@@ -26,6 +26,7 @@
 #include <error.h>
 #include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -38,13 +39,16 @@
 #include "glfs-cat.h"
 #include "glfs-cp.h"
 #include "glfs-cli-commands.h"
+#include "glfs-du.h"
 #include "glfs-flock.h"
 #include "glfs-ls.h"
 #include "glfs-mkdir.h"
+#include "glfs-mv.h"
 #include "glfs-rm.h"
 #include "glfs-stat.h"
 #include "glfs-tail.h"
 #include "glfs-util.h"
+#include "glfs-work-queue.h"
 
 #define AUTHORS "Written by Craig Cabrey."
 
@@ -52,10 +56,16 @@ extern bool debug;
 
 struct cli_context *ctx;
 
+/**
+ * A command of the shell. Serial commands change the shared cli_context (or
+ * exit), so a batch waits for all running commands to finish before running
+ * one.
+ */
 struct cmd {
         char *alias;
         char *name;
         int (*execute) (struct cli_context *ctx);
+        bool serial;
 };
 
 static int
@@ -66,6 +76,7 @@ shell_usage ()
                 "* connect\n"
                 "* cp\n"
                 "* disconnect\n"
+                "* du\n"
                 "* help\n"
                 "* ls\n"
                 "* mkdir\n"
@@ -78,22 +89,23 @@ shell_usage ()
         return 0;
 }
 
-#define NUM_CMDS 13
+#define NUM_CMDS 14
 static struct cmd const cmds[] =
 {
-        { .name = "connect", .execute = cli_connect },
-        { .name = "disconnect", .execute = cli_disconnect },
+        { .name = "connect", .execute = cli_connect, .serial = true },
+        { .name = "disconnect", .execute = cli_disconnect, .serial = true },
         { .alias = "gfcat", .name = "cat", .execute = do_cat },
         { .alias = "gfcp", .name = "cp", .execute = do_cp },
+        { .alias = "gfdu", .name = "du", .execute = do_du },
         { .name = "help", .execute = shell_usage },
         { .alias = "gfls", .name = "ls", .execute = do_ls },
         { .alias = "gfmkdir", .name = "mkdir", .execute = do_mkdir },
-        { .alias = "gfmv", .name = "mv", .execute = not_implemented },
-        { .name = "quit", .execute = handle_quit },
+        { .alias = "gfmv", .name = "mv", .execute = do_mv },
+        { .name = "quit", .execute = handle_quit, .serial = true },
         { .alias = "gfrm", .name = "rm", .execute = do_rm },
         { .alias = "gfstat", .name = "stat", .execute = do_stat },
         { .alias = "gftail", .name = "tail", .execute = do_tail },
-        { .name = "flock", .execute = do_flock }
+        { .name = "flock", .execute = do_flock, .serial = true }
 };
 
 static const struct cmd*
@@ -227,10 +239,296 @@ out:
         return ret;
 }
 
+/**
+ * A command read from a batch file. line is kept intact for error reports,
+ * while argv points into input.
+ */
+struct batch_cmd {
+        const struct cmd *cmd;
+        char *line;
+        char *input;
+        char **argv;
+        int argc;
+        size_t number;
+};
+
+/**
+ * State of a batch run shared with the worker threads.
+ *
+ * in_flight: Number of commands queued or running on the workers.
+ * failed: Number of commands that returned a non-zero status.
+ */
+struct batch {
+        const char *name;
+        struct work_queue queue;
+        pthread_mutex_t lock;
+        pthread_cond_t idle;
+        unsigned int in_flight;
+        unsigned int failed;
+};
+
+static void
+batch_cmd_free (struct batch_cmd *batch_cmd)
+{
+        free (batch_cmd->argv);
+        free (batch_cmd->input);
+        free (batch_cmd->line);
+        free (batch_cmd);
+}
+
+static struct batch_cmd *
+batch_cmd_new (const char *line, size_t number)
+{
+        struct batch_cmd *batch_cmd = calloc (1, sizeof (*batch_cmd));
+
+        if (batch_cmd == NULL) {
+                return NULL;
+        }
+
+        batch_cmd->number = number;
+        batch_cmd->line = strdup (line);
+        batch_cmd->input = strdup (line);
+        if (batch_cmd->line == NULL || batch_cmd->input == NULL) {
+                batch_cmd_free (batch_cmd);
+                return NULL;
+        }
+
+        batch_cmd->argc = split_str (batch_cmd->input, &batch_cmd->argv);
+        if (batch_cmd->argv == NULL) {
+                batch_cmd_free (batch_cmd);
+                return NULL;
+        }
+
+        return batch_cmd;
+}
+
+/**
+ * Runs one batch command against the given context and reports its status if
+ * it failed. Commands run on the shared context get their messages prefixed
+ * with the command name, as in the shell.
+ */
+static void
+run_batch_cmd (struct batch *batch, struct cli_context *context, struct batch_cmd *batch_cmd)
+{
+        char *name = program_invocation_name;
+        int ret;
+
+        context->argc = batch_cmd->argc;
+        context->argv = batch_cmd->argv;
+
+        if (context == ctx) {
+                program_invocation_name = batch_cmd->argv[0];
+        }
+
+        ret = batch_cmd->cmd->execute (context);
+
+        // Some commands write straight to the descriptor, so keep buffered
+        // output from interleaving with theirs.
+        fflush (stdout);
+
+        program_invocation_name = name;
+        context->argc = 0;
+        context->argv = NULL;
+
+        if (ret != 0) {
+                pthread_mutex_lock (&batch->lock);
+                batch->failed++;
+                error (0, 0, "%s:%zu: '%s' exited with status %d",
+                                batch->name,
+                                batch_cmd->number,
+                                batch_cmd->line,
+                                ret == -1 ? EXIT_FAILURE : ret);
+                pthread_mutex_unlock (&batch->lock);
+        }
+}
+
+static void *
+batch_worker (void *data)
+{
+        struct batch *batch = data;
+        struct batch_cmd *batch_cmd;
+        struct cli_context context;
+
+        while ((batch_cmd = work_queue_pop (&batch->queue)) != NULL) {
+                // Take a fresh copy of the shared context for every command,
+                // as a serial command (e.g. connect) may have changed it.
+                context = *ctx;
+                run_batch_cmd (batch, &context, batch_cmd);
+                batch_cmd_free (batch_cmd);
+
+                pthread_mutex_lock (&batch->lock);
+                if (--batch->in_flight == 0) {
+                        pthread_cond_broadcast (&batch->idle);
+                }
+
+                pthread_mutex_unlock (&batch->lock);
+        }
+
+        return NULL;
+}
+
+/**
+ * Waits until no batch command is queued or running.
+ */
+static void
+wait_batch_idle (struct batch *batch)
+{
+        pthread_mutex_lock (&batch->lock);
+        while (batch->in_flight > 0) {
+                pthread_cond_wait (&batch->idle, &batch->lock);
+        }
+
+        pthread_mutex_unlock (&batch->lock);
+}
+
+/**
+ * Executes the commands of a batch file against the shared context, stopping
+ * early at a quit command. With more than one job, commands are dispatched to
+ * a pool of worker threads and may run (and print their output) concurrently;
+ * serial commands such as connect act as barriers between them.
+ *
+ * Returns 0 if every command succeeded, or -1 otherwise.
+ */
+static int
+start_batch ()
+{
+        struct batch batch = {
+                .name = ctx->options->batch,
+                .in_flight = 0,
+                .failed = 0,
+        };
+        struct batch_cmd *batch_cmd;
+        unsigned int num_workers = 0;
+        pthread_t *workers = NULL;
+        char delim = ctx->options->null_separated ? '\0' : '\n';
+        char *input = NULL;
+        size_t number = 0;
+        size_t size = 0;
+        ssize_t length;
+        FILE *stream;
+        int ret = -1;
+
+        if (strcmp (batch.name, "-") == 0) {
+                stream = stdin;
+                batch.name = "-";
+        } else {
+                stream = fopen (batch.name, "r");
+                if (stream == NULL) {
+                        error (0, errno, "%s", batch.name);
+                        return -1;
+                }
+        }
+
+        if (work_queue_init (&batch.queue, ctx->options->jobs * 4) == -1) {
+                error (0, errno, "failed to initialize batch queue");
+                goto out;
+        }
+
+        pthread_mutex_init (&batch.lock, NULL);
+        pthread_cond_init (&batch.idle, NULL);
+
+        if (ctx->options->jobs > 1) {
+                workers = malloc (sizeof (*workers) * ctx->options->jobs);
+                if (workers == NULL) {
+                        error (0, errno, "failed to allocate batch workers");
+                        goto done;
+                }
+
+                for (; num_workers < ctx->options->jobs; num_workers++) {
+                        if (pthread_create (&workers[num_workers], NULL, batch_worker, &batch) != 0) {
+                                break;
+                        }
+                }
+        }
+
+        while ((length = getdelim (&input, &size, delim, stream)) != -1) {
+                number++;
+
+                while (length > 0 && (input[length - 1] == delim
+                                      || input[length - 1] == '\n'
+                                      || input[length - 1] == '\r')) {
+                        input[--length] = '\0';
+                }
+
+                // Skip blank lines and comments.
+                if (length == 0 || input[0] == '#') {
+                        continue;
+                }
+
+                batch_cmd = batch_cmd_new (input, number);
+                if (batch_cmd == NULL) {
+                        error (0, errno, "%s:%zu", batch.name, number);
+                        batch.failed++;
+                        continue;
+                }
+
+                batch_cmd->cmd = get_cmd (batch_cmd->argv[0]);
+                if (batch_cmd->cmd == NULL) {
+                        error (0, 0, "%s:%zu: unknown command '%s'",
+                                        batch.name, number, batch_cmd->argv[0]);
+                        batch.failed++;
+                        batch_cmd_free (batch_cmd);
+                        continue;
+                }
+
+                if (num_workers > 0 && !batch_cmd->cmd->serial) {
+                        pthread_mutex_lock (&batch.lock);
+                        batch.in_flight++;
+                        pthread_mutex_unlock (&batch.lock);
+
+                        work_queue_push (&batch.queue, batch_cmd);
+                        continue;
+                }
+
+                wait_batch_idle (&batch);
+
+                if (batch_cmd->cmd->execute == handle_quit) {
+                        batch_cmd_free (batch_cmd);
+                        break;
+                }
+
+                run_batch_cmd (&batch, ctx, batch_cmd);
+
+                batch_cmd_free (batch_cmd);
+        }
+
+        if (ferror (stream)) {
+                error (0, errno, "%s", batch.name);
+                batch.failed++;
+        }
+
+done:
+        work_queue_close (&batch.queue);
+
+        for (unsigned int i = 0; i < num_workers; i++) {
+                pthread_join (workers[i], NULL);
+        }
+
+        pthread_cond_destroy (&batch.idle);
+        pthread_mutex_destroy (&batch.lock);
+        work_queue_destroy (&batch.queue);
+
+        ret = batch.failed ? -1 : 0;
+
+out:
+        free (workers);
+        free (input);
+
+        if (stream != stdin) {
+                fclose (stream);
+        }
+
+        return ret;
+}
+
 static struct option const long_options[] =
 {
+        {"attr-timeout", required_argument, NULL, 'a'},
+        {"batch", required_argument, NULL, 'b'},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"null", no_argument, NULL, '0'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -241,6 +539,17 @@ usage ()
 {
         printf ("Usage: %s [OPTION]... [URL]\n"
                 "Start a Gluster shell to execute commands on a remote Gluster volume.\n\n"
+                "      --attr-timeout=SECONDS   cache the attributes of the paths looked up\n"
+                "                               for SECONDS, up to %d, saving round trips\n"
+                "                               when commands revisit them; changes made\n"
+                "                               by other clients may go unseen that long\n"
+                "                               unless the volume sends upcalls\n"
+                "      --batch=FILE             execute the commands in FILE, one per\n"
+                "                               line, instead of starting a shell; with\n"
+                "                               FILE of -, read standard input\n"
+                "  -j, --jobs=N                 with --batch, run up to N commands at once\n"
+                "  -0, --null                   with --batch, commands are separated by\n"
+                "                               NUL characters instead of newlines\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
@@ -252,8 +561,12 @@ usage ()
                 "        Start a shell with a connection to localhost opened.\n"
                 "  gfcli -o *replicate*.data-self-heal=on glfs://localhost/groot\n"
                 "        Start a shell with a connection localhost open, with the\n"
-                "        translator option data-self-head set to on.\n",
-                program_invocation_name);
+                "        translator option data-self-head set to on.\n"
+                "  gfcli --batch=- -j 8 glfs://localhost/groot < commands\n"
+                "        Run the commands read from the file commands against the\n"
+                "        volume groot, up to 8 at a time.\n",
+                program_invocation_name,
+                MAX_ATTR_TIMEOUT);
         exit (EXIT_SUCCESS);
 }
 
@@ -271,7 +584,7 @@ parse_options (struct cli_context *ctx)
         opterr = 0;
 
         while (true) {
-                opt = getopt_long (argc, argv, "o:", long_options,
+                opt = getopt_long (argc, argv, "0j:o:", long_options,
                                 &option_index);
 
                 if (opt == -1) {
@@ -279,8 +592,28 @@ parse_options (struct cli_context *ctx)
                 }
 
                 switch (opt) {
+                        case '0':
+                                ctx->options->null_separated = true;
+                                break;
+                        case 'a':
+                                ctx->options->attr_timeout = strtoattrtimeout (optarg);
+                                if (ctx->options->attr_timeout == 0) {
+                                        exit (EXIT_FAILURE);
+                                }
+
+                                break;
+                        case 'b':
+                                ctx->options->batch = optarg;
+                                break;
                         case 'd':
                                 ctx->options->debug = true;
+                                break;
+                        case 'j':
+                                ctx->options->jobs = strtojobs (optarg);
+                                if (ctx->options->jobs == 0) {
+                                        exit (EXIT_FAILURE);
+                                }
+
                                 break;
                         case 'o':
                                 option = parse_xlator_option (optarg);
@@ -314,7 +647,7 @@ parse_options (struct cli_context *ctx)
                 }
         }
 
-        if (argc - option_index >= 2) {
+        if (optind < argc) {
                 if (cli_connect (ctx) == -1) {
                         exit (EXIT_FAILURE);
                 }
@@ -328,8 +661,6 @@ parse_options (struct cli_context *ctx)
 void
 cleanup ()
 {
-        struct fd_list *cur, *ptr = NULL;
-
         if (ctx->url) {
                 gluster_url_free (ctx->url);
                 ctx->url = NULL;
@@ -340,29 +671,15 @@ cleanup ()
                 free (ctx->options);
         }
 
-        /* Traverse fd_list and cleanup each entry.*/
-        ptr = ctx->flist;
-        while (ptr) {
-                if (ptr->fd) {
-                        glfs_close (ptr->fd);
-                        ptr->fd = NULL;
-                }
-
-                if (ptr->path) {
-                        free (ptr->path);
-                        ptr->path = NULL;
-                }
-
-                cur = ptr;
-                ptr = ptr->next;
-                free (cur);
-        }
+        fd_table_free (ctx->fds);
+        ctx->fds = NULL;
 
         if (ctx->fs) {
-                glfs_fini (ctx->fs);
+                gluster_fini (ctx->fs);
                 ctx->fs = NULL;
         }
 
+        fs_cache_free (ctx->fs_cache);
         free (ctx);
 }
 
@@ -397,13 +714,24 @@ main (int argc, char *argv[])
         ctx->argv = argv;
         ctx->conn_str = NULL;
         ctx->fs = NULL;
-        ctx->flist = NULL;
+        ctx->fds = NULL;
+
+        // Keeps connections to remote volumes open across shell commands.
+        ctx->fs_cache = fs_cache_init ();
+        if (ctx->fs_cache == NULL) {
+                error (EXIT_FAILURE, errno, "failed to initialize connection cache");
+        }
+
         ctx->options = malloc (sizeof (*(ctx->options)));
         if (ctx->options == NULL) {
                 error (EXIT_FAILURE, errno, "failed to initialize options");
         }
 
+        ctx->options->attr_timeout = 0;
+        ctx->options->batch = NULL;
         ctx->options->debug = false;
+        ctx->options->jobs = 1;
+        ctx->options->null_separated = false;
         ctx->options->xlator_options = NULL;
         ctx->url = NULL;
 
@@ -423,7 +751,12 @@ main (int argc, char *argv[])
                 // invalid free ().
                 ctx->argc = 0;
                 ctx->argv = NULL;
-                ret = start_shell ();
+
+                if (ctx->options->batch) {
+                        ret = start_batch ();
+                } else {
+                        ret = start_shell ();
+                }
 
                 if (ctx->options->debug) {
                         print_xlator_options (&ctx->options->xlator_options);
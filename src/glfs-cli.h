@@ -24,15 +24,32 @@
 #include <glusterfs/api/glfs.h>
 #include <stdbool.h>
 
-struct fd_list {
-        struct fd_list *next;
+/**
+ * A file held open by flock, so that its lock outlives the command.
+ *
+ * path: Canonical path of the file on the connected volume.
+ */
+struct fd_entry {
+        struct fd_entry *next;
         glfs_fd_t *fd;
         char *path;
 };
 
+/**
+ * The files held open by flock, hashed by path; entries go when their lock is
+ * dropped. The table grows as it fills, so that looking up a path stays cheap
+ * however many locks the shell holds.
+ */
+struct fd_table {
+        struct fd_entry **buckets;
+        size_t num_buckets;
+        size_t count;
+};
+
 struct cli_context {
         glfs_t *fs;
-        struct fd_list *flist;
+        struct fs_cache *fs_cache;
+        struct fd_table *fds;
         struct gluster_url *url;
         struct options *options;
         char *conn_str;
@@ -41,9 +58,23 @@ struct cli_context {
         char **argv;
 };
 
+/**
+ * Options of gfcli itself.
+ *
+ * attr_timeout: Seconds for which the attributes looked up on the connection
+ *               are cached, or 0 not to cache them.
+ * batch: File (or - for stdin) to read commands from instead of the shell.
+ * jobs: Maximum number of batch commands to run concurrently.
+ * null_separated: Whether batch commands are separated by NUL characters
+ *                 instead of newlines.
+ */
 struct options {
         struct xlator_option *xlator_options;
+        unsigned int attr_timeout;
         bool debug;
+        char *batch;
+        unsigned int jobs;
+        bool null_separated;
 };
 
 #endif
@@ -0,0 +1,1936 @@
+/**
+ * Helpers for moving file data between local files and files on a Gluster
+ * volume, including a chunked copy engine that keeps several requests in
+ * flight at once.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-checksum.h"
+#include "glfs-copy-util.h"
+#include "glfs-handle.h"
+#include "glfs-stats.h"
+#include "glfs-util.h"
+#include "glfs-work-queue.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <glusterfs/api/glfs.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#define COPY_IO_SIZE 1024*1024
+#define OFFLOAD_SIZE 1024*1024*1024
+#define TREE_FILE_QUEUE_SIZE 1024
+
+// Completed chunks are committed to the journal in batches of this many,
+// each preceded by a flush of the destination.
+#define JOURNAL_BATCH 64
+#define JOURNAL_MAGIC "gfcp journal 1"
+
+/**
+ * A sidecar file recording which chunks of a parallel copy have reached the
+ * destination, so that an interrupted copy can skip them when resumed. Each
+ * line after the header holds the offset of one completed chunk.
+ *
+ * done: Bitmap of the chunks recorded, either by this copy or by the one it
+ *       resumes.
+ * pending: Chunks copied since the last batch was committed.
+ */
+struct copy_journal {
+        char *path;
+        int fd;
+        off_t size;
+        size_t chunk_size;
+        size_t num_chunks;
+        size_t num_done;
+        unsigned char *done;
+        pthread_mutex_t lock;
+        size_t pending[JOURNAL_BATCH];
+        size_t num_pending;
+};
+
+/**
+ * Shared state of a chunked copy, or of a checksum sweep of source when
+ * there is no dest. Workers claim the next chunk under the lock and the first
+ * worker to fail records its errno, which stops the others.
+ *
+ * crcs: If not NULL, the checksum of each chunk from start, as it is in dest
+ *       once copied, for the caller to join into one.
+ */
+struct copy_job {
+        struct copy_endpoint *source;
+        struct copy_endpoint *dest;
+        pthread_mutex_t lock;
+        off_t start;
+        off_t next_offset;
+        off_t size;
+        size_t chunk_size;
+        size_t io_size;
+        bool sparse;
+        struct copy_journal *journal;
+        struct stats *stats;
+        uint32_t *crcs;
+        int error;
+};
+
+ssize_t
+endpoint_pread (struct copy_endpoint *endpoint, void *buf, size_t count, off_t offset)
+{
+        uint64_t start;
+        ssize_t ret;
+
+        if (endpoint->glfs_fd) {
+                start = stats_start ();
+                ret = glfs_pread (endpoint->glfs_fd, buf, count, offset, 0);
+                stats_end (STATS_READ, start, ret);
+
+                return ret;
+        }
+
+        return pread (endpoint->fd, buf, count, offset);
+}
+
+ssize_t
+endpoint_pwrite (struct copy_endpoint *endpoint, const void *buf, size_t count, off_t offset)
+{
+        uint64_t start;
+        ssize_t ret;
+
+        if (endpoint->glfs_fd) {
+                start = stats_start ();
+                ret = glfs_pwrite (endpoint->glfs_fd, buf, count, offset, 0);
+                stats_end (STATS_WRITE, start, ret);
+
+                return ret;
+        }
+
+        return pwrite (endpoint->fd, buf, count, offset);
+}
+
+int
+endpoint_fstat (struct copy_endpoint *endpoint, struct stat *statbuf)
+{
+        uint64_t start;
+        int ret;
+
+        if (endpoint->glfs_fd) {
+                start = stats_start ();
+                ret = glfs_fstat (endpoint->glfs_fd, statbuf);
+                stats_end (STATS_STAT, start, ret);
+
+                return ret;
+        }
+
+        return fstat (endpoint->fd, statbuf);
+}
+
+int
+endpoint_ftruncate (struct copy_endpoint *endpoint, off_t length)
+{
+        if (endpoint->glfs_fd) {
+                return glfs_ftruncate (endpoint->glfs_fd, length);
+        }
+
+        return ftruncate (endpoint->fd, length);
+}
+
+off_t
+endpoint_lseek (struct copy_endpoint *endpoint, off_t offset, int whence)
+{
+        if (endpoint->glfs_fd) {
+                return glfs_lseek (endpoint->glfs_fd, offset, whence);
+        }
+
+        return lseek (endpoint->fd, offset, whence);
+}
+
+int
+endpoint_fsync (struct copy_endpoint *endpoint)
+{
+        if (endpoint->glfs_fd) {
+                return glfs_fsync (endpoint->glfs_fd);
+        }
+
+        return fsync (endpoint->fd);
+}
+
+static ssize_t
+endpoint_fgetxattr (struct copy_endpoint *endpoint, const char *name, void *value, size_t size)
+{
+        if (endpoint->glfs_fd) {
+                return glfs_fgetxattr (endpoint->glfs_fd, name, value, size);
+        }
+
+        return fgetxattr (endpoint->fd, name, value, size);
+}
+
+static int
+endpoint_fsetxattr (struct copy_endpoint *endpoint, const char *name, const void *value, size_t size)
+{
+        if (endpoint->glfs_fd) {
+                return glfs_fsetxattr (endpoint->glfs_fd, name, value, size, 0);
+        }
+
+        return fsetxattr (endpoint->fd, name, value, size, 0);
+}
+
+/**
+ * Reads exactly count bytes unless the end of the file comes first.
+ */
+static ssize_t
+endpoint_pread_full (struct copy_endpoint *endpoint, void *buf, size_t count, off_t offset)
+{
+        size_t total = 0;
+        ssize_t ret;
+
+        while (total < count) {
+                ret = endpoint_pread (endpoint, (char *) buf + total, count - total, offset + total);
+                if (ret == -1) {
+                        return -1;
+                }
+
+                if (ret == 0) {
+                        break;
+                }
+
+                total += ret;
+        }
+
+        return total;
+}
+
+/**
+ * Works out where an interrupted copy of the first size bytes of source into
+ * dest can pick up. The last writes before the interruption may not all have
+ * landed, so as many bytes at the end of dest as the transfer may have had
+ * in flight, gluster_resume_window (), are compared with the source a block
+ * at a time. The copy resumes at the first block that differs. A destination
+ * larger than the source is not a partial copy of it and is started over.
+ *
+ * Returns the offset to resume from, or -1 with errno set.
+ */
+off_t
+gluster_resume_offset (struct copy_endpoint *source, struct copy_endpoint *dest, off_t size)
+{
+        struct stat statbuf;
+        char *source_buf = NULL;
+        char *dest_buf = NULL;
+        off_t offset = -1;
+        off_t window = gluster_resume_window ();
+        off_t end;
+        size_t length;
+        ssize_t source_read;
+        ssize_t dest_read;
+
+        if (endpoint_fstat (dest, &statbuf) == -1) {
+                goto out;
+        }
+
+        end = statbuf.st_size;
+        if (end > size) {
+                offset = 0;
+                goto out;
+        }
+
+        source_buf = alloc_buffer (RESUME_BLOCK_SIZE);
+        dest_buf = alloc_buffer (RESUME_BLOCK_SIZE);
+        if (source_buf == NULL || dest_buf == NULL) {
+                goto out;
+        }
+
+        offset = end > window ? end - window : 0;
+        while (offset < end) {
+                length = end - offset < RESUME_BLOCK_SIZE ? end - offset : RESUME_BLOCK_SIZE;
+
+                source_read = endpoint_pread_full (source, source_buf, length, offset);
+                dest_read = endpoint_pread_full (dest, dest_buf, length, offset);
+                if (source_read == -1 || dest_read == -1) {
+                        offset = -1;
+                        goto out;
+                }
+
+                if (source_read != dest_read
+                                || memcmp (source_buf, dest_buf, source_read) != 0) {
+                        break;
+                }
+
+                offset += length;
+        }
+
+out:
+        free (source_buf);
+        free (dest_buf);
+
+        return offset;
+}
+
+static void
+journal_mark (struct copy_journal *journal, size_t chunk)
+{
+        if (!(journal->done[chunk / 8] & (1 << (chunk % 8)))) {
+                journal->done[chunk / 8] |= 1 << (chunk % 8);
+                journal->num_done++;
+        }
+}
+
+static bool
+journal_is_done (struct copy_journal *journal, size_t chunk)
+{
+        return journal->done[chunk / 8] & (1 << (chunk % 8));
+}
+
+/**
+ * Forgets every chunk recorded and starts the journal file afresh.
+ */
+static int
+journal_reset (struct copy_journal *journal)
+{
+        char header[128];
+        int length;
+
+        memset (journal->done, 0, (journal->num_chunks + 7) / 8);
+        journal->num_done = 0;
+        journal->num_pending = 0;
+
+        length = snprintf (header, sizeof (header), "%s %lld %zu\n", JOURNAL_MAGIC,
+                           (long long) journal->size, journal->chunk_size);
+
+        if (ftruncate (journal->fd, 0) == -1 || write (journal->fd, header, length) != length) {
+                return -1;
+        }
+
+        return 0;
+}
+
+/**
+ * Loads the chunks recorded in the journal file, provided it was written for
+ * a copy of the same size in chunks of the same size. Returns 0 if the file
+ * describes another copy, otherwise the number of chunks loaded.
+ */
+static size_t
+journal_load (struct copy_journal *journal)
+{
+        FILE *file;
+        char line[128];
+        long long size;
+        long long offset;
+        size_t chunk_size;
+        char *end;
+
+        file = fdopen (dup (journal->fd), "r");
+        if (file == NULL) {
+                return 0;
+        }
+
+        if (fgets (line, sizeof (line), file) == NULL
+                        || strncmp (line, JOURNAL_MAGIC " ", sizeof (JOURNAL_MAGIC)) != 0
+                        || sscanf (line + sizeof (JOURNAL_MAGIC), "%lld %zu", &size, &chunk_size) != 2
+                        || size != journal->size || chunk_size != journal->chunk_size) {
+                goto out;
+        }
+
+        while (fgets (line, sizeof (line), file)) {
+                offset = strtoll (line, &end, 10);
+
+                // A torn final line is simply not a completed chunk.
+                if (end == line || *end != '\n' || offset < 0 || offset >= size
+                                || offset % chunk_size != 0) {
+                        continue;
+                }
+
+                journal_mark (journal, offset / chunk_size);
+        }
+
+out:
+        fclose (file);
+
+        return journal->num_done;
+}
+
+/**
+ * Opens the journal at path for a parallel copy of size bytes in chunks of
+ * chunk_size. With resume, the chunks recorded by an interrupted copy with
+ * the same geometry are kept; otherwise the journal starts out empty.
+ *
+ * Returns NULL with errno set on failure.
+ */
+struct copy_journal *
+copy_journal_open (const char *path, off_t size, size_t chunk_size, bool resume)
+{
+        struct copy_journal *journal = calloc (1, sizeof (*journal));
+
+        if (journal == NULL) {
+                return NULL;
+        }
+
+        journal->fd = -1;
+        journal->size = size;
+        journal->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+        journal->num_chunks = (size + journal->chunk_size - 1) / journal->chunk_size;
+        pthread_mutex_init (&journal->lock, NULL);
+
+        journal->path = strdup (path);
+        journal->done = calloc ((journal->num_chunks + 7) / 8 + 1, 1);
+        if (journal->path == NULL || journal->done == NULL) {
+                goto err;
+        }
+
+        journal->fd = open (path, O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (journal->fd == -1) {
+                goto err;
+        }
+
+        if (resume && journal_load (journal) > 0) {
+                return journal;
+        }
+
+        if (journal_reset (journal) == -1) {
+                goto err;
+        }
+
+        return journal;
+
+err:
+        copy_journal_close (journal, false);
+        return NULL;
+}
+
+/**
+ * Closes the journal, removing its file if the copy it tracked is complete.
+ */
+void
+copy_journal_close (struct copy_journal *journal, bool complete)
+{
+        if (journal == NULL) {
+                return;
+        }
+
+        if (journal->fd != -1) {
+                close (journal->fd);
+
+                if (complete) {
+                        unlink (journal->path);
+                }
+        }
+
+        pthread_mutex_destroy (&journal->lock);
+        free (journal->done);
+        free (journal->path);
+        free (journal);
+}
+
+/**
+ * Makes the given chunks durable on the destination and only then records
+ * them in the journal, so that a chunk in the journal is never lost to a
+ * crash of the client or a brick.
+ */
+static int
+journal_commit (struct copy_job *job, const size_t *chunks, size_t count)
+{
+        struct copy_journal *journal = job->journal;
+        char line[32];
+        char *buf;
+        size_t length = 0;
+        int ret = -1;
+
+        if (count == 0) {
+                return 0;
+        }
+
+        if (endpoint_fsync (job->dest) == -1) {
+                return -1;
+        }
+
+        buf = malloc (count * sizeof (line));
+        if (buf == NULL) {
+                return -1;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+                length += snprintf (buf + length, sizeof (line), "%lld\n",
+                                    (long long) chunks[i] * journal->chunk_size);
+        }
+
+        // A single append, so that concurrent batches don't interleave.
+        if (write (journal->fd, buf, length) == (ssize_t) length) {
+                ret = 0;
+        }
+
+        free (buf);
+
+        return ret;
+}
+
+/**
+ * Notes that a chunk has been copied, committing the batch it completes.
+ */
+static int
+journal_record (struct copy_job *job, size_t chunk)
+{
+        struct copy_journal *journal = job->journal;
+        size_t batch[JOURNAL_BATCH];
+        size_t count = 0;
+
+        pthread_mutex_lock (&journal->lock);
+        journal->pending[journal->num_pending++] = chunk;
+        if (journal->num_pending == JOURNAL_BATCH) {
+                memcpy (batch, journal->pending, sizeof (batch));
+                count = JOURNAL_BATCH;
+                journal->num_pending = 0;
+        }
+        pthread_mutex_unlock (&journal->lock);
+
+        return journal_commit (job, batch, count);
+}
+
+/**
+ * Finds the first extent of data in the range [offset, end) of source with
+ * SEEK_DATA and SEEK_HOLE, storing its bounds in data and hole. If the source
+ * cannot report holes, sparse is cleared and the whole range is returned.
+ *
+ * Returns 1 if an extent was found or 0 if the rest of the range is a hole.
+ */
+static int
+next_data_extent (struct copy_endpoint *source, bool *sparse, off_t offset, off_t end,
+                  off_t *data, off_t *hole)
+{
+        if (*sparse) {
+                *data = endpoint_lseek (source, offset, SEEK_DATA);
+                if (*data == -1 && errno == ENXIO) {
+                        return 0;
+                }
+
+                if (*data == -1) {
+                        *sparse = false;
+                }
+        }
+
+        if (!*sparse) {
+                *data = offset;
+                *hole = end;
+                return offset < end;
+        }
+
+        if (*data >= end) {
+                return 0;
+        }
+
+        *hole = endpoint_lseek (source, *data, SEEK_HOLE);
+        if (*hole == -1 || *hole > end) {
+                *hole = end;
+        }
+
+        return 1;
+}
+
+/**
+ * Returns whether the file described by statbuf occupies less space than its
+ * size, i.e. it has holes worth preserving.
+ */
+bool
+is_sparse (const struct stat *statbuf)
+{
+        return S_ISREG (statbuf->st_mode)
+                && (off_t) statbuf->st_blocks * 512 < statbuf->st_size;
+}
+
+/**
+ * Has the bricks copy the first size bytes of source to dest, which must be
+ * open on the same volume, so that the data never passes through the client.
+ * Copying starts at the offset in copied, normally 0, and anything dest holds
+ * past it is discarded first. Only the data extents of source are copied, so
+ * that its holes are preserved. On return copied holds the end of what was
+ * copied, which falls short of size if the volume cannot offload the copy or
+ * fails part way; the caller may then copy the rest itself.
+ *
+ * Returns 0 once everything has been copied, or -1 with errno set.
+ */
+int
+gluster_copy_offload (glfs_fd_t *source, glfs_fd_t *dest, off_t size, off_t *copied)
+{
+#ifdef HAVE_GLFS_COPY_FILE_RANGE
+        struct copy_endpoint endpoint = { .glfs_fd = source, .fd = -1 };
+        bool sparse = true;
+        off_t source_offset;
+        off_t dest_offset;
+        off_t data;
+        off_t hole;
+        size_t length;
+        ssize_t ret;
+
+        if (glfs_ftruncate (dest, *copied) == -1 || glfs_ftruncate (dest, size) == -1) {
+                return -1;
+        }
+
+        while (next_data_extent (&endpoint, &sparse, *copied, size, &data, &hole)) {
+                source_offset = data;
+                dest_offset = data;
+
+                while (source_offset < hole) {
+                        length = hole - source_offset;
+                        if (length > OFFLOAD_SIZE) {
+                                length = OFFLOAD_SIZE;
+                        }
+
+                        ret = glfs_copy_file_range (source, &source_offset, dest, &dest_offset,
+                                                    length, 0, NULL, NULL, NULL);
+                        if (ret == -1) {
+                                return -1;
+                        }
+
+                        // The source was truncated underneath us; so is dest
+                        // below.
+                        if (ret == 0) {
+                                return glfs_ftruncate (dest, *copied);
+                        }
+
+                        *copied = source_offset;
+                }
+
+                *copied = hole;
+        }
+
+        *copied = size;
+
+        return 0;
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+/**
+ * Copies the byte range [offset, end), which holds data, from the source to
+ * the same offset of the destination, adding it to the checksum at crc if
+ * that is not NULL.
+ */
+static int
+copy_extent (struct copy_job *job, char *buf, size_t buf_size, off_t offset, off_t end,
+             uint32_t *crc)
+{
+        ssize_t num_read;
+        ssize_t num_written;
+        ssize_t ret;
+
+        while (offset < end) {
+                size_t count = end - offset < buf_size ? end - offset : buf_size;
+
+                num_read = endpoint_pread (job->source, buf, count, offset);
+                if (num_read == -1) {
+                        return -1;
+                }
+
+                // The source shrank underneath us; nothing more to copy, and
+                // dest is left with zeros up to its size.
+                if (num_read == 0) {
+                        if (crc) {
+                                *crc = crc32c_zeros (*crc, end - offset);
+                        }
+
+                        break;
+                }
+
+                if (crc) {
+                        *crc = crc32c (*crc, buf, num_read);
+                }
+
+                for (num_written = 0; num_written < num_read;) {
+                        ret = endpoint_pwrite (job->dest,
+                                               &buf[num_written],
+                                               num_read - num_written,
+                                               offset + num_written);
+                        if (ret == -1) {
+                                return -1;
+                        }
+
+                        num_written += ret;
+                }
+
+                offset += num_read;
+        }
+
+        return 0;
+}
+
+/**
+ * Copies the byte range [offset, offset + length) from the source to the same
+ * offset of the destination. Holes in the source are skipped, leaving the
+ * already truncated destination sparse there as well. If crc is not NULL, it
+ * is set to the checksum of the range, holes included.
+ */
+static int
+copy_range (struct copy_job *job, char *buf, size_t buf_size, off_t offset, off_t length,
+            uint32_t *crc)
+{
+        bool sparse = job->sparse;
+        off_t end = offset + length;
+        off_t data;
+        off_t hole;
+
+        if (crc) {
+                *crc = 0;
+        }
+
+        while (next_data_extent (job->source, &sparse, offset, end, &data, &hole)) {
+                if (crc) {
+                        *crc = crc32c_zeros (*crc, data - offset);
+                }
+
+                if (copy_extent (job, buf, buf_size, data, hole, crc) == -1) {
+                        return -1;
+                }
+
+                offset = hole;
+        }
+
+        if (crc) {
+                *crc = crc32c_zeros (*crc, end - offset);
+        }
+
+        return 0;
+}
+
+/**
+ * Sets crc to the checksum of the byte range [offset, offset + length) of
+ * endpoint, reading only its data extents. Anything past the end of the file
+ * counts as zeros.
+ */
+static int
+checksum_range (struct copy_endpoint *endpoint, char *buf, size_t buf_size,
+                off_t offset, off_t length, uint32_t *crc)
+{
+        bool sparse = true;
+        off_t end = offset + length;
+        off_t data;
+        off_t hole;
+        ssize_t num_read;
+
+        *crc = 0;
+
+        while (next_data_extent (endpoint, &sparse, offset, end, &data, &hole)) {
+                *crc = crc32c_zeros (*crc, data - offset);
+
+                for (offset = data; offset < hole; offset += num_read) {
+                        num_read = endpoint_pread (endpoint, buf,
+                                                   hole - offset < buf_size ? hole - offset : buf_size,
+                                                   offset);
+                        if (num_read == -1) {
+                                return -1;
+                        }
+
+                        if (num_read == 0) {
+                                break;
+                        }
+
+                        *crc = crc32c (*crc, buf, num_read);
+                }
+        }
+
+        *crc = crc32c_zeros (*crc, end - offset);
+
+        return 0;
+}
+
+static void *
+copy_worker (void *data)
+{
+        struct copy_job *job = data;
+        size_t buf_size = job->chunk_size < job->io_size ? job->chunk_size : job->io_size;
+        off_t offset;
+        off_t length;
+        uint32_t *crc;
+        char *buf;
+
+        stats_attach (job->stats);
+
+        // Don't allocate more than the whole file for small copies.
+        if (job->size < buf_size) {
+                buf_size = job->size;
+        }
+
+        buf = alloc_buffer (buf_size);
+        if (buf == NULL) {
+                pthread_mutex_lock (&job->lock);
+                job->error = job->error ? job->error : errno;
+                pthread_mutex_unlock (&job->lock);
+                return NULL;
+        }
+
+        while (true) {
+                pthread_mutex_lock (&job->lock);
+                if (job->error || job->next_offset >= job->size) {
+                        pthread_mutex_unlock (&job->lock);
+                        break;
+                }
+
+                offset = job->next_offset;
+                job->next_offset += job->chunk_size;
+                pthread_mutex_unlock (&job->lock);
+
+                length = job->size - offset;
+                if (length > job->chunk_size) {
+                        length = job->chunk_size;
+                }
+
+                crc = job->crcs ? &job->crcs[(offset - job->start) / job->chunk_size] : NULL;
+
+                // Copied before the copy being resumed was interrupted, so
+                // only its checksum is needed, from what dest should hold.
+                if (job->journal && journal_is_done (job->journal, offset / job->chunk_size)) {
+                        if (crc && checksum_range (job->source, buf, buf_size, offset, length, crc) == -1) {
+                                pthread_mutex_lock (&job->lock);
+                                job->error = job->error ? job->error : errno;
+                                pthread_mutex_unlock (&job->lock);
+                                break;
+                        }
+
+                        continue;
+                }
+
+                if (copy_range (job, buf, buf_size, offset, length, crc) == -1
+                                || (job->journal && journal_record (job, offset / job->chunk_size) == -1)) {
+                        pthread_mutex_lock (&job->lock);
+                        job->error = job->error ? job->error : errno;
+                        pthread_mutex_unlock (&job->lock);
+                        break;
+                }
+        }
+
+        free (buf);
+
+        return NULL;
+}
+
+/**
+ * Runs worker over job from up to jobs threads, or from the calling thread
+ * alone for a single job, and waits for them all to finish.
+ */
+static void
+run_workers (struct copy_job *job, unsigned int jobs, void *(*worker) (void *))
+{
+        pthread_t *threads;
+        unsigned int started;
+
+        pthread_mutex_init (&job->lock, NULL);
+
+        threads = jobs > 1 ? malloc (sizeof (*threads) * jobs) : NULL;
+        if (threads == NULL) {
+                worker (job);
+                goto out;
+        }
+
+        for (started = 0; started < jobs; started++) {
+                errno = pthread_create (&threads[started], NULL, worker, job);
+                if (errno != 0) {
+                        break;
+                }
+        }
+
+        // Run with the workers we already have, if any.
+        if (started == 0) {
+                worker (job);
+        }
+
+        for (unsigned int i = 0; i < started; i++) {
+                pthread_join (threads[i], NULL);
+        }
+
+out:
+        free (threads);
+        pthread_mutex_destroy (&job->lock);
+}
+
+/**
+ * Joins the checksums of the num_chunks chunks of job in file order.
+ */
+static uint32_t
+join_checksums (struct copy_job *job, size_t num_chunks)
+{
+        uint32_t crc = 0;
+        off_t length;
+
+        for (size_t i = 0; i < num_chunks; i++) {
+                length = job->size - job->start - (off_t) i * job->chunk_size;
+                if (length > job->chunk_size) {
+                        length = job->chunk_size;
+                }
+
+                crc = crc32c_combine (crc, job->crcs[i], length);
+        }
+
+        return crc;
+}
+
+/**
+ * Copies the range [offset, size) of source to the same place in dest by
+ * splitting it into chunk_size pieces and copying them concurrently from a
+ * pool of up to jobs worker threads using positional reads and writes. offset
+ * is normally 0, or where an interrupted copy is resumed from. A single job
+ * runs on the calling thread.
+ *
+ * Anything dest holds past offset is discarded first, and dest is only
+ * extended to size at the end, so a single job leaves behind a destination
+ * whose size says how far it got. Only the data extents of the source are
+ * transferred; its holes are left as holes in dest.
+ *
+ * With a journal (and offset 0), dest is extended to size up front and each
+ * chunk is recorded once it is durable; the chunks the journal holds from an
+ * interrupted copy are skipped instead. Those are only trusted if dest still
+ * has the full size, and the chunks copied again are copied in full, as dest
+ * may hold stale data in their holes.
+ *
+ * If crc is not NULL, it is set to the checksum of [offset, size) as copied,
+ * worked out from the data on its way through. The chunks skipped thanks to
+ * the journal are read from source for it.
+ *
+ * Returns 0 on success, or -1 with errno set to the first error encountered.
+ */
+int
+gluster_copy_parallel (struct copy_endpoint *source, struct copy_endpoint *dest,
+                       off_t offset, off_t size, unsigned int jobs,
+                       size_t chunk_size, struct copy_journal *journal, uint32_t *crc)
+{
+        struct copy_job job = {
+                .source = source,
+                .dest = dest,
+                .start = offset,
+                .next_offset = offset,
+                .size = size,
+                .chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE,
+                .io_size = gluster_get_buffer_size (COPY_IO_SIZE),
+                .sparse = true,
+                .journal = journal,
+                .stats = stats_current (),
+                .crcs = NULL,
+                .error = 0,
+        };
+        struct stat statbuf;
+        size_t num_chunks;
+        int ret = -1;
+
+        if (journal && journal->num_done > 0) {
+                if (endpoint_fstat (dest, &statbuf) == -1) {
+                        goto out;
+                }
+
+                if (statbuf.st_size != size && journal_reset (journal) == -1) {
+                        goto out;
+                }
+        }
+
+        if (journal && journal->num_done > 0) {
+                job.sparse = false;
+        } else {
+                if (endpoint_ftruncate (dest, offset) == -1) {
+                        goto out;
+                }
+
+                // A source that is all hole past offset has no data there
+                // either.
+                if (endpoint_lseek (source, offset, SEEK_DATA) == -1 && errno != ENXIO) {
+                        job.sparse = false;
+                }
+        }
+
+        if (journal && endpoint_ftruncate (dest, size) == -1) {
+                goto out;
+        }
+
+        num_chunks = (size - offset + job.chunk_size - 1) / job.chunk_size;
+        if (num_chunks == 0) {
+                if (crc) {
+                        *crc = 0;
+                }
+
+                ret = endpoint_ftruncate (dest, size);
+                goto out;
+        }
+
+        if (crc) {
+                job.crcs = malloc (sizeof (*job.crcs) * num_chunks);
+                if (job.crcs == NULL) {
+                        goto out;
+                }
+        }
+
+        run_workers (&job, jobs < num_chunks ? jobs : num_chunks, copy_worker);
+
+        if (!job.error && journal
+                        && journal_commit (&job, journal->pending, journal->num_pending) == -1) {
+                job.error = errno;
+        }
+
+        if (job.error) {
+                errno = job.error;
+                goto out;
+        }
+
+        if (crc) {
+                *crc = join_checksums (&job, num_chunks);
+        }
+
+        ret = endpoint_ftruncate (dest, size);
+
+out:
+        free (job.crcs);
+
+        return ret;
+}
+
+static void *
+checksum_worker (void *data)
+{
+        struct copy_job *job = data;
+        size_t buf_size = job->chunk_size < job->io_size ? job->chunk_size : job->io_size;
+        off_t offset;
+        off_t length;
+        char *buf;
+
+        stats_attach (job->stats);
+
+        if (job->size - job->start < buf_size) {
+                buf_size = job->size - job->start;
+        }
+
+        buf = alloc_buffer (buf_size);
+        if (buf == NULL) {
+                pthread_mutex_lock (&job->lock);
+                job->error = job->error ? job->error : errno;
+                pthread_mutex_unlock (&job->lock);
+                return NULL;
+        }
+
+        while (true) {
+                pthread_mutex_lock (&job->lock);
+                if (job->error || job->next_offset >= job->size) {
+                        pthread_mutex_unlock (&job->lock);
+                        break;
+                }
+
+                offset = job->next_offset;
+                job->next_offset += job->chunk_size;
+                pthread_mutex_unlock (&job->lock);
+
+                length = job->size - offset;
+                if (length > job->chunk_size) {
+                        length = job->chunk_size;
+                }
+
+                if (checksum_range (job->source, buf, buf_size, offset, length,
+                                    &job->crcs[(offset - job->start) / job->chunk_size]) == -1) {
+                        pthread_mutex_lock (&job->lock);
+                        job->error = job->error ? job->error : errno;
+                        pthread_mutex_unlock (&job->lock);
+                        break;
+                }
+        }
+
+        free (buf);
+
+        return NULL;
+}
+
+/**
+ * Sets crc to the checksum of the range [offset, size) of endpoint, reading
+ * it in chunk_size pieces from up to jobs threads at once, as
+ * gluster_copy_parallel () copies them.
+ *
+ * Returns 0 on success, or -1 with errno set to the first error encountered.
+ */
+int
+gluster_checksum_parallel (struct copy_endpoint *endpoint, off_t offset, off_t size,
+                           unsigned int jobs, size_t chunk_size, uint32_t *crc)
+{
+        struct copy_job job = {
+                .source = endpoint,
+                .dest = NULL,
+                .start = offset,
+                .next_offset = offset,
+                .size = size,
+                .chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE,
+                .io_size = gluster_get_buffer_size (COPY_IO_SIZE),
+                .journal = NULL,
+                .stats = stats_current (),
+                .error = 0,
+        };
+        size_t num_chunks = size > offset ? (size - offset + job.chunk_size - 1) / job.chunk_size : 0;
+
+        *crc = 0;
+        if (num_chunks == 0) {
+                return 0;
+        }
+
+        job.crcs = malloc (sizeof (*job.crcs) * num_chunks);
+        if (job.crcs == NULL) {
+                return -1;
+        }
+
+        run_workers (&job, jobs < num_chunks ? jobs : num_chunks, checksum_worker);
+
+        if (job.error == 0) {
+                *crc = join_checksums (&job, num_chunks);
+        }
+
+        free (job.crcs);
+
+        errno = job.error;
+
+        return job.error ? -1 : 0;
+}
+
+/**
+ * Reads the checksum recorded on endpoint by gluster_copy_check (), if it is
+ * still current: the file must have the size and modification time it had
+ * when the checksum was recorded. Returns 1 if crc was set, otherwise 0.
+ */
+static int
+checksum_load (struct copy_endpoint *endpoint, uint32_t *crc)
+{
+        struct stat statbuf;
+        char value[128];
+        unsigned int stored_crc;
+        long long size;
+        long long sec;
+        long nsec;
+        ssize_t length;
+
+        length = endpoint_fgetxattr (endpoint, CHECKSUM_XATTR, value, sizeof (value) - 1);
+        if (length <= 0 || endpoint_fstat (endpoint, &statbuf) == -1) {
+                return 0;
+        }
+
+        value[length] = '\0';
+        if (sscanf (value, "crc32c:%8x %lld %lld.%9ld", &stored_crc, &size, &sec, &nsec) != 4
+                        || size != statbuf.st_size
+                        || sec != statbuf.st_mtim.tv_sec
+                        || nsec != statbuf.st_mtim.tv_nsec) {
+                return 0;
+        }
+
+        *crc = stored_crc;
+
+        return 1;
+}
+
+/**
+ * Records crc as the checksum of endpoint as it is now. This is best effort,
+ * as not every file system takes extended attributes.
+ */
+static void
+checksum_store (struct copy_endpoint *endpoint, uint32_t crc)
+{
+        struct stat statbuf;
+        char value[128];
+        int length;
+
+        if (endpoint_fstat (endpoint, &statbuf) == -1) {
+                return;
+        }
+
+        length = snprintf (value, sizeof (value), "crc32c:%08x %lld %lld.%09ld", crc,
+                           (long long) statbuf.st_size,
+                           (long long) statbuf.st_mtim.tv_sec,
+                           statbuf.st_mtim.tv_nsec);
+
+        endpoint_fsetxattr (endpoint, CHECKSUM_XATTR, value, length);
+}
+
+/**
+ * Checks a transfer into dest of the range [offset, end), whose data had the
+ * checksum crc on its way through, once dest has been flushed. dest must be
+ * end bytes long and its range must read back with the same checksum, which
+ * is worked out by gluster_checksum_parallel () with jobs and chunk_size.
+ *
+ * When the whole file was transferred, the checksum is also compared with
+ * the one recorded on source, if it has a current one (source may be NULL,
+ * for a stream), and is then recorded on dest for later copies of it.
+ *
+ * Returns 0 if the transfer checks out, or -1 with errno set: EIO if what
+ * dest holds does not match what was sent, EBADMSG if what was sent does not
+ * match the checksum recorded on source.
+ */
+int
+gluster_copy_check (struct copy_endpoint *source, struct copy_endpoint *dest,
+                    off_t offset, off_t end, uint32_t crc, unsigned int jobs,
+                    size_t chunk_size)
+{
+        struct stat statbuf;
+        uint32_t stored_crc;
+        uint32_t dest_crc;
+
+        if (offset == 0 && source && checksum_load (source, &stored_crc) && stored_crc != crc) {
+                errno = EBADMSG;
+                return -1;
+        }
+
+        if (endpoint_fsync (dest) == -1 || endpoint_fstat (dest, &statbuf) == -1) {
+                return -1;
+        }
+
+        if (statbuf.st_size != end) {
+                errno = EIO;
+                return -1;
+        }
+
+        if (gluster_checksum_parallel (dest, offset, end, jobs, chunk_size, &dest_crc) == -1) {
+                return -1;
+        }
+
+        if (dest_crc != crc) {
+                errno = EIO;
+                return -1;
+        }
+
+        if (offset == 0) {
+                checksum_store (dest, crc);
+        }
+
+        return 0;
+}
+
+/**
+ * Checks that the copy of source in dest can stand in for it, before source
+ * is removed. before holds the attributes of source from before the copy.
+ * dest is flushed and must hold as many bytes as source did, and source must
+ * not have changed since. Returns -1 with errno set if the copy cannot be
+ * trusted: EAGAIN if source changed and EIO if dest is short.
+ */
+int
+gluster_copy_verify (struct copy_endpoint *source, struct copy_endpoint *dest,
+                     const struct stat *before)
+{
+        struct stat statbuf;
+
+        if (endpoint_fsync (dest) == -1 || endpoint_fstat (source, &statbuf) == -1) {
+                return -1;
+        }
+
+        if (statbuf.st_size != before->st_size
+                        || statbuf.st_mtim.tv_sec != before->st_mtim.tv_sec
+                        || statbuf.st_mtim.tv_nsec != before->st_mtim.tv_nsec) {
+                errno = EAGAIN;
+                return -1;
+        }
+
+        if (endpoint_fstat (dest, &statbuf) == -1) {
+                return -1;
+        }
+
+        if (statbuf.st_size != before->st_size) {
+                errno = EIO;
+                return -1;
+        }
+
+        return 0;
+}
+
+/**
+ * A directory or regular file found by the walk, along with its path on the
+ * destination. size and mtime are only meaningful for regular files.
+ *
+ * On a Gluster volume, the handles are those of the directory itself for a
+ * directory, and of the directory containing it for a file, which is then
+ * opened or created by name so that no full path is ever resolved.
+ *
+ * name: Last component of the paths, or NULL for the top directory.
+ */
+struct tree_entry {
+        char *source;
+        char *dest;
+        const char *name;
+        struct gluster_handle *source_handle;
+        struct gluster_handle *dest_handle;
+        off_t size;
+        struct timespec mtime;
+};
+
+/**
+ * Shared state of a recursive copy. Walkers pop directories from dirs, create
+ * their counterparts on the destination and push the regular files they find
+ * onto the bounded files queue, which the copy workers drain. Either file
+ * system may be NULL, in which case that side is the local file system.
+ */
+struct tree_copy {
+        glfs_t *source_fs;
+        glfs_t *dest_fs;
+        const struct copy_options *options;
+        struct work_queue dirs;
+        struct work_queue files;
+        pthread_mutex_t lock;
+        struct stats *stats;
+        bool failed;
+};
+
+/**
+ * An open directory on either a Gluster volume or the local file system.
+ */
+struct tree_dir {
+        glfs_fd_t *glfs_fd;
+        DIR *dir;
+};
+
+/**
+ * Reports an error for a single entry without aborting the rest of the copy.
+ * Messages are serialized so that output from different threads does not
+ * interleave.
+ */
+static void
+tree_error (struct tree_copy *tree, int errnum, const char *fmt, ...)
+{
+        char message[PATH_MAX * 2];
+        va_list args;
+
+        va_start (args, fmt);
+        vsnprintf (message, sizeof (message), fmt, args);
+        va_end (args);
+
+        pthread_mutex_lock (&tree->lock);
+        tree->failed = true;
+        error (0, errnum, "%s", message);
+        pthread_mutex_unlock (&tree->lock);
+}
+
+static void
+tree_entry_free (struct tree_entry *entry)
+{
+        gluster_handle_unref (entry->source_handle);
+        gluster_handle_unref (entry->dest_handle);
+        free (entry->source);
+        free (entry->dest);
+        free (entry);
+}
+
+/**
+ * Creates an entry for name inside the given source and destination
+ * directories, or for the directories themselves if name is NULL.
+ */
+static struct tree_entry *
+tree_entry_new (const char *source_dir, const char *dest_dir, const char *name)
+{
+        struct tree_entry *entry = calloc (1, sizeof (*entry));
+
+        if (entry == NULL) {
+                return NULL;
+        }
+
+        if (name) {
+                entry->source = append_path (source_dir, name);
+                entry->dest = append_path (dest_dir, name);
+        } else {
+                entry->source = strdup (source_dir);
+                entry->dest = strdup (dest_dir);
+        }
+
+        if (entry->source == NULL || entry->dest == NULL) {
+                tree_entry_free (entry);
+                return NULL;
+        }
+
+        if (name) {
+                entry->name = entry->source + strlen (entry->source) - strlen (name);
+        }
+
+        return entry;
+}
+
+/**
+ * Gets the attributes of name inside the directory dir, at path on the local
+ * file system if fs is NULL.
+ */
+static int
+tree_lstat (glfs_t *fs, struct gluster_handle *dir, const char *path, const char *name,
+            struct stat *statbuf)
+{
+        struct gluster_handle *handle;
+
+        if (fs) {
+                handle = gluster_handle_lookup (fs, dir, name, statbuf, false);
+                gluster_handle_unref (handle);
+
+                return handle ? 0 : -1;
+        }
+
+        return lstat (path, statbuf);
+}
+
+/**
+ * Creates the directory name inside parent, or path if parent is NULL, and
+ * returns its handle in handle (NULL on the local file system). Succeeds if a
+ * directory already exists there so that a tree can be copied over an earlier
+ * copy.
+ */
+static int
+tree_mkdir (glfs_t *fs, struct gluster_handle *parent, const char *path, const char *name,
+            struct gluster_handle **handle)
+{
+        const char *where = parent ? name : path;
+        mode_t mode = get_default_dir_mode_perm ();
+        struct stat statbuf;
+        int ret;
+
+        *handle = NULL;
+
+        if (fs) {
+                *handle = gluster_handle_mkdir (fs, parent, where, mode, NULL);
+                if (*handle == NULL && errno == EEXIST) {
+                        *handle = gluster_handle_lookup (fs, parent, where, &statbuf, false);
+                        if (*handle && !S_ISDIR (statbuf.st_mode)) {
+                                gluster_handle_unref (*handle);
+                                *handle = NULL;
+                                errno = ENOTDIR;
+                        }
+                }
+
+                return *handle ? 0 : -1;
+        }
+
+        ret = mkdir (path, mode);
+        if (ret == -1 && errno == EEXIST) {
+                if (lstat (path, &statbuf) == -1) {
+                        return -1;
+                }
+
+                if (!S_ISDIR (statbuf.st_mode)) {
+                        errno = ENOTDIR;
+                        return -1;
+                }
+
+                ret = 0;
+        }
+
+        return ret;
+}
+
+static int
+tree_opendir (glfs_t *fs, struct gluster_handle *handle, const char *path, struct tree_dir *dir)
+{
+        dir->glfs_fd = NULL;
+        dir->dir = NULL;
+
+        if (fs) {
+                dir->glfs_fd = gluster_handle_opendir (fs, handle);
+                return dir->glfs_fd ? 0 : -1;
+        }
+
+        dir->dir = opendir (path);
+        return dir->dir ? 0 : -1;
+}
+
+static void
+tree_closedir (struct tree_dir *dir)
+{
+        if (dir->glfs_fd) {
+                glfs_closedir (dir->glfs_fd);
+        }
+
+        if (dir->dir) {
+                closedir (dir->dir);
+        }
+}
+
+/**
+ * Returns the next entry of dir along with its attributes, which for a Gluster
+ * volume come back with the listing itself. A zeroed st_mode means that the
+ * attributes were not available and the caller should lstat the entry.
+ * Returns NULL at the end of the directory or on error, setting errno only in
+ * the latter case.
+ */
+static struct dirent *
+tree_readdir (struct tree_dir *dir, struct stat *statbuf)
+{
+        struct dirent *entry;
+        uint64_t start;
+
+        errno = 0;
+        if (dir->glfs_fd) {
+                memset (statbuf, 0, sizeof (*statbuf));
+
+                start = stats_start ();
+                entry = glfs_readdirplus (dir->glfs_fd, statbuf);
+                stats_end (STATS_READDIR, start, entry == NULL && errno ? -1 : 0);
+
+                return entry;
+        }
+
+        entry = readdir (dir->dir);
+        if (entry && fstatat (dirfd (dir->dir), entry->d_name, statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+                memset (statbuf, 0, sizeof (*statbuf));
+        }
+
+        return entry;
+}
+
+/**
+ * Opens the regular file an entry stands for on the source.
+ */
+static glfs_fd_t *
+tree_open (glfs_t *fs, struct tree_entry *entry)
+{
+        struct gluster_handle *handle;
+        glfs_fd_t *fd;
+        int saved_errno;
+
+        handle = gluster_handle_lookup (fs, entry->source_handle, entry->name, NULL, false);
+        if (handle == NULL) {
+                return NULL;
+        }
+
+        fd = gluster_handle_open (fs, handle, O_RDONLY);
+
+        saved_errno = errno;
+        gluster_handle_unref (handle);
+        errno = saved_errno;
+
+        return fd;
+}
+
+static int
+tree_unlink (glfs_t *fs, struct tree_entry *entry)
+{
+        if (fs) {
+                return gluster_handle_unlink (fs, entry->source_handle, entry->name);
+        }
+
+        return unlink (entry->source);
+}
+
+/**
+ * Recreates the symbolic link entry, found in dir, on the destination.
+ */
+static int
+tree_copy_symlink (struct tree_copy *tree, struct tree_entry *dir, struct tree_entry *entry)
+{
+        struct gluster_handle *handle;
+        char target[PATH_MAX];
+        ssize_t length;
+
+        if (tree->source_fs) {
+                handle = gluster_handle_lookup (tree->source_fs, dir->source_handle, entry->name,
+                                                NULL, false);
+                if (handle == NULL) {
+                        return -1;
+                }
+
+                length = gluster_handle_readlink (tree->source_fs, handle, target, sizeof (target) - 1);
+                gluster_handle_unref (handle);
+        } else {
+                length = readlink (entry->source, target, sizeof (target) - 1);
+        }
+
+        if (length == -1) {
+                return -1;
+        }
+
+        target[length] = '\0';
+
+        if (tree->dest_fs) {
+                return gluster_handle_symlink (tree->dest_fs, dir->dest_handle, entry->name, target);
+        }
+
+        return symlink (target, entry->dest);
+}
+
+/**
+ * Copies one regular file found by the walk, checking the copy against the
+ * checksum of the data with verify, and with remove_source removes it from
+ * the source once the copy is verified. Removing the source always checks
+ * the copy, as it is about to be the only one.
+ */
+static void
+tree_copy_file (struct tree_copy *tree, struct tree_entry *entry)
+{
+        struct copy_endpoint source = { .glfs_fd = NULL, .fd = -1 };
+        struct copy_endpoint dest = { .glfs_fd = NULL, .fd = -1 };
+        struct stat statbuf = {
+                .st_mode = S_IFREG,
+                .st_size = entry->size,
+                .st_mtim = entry->mtime,
+        };
+        mode_t mode = get_default_file_mode_perm ();
+        bool verify = tree->options->verify || tree->options->remove_source;
+        int flags = verify ? O_RDWR : O_WRONLY;
+        uint32_t crc = 0;
+        off_t copied = 0;
+
+        gluster_apply_buffer_size (tree->options->buffer_size,
+                                   tree->source_fs ? tree->source_fs : tree->dest_fs,
+                                   &statbuf);
+
+        if (tree->source_fs) {
+                source.glfs_fd = tree_open (tree->source_fs, entry);
+        } else {
+                source.fd = open (entry->source, O_RDONLY);
+        }
+
+        if (source.glfs_fd == NULL && source.fd == -1) {
+                tree_error (tree, errno, "%s", entry->source);
+                goto out;
+        }
+
+        if (tree->dest_fs) {
+                dest.glfs_fd = gluster_handle_creat (tree->dest_fs, entry->dest_handle, entry->name,
+                                                     flags, mode);
+        } else {
+                dest.fd = open (entry->dest, O_CREAT | flags, mode);
+        }
+
+        if (dest.glfs_fd == NULL && dest.fd == -1) {
+                tree_error (tree, errno, "failed to create %s", entry->dest);
+                goto out;
+        }
+
+        // Within a volume, try to leave the copy to the bricks. Anything short
+        // of a complete offload is copied again from the start. The data
+        // then never passes through here, so the source is read for its
+        // checksum.
+        if (tree->source_fs && tree->source_fs == tree->dest_fs
+                        && gluster_copy_offload (source.glfs_fd, dest.glfs_fd, entry->size, &copied) == 0) {
+                if (verify
+                                && gluster_checksum_parallel (&source, 0, entry->size, 1,
+                                                              tree->options->chunk_size, &crc) == -1) {
+                        tree_error (tree, errno, "failed to read %s", entry->source);
+                        goto out;
+                }
+
+                goto copied;
+        }
+
+        if (gluster_copy_parallel (&source, &dest, 0, entry->size, 1, tree->options->chunk_size, NULL,
+                                   verify ? &crc : NULL) == -1) {
+                tree_error (tree, errno, "failed to transfer %s", entry->source);
+                goto out;
+        }
+
+copied:
+        if (verify
+                        && gluster_copy_check (&source, &dest, 0, entry->size, crc, 1,
+                                               tree->options->chunk_size) == -1) {
+                tree_error (tree, errno, "failed to verify %s", entry->dest);
+                goto out;
+        }
+
+        if (!tree->options->remove_source) {
+                goto out;
+        }
+
+        if (gluster_copy_verify (&source, &dest, &statbuf) == -1) {
+                tree_error (tree, errno, "failed to verify the copy of %s, not removing it", entry->source);
+        } else if (tree_unlink (tree->source_fs, entry) == -1) {
+                tree_error (tree, errno, "cannot remove %s", entry->source);
+        }
+
+out:
+        if (source.glfs_fd) {
+                glfs_close (source.glfs_fd);
+        } else if (source.fd != -1) {
+                close (source.fd);
+        }
+
+        if (dest.glfs_fd) {
+                glfs_close (dest.glfs_fd);
+        } else if (dest.fd != -1) {
+                close (dest.fd);
+        }
+}
+
+/**
+ * Reads one source directory, recreating its subdirectories and symbolic links
+ * on the destination and queueing subdirectories and files for the walkers
+ * and copy workers respectively.
+ */
+static void
+tree_walk_dir (struct tree_copy *tree, struct tree_entry *dir_entry)
+{
+        struct tree_dir dir;
+        struct tree_entry *child;
+        struct dirent *entry;
+        struct stat statbuf;
+
+        if (tree_opendir (tree->source_fs, dir_entry->source_handle, dir_entry->source, &dir) == -1) {
+                tree_error (tree, errno, "cannot access %s", dir_entry->source);
+                return;
+        }
+
+        while ((entry = tree_readdir (&dir, &statbuf)) != NULL) {
+                if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0) {
+                        continue;
+                }
+
+                child = tree_entry_new (dir_entry->source, dir_entry->dest, entry->d_name);
+                if (child == NULL) {
+                        tree_error (tree, errno, "%s", dir_entry->source);
+                        break;
+                }
+
+                if (statbuf.st_mode == 0 && tree_lstat (tree->source_fs, dir_entry->source_handle,
+                                                        child->source, child->name, &statbuf) == -1) {
+                        tree_error (tree, errno, "cannot stat %s", child->source);
+                        tree_entry_free (child);
+                        continue;
+                }
+
+                if (S_ISDIR (statbuf.st_mode)) {
+                        if (tree->source_fs) {
+                                child->source_handle = gluster_handle_lookup (tree->source_fs,
+                                                                              dir_entry->source_handle,
+                                                                              child->name, NULL, false);
+                        }
+
+                        if (tree->source_fs && child->source_handle == NULL) {
+                                tree_error (tree, errno, "cannot access %s", child->source);
+                                tree_entry_free (child);
+                        } else if (tree_mkdir (tree->dest_fs, dir_entry->dest_handle, child->dest,
+                                               child->name, &child->dest_handle) == -1) {
+                                tree_error (tree, errno, "cannot create directory %s", child->dest);
+                                tree_entry_free (child);
+                        } else if (work_queue_push (&tree->dirs, child) == -1) {
+                                tree_error (tree, errno, "%s", child->source);
+                                tree_entry_free (child);
+                        }
+                } else if (S_ISREG (statbuf.st_mode)) {
+                        child->size = statbuf.st_size;
+                        child->mtime = statbuf.st_mtim;
+                        child->source_handle = gluster_handle_ref (dir_entry->source_handle);
+                        child->dest_handle = gluster_handle_ref (dir_entry->dest_handle);
+                        if (work_queue_push (&tree->files, child) == -1) {
+                                tree_error (tree, errno, "%s", child->source);
+                                tree_entry_free (child);
+                        }
+                } else if (S_ISLNK (statbuf.st_mode)) {
+                        if (tree_copy_symlink (tree, dir_entry, child) == -1) {
+                                tree_error (tree, errno, "cannot create symbolic link %s", child->dest);
+                        }
+
+                        tree_entry_free (child);
+                } else {
+                        tree_error (tree, 0, "skipping special file %s", child->source);
+                        tree_entry_free (child);
+                }
+        }
+
+        if (errno != 0) {
+                tree_error (tree, errno, "reading directory %s", dir_entry->source);
+        }
+
+        tree_closedir (&dir);
+}
+
+static void *
+tree_walker (void *data)
+{
+        struct tree_copy *tree = data;
+        struct tree_entry *entry;
+
+        stats_attach (tree->stats);
+
+        while ((entry = work_queue_pop (&tree->dirs)) != NULL) {
+                tree_walk_dir (tree, entry);
+                tree_entry_free (entry);
+
+                // Closes the queue, releasing the other walkers, once the
+                // last directory has been read.
+                work_queue_done (&tree->dirs);
+        }
+
+        return NULL;
+}
+
+static void *
+tree_copier (void *data)
+{
+        struct tree_copy *tree = data;
+        struct tree_entry *entry;
+
+        stats_attach (tree->stats);
+
+        while ((entry = work_queue_pop (&tree->files)) != NULL) {
+                tree_copy_file (tree, entry);
+                tree_entry_free (entry);
+        }
+
+        return NULL;
+}
+
+/**
+ * Returns true if path lies strictly underneath dir.
+ */
+static bool
+is_subpath (const char *dir, const char *path)
+{
+        size_t length = strlen (dir);
+
+        while (length > 1 && dir[length - 1] == '/') {
+                length--;
+        }
+
+        return strncmp (dir, path, length) == 0 && path[length] == '/';
+}
+
+/**
+ * Recursively copies the directory source_path to dest_path, which is created
+ * if it does not already exist. Either file system may be NULL to refer to the
+ * local file system.
+ *
+ * The copy is a pipeline: options->meta_jobs walker threads read directories
+ * (using readdirplus on a Gluster volume so that no extra round trip is needed
+ * per entry) and create the destination directories, while options->jobs
+ * copy workers transfer the regular files the walkers queue up. The file queue
+ * is bounded, so a fast walk cannot run arbitrarily far ahead of the copy.
+ *
+ * Errors for individual entries are reported as they occur and do not stop
+ * the rest of the copy. Returns 0 if everything was copied, or -1 otherwise.
+ */
+int
+gluster_copy_tree (glfs_t *source_fs, const char *source_path,
+                   glfs_t *dest_fs, const char *dest_path,
+                   const struct copy_options *options)
+{
+        struct tree_copy tree = {
+                .source_fs = source_fs,
+                .dest_fs = dest_fs,
+                .options = options,
+                .stats = stats_current (),
+                .failed = false,
+        };
+        unsigned int jobs = options->jobs ? options->jobs : DEFAULT_TREE_JOBS;
+        unsigned int meta_jobs = options->meta_jobs ? options->meta_jobs : DEFAULT_TREE_META_JOBS;
+        unsigned int num_copiers = 0;
+        unsigned int num_walkers = 0;
+        pthread_t *copiers = NULL;
+        pthread_t *walkers = NULL;
+        struct tree_entry *root;
+        int ret = -1;
+
+        if (source_fs == dest_fs && is_subpath (source_path, dest_path)) {
+                error (0, 0, "cannot copy a directory, %s, into itself, %s",
+                                source_path, dest_path);
+                return -1;
+        }
+
+        root = tree_entry_new (source_path, dest_path, NULL);
+        if (root == NULL) {
+                error (0, errno, "%s", source_path);
+                return -1;
+        }
+
+        // Everything below the top directories is then reached through their
+        // handles, so these are the only full paths resolved.
+        if (source_fs) {
+                root->source_handle = gluster_handle_lookup (source_fs, NULL, source_path, NULL, true);
+                if (root->source_handle == NULL) {
+                        error (0, errno, "cannot access %s", source_path);
+                        tree_entry_free (root);
+                        return -1;
+                }
+        }
+
+        if (tree_mkdir (dest_fs, NULL, dest_path, NULL, &root->dest_handle) == -1) {
+                error (0, errno, "cannot create directory %s", dest_path);
+                tree_entry_free (root);
+                return -1;
+        }
+
+        if (work_queue_init (&tree.dirs, 0) == -1) {
+                error (0, errno, "failed to initialize directory queue");
+                tree_entry_free (root);
+                return -1;
+        }
+
+        if (work_queue_init (&tree.files, TREE_FILE_QUEUE_SIZE) == -1) {
+                error (0, errno, "failed to initialize file queue");
+                work_queue_destroy (&tree.dirs);
+                tree_entry_free (root);
+                return -1;
+        }
+
+        pthread_mutex_init (&tree.lock, NULL);
+        work_queue_push (&tree.dirs, root);
+
+        copiers = malloc (sizeof (*copiers) * jobs);
+        walkers = malloc (sizeof (*walkers) * meta_jobs);
+        if (copiers == NULL || walkers == NULL) {
+                error (0, errno, "failed to allocate workers");
+                goto out;
+        }
+
+        for (; num_copiers < jobs; num_copiers++) {
+                if (pthread_create (&copiers[num_copiers], NULL, tree_copier, &tree) != 0) {
+                        break;
+                }
+        }
+
+        if (num_copiers == 0) {
+                error (0, errno, "failed to start copy workers");
+                goto out;
+        }
+
+        for (; num_walkers < meta_jobs; num_walkers++) {
+                if (pthread_create (&walkers[num_walkers], NULL, tree_walker, &tree) != 0) {
+                        break;
+                }
+        }
+
+        // Walk on this thread if no walker could be started.
+        if (num_walkers == 0) {
+                tree_walker (&tree);
+        }
+
+        for (unsigned int i = 0; i < num_walkers; i++) {
+                pthread_join (walkers[i], NULL);
+        }
+
+        ret = tree.failed ? -1 : 0;
+
+out:
+        // Let the copy workers finish whatever the walkers queued.
+        work_queue_close (&tree.files);
+
+        for (unsigned int i = 0; i < num_copiers; i++) {
+                pthread_join (copiers[i], NULL);
+        }
+
+        if (ret == 0 && tree.failed) {
+                ret = -1;
+        }
+
+        // Free anything left behind if the copy never got started.
+        work_queue_close (&tree.dirs);
+        while ((root = work_queue_pop (&tree.dirs)) != NULL) {
+                tree_entry_free (root);
+        }
+
+        pthread_mutex_destroy (&tree.lock);
+        work_queue_destroy (&tree.files);
+        work_queue_destroy (&tree.dirs);
+        free (walkers);
+        free (copiers);
+
+        return ret;
+}
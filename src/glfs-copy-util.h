@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_COPY_UTIL_H
+#define GLFS_COPY_UTIL_H
+
+#include <glusterfs/api/glfs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define DEFAULT_CHUNK_SIZE 4*1024*1024
+#define DEFAULT_TREE_JOBS 8
+#define DEFAULT_TREE_META_JOBS 4
+#define DEFAULT_VERIFY_JOBS 8
+
+// Extended attribute in which a verified copy records its checksum.
+#define CHECKSUM_XATTR "user.glusterfs-coreutils.crc32c"
+
+/**
+ * One side of a transfer: either an open file on a Gluster volume (glfs_fd is
+ * set) or a local file descriptor (glfs_fd is NULL and fd is used).
+ */
+struct copy_endpoint {
+        glfs_fd_t *glfs_fd;
+        int fd;
+};
+
+ssize_t
+endpoint_pread (struct copy_endpoint *endpoint, void *buf, size_t count, off_t offset);
+
+ssize_t
+endpoint_pwrite (struct copy_endpoint *endpoint, const void *buf, size_t count, off_t offset);
+
+int
+endpoint_fstat (struct copy_endpoint *endpoint, struct stat *statbuf);
+
+int
+endpoint_fsync (struct copy_endpoint *endpoint);
+
+int
+endpoint_ftruncate (struct copy_endpoint *endpoint, off_t length);
+
+off_t
+endpoint_lseek (struct copy_endpoint *endpoint, off_t offset, int whence);
+
+bool
+is_sparse (const struct stat *statbuf);
+
+/**
+ * Tunables for a recursive copy.
+ *
+ * jobs: Number of files copied concurrently (the data limit).
+ * meta_jobs: Number of directories read and created concurrently (the
+ *            metadata limit).
+ * chunk_size: Size of the positional reads and writes used for each file.
+ * buffer_size: Size of the buffers used for each file, BUFFER_SIZE_AUTO to
+ *              size them per file, or 0 for the default.
+ * remove_source: Whether to remove each regular file from the source once
+ *                its copy has been verified, for a move. Implies verify.
+ * verify: Whether to check each regular file copied against the checksum of
+ *         its data, as gluster_copy_check () does.
+ */
+struct copy_options {
+        unsigned int jobs;
+        unsigned int meta_jobs;
+        size_t chunk_size;
+        size_t buffer_size;
+        bool remove_source;
+        bool verify;
+};
+
+struct copy_journal;
+
+struct copy_journal *
+copy_journal_open (const char *path, off_t size, size_t chunk_size, bool resume);
+
+void
+copy_journal_close (struct copy_journal *journal, bool complete);
+
+off_t
+gluster_resume_offset (struct copy_endpoint *source, struct copy_endpoint *dest, off_t size);
+
+int
+gluster_copy_offload (glfs_fd_t *source, glfs_fd_t *dest, off_t size, off_t *copied);
+
+int
+gluster_copy_parallel (struct copy_endpoint *source, struct copy_endpoint *dest,
+                       off_t offset, off_t size, unsigned int jobs,
+                       size_t chunk_size, struct copy_journal *journal, uint32_t *crc);
+
+int
+gluster_checksum_parallel (struct copy_endpoint *endpoint, off_t offset, off_t size,
+                           unsigned int jobs, size_t chunk_size, uint32_t *crc);
+
+int
+gluster_copy_check (struct copy_endpoint *source, struct copy_endpoint *dest,
+                    off_t offset, off_t end, uint32_t crc, unsigned int jobs,
+                    size_t chunk_size);
+
+int
+gluster_copy_verify (struct copy_endpoint *source, struct copy_endpoint *dest,
+                     const struct stat *before);
+
+int
+gluster_copy_tree (glfs_t *source_fs, const char *source_path,
+                   glfs_t *dest_fs, const char *dest_path,
+                   const struct copy_options *options);
+
+#endif /* GLFS_COPY_UTIL_H */
@@ -21,7 +21,11 @@
 
 #include <config.h>
 
+#include "glfs-attr-cache.h"
+#include "glfs-checksum.h"
 #include "glfs-cp.h"
+#include "glfs-copy-util.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 
 #include <errno.h>
@@ -66,7 +70,19 @@ enum transfer_mode {
  * dest: Raw destination string supplied by the user.
  * source: Raw source string supplied by the user.
  * debug: Whether to log additional debug information.
+ * buffer_size: Size of the transfer buffers, BUFFER_SIZE_AUTO to size them
+ *              from the volume and the source, or 0 for the default.
+ * chunk_size: Size of the ranges a file is split into for a parallel copy.
+ * jobs: Number of chunks to copy concurrently, or of files when copying a
+ *       directory recursively. 0 selects the default for the mode.
+ * meta_jobs: Number of directories to read and create concurrently when
+ *            copying recursively.
+ * recursive: Whether to copy directories recursively.
+ * resume: Whether to pick up an interrupted copy of a file where it stopped.
+ * journal: Local path of the progress journal of a chunked copy, if any.
+ * verify: Whether to check the copy against the checksum of the data sent.
  * mode: The detected transfer mode (deduced from the supplied source and dest).
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
         struct gluster_url *gluster_dest;
@@ -75,15 +91,34 @@ struct state {
         char *dest;
         char *source;
         bool debug;
+        size_t buffer_size;
+        size_t chunk_size;
+        unsigned int jobs;
+        unsigned int meta_jobs;
+        bool recursive;
+        bool resume;
+        char *journal;
+        bool verify;
         enum transfer_mode mode;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 static struct option const long_options[] =
 {
+        {"buffer-size", required_argument, NULL, 'B'},
+        {"chunk-size", required_argument, NULL, 'c'},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"journal", required_argument, NULL, 'J'},
+        {"meta-jobs", required_argument, NULL, 'm'},
         {"port", required_argument, NULL, 'p'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"recursive", no_argument, NULL, 'r'},
+        {"resume", no_argument, NULL, 'R'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"verify", no_argument, NULL, 'V'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -119,6 +154,22 @@ usage ()
 {
         printf ("Usage: %s [OPTION]... SOURCE DEST\n"
                 "Copy SOURCE to DEST; one of local to remote, remote to local, or remote to remote.\n\n"
+                "      --buffer-size=SIZE       transfer data in blocks of SIZE bytes; with\n"
+                "                               auto, size them from the shard, stripe or\n"
+                "                               cache block size of the volume and from\n"
+                "                               the source file\n"
+                "      --chunk-size=SIZE        with -j, split the file into ranges of SIZE\n"
+                "                               bytes (default 4M); K, M and G suffixes\n"
+                "                               are accepted\n"
+                "  -j, --jobs=N                 copy up to N ranges of the file concurrently;\n"
+                "                               with -r, copy up to N files concurrently\n"
+                "                               (default 8)\n"
+                "      --journal=FILE           copy the file in chunks, recording those\n"
+                "                               completed in the local FILE so that --resume\n"
+                "                               can skip them; FILE is removed once the copy\n"
+                "                               is complete\n"
+                "      --meta-jobs=N            with -r, read and create up to N directories\n"
+                "                               concurrently (default 4)\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
@@ -126,6 +177,23 @@ usage ()
                 "                               destination being Gluster URLs, the options\n"
                 "                               will be applied to both connections.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
+                "      --queue-depth=N          keep up to N requests in flight when\n"
+                "                               streaming a file (default 4)\n"
+                "  -r, --recursive              copy directories recursively\n"
+                "      --resume                 continue an interrupted copy of a file after\n"
+                "                               the data already at the destination, once\n"
+                "                               its tail has been checked against the source;\n"
+                "                               give the same --journal as the interrupted\n"
+                "                               copy, which is required with -j\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
+                "      --verify                 checksum the data as it is copied, then read\n"
+                "                               the copy back in parallel and check it has\n"
+                "                               the same checksum; a whole file copied is\n"
+                "                               also checked against the checksum recorded\n"
+                "                               on the source by an earlier verified copy,\n"
+                "                               and its own is recorded on the copy\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
@@ -139,6 +207,13 @@ usage ()
                 "       Copies the file 'remote_file' on the remote Gluster gluster\n"
                 "       volume of groot on the host localhost to a second remote Gluster\n"
                 "       volume of groot on the host remote_host to the file 'file'.\n"
+                "  gfcp -j 8 --chunk-size=16M glfs://localhost/groot/image ./image\n"
+                "       Copies the file 'image' to the local file 'image', transferring\n"
+                "       16 MiB ranges of the file over 8 concurrent streams.\n"
+                "  gfcp -r -j 32 ./data glfs://localhost/groot/\n"
+                "       Copies the local directory 'data' and everything underneath it\n"
+                "       to the directory '/data' on the remote Gluster volume, copying\n"
+                "       up to 32 files at a time.\n"
                 "  gfcli (localhost/groot)> cp /example file://example\n"
                 "       Copy the file example relative to the root of the connected\n"
                 "       Gluster volume to a local file called example.\n"
@@ -155,15 +230,18 @@ static int
 parse_options (int argc, char *argv[], bool has_connection)
 {
         uint16_t port = GLUSTER_DEFAULT_PORT;
+        unsigned int depth;
         int ret = -1;
         int opt = 0;
         int option_index = 0;
         struct xlator_option *option;
 
+        lock_getopt ();
+
         // Reset getopt as other utilities may have called it already.
         optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "o:p:", long_options,
+                opt = getopt_long (argc, argv, "j:o:p:r", long_options,
                                 &option_index);
 
                 if (opt == -1) {
@@ -171,8 +249,45 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
 
                 switch (opt) {
+                        case 'B':
+                                state->buffer_size = strtobuffersize (optarg);
+                                if (state->buffer_size == 0) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'c':
+                                state->chunk_size = strtosize (optarg);
+                                if (state->chunk_size == 0) {
+                                        goto err;
+                                }
+
+                                break;
                         case 'd':
                                 state->debug = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'J':
+                                free (state->journal);
+                                state->journal = strdup (optarg);
+                                if (state->journal == NULL) {
+                                        error (0, errno, "strdup");
+                                        goto out;
+                                }
+
+                                break;
+                        case 'm':
+                                state->meta_jobs = strtojobs (optarg);
+                                if (state->meta_jobs == 0) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'o':
                                 option = parse_xlator_option (optarg);
@@ -193,6 +308,30 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto out;
                                 }
 
+                                break;
+                        case 'q':
+                                depth = strtoqueuedepth (optarg);
+                                if (depth == 0) {
+                                        goto err;
+                                }
+
+                                gluster_set_queue_depth (depth);
+                                break;
+                        case 'r':
+                                state->recursive = true;
+                                break;
+                        case 'R':
+                                state->resume = true;
+                                break;
+                        case 'V':
+                                state->verify = true;
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -213,7 +352,19 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 3) {
+        if (state->recursive && (state->resume || state->journal)) {
+                error (0, 0, "--resume and --journal cannot be used with -r");
+                goto err;
+        }
+
+        // Without a journal, how far a parallel copy got cannot be told from
+        // the destination, as its chunks land in any order.
+        if (state->resume && state->jobs > 1 && state->journal == NULL) {
+                error (0, 0, "--resume with -j requires --journal");
+                goto err;
+        }
+
+        if ((argc - optind) < 2) {
                 error (0, 0, "missing operand");
                 goto err;
         } else {
@@ -444,6 +595,8 @@ parse_options (int argc, char *argv[], bool has_connection)
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -459,13 +612,27 @@ init_state ()
                 goto out;
         }
 
+        state->buffer_size = 0;
+        state->chunk_size = 0;
         state->debug = false;
         state->dest = NULL;
         state->gluster_dest = NULL;
         state->gluster_source = NULL;
+        state->jobs = 0;
+        state->meta_jobs = 0;
+        state->journal = NULL;
+        state->recursive = false;
+        state->resume = false;
         state->source = NULL;
+        state->verify = false;
+        state->stats = STATS_OFF;
         state->xlator_options = NULL;
 
+        // The queue depth and buffer size may have been changed by an
+        // earlier command.
+        gluster_set_queue_depth (DEFAULT_QUEUE_DEPTH);
+        gluster_set_buffer_size (0);
+
 out:
         return state;
 }
@@ -522,6 +689,261 @@ out:
         return full_path;
 }
 
+/**
+ * Sets the buffer size for copying from source, which lives on fs if it is
+ * remote.
+ */
+static void
+apply_buffer_size (glfs_t *fs, struct copy_endpoint *source)
+{
+        struct stat statbuf;
+        bool have_stat = false;
+
+        if (state->buffer_size == BUFFER_SIZE_AUTO) {
+                have_stat = endpoint_fstat (source, &statbuf) == 0;
+        }
+
+        gluster_apply_buffer_size (state->buffer_size, fs, have_stat ? &statbuf : NULL);
+}
+
+/**
+ * Works out where a --resume of an interrupted sequential copy of source into
+ * dest picks up, and positions both of them there. A copy with a journal
+ * leaves that to the journal, and one from a source that is not a regular
+ * file starts over. Returns the offset, or -1 with errno set.
+ */
+static off_t
+resume_offset (struct copy_endpoint *source, struct copy_endpoint *dest)
+{
+        struct stat statbuf;
+        off_t offset;
+
+        if (!state->resume || state->journal) {
+                return 0;
+        }
+
+        if (endpoint_fstat (source, &statbuf) == -1 || !S_ISREG (statbuf.st_mode)) {
+                return 0;
+        }
+
+        offset = gluster_resume_offset (source, dest, statbuf.st_size);
+        if (offset == -1
+                        || endpoint_ftruncate (dest, offset) == -1
+                        || endpoint_lseek (source, offset, SEEK_SET) == -1
+                        || endpoint_lseek (dest, offset, SEEK_SET) == -1) {
+                return -1;
+        }
+
+        return offset;
+}
+
+/**
+ * Copies source to dest from offset with the chunked parallel engine if the
+ * source is a regular file, whose size is therefore known up front, and
+ * either the user asked for it or the file has holes, which the engine skips
+ * over. dest is then positioned at the end of the copy, as it is after
+ * streaming, and crc, if not NULL, extended with the data copied. Returns 1
+ * if the caller should stream the data instead.
+ */
+static int
+try_copy_parallel (struct copy_endpoint *source, struct copy_endpoint *dest, off_t offset,
+                   uint32_t *crc)
+{
+        struct copy_journal *journal;
+        struct stat statbuf;
+        int ret;
+
+        if (endpoint_fstat (source, &statbuf) == -1 || !S_ISREG (statbuf.st_mode)) {
+                return 1;
+        }
+
+        if (state->jobs <= 1 && state->chunk_size == 0
+                        && state->journal == NULL && !is_sparse (&statbuf)) {
+                return 1;
+        }
+
+        if (state->journal == NULL) {
+                ret = gluster_copy_parallel (source,
+                                             dest,
+                                             offset,
+                                             statbuf.st_size,
+                                             state->jobs ? state->jobs : 1,
+                                             state->chunk_size,
+                                             NULL,
+                                             crc);
+                goto out;
+        }
+
+        journal = copy_journal_open (state->journal,
+                                     statbuf.st_size,
+                                     state->chunk_size,
+                                     state->resume);
+        if (journal == NULL) {
+                error (0, errno, "failed to open journal %s", state->journal);
+                return -1;
+        }
+
+        ret = gluster_copy_parallel (source,
+                                     dest,
+                                     0,
+                                     statbuf.st_size,
+                                     state->jobs ? state->jobs : 1,
+                                     state->chunk_size,
+                                     journal,
+                                     crc);
+
+        copy_journal_close (journal, ret == 0);
+
+out:
+        if (ret == 0 && endpoint_lseek (dest, statbuf.st_size, SEEK_SET) == -1) {
+                ret = -1;
+        }
+
+        return ret;
+}
+
+/**
+ * Copies a regular file from offset between two fds open on the same volume
+ * without moving the data through the client, if the volume supports it. Returns 1
+ * if the caller should copy the data itself, with both fds positioned after
+ * whatever was copied by the volume. If crc is not NULL and the volume copied
+ * everything, the source is read back for the checksum of what was copied
+ * and dest is positioned at its end.
+ */
+static int
+try_copy_offload (glfs_fd_t *source_fd, glfs_fd_t *dest_fd, off_t offset, uint32_t *crc)
+{
+        struct stat statbuf;
+        off_t copied = offset;
+        uint64_t start = stats_start ();
+        int ret;
+
+        ret = glfs_fstat (source_fd, &statbuf);
+        stats_end (STATS_STAT, start, ret);
+        if (ret == -1 || !S_ISREG (statbuf.st_mode)) {
+                return 1;
+        }
+
+        if (gluster_copy_offload (source_fd, dest_fd, statbuf.st_size, &copied) == 0) {
+                if (crc && gluster_checksum_parallel (&(struct copy_endpoint) { .glfs_fd = source_fd },
+                                                      offset,
+                                                      statbuf.st_size,
+                                                      state->jobs ? state->jobs : DEFAULT_VERIFY_JOBS,
+                                                      state->chunk_size,
+                                                      crc) == -1) {
+                        return -1;
+                }
+
+                return glfs_lseek (dest_fd, statbuf.st_size, SEEK_SET) == -1 ? -1 : 0;
+        }
+
+        if (glfs_lseek (source_fd, copied, SEEK_SET) == -1
+                        || glfs_lseek (dest_fd, copied, SEEK_SET) == -1) {
+                return -1;
+        }
+
+        return 1;
+}
+
+/**
+ * With --verify, checks the copy into dest of the data from offset up to
+ * where dest is now positioned, which had the checksum crc as it was sent.
+ * Prints why it failed, and returns -1 if it did.
+ */
+static int
+check_copy (struct copy_endpoint *source, struct copy_endpoint *dest, off_t offset,
+            uint32_t crc, const char *path)
+{
+        off_t end;
+
+        if (!state->verify) {
+                return 0;
+        }
+
+        end = endpoint_lseek (dest, 0, SEEK_CUR);
+        if (end == -1 || gluster_copy_check (source,
+                                             dest,
+                                             offset,
+                                             end,
+                                             crc,
+                                             state->jobs ? state->jobs : DEFAULT_VERIFY_JOBS,
+                                             state->chunk_size) == -1) {
+                error (0, errno, "failed to verify %s", path);
+                return -1;
+        }
+
+        return 0;
+}
+
+/**
+ * Copies the source directory recursively if that is what it is. Either file
+ * system may be NULL for a local path. Returns 1 if the source is not a
+ * directory and the caller should copy it as a single file.
+ */
+static int
+try_copy_tree (glfs_t *source_fs, const char *source_path, glfs_t *dest_fs, const char *dest_path)
+{
+        struct stat statbuf;
+        char *full_path;
+        char *source_name;
+        int ret;
+
+        if (source_fs) {
+                ret = gluster_stat (source_fs, source_path, &statbuf);
+        } else {
+                ret = stat (source_path, &statbuf);
+        }
+
+        // Let the single file path report any error accessing the source.
+        if (ret == -1 || !S_ISDIR (statbuf.st_mode)) {
+                return 1;
+        }
+
+        if (!state->recursive) {
+                error (0, 0, "-r not specified; omitting directory '%s'", source_path);
+                return -1;
+        }
+
+        if (dest_fs) {
+                ret = gluster_stat (dest_fs, dest_path, &statbuf);
+        } else {
+                ret = stat (dest_path, &statbuf);
+        }
+
+        // Strip trailing slashes so that "dir/" is copied as "dir".
+        source_name = strdup (source_path);
+        if (source_name == NULL) {
+                error (0, errno, "strdup");
+                return -1;
+        }
+
+        for (size_t length = strlen (source_name); length > 1 && source_name[length - 1] == '/'; length--) {
+                source_name[length - 1] = '\0';
+        }
+
+        full_path = complete_path (source_name, dest_path, ret == -1 ? NULL : &statbuf);
+        free (source_name);
+        if (full_path == NULL) {
+                return -1;
+        }
+
+        ret = gluster_copy_tree (source_fs,
+                                 source_path,
+                                 dest_fs,
+                                 full_path,
+                                 &(struct copy_options) {
+                                         .jobs = state->jobs,
+                                         .meta_jobs = state->meta_jobs,
+                                         .chunk_size = state->chunk_size,
+                                         .buffer_size = state->buffer_size,
+                                         .verify = state->verify,
+                                 });
+
+        free (full_path);
+
+        return ret;
+}
+
 /**
  * Perform a LOCAL_TO_REMOTE transfer, given the local source and remote
  * destination, and an active connection to the remote destination.
@@ -534,6 +956,13 @@ local_to_remote (const char *local_path, const char *remote_path, glfs_t *fs)
         glfs_fd_t *remote_fd = NULL;
         struct stat statbuf;
         char *full_path = NULL;
+        off_t offset;
+        uint32_t crc = 0;
+
+        ret = try_copy_tree (NULL, local_path, fs, remote_path);
+        if (ret != 1) {
+                return ret;
+        }
 
         fd = open (local_path, O_RDONLY);
         if (fd == -1) {
@@ -541,7 +970,7 @@ local_to_remote (const char *local_path, const char *remote_path, glfs_t *fs)
                 goto out;
         }
 
-        ret = glfs_lstat (fs, remote_path, &statbuf);
+        ret = gluster_lstat (fs, remote_path, &statbuf);
 
         if (ret == -1) {
                 full_path = complete_path (local_path, remote_path, NULL);
@@ -561,23 +990,51 @@ local_to_remote (const char *local_path, const char *remote_path, glfs_t *fs)
                 goto out;
         }
 
+        gluster_attr_cache_invalidate (fs, full_path);
+
         ret = gluster_lock (remote_fd, F_WRLCK, false);
         if (ret == -1) {
                 error (0, errno, "failed to lock %s", full_path);
                 goto out;
         }
 
-        ret = glfs_ftruncate (remote_fd, 0);
-        if (ret == -1) {
-                error (0, errno, "failed to truncate %s", full_path);
-                goto out;
+        if (!state->resume) {
+                ret = glfs_ftruncate (remote_fd, 0);
+                if (ret == -1) {
+                        error (0, errno, "failed to truncate %s", full_path);
+                        goto out;
+                }
         }
 
-        if (gluster_write (fd, remote_fd) == 0) {
+        apply_buffer_size (fs, &(struct copy_endpoint) { .fd = fd });
+
+        offset = resume_offset (&(struct copy_endpoint) { .fd = fd },
+                                &(struct copy_endpoint) { .glfs_fd = remote_fd });
+        if (offset == -1) {
+                error (0, errno, "failed to resume %s", full_path);
                 ret = -1;
+                goto out;
+        }
+
+        ret = try_copy_parallel (&(struct copy_endpoint) { .fd = fd },
+                                 &(struct copy_endpoint) { .glfs_fd = remote_fd },
+                                 offset,
+                                 state->verify ? &crc : NULL);
+        if (ret == 1) {
+                ret = gluster_write (fd, remote_fd, state->verify ? &crc : NULL);
+        }
+
+        if (ret == -1) {
                 error (0, errno, "failed to transfer %s", local_path);
+                goto out;
         }
 
+        ret = check_copy (&(struct copy_endpoint) { .fd = fd },
+                          &(struct copy_endpoint) { .glfs_fd = remote_fd },
+                          offset,
+                          crc,
+                          full_path);
+
 out:
         free (full_path);
 
@@ -604,6 +1061,13 @@ remote_to_local (const char *remote_path, const char *local_path, glfs_t *fs)
         glfs_fd_t *remote_fd = NULL;
         struct stat statbuf;
         char *full_path;
+        off_t offset;
+        uint32_t crc = 0;
+
+        ret = try_copy_tree (fs, remote_path, NULL, local_path);
+        if (ret != 1) {
+                return ret;
+        }
 
         ret = stat (local_path, &statbuf);
         if (ret == -1) {
@@ -623,7 +1087,10 @@ remote_to_local (const char *remote_path, const char *local_path, glfs_t *fs)
                 goto out;
         }
 
-        local_fd = open (full_path, O_CREAT | O_WRONLY, get_default_file_mode_perm ());
+        // Resuming and verifying read back the data already copied.
+        local_fd = open (full_path,
+                         O_CREAT | (state->resume || state->verify ? O_RDWR : O_WRONLY),
+                         get_default_file_mode_perm ());
         if (local_fd == -1) {
                 error (0, errno, "%s", full_path);
                 goto out;
@@ -635,10 +1102,35 @@ remote_to_local (const char *remote_path, const char *local_path, glfs_t *fs)
                 goto out;
         }
 
-        if ((ret = gluster_read (remote_fd, local_fd)) == -1) {
+        apply_buffer_size (fs, &(struct copy_endpoint) { .glfs_fd = remote_fd });
+
+        offset = resume_offset (&(struct copy_endpoint) { .glfs_fd = remote_fd },
+                                &(struct copy_endpoint) { .fd = local_fd });
+        if (offset == -1) {
+                error (0, errno, "failed to resume %s", full_path);
+                ret = -1;
+                goto out;
+        }
+
+        ret = try_copy_parallel (&(struct copy_endpoint) { .glfs_fd = remote_fd },
+                                 &(struct copy_endpoint) { .fd = local_fd },
+                                 offset,
+                                 state->verify ? &crc : NULL);
+        if (ret == 1) {
+                ret = gluster_read (remote_fd, local_fd, state->verify ? &crc : NULL);
+        }
+
+        if (ret == -1) {
                 error (0, errno, "write error");
+                goto out;
         }
 
+        ret = check_copy (&(struct copy_endpoint) { .glfs_fd = remote_fd },
+                          &(struct copy_endpoint) { .fd = local_fd },
+                          offset,
+                          crc,
+                          full_path);
+
 out:
         free (full_path);
 
@@ -655,7 +1147,8 @@ out:
 
 /**
  * Perform a REMOTE_TO_REMOTE transfer, given both source and destination remote
- * paths and active connections to both the source and destination.
+ * paths and active connections to both the source and destination. When both
+ * share a connection, the copy is offloaded to the volume where possible.
  */
 static int
 remote_to_remote (const char *source_path, const char *dest_path, glfs_t *source_fs, glfs_t *dest_fs)
@@ -666,10 +1159,19 @@ remote_to_remote (const char *source_path, const char *dest_path, glfs_t *source
         glfs_fd_t *source_fd = NULL;
         glfs_fd_t *dest_fd = NULL;
         struct stat statbuf;
-        char buf[BUFFER_SIZE];
+        uint64_t start;
+        size_t buf_size;
+        char *buf = NULL;
         char *full_path;
+        off_t offset;
+        uint32_t crc = 0;
 
-        ret = glfs_lstat (dest_fs, dest_path, &statbuf);
+        ret = try_copy_tree (source_fs, source_path, dest_fs, dest_path);
+        if (ret != 1) {
+                return ret;
+        }
+
+        ret = gluster_lstat (dest_fs, dest_path, &statbuf);
 
         if (ret == -1) {
                 full_path = complete_path (source_path, dest_path, NULL);
@@ -688,27 +1190,80 @@ remote_to_remote (const char *source_path, const char *dest_path, glfs_t *source
                 goto out;
         }
 
-        dest_fd = glfs_creat (dest_fs, full_path, O_CREAT | O_WRONLY, get_default_file_mode_perm ());
+        dest_fd = glfs_creat (dest_fs,
+                              full_path,
+                              O_CREAT | (state->resume || state->verify ? O_RDWR : O_WRONLY),
+                              get_default_file_mode_perm ());
         if (dest_fd == NULL) {
                 error (0, errno, "%s", full_path);
                 goto out;
         }
 
+        gluster_attr_cache_invalidate (dest_fs, full_path);
+
+        apply_buffer_size (source_fs, &(struct copy_endpoint) { .glfs_fd = source_fd });
+
+        offset = resume_offset (&(struct copy_endpoint) { .glfs_fd = source_fd },
+                                &(struct copy_endpoint) { .glfs_fd = dest_fd });
+        if (offset == -1) {
+                error (0, errno, "failed to resume %s", full_path);
+                ret = -1;
+                goto out;
+        }
+
+        // A journal asks for the copy to be made in chunks that are tracked.
+        if (source_fs == dest_fs && state->journal == NULL) {
+                ret = try_copy_offload (source_fd, dest_fd, offset, state->verify ? &crc : NULL);
+                if (ret == -1) {
+                        error (0, errno, "write error");
+                        goto out;
+                } else if (ret == 0) {
+                        goto check;
+                }
+        }
+
+        ret = try_copy_parallel (&(struct copy_endpoint) { .glfs_fd = source_fd },
+                                 &(struct copy_endpoint) { .glfs_fd = dest_fd },
+                                 offset,
+                                 state->verify ? &crc : NULL);
+        if (ret == -1) {
+                error (0, errno, "write error");
+                goto out;
+        } else if (ret == 0) {
+                goto check;
+        }
+
+        buf_size = gluster_get_buffer_size (BUFFER_SIZE);
+        buf = alloc_buffer (buf_size);
+        if (buf == NULL) {
+                error (0, errno, "failed to allocate buffer");
+                ret = -1;
+                goto out;
+        }
+
         while (true) {
-                num_read = glfs_read (source_fd, buf, BUFFER_SIZE, 0);
+                start = stats_start ();
+                num_read = glfs_read (source_fd, buf, buf_size, 0);
+                stats_end (STATS_READ, start, num_read);
                 if (num_read == -1) {
                         ret = -1;
                         goto out;
                 }
 
                 if (num_read == 0) {
-                        goto out;
+                        break;
+                }
+
+                if (state->verify) {
+                        crc = crc32c (crc, buf, num_read);
                 }
 
                 for (num_written = 0; num_written < num_read;) {
+                        start = stats_start ();
                         ret = glfs_write (dest_fd,
                                         &buf[num_written],
                                         num_read - num_written, 0);
+                        stats_end (STATS_WRITE, start, ret);
                         if (ret == -1) {
                                 error (0, errno, "write error");
                                 goto out;
@@ -718,7 +1273,15 @@ remote_to_remote (const char *source_path, const char *dest_path, glfs_t *source
                 }
         }
 
+check:
+        ret = check_copy (&(struct copy_endpoint) { .glfs_fd = source_fd },
+                          &(struct copy_endpoint) { .glfs_fd = dest_fd },
+                          offset,
+                          crc,
+                          full_path);
+
 out:
+        free (buf);
         free (full_path);
 
         if (source_fd) {
@@ -733,7 +1296,7 @@ out:
 }
 
 static int
-cp_without_context ()
+cp_without_context (struct fs_cache *fs_cache)
 {
         glfs_t *dest_fs = NULL;
         glfs_t *source_fs = NULL;
@@ -741,18 +1304,12 @@ cp_without_context ()
 
         switch (state->mode) {
                 case LOCAL_TO_REMOTE:
-                        ret = gluster_getfs (&dest_fs, state->gluster_dest);
+                        ret = gluster_getfs_cached (&dest_fs, fs_cache, state->gluster_dest, &state->xlator_options);
                         if (ret == -1) {
                                 error (0, errno, "%s", state->dest);
                                 goto out;
                         }
 
-                        ret = apply_xlator_options (dest_fs, &state->xlator_options);
-                        if (ret == -1) {
-                                error (0, errno, "failed to apply translator options");
-                                goto out;
-                        }
-
                         ret = local_to_remote (state->source,
                                                 state->gluster_dest->path,
                                                 dest_fs);
@@ -762,18 +1319,12 @@ cp_without_context ()
 
                         break;
                 case REMOTE_TO_LOCAL:
-                        ret = gluster_getfs (&source_fs, state->gluster_source);
+                        ret = gluster_getfs_cached (&source_fs, fs_cache, state->gluster_source, &state->xlator_options);
                         if (ret == -1) {
                                 error (0, errno, "%s", state->source);
                                 goto out;
                         }
 
-                        ret = apply_xlator_options (source_fs, &state->xlator_options);
-                        if (ret == -1) {
-                                error (0, errno, "failed to apply translator options");
-                                goto out;
-                        }
-
                         ret = remote_to_local (state->gluster_source->path,
                                                 state->dest,
                                                 source_fs);
@@ -783,18 +1334,12 @@ cp_without_context ()
 
                         break;
                 case REMOTE_TO_REMOTE:
-                        ret = gluster_getfs (&dest_fs, state->gluster_dest);
+                        ret = gluster_getfs_cached (&dest_fs, fs_cache, state->gluster_dest, &state->xlator_options);
                         if (ret == -1) {
                                 error (0, errno, "%s", state->dest);
                                 goto out;
                         }
 
-                        ret = apply_xlator_options (dest_fs, &state->xlator_options);
-                        if (ret == -1) {
-                                error (0, errno, "failed to apply translator options");
-                                goto out;
-                        }
-
                         /**
                          * If the host and volume of the source and destination
                          * are the same, then simply use the same connection to
@@ -804,17 +1349,11 @@ cp_without_context ()
                                && strcmp (state->gluster_source->volume, state->gluster_dest->volume) == 0) {
                                 source_fs = dest_fs;
                         } else {
-                                ret = gluster_getfs (&source_fs, state->gluster_source);
+                                ret = gluster_getfs_cached (&source_fs, fs_cache, state->gluster_source, &state->xlator_options);
                                 if (ret == -1) {
                                         error (0, errno, "%s", state->source);
                                         goto out;
                                 }
-
-                                ret = apply_xlator_options (source_fs, &state->xlator_options);
-                                if (ret == -1) {
-                                        error (0, errno, "failed to apply translator options");
-                                        goto out;
-                                }
                         }
 
                         ret = remote_to_remote (state->gluster_source->path,
@@ -831,19 +1370,18 @@ cp_without_context ()
         }
 
 out:
-        if (dest_fs) {
-                glfs_fini (dest_fs);
-        }
+        gluster_putfs (fs_cache, dest_fs);
 
-        if (source_fs) {
-                glfs_fini (source_fs);
+        // The source may share the destination's connection.
+        if (source_fs != dest_fs) {
+                gluster_putfs (fs_cache, source_fs);
         }
 
         return ret;
 }
 
 static int
-cp_with_context (glfs_t *fs)
+cp_with_context (glfs_t *fs, struct fs_cache *fs_cache)
 {
         glfs_t *dest_fs = NULL;
         glfs_t *source_fs = NULL;
@@ -860,18 +1398,12 @@ cp_with_context (glfs_t *fs)
                         ret = remote_to_local (state->source, state->dest, fs);
                         break;
                 case ESTABLISHED_TO_REMOTE:
-                        ret = gluster_getfs (&dest_fs, state->gluster_dest);
+                        ret = gluster_getfs_cached (&dest_fs, fs_cache, state->gluster_dest, &state->xlator_options);
                         if (ret == -1) {
                                 error (0, errno, "%s", state->dest);
                                 goto out;
                         }
 
-                        ret = apply_xlator_options (dest_fs, &state->xlator_options);
-                        if (ret == -1) {
-                                error (0, errno, "failed to apply translator options");
-                                goto out;
-                        }
-
                         ret = remote_to_remote (state->source, state->gluster_dest->path, fs, dest_fs);
 
                         break;
@@ -880,18 +1412,12 @@ cp_with_context (glfs_t *fs)
 
                         break;
                 case REMOTE_TO_ESTABLISHED:
-                        ret = gluster_getfs (&source_fs, state->gluster_source);
+                        ret = gluster_getfs_cached (&source_fs, fs_cache, state->gluster_source, &state->xlator_options);
                         if (ret == -1) {
                                 error (0, errno, "%s", state->source);
                                 goto out;
                         }
 
-                        ret = apply_xlator_options (source_fs, &state->xlator_options);
-                        if (ret == -1) {
-                                error (0, errno, "failed to apply translator options");
-                                goto out;
-                        }
-
                         ret = remote_to_remote (state->gluster_source->path,
                                                 state->dest,
                                                 source_fs,
@@ -903,20 +1429,15 @@ cp_with_context (glfs_t *fs)
                 case LOCAL_TO_REMOTE:
                 case REMOTE_TO_LOCAL:
                 case REMOTE_TO_REMOTE:
-                        ret = cp_without_context ();
+                        ret = cp_without_context (fs_cache);
                         break;
                 default:
                         error (0, 0, "unknown error");
         }
 
 out:
-        if (dest_fs) {
-                glfs_fini (dest_fs);
-        }
-
-        if (source_fs) {
-                glfs_fini (source_fs);
-        }
+        gluster_putfs (fs_cache, dest_fs);
+        gluster_putfs (fs_cache, source_fs);
 
         return ret;
 }
@@ -943,7 +1464,13 @@ do_cp (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = cp_with_context (ctx->fs);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = cp_with_context (ctx->fs, ctx->fs_cache);
         } else {
                 ret = parse_options (argc, argv, false);
                 switch (ret) {
@@ -954,10 +1481,18 @@ do_cp (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = cp_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = cp_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
                 if (state->gluster_dest) {
                         gluster_url_free (state->gluster_dest);
@@ -968,6 +1503,7 @@ out:
                 }
 
                 free (state->dest);
+                free (state->journal);
                 free (state->source);
         }
 
@@ -0,0 +1,982 @@
+/**
+ * A utility to summarize the space used by files and directories on a remote
+ * Gluster volume.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-du.h"
+#include "glfs-handle.h"
+#include "glfs-stats.h"
+#include "glfs-util.h"
+#include "glfs-work-queue.h"
+#include "human.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <glusterfs/api/glfs.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define AUTHORS "Written by Craig Cabrey."
+
+#define DEFAULT_DU_JOBS 8
+#define DU_INODE_STRIPES 64
+#define DU_INODE_MIN_BUCKETS 64
+
+/**
+ * A path supplied by the user.
+ *
+ * gluster_url: Struct of the parsed url.
+ * url: Full url used to find the remote file or directory.
+ */
+struct du_path {
+        struct gluster_url *gluster_url;
+        char *url;
+};
+
+/**
+ * Used to store the state of the program, including user supplied options.
+ *
+ * paths: The files or directories to summarize (supplied by user).
+ * num_paths: Number of entries in paths.
+ * jobs: Number of threads reading directories concurrently.
+ * max_depth: Depth below the supplied paths down to which directories are
+ *            printed, or -1 for all of them.
+ * apparent_size: Whether to count the sizes of files rather than the space
+ *                allocated to them.
+ * bytes: Whether to print sizes in bytes rather than in kilobytes.
+ * debug: Whether to log additional debug information.
+ * human_readable: Whether to print sizes in human readable format.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
+ */
+struct state {
+        struct xlator_option *xlator_options;
+        struct du_path *paths;
+        int num_paths;
+        unsigned int jobs;
+        int max_depth;
+        bool apparent_size;
+        bool bytes;
+        bool debug;
+        bool human_readable;
+        enum stats_format stats;
+};
+
+static __thread struct state *state;
+
+static struct option const long_options[] =
+{
+        {"apparent-size", no_argument, NULL, 'A'},
+        {"bytes", no_argument, NULL, 'b'},
+        {"debug", no_argument, NULL, 'D'},
+        {"help", no_argument, NULL, 'x'},
+        {"human-readable", no_argument, NULL, 'h'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"max-depth", required_argument, NULL, 'd'},
+        {"port", required_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"summarize", no_argument, NULL, 's'},
+        {"version", no_argument, NULL, 'v'},
+        {"xlator-option", required_argument, NULL, 'o'},
+        {NULL, no_argument, NULL, 0}
+};
+
+static void
+usage ()
+{
+        printf ("Usage: %s [OPTION]... URL...\n"
+                "Summarize the disk usage of the files and directories on a remote Gluster volume,\n"
+                "recursively for directories.\n\n"
+                "      --apparent-size          print apparent sizes, rather than disk usage\n"
+                "  -b, --bytes                  equivalent to --apparent-size with sizes in\n"
+                "                               bytes\n"
+                "  -d, --max-depth=N            print the total for a directory only if it\n"
+                "                               is N or fewer levels below the command line\n"
+                "                               argument; --max-depth=0 is --summarize\n"
+                "  -h, --human-readable         print sizes in human readable format (e.g.,\n"
+                "                               1K 234M 2G)\n"
+                "  -j, --jobs=N                 read up to N directories concurrently\n"
+                "                               (default %d)\n"
+                "  -o, --xlator-option=OPTION   specify a translator option for the\n"
+                "                               connection. Multiple options are supported\n"
+                "                               and take the form xlator.key=value.\n"
+                "  -p, --port=PORT              specify the port on which to connect\n"
+                "  -s, --summarize              print only a total for each argument\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
+                "      --help     display this help and exit\n"
+                "      --version  output version information and exit\n\n"
+                "Sizes are in kilobytes unless asked otherwise. Files with many hard links\n"
+                "are only counted once. Directories are printed as soon as everything below\n"
+                "them has been counted, so each comes after its sub-directories but the\n"
+                "order in which sibling directories are printed varies.\n\n"
+                "Examples:\n"
+                "  gfdu -sh glfs://localhost/groot/directory\n"
+                "       Print the space used by /directory on the Gluster volume\n"
+                "       groot on host localhost, in human readable format.\n"
+                "  gfdu -d 1 glfs://localhost/groot/\n"
+                "       Print the space used by each directory at the root of the\n"
+                "       Gluster volume groot, and by the whole volume.\n"
+                "  gfcli (localhost/groot)> du /directory\n"
+                "       In the context of a shell with a connection established,\n"
+                "       print the space used by /directory and each directory below\n"
+                "       it on the connected Gluster volume.\n",
+                program_invocation_name,
+                DEFAULT_DU_JOBS);
+}
+
+/**
+ * Converts the argument of --max-depth, which may be 0 unlike most counts.
+ * Returns -1 on failure.
+ */
+static int
+strtodepth (const char *str)
+{
+        long depth;
+        char *end;
+
+        errno = 0;
+        depth = strtol (str, &end, 10);
+        if (str == end || *end != '\0' || errno != 0 || depth < 0 || depth > INT_MAX) {
+                error (0, 0, "invalid maximum depth: \"%s\"", str);
+                return -1;
+        }
+
+        return (int) depth;
+}
+
+static int
+parse_options (int argc, char *argv[], bool has_connection)
+{
+        uint16_t port = GLUSTER_DEFAULT_PORT;
+        int ret = -1;
+        int opt = 0;
+        int option_index = 0;
+        struct du_path *path;
+        struct xlator_option *option;
+
+        lock_getopt ();
+
+        // Reset getopt since other utilities may have called it already.
+        optind = 0;
+        while (true) {
+                opt = getopt_long (argc, argv, "bd:hj:o:p:s", long_options,
+                                   &option_index);
+
+                if (opt == -1) {
+                        break;
+                }
+
+                switch (opt) {
+                        case 'A':
+                                state->apparent_size = true;
+                                break;
+                        case 'b':
+                                state->apparent_size = true;
+                                state->bytes = true;
+                                break;
+                        case 'd':
+                                state->max_depth = strtodepth (optarg);
+                                if (state->max_depth == -1) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'D':
+                                state->debug = true;
+                                break;
+                        case 'h':
+                                state->human_readable = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto out;
+                                }
+
+                                break;
+                        case 'o':
+                                option = parse_xlator_option (optarg);
+                                if (option == NULL) {
+                                        error (0, errno, "%s", optarg);
+                                        goto err;
+                                }
+
+                                if (append_xlator_option (&state->xlator_options, option) == -1) {
+                                        error (0, errno, "append_xlator_option: %s", optarg);
+                                        goto err;
+                                }
+
+                                break;
+                        case 'p':
+                                port = strtoport (optarg);
+                                if (port == 0) {
+                                        goto out;
+                                }
+
+                                break;
+                        case 's':
+                                state->max_depth = 0;
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'v':
+                                printf ("%s (%s) %s\n%s\n%s\n%s\n",
+                                        program_invocation_name,
+                                        PACKAGE_NAME,
+                                        PACKAGE_VERSION,
+                                        COPYRIGHT,
+                                        LICENSE,
+                                        AUTHORS);
+                                ret = -2;
+                                goto out;
+                        case 'x':
+                                usage ();
+                                ret = -2;
+                                goto out;
+                        default:
+                                goto err;
+                }
+        }
+
+        if ((argc - optind) < 1) {
+                error (0, 0, "missing operand");
+                goto err;
+        }
+
+        // state->paths is free'd in do_du()
+        state->paths = calloc (argc - optind, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
+                        error (0, errno, "strdup");
+                        goto out;
+                }
+
+                if (has_connection) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
+                                error (0, errno, "gluster_url_init");
+                                goto out;
+                        }
+
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
+                                error (0, errno, "strdup");
+                                goto out;
+                        }
+
+                        continue;
+                }
+
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
+                        goto err;
+                }
+
+                path->gluster_url->port = port;
+        }
+
+        ret = 0;
+        goto out;
+
+err:
+        error (0, 0, "Try --help for more information.");
+out:
+        unlock_getopt ();
+
+        return ret;
+}
+
+static struct state*
+init_state ()
+{
+        struct state *state = malloc (sizeof (*state));
+
+        if (state == NULL) {
+                goto out;
+        }
+
+        state->apparent_size = false;
+        state->bytes = false;
+        state->debug = false;
+        state->human_readable = false;
+        state->jobs = DEFAULT_DU_JOBS;
+        state->max_depth = -1;
+        state->num_paths = 0;
+        state->paths = NULL;
+        state->stats = STATS_OFF;
+        state->xlator_options = NULL;
+
+out:
+        return state;
+}
+
+/**
+ * A file with more than one link, counted already.
+ */
+struct du_inode {
+        dev_t dev;
+        ino_t ino;
+        struct du_inode *next;
+};
+
+/**
+ * A share of the set of files with many links seen so far, hashed by inode.
+ * The set is split in stripes with a lock each so that the threads reading
+ * directories seldom wait on one another.
+ */
+struct du_inode_stripe {
+        pthread_mutex_t lock;
+        struct du_inode **buckets;
+        size_t num_buckets;
+        size_t count;
+};
+
+/**
+ * A directory being counted. It is printed, and its size added to that of its
+ * parent, once pending drops to zero.
+ *
+ * parent: Directory containing this one, or NULL for a user supplied path.
+ * handle: Handle of the directory once it is looked up, through which it is
+ *         read.
+ * name: Name of the directory as printed.
+ * depth: Number of levels below the user supplied path.
+ * pending: One for the read of this directory, plus one for each of its
+ *          sub-directories not yet counted.
+ * size: Space used by the directory and everything counted below it so far.
+ * incomplete: Whether a directory below it could not be queued to be read,
+ *             so that no total would be right.
+ */
+struct du_dir {
+        struct du_dir *parent;
+        struct gluster_handle *handle;
+        char *name;
+        int depth;
+        size_t pending;
+        uintmax_t size;
+        bool incomplete;
+};
+
+/**
+ * State shared by the threads of a count, including the options they need,
+ * since the state of the program is only visible to the thread running it.
+ * With several paths, hash_all has every file and directory remembered, as
+ * du does, so that one found under an earlier path is not counted again.
+ */
+struct du_tree {
+        glfs_t *fs;
+        int max_depth;
+        bool apparent_size;
+        bool bytes;
+        bool human_readable;
+        bool hash_all;
+        struct work_queue queue;
+        pthread_mutex_t lock;
+        struct du_inode_stripe inodes[DU_INODE_STRIPES];
+        struct stats *stats;
+        bool failed;
+};
+
+static void
+du_report (struct du_tree *tree, int errnum, const char *fmt, const char *name)
+{
+        pthread_mutex_lock (&tree->lock);
+        error (0, errnum, fmt, name);
+        tree->failed = true;
+        pthread_mutex_unlock (&tree->lock);
+}
+
+static size_t
+du_inode_hash (dev_t dev, ino_t ino)
+{
+        uint64_t hash = ((uint64_t) ino ^ ((uint64_t) dev << 32)) * 0x9e3779b97f4a7c15ULL;
+
+        return hash ^ (hash >> 29);
+}
+
+/**
+ * Doubles the number of buckets of stripe once it holds as many entries. If
+ * memory runs out the stripe stays as it is, only slower.
+ */
+static void
+du_inode_grow (struct du_inode_stripe *stripe)
+{
+        struct du_inode **old_buckets = stripe->buckets;
+        size_t old_num_buckets = stripe->num_buckets;
+        size_t num_buckets = old_num_buckets ? old_num_buckets * 2 : DU_INODE_MIN_BUCKETS;
+        struct du_inode *inode;
+        struct du_inode *next;
+        size_t bucket;
+
+        stripe->buckets = calloc (num_buckets, sizeof (*stripe->buckets));
+        if (stripe->buckets == NULL) {
+                stripe->buckets = old_buckets;
+                return;
+        }
+
+        stripe->num_buckets = num_buckets;
+
+        for (size_t i = 0; i < old_num_buckets; i++) {
+                for (inode = old_buckets[i]; inode; inode = next) {
+                        next = inode->next;
+                        bucket = (du_inode_hash (inode->dev, inode->ino) / DU_INODE_STRIPES)
+                                & (num_buckets - 1);
+                        inode->next = stripe->buckets[bucket];
+                        stripe->buckets[bucket] = inode;
+                }
+        }
+
+        free (old_buckets);
+}
+
+/**
+ * Returns whether the file with statbuf should be counted, that is unless it
+ * was already seen; only files with more than one link are remembered unless
+ * tree->hash_all is set. Should memory run out, the file is counted, which is
+ * the worst that can happen.
+ */
+static bool
+du_first_link (struct du_tree *tree, const struct stat *statbuf)
+{
+        size_t hash = du_inode_hash (statbuf->st_dev, statbuf->st_ino);
+        struct du_inode_stripe *stripe = &tree->inodes[hash % DU_INODE_STRIPES];
+        struct du_inode *inode;
+        bool first = true;
+        size_t bucket;
+
+        if (!tree->hash_all && (S_ISDIR (statbuf->st_mode) || statbuf->st_nlink <= 1)) {
+                return true;
+        }
+
+        pthread_mutex_lock (&stripe->lock);
+
+        if (stripe->count >= stripe->num_buckets) {
+                du_inode_grow (stripe);
+        }
+
+        if (stripe->buckets == NULL) {
+                goto out;
+        }
+
+        bucket = (hash / DU_INODE_STRIPES) & (stripe->num_buckets - 1);
+        for (inode = stripe->buckets[bucket]; inode; inode = inode->next) {
+                if (inode->dev == statbuf->st_dev && inode->ino == statbuf->st_ino) {
+                        first = false;
+                        goto out;
+                }
+        }
+
+        inode = malloc (sizeof (*inode));
+        if (inode == NULL) {
+                goto out;
+        }
+
+        inode->dev = statbuf->st_dev;
+        inode->ino = statbuf->st_ino;
+        inode->next = stripe->buckets[bucket];
+        stripe->buckets[bucket] = inode;
+        stripe->count++;
+
+out:
+        pthread_mutex_unlock (&stripe->lock);
+
+        return first;
+}
+
+static uintmax_t
+du_size (const struct du_tree *tree, const struct stat *statbuf)
+{
+        if (tree->apparent_size) {
+                return statbuf->st_size > 0 ? (uintmax_t) statbuf->st_size : 0;
+        }
+
+        return (uintmax_t) statbuf->st_blocks * 512;
+}
+
+/**
+ * Prints size as du does, followed by name. Called with the tree locked.
+ */
+static void
+du_print (const struct du_tree *tree, uintmax_t size, const char *name)
+{
+        char buf[LONGEST_HUMAN_READABLE + 1];
+
+        if (tree->human_readable) {
+                printf ("%s\t%s\n",
+                        human_readable (size, buf,
+                                        human_autoscale | human_ceiling | human_SI | human_base_1024,
+                                        1, 1),
+                        name);
+        } else if (tree->bytes) {
+                printf ("%ju\t%s\n", size, name);
+        } else {
+                printf ("%ju\t%s\n", (size + 1023) / 1024, name);
+        }
+}
+
+static struct du_dir *
+du_dir_new (struct du_dir *parent, const char *name, uintmax_t size)
+{
+        struct du_dir *dir = malloc (sizeof (*dir));
+
+        if (dir == NULL) {
+                return NULL;
+        }
+
+        dir->name = parent ? append_path (parent->name, name) : strdup (name);
+        if (dir->name == NULL) {
+                free (dir);
+                return NULL;
+        }
+
+        dir->parent = parent;
+        dir->handle = NULL;
+        dir->depth = parent ? parent->depth + 1 : 0;
+        dir->pending = 1;
+        dir->size = size;
+        dir->incomplete = false;
+
+        return dir;
+}
+
+static void
+du_dir_free (struct du_dir *dir)
+{
+        gluster_handle_unref (dir->handle);
+        free (dir->name);
+        free (dir);
+}
+
+/**
+ * Drops a reference to a directory, adding size to it. The last reference
+ * prints the directory and passes its total on to its parent, so that each
+ * directory is printed as soon as everything below it has been counted. An
+ * incomplete directory is not printed, and neither are those above it.
+ */
+static void
+du_release (struct du_tree *tree, struct du_dir *dir, uintmax_t size)
+{
+        struct du_dir *parent;
+        bool incomplete = false;
+
+        while (dir != NULL) {
+                pthread_mutex_lock (&tree->lock);
+
+                dir->size += size;
+                dir->incomplete |= incomplete;
+                if (--dir->pending > 0) {
+                        pthread_mutex_unlock (&tree->lock);
+                        return;
+                }
+
+                incomplete = dir->incomplete;
+                if (!incomplete && (tree->max_depth == -1 || dir->depth <= tree->max_depth)) {
+                        du_print (tree, dir->size, dir->name);
+                }
+
+                pthread_mutex_unlock (&tree->lock);
+
+                size = dir->size;
+                parent = dir->parent;
+                du_dir_free (dir);
+                dir = parent;
+        }
+}
+
+/**
+ * Queues the directory name inside parent, whose own entry takes size, to be
+ * read. The parent is held until the directory has been counted.
+ */
+static void
+du_start_dir (struct du_tree *tree, struct du_dir *parent, const char *name,
+              struct gluster_handle *handle, uintmax_t size)
+{
+        struct du_dir *dir = du_dir_new (parent, name, size);
+
+        if (dir == NULL) {
+                du_report (tree, errno, "cannot read directory `%s'", name);
+
+                if (parent != NULL) {
+                        pthread_mutex_lock (&tree->lock);
+                        parent->incomplete = true;
+                        pthread_mutex_unlock (&tree->lock);
+                }
+
+                return;
+        }
+
+        dir->handle = gluster_handle_ref (handle);
+
+        if (parent != NULL) {
+                pthread_mutex_lock (&tree->lock);
+                parent->pending++;
+                pthread_mutex_unlock (&tree->lock);
+        }
+
+        if (work_queue_push (&tree->queue, dir) == -1) {
+                du_report (tree, errno, "cannot read directory `%s'", dir->name);
+                dir->incomplete = true;
+                du_release (tree, dir, 0);
+        }
+}
+
+/**
+ * Reads a directory, counting its files from the attributes the listing
+ * returns and queueing its sub-directories to be read in turn.
+ */
+static void
+du_scan (struct du_tree *tree, struct du_dir *dir)
+{
+        struct gluster_handle *child;
+        struct dirent *entry;
+        struct stat statbuf;
+        uintmax_t size = 0;
+        uint64_t start;
+        glfs_fd_t *fd;
+
+        // Sub-directories are looked up when read rather than when found,
+        // relative to their parent so that the lookup costs the same at any
+        // depth.
+        if (dir->handle == NULL) {
+                dir->handle = gluster_handle_lookup (tree->fs, dir->parent->handle,
+                                                     strrchr (dir->name, '/') + 1,
+                                                     NULL, false);
+        }
+
+        fd = dir->handle ? gluster_handle_opendir (tree->fs, dir->handle) : NULL;
+        if (fd == NULL) {
+                du_report (tree, errno, "cannot read directory `%s'", dir->name);
+                goto out;
+        }
+
+        while (true) {
+                errno = 0;
+                memset (&statbuf, 0, sizeof (statbuf));
+                start = stats_start ();
+                entry = glfs_readdirplus (fd, &statbuf);
+                stats_end (STATS_READDIR, start, entry == NULL && errno ? -1 : 0);
+                if (entry == NULL) {
+                        break;
+                }
+
+                if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0) {
+                        continue;
+                }
+
+                // Entries the listing returns no attributes for are looked
+                // up on their own.
+                if (statbuf.st_mode == 0) {
+                        child = gluster_handle_lookup (tree->fs, dir->handle, entry->d_name,
+                                                       &statbuf, false);
+                        if (child == NULL) {
+                                if (errno != ENOENT) {
+                                        du_report (tree, errno, "cannot access `%s'", entry->d_name);
+                                }
+
+                                continue;
+                        }
+
+                        gluster_handle_unref (child);
+                }
+
+                if (!du_first_link (tree, &statbuf)) {
+                        continue;
+                }
+
+                if (S_ISDIR (statbuf.st_mode)) {
+                        du_start_dir (tree, dir, entry->d_name, NULL, du_size (tree, &statbuf));
+                } else {
+                        size += du_size (tree, &statbuf);
+                }
+        }
+
+        if (errno != 0) {
+                du_report (tree, errno, "cannot read directory `%s'", dir->name);
+        }
+
+        glfs_closedir (fd);
+
+out:
+        du_release (tree, dir, size);
+}
+
+static void *
+du_worker (void *data)
+{
+        struct du_tree *tree = data;
+        struct du_dir *dir;
+
+        stats_attach (tree->stats);
+
+        while ((dir = work_queue_pop (&tree->queue)) != NULL) {
+                du_scan (tree, dir);
+                work_queue_done (&tree->queue);
+        }
+
+        return NULL;
+}
+
+/**
+ * Counts the space used by the directory at path, whose own entry takes size,
+ * reading it and those below it with up to state->jobs threads, the calling
+ * one included. Returns once the whole tree has been counted and printed.
+ */
+static void
+du_walk (struct du_tree *tree, const char *path, struct gluster_handle *handle,
+         uintmax_t size)
+{
+        unsigned int num_workers = 0;
+        pthread_t *workers = NULL;
+
+        // The queue closes itself once the tree is done, so each gets its own.
+        if (work_queue_init (&tree->queue, 0) == -1) {
+                du_report (tree, errno, "cannot read directory `%s'", path);
+                return;
+        }
+
+        du_start_dir (tree, NULL, path, handle, size);
+
+        if (work_queue_length (&tree->queue) == 0) {
+                goto out;
+        }
+
+        if (state->jobs > 1) {
+                workers = malloc (sizeof (*workers) * (state->jobs - 1));
+        }
+
+        for (; workers && num_workers < state->jobs - 1; num_workers++) {
+                if (pthread_create (&workers[num_workers], NULL, du_worker, tree) != 0) {
+                        break;
+                }
+        }
+
+        du_worker (tree);
+
+        for (unsigned int i = 0; i < num_workers; i++) {
+                pthread_join (workers[i], NULL);
+        }
+
+out:
+        free (workers);
+        work_queue_destroy (&tree->queue);
+}
+
+/**
+ * Counts the space used by each of paths on fs, printing the totals of the
+ * directories below them down to the maximum depth. The paths are counted
+ * and printed one after the other in the order given, as du does, and a file
+ * linked from several of them is only counted for the first.
+ */
+static int
+du (glfs_t *fs, struct du_path *paths, int count)
+{
+        struct du_tree tree = {
+                .fs = fs,
+                .max_depth = state->max_depth,
+                .apparent_size = state->apparent_size,
+                .bytes = state->bytes,
+                .human_readable = state->human_readable,
+                .hash_all = count > 1,
+                .stats = stats_current (),
+                .failed = false,
+        };
+        struct gluster_handle *handle;
+        struct stat statbuf;
+        size_t length;
+
+        pthread_mutex_init (&tree.lock, NULL);
+        for (int i = 0; i < DU_INODE_STRIPES; i++) {
+                pthread_mutex_init (&tree.inodes[i].lock, NULL);
+                tree.inodes[i].buckets = NULL;
+                tree.inodes[i].num_buckets = 0;
+                tree.inodes[i].count = 0;
+        }
+
+        for (int i = 0; i < count; i++) {
+                handle = gluster_handle_lookup (fs, NULL, paths[i].gluster_url->path,
+                                                &statbuf, false);
+                if (handle == NULL) {
+                        du_report (&tree, errno, "cannot access `%s'", paths[i].url);
+                        continue;
+                }
+
+                if (!du_first_link (&tree, &statbuf)) {
+                        // Already counted under an earlier path.
+                } else if (S_ISDIR (statbuf.st_mode)) {
+                        // Print "dir/" as "dir", but "/" as it is.
+                        length = strlen (paths[i].url);
+                        while (length > 1 && paths[i].url[length - 1] == '/') {
+                                paths[i].url[--length] = '\0';
+                        }
+
+                        du_walk (&tree, paths[i].url, handle, du_size (&tree, &statbuf));
+                } else {
+                        pthread_mutex_lock (&tree.lock);
+                        du_print (&tree, du_size (&tree, &statbuf), paths[i].url);
+                        pthread_mutex_unlock (&tree.lock);
+                }
+
+                gluster_handle_unref (handle);
+        }
+
+        for (int i = 0; i < DU_INODE_STRIPES; i++) {
+                for (size_t j = 0; j < tree.inodes[i].num_buckets; j++) {
+                        for (struct du_inode *inode = tree.inodes[i].buckets[j], *next; inode; inode = next) {
+                                next = inode->next;
+                                free (inode);
+                        }
+                }
+
+                free (tree.inodes[i].buckets);
+                pthread_mutex_destroy (&tree.inodes[i].lock);
+        }
+
+        pthread_mutex_destroy (&tree.lock);
+
+        return tree.failed ? -1 : 0;
+}
+
+static int
+du_without_context (struct fs_cache *fs_cache)
+{
+        struct du_path *paths = state->paths;
+        glfs_t *fs;
+        int next;
+        int ret = 0;
+
+        for (int i = 0; i < state->num_paths; i = next) {
+                next = i + 1;
+
+                fs = NULL;
+                if (gluster_getfs_cached (&fs, fs_cache, paths[i].gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "failed to connect to `%s'", paths[i].url);
+                        ret = -1;
+                        continue;
+                }
+
+                if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
+                        error (0, errno, "failed to set logging level");
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
+                }
+
+                // Later paths on the same volume are counted together.
+                while (next < state->num_paths && gluster_same_volume (paths[i].gluster_url, paths[next].gluster_url)) {
+                        next++;
+                }
+
+                if (du (fs, &paths[i], next - i) == -1) {
+                        ret = -1;
+                }
+
+                gluster_putfs (fs_cache, fs);
+        }
+
+        return ret;
+}
+
+int
+do_du (struct cli_context *ctx)
+{
+        int argc = ctx->argc;
+        char **argv = ctx->argv;
+        int ret = -1;
+
+        state = init_state ();
+        if (state == NULL) {
+                error (0, errno, "failed to initialize state");
+                ret = -1;
+                goto out;
+        }
+
+        state->debug = ctx->options->debug;
+
+        if (ctx->fs) {
+                ret = parse_options (argc, argv, true);
+                if (ret != 0) {
+                        goto out;
+                }
+
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = du (ctx->fs, state->paths, state->num_paths);
+        } else {
+                ret = parse_options (argc, argv, false);
+                switch (ret) {
+                        case -2:
+                                // Fall through
+                                ret = 0;
+                        case -1:
+                                goto out;
+                }
+
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = du_without_context (ctx->fs_cache);
+        }
+
+out:
+        stats_finish ();
+
+        if (state) {
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
+                free_xlator_options (&state->xlator_options);
+        }
+
+        free (state);
+
+        return ret;
+}
@@ -35,22 +35,26 @@
 
 #define AUTHORS "Written by Anoop C S."
 
+#define FD_TABLE_MIN_BUCKETS 64
+
 /**
  * Used to store the state of the program, including user supplied options.
  *
- * path         : Path used to find the remote file or directory (supplied by user).
+ * paths        : Paths of the remote files or directories (supplied by user).
+ * num_paths    : Number of paths.
  * block        : Whether to block the lock request in case of a conflicting lock.
  * debug        : Whether to log additional debug information.
  * l_type       : Stores the requested lock type.
  */
 struct state {
-        char *path;
+        char **paths;
+        int num_paths;
         bool block;
         bool debug;
         short l_type;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
@@ -66,7 +70,7 @@ static struct option const long_options[] =
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n"
+        printf ("Usage: %s [OPTION]... URL...\n"
                 "Request a full file advisory lock on files from a remote Gluster volume.\n\n"
                 "  -e, --exclusive              Obtain an exclusive lock. This is the default.\n"
                 "  -h, --help                   Display this help and exit.\n"
@@ -74,10 +78,14 @@ usage ()
                 "  -s, --shared                 Obtain a shared lock.\n"
                 "  -u, --unlock                 Drop  a  lock.\n"
                 "  -v, --version                Output version information and exit\n\n"
+                "Locks on many files are taken in the order of their paths, whatever order\n"
+                "they are given in, so that shells locking the same files do not deadlock.\n\n"
                 "Examples:\n"
                 "  gfcli (localhost/groot)> flock /file\n"
                 "       In the context of a shell with a connection established, request full file\n"
-                "       lock on a file present under root of the Gluster volume groot on localhost.\n",
+                "       lock on a file present under root of the Gluster volume groot on localhost.\n"
+                "  gfcli (localhost/groot)> flock -u /file /other\n"
+                "       Drop the locks held on both files.\n",
                 program_invocation_name);
 }
 
@@ -133,15 +141,26 @@ parse_options (int argc, char *argv[])
                 usage ();
                 ret = -2;
                 goto out;
-        } else {
-                state->path = strdup (argv[argc - 1]);
-                if (state->path == NULL) {
-                        error (0, errno, "strdup");
+        }
+
+        state->num_paths = argc - optind;
+        state->paths = calloc (state->num_paths, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (int i = 0; i < state->num_paths; i++) {
+                // Keyed the same however they are spelled, e.g. "a//b/".
+                state->paths[i] = canonical_path (argv[optind + i]);
+                if (state->paths[i] == NULL) {
+                        error (0, errno, "%s", argv[optind + i]);
                         goto out;
                 }
-                ret = 0;
         }
 
+        ret = 0;
+
         goto out;
 
 err:
@@ -160,7 +179,8 @@ init_state ()
         }
 
         state->debug = false;
-        state->path = NULL;
+        state->paths = NULL;
+        state->num_paths = 0;
         state->block = true;
         state->l_type = F_WRLCK;
 
@@ -168,97 +188,241 @@ out:
         return state;
 }
 
-static char *
-format_file_path (char *str)
+static size_t
+fd_table_bucket (const struct fd_table *table, const char *path)
 {
-        char *last_char;
+        uint64_t hash = 14695981039346656037ULL;
 
-        while (*str == '/')
-                str++;
+        for (; *path; path++) {
+                hash = (hash ^ (unsigned char) *path) * 1099511628211ULL;
+        }
 
-        if (*str == '\0')
-                return str;
+        return hash & (table->num_buckets - 1);
+}
 
-        last_char = str + strlen (str) - 1;
+static struct fd_table *
+fd_table_new ()
+{
+        struct fd_table *table = malloc (sizeof (*table));
 
-        while (last_char > str && *last_char == '/')
-                last_char--;
+        if (table == NULL) {
+                return NULL;
+        }
 
-        *(last_char + 1) = '\0';
+        table->num_buckets = FD_TABLE_MIN_BUCKETS;
+        table->count = 0;
+        table->buckets = calloc (table->num_buckets, sizeof (*table->buckets));
+        if (table->buckets == NULL) {
+                free (table);
+                return NULL;
+        }
 
-        return str;
+        return table;
 }
 
-static glfs_fd_t *
-query_fd_from_path (struct cli_context *ctx, const char *path)
+/**
+ * Returns the link to the entry of path in table, which points to NULL if
+ * there is none.
+ */
+static struct fd_entry **
+fd_table_find (struct fd_table *table, const char *path)
 {
-        struct fd_list *ptr = NULL;
+        struct fd_entry **link = &table->buckets[fd_table_bucket (table, path)];
+
+        while (*link && strcmp ((*link)->path, path) != 0) {
+                link = &(*link)->next;
+        }
+
+        return link;
+}
 
-        ptr = ctx->flist;
-        while (ptr) {
-                if (strcmp(ptr->path, path) == 0)
-                        return ptr->fd;
+/**
+ * Doubles the number of buckets of table once it holds as many entries. If
+ * memory runs out the table stays as it is, only slower.
+ */
+static void
+fd_table_grow (struct fd_table *table)
+{
+        struct fd_entry **old_buckets = table->buckets;
+        size_t old_num_buckets = table->num_buckets;
+        struct fd_entry *entry;
+        struct fd_entry *next;
+        size_t bucket;
+
+        if (table->count < table->num_buckets) {
+                return;
+        }
 
-                ptr = ptr->next;
+        table->buckets = calloc (old_num_buckets * 2, sizeof (*table->buckets));
+        if (table->buckets == NULL) {
+                table->buckets = old_buckets;
+                return;
         }
 
-        return NULL;
+        table->num_buckets = old_num_buckets * 2;
+
+        for (size_t i = 0; i < old_num_buckets; i++) {
+                for (entry = old_buckets[i]; entry; entry = next) {
+                        next = entry->next;
+                        bucket = fd_table_bucket (table, entry->path);
+                        entry->next = table->buckets[bucket];
+                        table->buckets[bucket] = entry;
+                }
+        }
+
+        free (old_buckets);
 }
 
-static int
-flock_with_fs (struct cli_context **ctx)
+/**
+ * Adds fd as that of path to table, at link as returned by fd_table_find ().
+ * Returns the new entry, or NULL if memory runs out.
+ */
+static struct fd_entry *
+fd_table_add (struct fd_table *table, struct fd_entry **link, const char *path,
+              glfs_fd_t *fd)
 {
-        int ret = -1;
-        char *tmp_path = NULL;
-        glfs_fd_t *fd = NULL;
-        struct fd_list *new, *ptr, *cur = NULL;
+        struct fd_entry *entry = malloc (sizeof (*entry));
 
-        if (state->debug)
-                glfs_set_logging ((*ctx)->fs, "/dev/stderr", GF_LOG_DEBUG);
-
-        /* Format the file path in such a way that leading and trailing forward
-         * slashes are removed for a generic comaprison. */
-        tmp_path = strdup (format_file_path (state->path));
-
-        /* Check whether we already have an open fd corresponding to the file
-         * on which lock request is issued.*/
-        fd = query_fd_from_path (*ctx, tmp_path);
-        if (!fd) {
-                /* No previous open fd. Create new one and store it to fd_list
-                 * for future reference.*/
-                new = (struct fd_list *)malloc (sizeof(struct fd_list));
-                new->path = NULL;
-
-                new->fd = fd = glfs_open ((*ctx)->fs, state->path, O_RDWR);
-                if (!fd) {
-                        error (0, errno, "failed to open %s", state->path);
-                        ret = -1;
-                        goto out;
+        if (entry == NULL) {
+                return NULL;
+        }
+
+        entry->path = strdup (path);
+        if (entry->path == NULL) {
+                free (entry);
+                return NULL;
+        }
+
+        entry->fd = fd;
+        entry->next = NULL;
+        *link = entry;
+        table->count++;
+
+        fd_table_grow (table);
+
+        return entry;
+}
+
+/**
+ * Removes the entry at link from table, closing its file, which drops any
+ * lock held on it.
+ */
+static void
+fd_table_remove (struct fd_table *table, struct fd_entry **link)
+{
+        struct fd_entry *entry = *link;
+
+        *link = entry->next;
+        table->count--;
+
+        glfs_close (entry->fd);
+        free (entry->path);
+        free (entry);
+}
+
+/**
+ * Closes all the files of table, dropping their locks, and frees it.
+ */
+void
+fd_table_free (struct fd_table *table)
+{
+        if (table == NULL) {
+                return;
+        }
+
+        for (size_t i = 0; i < table->num_buckets; i++) {
+                while (table->buckets[i]) {
+                        fd_table_remove (table, &table->buckets[i]);
                 }
+        }
 
-                new->path = strdup (tmp_path);
-                new->next = NULL;
+        free (table->buckets);
+        free (table);
+}
 
-                if ((*ctx)->flist == NULL) {
-                        (*ctx)->flist = new;
-                } else {
-                        ptr = (*ctx)->flist;
-                        while (ptr) {
-                                cur = ptr;
-                                ptr = ptr->next;
-                        }
+static int
+compare_paths (const void *a, const void *b)
+{
+        return strcmp (*(char * const *) a, *(char * const *) b);
+}
 
-                        cur->next = new;
+/**
+ * Takes or drops the requested lock on path, keeping the file open in the
+ * table of the context for as long as a lock is held on it.
+ */
+static int
+flock_path (struct cli_context *ctx, const char *path)
+{
+        struct fd_entry **link = fd_table_find (ctx->fds, path);
+        struct fd_entry *entry = *link;
+        bool opened = false;
+        glfs_fd_t *fd;
+        int ret;
+
+        if (entry == NULL) {
+                // Nothing is held on a file that is not open.
+                if (state->l_type == F_UNLCK) {
+                        return 0;
                 }
+
+                fd = glfs_open (ctx->fs, path, O_RDWR);
+                if (fd == NULL) {
+                        error (0, errno, "failed to open %s", path);
+                        return -1;
+                }
+
+                entry = fd_table_add (ctx->fds, link, path, fd);
+                if (entry == NULL) {
+                        error (0, errno, "failed to open %s", path);
+                        glfs_close (fd);
+                        return -1;
+                }
+
+                opened = true;
         }
 
         /* Request advisory lock. */
-        ret = gluster_lock (fd, state->l_type, state->block);
-        if (ret)
-                error (0, errno, "failed to lock %s", state->path);
-out:
-        if (tmp_path)
-                free (tmp_path);
+        ret = gluster_lock (entry->fd, state->l_type, state->block);
+        if (ret) {
+                error (0, errno, "failed to lock %s", path);
+        }
+
+        // Files are only kept open while they are locked. The table may have
+        // grown since link was found, so look again.
+        if ((ret == 0 && state->l_type == F_UNLCK) || (ret != 0 && opened)) {
+                fd_table_remove (ctx->fds, fd_table_find (ctx->fds, path));
+        }
+
+        return ret;
+}
+
+static int
+flock_with_fs (struct cli_context *ctx)
+{
+        int ret = 0;
+
+        if (state->debug)
+                glfs_set_logging (ctx->fs, "/dev/stderr", GF_LOG_DEBUG);
+
+        if (ctx->fds == NULL) {
+                ctx->fds = fd_table_new ();
+                if (ctx->fds == NULL) {
+                        error (0, errno, "failed to initialize file table");
+                        return -1;
+                }
+        }
+
+        qsort (state->paths, state->num_paths, sizeof (*state->paths), compare_paths);
+
+        for (int i = 0; i < state->num_paths; i++) {
+                if (i > 0 && strcmp (state->paths[i], state->paths[i - 1]) == 0) {
+                        continue;
+                }
+
+                if (flock_path (ctx, state->paths[i]) == -1) {
+                        ret = -1;
+                }
+        }
 
         return ret;
 }
@@ -285,7 +449,7 @@ do_flock (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = flock_with_fs (&ctx);
+                ret = flock_with_fs (ctx);
         } else {
                 /* flock can only be invoked within a Gluster remote shell
                  * connected to Gluster volume. Or else we return error. */
@@ -295,9 +459,11 @@ do_flock (struct cli_context *ctx)
 
 out:
         if (state) {
-                if (state->path) {
-                        free (state->path);
+                for (int i = 0; state->paths && i < state->num_paths; i++) {
+                        free (state->paths[i]);
                 }
+
+                free (state->paths);
                 free (state);
         }
 
@@ -24,4 +24,7 @@
 int
 do_flock (struct cli_context *ctx);
 
+void
+fd_table_free (struct fd_table *table);
+
 #endif
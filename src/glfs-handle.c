@@ -0,0 +1,704 @@
+/**
+ * Walks trees on a volume by handle rather than by path, so that every step
+ * down a deep tree resolves a single component instead of the whole path.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-attr-cache.h"
+#include "glfs-handle.h"
+#include "glfs-stats.h"
+#include "glfs-util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glusterfs/api/glfs.h>
+#ifdef HAVE_GLFS_HANDLES
+#include <glusterfs/api/glfs-handles.h>
+#endif
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct gluster_handle *
+handle_new (struct gluster_handle *parent, const char *path)
+{
+        struct gluster_handle *handle = malloc (sizeof (*handle));
+
+        if (handle == NULL) {
+                return NULL;
+        }
+
+        handle->path = parent ? append_path (parent->path, path) : strdup (path);
+        if (handle->path == NULL) {
+                free (handle);
+                return NULL;
+        }
+
+        handle->object = NULL;
+        handle->refs = 1;
+
+        return handle;
+}
+
+/**
+ * Returns the full path of name inside parent, or a copy of name if parent is
+ * NULL. It is the responsibility of the caller to free the return value.
+ */
+static char *
+child_path (struct gluster_handle *parent, const char *name)
+{
+        return parent ? append_path (parent->path, name) : strdup (name);
+}
+
+#ifdef HAVE_GLFS_HANDLES
+/**
+ * Forgets what the attribute cache knows about name inside parent once it has
+ * been created or removed.
+ */
+static void
+handle_invalidate (glfs_t *fs, struct gluster_handle *parent, const char *name)
+{
+        char *path = child_path (parent, name);
+
+        if (path) {
+                gluster_attr_cache_invalidate (fs, path);
+                free (path);
+        } else {
+                gluster_attr_cache_clear (fs);
+        }
+}
+#endif
+
+/**
+ * Looks up path relative to parent, or from the root of the volume if parent
+ * is NULL, filling statbuf with its attributes if it is not NULL. Symbolic
+ * links are only followed if follow is set.
+ *
+ * Without handle support the lookup only happens if statbuf is asked for, so
+ * a path that does not exist may only fail later on.
+ *
+ * Returns NULL with errno set on failure. The caller is responsible for
+ * dropping the reference returned with gluster_handle_unref ().
+ */
+struct gluster_handle *
+gluster_handle_lookup (glfs_t *fs, struct gluster_handle *parent,
+                       const char *path, struct stat *statbuf, bool follow)
+{
+        struct gluster_handle *handle = handle_new (parent, path);
+        struct gluster_handle *cached = NULL;
+        uint64_t start;
+        int saved_errno;
+        int ret = 0;
+#ifdef HAVE_GLFS_HANDLES
+        struct stat local;
+#endif
+
+        if (handle == NULL) {
+                return NULL;
+        }
+
+        ret = gluster_attr_cache_get (fs, handle->path, follow, statbuf, &cached);
+        if (ret == 0) {
+                gluster_handle_unref (handle);
+                return cached;
+        }
+
+        if (ret == -1) {
+                goto out;
+        }
+
+        ret = 0;
+
+#ifdef HAVE_GLFS_HANDLES
+        start = stats_start ();
+        handle->object = glfs_h_lookupat (fs, parent ? parent->object : NULL, path,
+                                          statbuf ? statbuf : &local, follow);
+        ret = handle->object ? 0 : -1;
+        stats_end (STATS_LOOKUP, start, ret);
+
+        saved_errno = errno;
+        gluster_attr_cache_put (fs, handle->path, follow, statbuf ? statbuf : &local,
+                                handle, ret == -1 ? saved_errno : 0);
+        errno = saved_errno;
+#else
+        if (statbuf) {
+                start = stats_start ();
+                if (follow) {
+                        ret = glfs_stat (fs, handle->path, statbuf);
+                } else {
+                        ret = glfs_lstat (fs, handle->path, statbuf);
+                }
+
+                stats_end (STATS_STAT, start, ret);
+
+                saved_errno = errno;
+                gluster_attr_cache_put (fs, handle->path, follow, statbuf, handle,
+                                        ret == -1 ? saved_errno : 0);
+                errno = saved_errno;
+        }
+#endif
+
+out:
+        if (ret == -1) {
+                saved_errno = errno;
+                gluster_handle_unref (handle);
+                errno = saved_errno;
+                return NULL;
+        }
+
+        return handle;
+}
+
+/**
+ * Takes another reference to handle, if it is not NULL, and returns it.
+ */
+struct gluster_handle *
+gluster_handle_ref (struct gluster_handle *handle)
+{
+        if (handle) {
+                __atomic_fetch_add (&handle->refs, 1, __ATOMIC_RELAXED);
+        }
+
+        return handle;
+}
+
+void
+gluster_handle_unref (struct gluster_handle *handle)
+{
+        if (handle == NULL || __atomic_sub_fetch (&handle->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+                return;
+        }
+
+#ifdef HAVE_GLFS_HANDLES
+        if (handle->object) {
+                glfs_h_close (handle->object);
+        }
+#endif
+
+        free (handle->path);
+        free (handle);
+}
+
+/**
+ * Gets the attributes of the file itself, not following a symbolic link.
+ */
+int
+gluster_handle_stat (glfs_t *fs, struct gluster_handle *handle, struct stat *statbuf)
+{
+        uint64_t start = stats_start ();
+        int ret;
+
+#ifdef HAVE_GLFS_HANDLES
+        ret = glfs_h_stat (fs, handle->object, statbuf);
+#else
+        ret = glfs_lstat (fs, handle->path, statbuf);
+#endif
+        stats_end (STATS_STAT, start, ret);
+
+        return ret;
+}
+
+glfs_fd_t *
+gluster_handle_open (glfs_t *fs, struct gluster_handle *handle, int flags)
+{
+        // Whatever is written will change the size and times cached.
+        if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC)) {
+                gluster_attr_cache_invalidate (fs, handle->path);
+        }
+
+#ifdef HAVE_GLFS_HANDLES
+        return glfs_h_open (fs, handle->object, flags);
+#else
+        return glfs_open (fs, handle->path, flags);
+#endif
+}
+
+glfs_fd_t *
+gluster_handle_opendir (glfs_t *fs, struct gluster_handle *handle)
+{
+#ifdef HAVE_GLFS_HANDLES
+        return glfs_h_opendir (fs, handle->object);
+#else
+        return glfs_opendir (fs, handle->path);
+#endif
+}
+
+ssize_t
+gluster_handle_readlink (glfs_t *fs, struct gluster_handle *handle, char *buf, size_t size)
+{
+#ifdef HAVE_GLFS_HANDLES
+        return glfs_h_readlink (fs, handle->object, buf, size);
+#else
+        return glfs_readlink (fs, handle->path, buf, size);
+#endif
+}
+
+/*
+ * The calls below act on name inside parent. If parent is NULL, name is a
+ * path from the root of the volume and the path based calls are used, since
+ * resolving the full path once cannot be avoided anyway.
+ */
+
+/**
+ * Opens name inside parent with flags, creating it with mode if it does not
+ * exist, like glfs_creat () does; with O_EXCL, it fails with EEXIST if it does.
+ * Returns NULL with errno set on failure.
+ */
+glfs_fd_t *
+gluster_handle_creat (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                      int flags, mode_t mode)
+{
+        glfs_fd_t *fd;
+        char *path;
+#ifdef HAVE_GLFS_HANDLES
+        struct glfs_object *object;
+        struct stat statbuf;
+        uint64_t start;
+        int saved_errno;
+
+        if (parent) {
+                // Existing files are opened as they are rather than created
+                // over, as with glfs_creat (), unless O_EXCL asks for a new
+                // one, which only the create itself can tell atomically.
+                if (flags & O_EXCL) {
+                        object = NULL;
+                        errno = ENOENT;
+                } else {
+                        start = stats_start ();
+                        object = glfs_h_lookupat (fs, parent->object, name, &statbuf, 0);
+                        stats_end (STATS_LOOKUP, start, object ? 0 : -1);
+                }
+
+                if (object == NULL && errno == ENOENT) {
+                        object = glfs_h_creat (fs, parent->object, name,
+                                               flags | O_CREAT, mode, &statbuf);
+                }
+
+                if (object == NULL) {
+                        return NULL;
+                }
+
+                fd = glfs_h_open (fs, object, flags & ~(O_CREAT | O_EXCL));
+
+                saved_errno = errno;
+                glfs_h_close (object);
+                handle_invalidate (fs, parent, name);
+                errno = saved_errno;
+
+                return fd;
+        }
+#endif
+
+        path = child_path (parent, name);
+        if (path == NULL) {
+                return NULL;
+        }
+
+        fd = glfs_creat (fs, path, flags, mode);
+        if (fd) {
+                gluster_attr_cache_invalidate (fs, path);
+        }
+
+        free (path);
+
+        return fd;
+}
+
+/**
+ * Creates the directory name inside parent, filling statbuf with its
+ * attributes if it is not NULL. Returns NULL with errno set on failure.
+ */
+struct gluster_handle *
+gluster_handle_mkdir (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                      mode_t mode, struct stat *statbuf)
+{
+        struct gluster_handle *handle;
+        uint64_t start;
+        int saved_errno;
+        int ret;
+#ifdef HAVE_GLFS_HANDLES
+        struct stat local;
+
+        if (parent) {
+                handle = handle_new (parent, name);
+                if (handle == NULL) {
+                        return NULL;
+                }
+
+                start = stats_start ();
+                handle->object = glfs_h_mkdir (fs, parent->object, name, mode,
+                                               statbuf ? statbuf : &local);
+                stats_end (STATS_MKDIR, start, handle->object ? 0 : -1);
+                if (handle->object == NULL) {
+                        saved_errno = errno;
+                        gluster_handle_unref (handle);
+                        errno = saved_errno;
+                        return NULL;
+                }
+
+                gluster_attr_cache_invalidate (fs, handle->path);
+
+                return handle;
+        }
+#endif
+
+        handle = handle_new (parent, name);
+        if (handle == NULL) {
+                return NULL;
+        }
+
+        start = stats_start ();
+        ret = glfs_mkdir (fs, handle->path, mode);
+        stats_end (STATS_MKDIR, start, ret);
+        saved_errno = errno;
+        if (ret == 0) {
+                // Or the lookup below would find the path still missing.
+                gluster_attr_cache_invalidate (fs, handle->path);
+        }
+
+        gluster_handle_unref (handle);
+        errno = saved_errno;
+
+        if (ret == -1) {
+                return NULL;
+        }
+
+        return gluster_handle_lookup (fs, parent, name, statbuf, false);
+}
+
+int
+gluster_handle_symlink (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                        const char *target)
+{
+        char *path;
+        int ret;
+#ifdef HAVE_GLFS_HANDLES
+        struct glfs_object *object;
+        struct stat statbuf;
+
+        if (parent) {
+                object = glfs_h_symlink (fs, parent->object, name, target, &statbuf);
+                if (object == NULL) {
+                        return -1;
+                }
+
+                glfs_h_close (object);
+                handle_invalidate (fs, parent, name);
+
+                return 0;
+        }
+#endif
+
+        path = child_path (parent, name);
+        if (path == NULL) {
+                return -1;
+        }
+
+        ret = glfs_symlink (fs, target, path);
+        if (ret == 0) {
+                gluster_attr_cache_invalidate (fs, path);
+        }
+
+        free (path);
+
+        return ret;
+}
+
+/**
+ * Removes the file or directory name inside parent; is_dir tells which of the
+ * two the path based calls should expect. glfs_h_unlink () removes either, so
+ * with handles a directory is not refused with EISDIR by the unlink: callers
+ * must only unlink what they know not to be a directory.
+ */
+static int
+handle_remove (glfs_t *fs, struct gluster_handle *parent, const char *name, bool is_dir)
+{
+        uint64_t start;
+        char *path;
+        int ret;
+
+#ifdef HAVE_GLFS_HANDLES
+        if (parent) {
+                start = stats_start ();
+                ret = glfs_h_unlink (fs, parent->object, name);
+                stats_end (STATS_UNLINK, start, ret);
+                if (ret == 0) {
+                        handle_invalidate (fs, parent, name);
+                }
+
+                return ret;
+        }
+#endif
+
+        path = child_path (parent, name);
+        if (path == NULL) {
+                return -1;
+        }
+
+        start = stats_start ();
+        ret = is_dir ? glfs_rmdir (fs, path) : glfs_unlink (fs, path);
+        stats_end (STATS_UNLINK, start, ret);
+        if (ret == 0) {
+                gluster_attr_cache_invalidate (fs, path);
+        }
+
+        free (path);
+
+        return ret;
+}
+
+int
+gluster_handle_unlink (glfs_t *fs, struct gluster_handle *parent, const char *name)
+{
+        return handle_remove (fs, parent, name, false);
+}
+
+int
+gluster_handle_rmdir (glfs_t *fs, struct gluster_handle *parent, const char *name)
+{
+        char *path;
+        int ret;
+
+        ret = handle_remove (fs, parent, name, true);
+        if (ret == 0) {
+                path = child_path (parent, name);
+                if (path) {
+                        gluster_dir_cache_forget (fs, path);
+                        free (path);
+                } else {
+                        gluster_dir_cache_drop (fs);
+                }
+        }
+
+        return ret;
+}
+
+#define DIR_CACHE_BUCKETS 4096
+#define DIR_CACHE_MAX 65536
+
+/**
+ * A directory known to exist, by connection and canonical path.
+ */
+struct dir_cache_entry {
+        glfs_t *fs;
+        char *path;
+        struct gluster_handle *handle;
+        struct dir_cache_entry *next;
+};
+
+/**
+ * Directories created or found by mkdir -p and the like, shared by all the
+ * commands run by the process so that the prefixes they have in common are
+ * only created once.
+ */
+static struct {
+        pthread_mutex_t lock;
+        struct dir_cache_entry *buckets[DIR_CACHE_BUCKETS];
+        size_t count;
+} dir_cache = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static size_t
+dir_cache_bucket (glfs_t *fs, const char *path)
+{
+        uint64_t hash = 14695981039346656037ULL ^ (uintptr_t) fs;
+
+        for (; *path; path++) {
+                hash = (hash ^ (unsigned char) *path) * 1099511628211ULL;
+        }
+
+        return hash % DIR_CACHE_BUCKETS;
+}
+
+static void
+dir_cache_entry_free (struct dir_cache_entry *entry)
+{
+        gluster_handle_unref (entry->handle);
+        free (entry->path);
+        free (entry);
+}
+
+/**
+ * Returns a reference to the handle of the directory at path on fs if it is
+ * known to exist, or NULL.
+ */
+struct gluster_handle *
+gluster_dir_cache_get (glfs_t *fs, const char *path)
+{
+        struct gluster_handle *handle = NULL;
+        struct dir_cache_entry *entry;
+        char *key;
+
+        // Most processes never fill the cache, so spare them the key.
+        if (__atomic_load_n (&dir_cache.count, __ATOMIC_RELAXED) == 0) {
+                return NULL;
+        }
+
+        key = canonical_path (path);
+        if (key == NULL) {
+                return NULL;
+        }
+
+        pthread_mutex_lock (&dir_cache.lock);
+
+        for (entry = dir_cache.buckets[dir_cache_bucket (fs, key)]; entry; entry = entry->next) {
+                if (entry->fs == fs && strcmp (entry->path, key) == 0) {
+                        handle = gluster_handle_ref (entry->handle);
+                        break;
+                }
+        }
+
+        pthread_mutex_unlock (&dir_cache.lock);
+        free (key);
+
+        return handle;
+}
+
+/**
+ * Records that the directory at path on fs exists, with its handle. Nothing is
+ * recorded once the cache is full (or memory runs out), which only costs the
+ * round trips the cache would have saved.
+ */
+void
+gluster_dir_cache_put (glfs_t *fs, const char *path, struct gluster_handle *handle)
+{
+        struct dir_cache_entry *entry;
+        char *key = canonical_path (path);
+        size_t bucket;
+
+        if (key == NULL) {
+                return;
+        }
+
+        bucket = dir_cache_bucket (fs, key);
+
+        pthread_mutex_lock (&dir_cache.lock);
+
+        for (entry = dir_cache.buckets[bucket]; entry; entry = entry->next) {
+                if (entry->fs == fs && strcmp (entry->path, key) == 0) {
+                        goto out;
+                }
+        }
+
+        if (dir_cache.count == DIR_CACHE_MAX) {
+                goto out;
+        }
+
+        entry = malloc (sizeof (*entry));
+        if (entry == NULL) {
+                goto out;
+        }
+
+        entry->path = key;
+        key = NULL;
+        entry->fs = fs;
+        entry->handle = gluster_handle_ref (handle);
+        entry->next = dir_cache.buckets[bucket];
+        dir_cache.buckets[bucket] = entry;
+        __atomic_add_fetch (&dir_cache.count, 1, __ATOMIC_RELAXED);
+
+out:
+        pthread_mutex_unlock (&dir_cache.lock);
+        free (key);
+}
+
+/**
+ * Returns whether entry is the directory at path on fs, of the given length,
+ * or lies below it. A NULL path matches every directory of fs.
+ */
+static bool
+dir_cache_matches (const struct dir_cache_entry *entry, glfs_t *fs, const char *path,
+                   size_t length)
+{
+        if (entry->fs != fs) {
+                return false;
+        }
+
+        if (path == NULL || strcmp (path, "/") == 0) {
+                return true;
+        }
+
+        return strncmp (entry->path, path, length) == 0
+                && (entry->path[length] == '\0' || entry->path[length] == '/');
+}
+
+static void
+dir_cache_remove (glfs_t *fs, const char *path)
+{
+        struct dir_cache_entry **link;
+        struct dir_cache_entry *entry;
+        size_t length = path ? strlen (path) : 0;
+
+        pthread_mutex_lock (&dir_cache.lock);
+
+        for (size_t i = 0; dir_cache.count > 0 && i < DIR_CACHE_BUCKETS; i++) {
+                link = &dir_cache.buckets[i];
+                while ((entry = *link) != NULL) {
+                        if (!dir_cache_matches (entry, fs, path, length)) {
+                                link = &entry->next;
+                                continue;
+                        }
+
+                        *link = entry->next;
+                        __atomic_sub_fetch (&dir_cache.count, 1, __ATOMIC_RELAXED);
+                        dir_cache_entry_free (entry);
+                }
+        }
+
+        pthread_mutex_unlock (&dir_cache.lock);
+}
+
+/**
+ * Forgets the directory at path on fs, and those below it, once they have
+ * been removed or renamed.
+ */
+void
+gluster_dir_cache_forget (glfs_t *fs, const char *path)
+{
+        char *key;
+
+        if (__atomic_load_n (&dir_cache.count, __ATOMIC_RELAXED) == 0) {
+                return;
+        }
+
+        key = canonical_path (path);
+        if (key == NULL) {
+                // Forgetting too much is always safe.
+                dir_cache_remove (fs, NULL);
+                return;
+        }
+
+        dir_cache_remove (fs, key);
+        free (key);
+}
+
+/**
+ * Forgets all that is known about fs, which must be done before it is
+ * finalized.
+ */
+void
+gluster_dir_cache_drop (glfs_t *fs)
+{
+        if (__atomic_load_n (&dir_cache.count, __ATOMIC_RELAXED) > 0) {
+                dir_cache_remove (fs, NULL);
+        }
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_HANDLE_H
+#define GLFS_HANDLE_H
+
+#include <glusterfs/api/glfs.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+struct glfs_object;
+
+/**
+ * A file or directory on a volume, as reached by a walk down a tree. Where
+ * the glusterfs api has handles, each one is looked up relative to its parent
+ * so that a step down the tree costs a single lookup however deep it is;
+ * otherwise the calls fall back to the full path.
+ *
+ * Handles are reference counted, and may be shared between threads.
+ *
+ * path: Full path on the volume, for messages and the path based calls.
+ * object: Handle of the file, or NULL without handle support.
+ * refs: Number of references held.
+ */
+struct gluster_handle {
+        char *path;
+        struct glfs_object *object;
+        unsigned int refs;
+};
+
+struct gluster_handle *
+gluster_handle_lookup (glfs_t *fs, struct gluster_handle *parent,
+                       const char *path, struct stat *statbuf, bool follow);
+
+struct gluster_handle *
+gluster_handle_ref (struct gluster_handle *handle);
+
+void
+gluster_handle_unref (struct gluster_handle *handle);
+
+int
+gluster_handle_stat (glfs_t *fs, struct gluster_handle *handle, struct stat *statbuf);
+
+glfs_fd_t *
+gluster_handle_open (glfs_t *fs, struct gluster_handle *handle, int flags);
+
+glfs_fd_t *
+gluster_handle_opendir (glfs_t *fs, struct gluster_handle *handle);
+
+ssize_t
+gluster_handle_readlink (glfs_t *fs, struct gluster_handle *handle, char *buf, size_t size);
+
+glfs_fd_t *
+gluster_handle_creat (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                      int flags, mode_t mode);
+
+struct gluster_handle *
+gluster_handle_mkdir (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                      mode_t mode, struct stat *statbuf);
+
+int
+gluster_handle_symlink (glfs_t *fs, struct gluster_handle *parent, const char *name,
+                        const char *target);
+
+int
+gluster_handle_unlink (glfs_t *fs, struct gluster_handle *parent, const char *name);
+
+int
+gluster_handle_rmdir (glfs_t *fs, struct gluster_handle *parent, const char *name);
+
+/**
+ * A process wide cache of the directories known to exist on each connection,
+ * keyed by path. Whatever removes or renames a directory must forget it, and
+ * a connection's entries must be dropped before it is finished.
+ */
+struct gluster_handle *
+gluster_dir_cache_get (glfs_t *fs, const char *path);
+
+void
+gluster_dir_cache_put (glfs_t *fs, const char *path, struct gluster_handle *handle);
+
+void
+gluster_dir_cache_forget (glfs_t *fs, const char *path);
+
+void
+gluster_dir_cache_drop (glfs_t *fs);
+
+#endif /* GLFS_HANDLE_H */
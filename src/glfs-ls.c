@@ -28,22 +28,44 @@
 #include <glusterfs/api/glfs.h>
 #include <grp.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "glfs-attr-cache.h"
+#include "glfs-handle.h"
 #include "glfs-ls.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 #include "glfs-stat-util.h"
 #include "human.h"
 
 #define AUTHORS "Written by Craig Cabrey."
 
+#define ARENA_MIN_BLOCK_SIZE 4096
+#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+#define ID_CACHE_BUCKETS 64
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+#define LS_NUMBER_SIZE 24
+#define DEFAULT_TERMINAL_WIDTH 80
+#define MIN_COLUMN_WIDTH 3
+#define COLUMN_GAP 2
+
+enum sort_key {
+        SORT_NONE,
+        SORT_NAME,
+        SORT_SIZE,
+        SORT_TIME
+};
+
 /**
  * Used to store the state of the program, including user supplied options.
  *
@@ -51,8 +73,13 @@
  * url: Raw url string supplied by the user.
  * debug: Whether to log additional debug information.
  * recursive: Whether to enable recursive mode.
+ * jobs: Number of directories to read concurrently in recursive mode.
  * show_all: Whether to show hidden files (denoated by a '.' prefix in names).
  * long_form: Whether to enable long form listing (similar to GNU ls).
+ * sort: What to sort the entries of each directory by, or SORT_NONE to print
+ *       them as they are read.
+ * reverse: Whether to reverse the order of the sort.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
         struct gluster_url *gluster_url;
@@ -64,9 +91,13 @@ struct state {
         bool show_atime;
         bool show_ctime;
         bool long_form;
+        enum sort_key sort;
+        bool reverse;
+        unsigned int jobs;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
@@ -74,8 +105,12 @@ static struct option const long_options[] =
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
         {"human", no_argument, NULL, 'h'},
+        {"jobs", required_argument, NULL, 'j'},
         {"port", required_argument, NULL, 'p'},
         {"recursive", no_argument, NULL, 'R'},
+        {"reverse", no_argument, NULL, 'r'},
+        {"sort", required_argument, NULL, 'O'},
+        {"stats", optional_argument, NULL, 's'},
         {"version", no_argument, NULL, 'v'},
         {NULL, no_argument, NULL, 0}
 };
@@ -91,9 +126,20 @@ usage ()
                 "  -a, --all              do not ignore entries starting with .\n"
                 "  -h, --human-readable   with -l, print sizes in human readable\n"
                 "                         format (e.g., 1K 234M 2G)\n"
+                "  -j, --jobs=N           with -R, read up to N directories at once;\n"
+                "                         output is in the same order as with one\n"
                 "  -l                     use a long listing format\n"
+                "  -r, --reverse          reverse the order of the sort\n"
                 "  -R, --recursive        list subdirectories recursively\n"
+                "  -S                     sort by size, largest first\n"
+                "      --sort=WORD        sort by WORD instead of name: none (-U),\n"
+                "                         size (-S), time (-t)\n"
+                "  -t                     sort by modification time, newest first\n"
+                "  -U                     do not sort; list entries as they are read\n"
                 "  -p, --port=PORT        specify the port on which to connect\n"
+                "      --stats[=FORMAT]   print the number and latency of the calls\n"
+                "                         made to the volume on exit; FORMAT is text\n"
+                "                         (the default) or json\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
@@ -122,10 +168,12 @@ parse_options (int argc, char *argv[], bool has_connection)
         int opt = 0;
         int option_index = 0;
 
+        lock_getopt ();
+
         // Reset getopt since other utilities may have called it already.
         optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "abcdhlp:R", long_options,
+                opt = getopt_long (argc, argv, "abcdhj:lp:rRStU", long_options,
                                 &option_index);
 
                 if (opt == -1) {
@@ -147,6 +195,13 @@ parse_options (int argc, char *argv[], bool has_connection)
                                 break;
                         case 'h':
                                 state->human_readable = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'l':
                                 state->long_form = true;
@@ -157,10 +212,44 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto out;
                                 }
 
+                                break;
+                        case 'O':
+                                if (strcmp (optarg, "none") == 0) {
+                                        state->sort = SORT_NONE;
+                                } else if (strcmp (optarg, "name") == 0) {
+                                        state->sort = SORT_NAME;
+                                } else if (strcmp (optarg, "size") == 0) {
+                                        state->sort = SORT_SIZE;
+                                } else if (strcmp (optarg, "time") == 0) {
+                                        state->sort = SORT_TIME;
+                                } else {
+                                        error (0, 0, "invalid argument \"%s\" for \"--sort\"", optarg);
+                                        goto err;
+                                }
+
+                                break;
+                        case 'r':
+                                state->reverse = true;
                                 break;
                         case 'R':
                                 state->recursive = true;
                                 break;
+                        case 'S':
+                                state->sort = SORT_SIZE;
+                                break;
+                        case 's':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 't':
+                                state->sort = SORT_TIME;
+                                break;
+                        case 'U':
+                                state->sort = SORT_NONE;
+                                break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
                                         program_invocation_name,
@@ -180,7 +269,7 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
         } else {
@@ -209,6 +298,8 @@ parse_options (int argc, char *argv[], bool has_connection)
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -226,12 +317,16 @@ init_state ()
 
         state->debug = false;
         state->human_readable = false;
+        state->jobs = 1;
         state->gluster_url = NULL;
         state->long_form = false;
         state->recursive = false;
+        state->reverse = false;
         state->show_all = false;
         state->show_atime = false;
         state->show_ctime = false;
+        state->sort = SORT_NAME;
+        state->stats = STATS_OFF;
         state->url = NULL;
 
 out:
@@ -239,192 +334,1248 @@ out:
 }
 
 /**
- * Prints the long form of a directory entry.
+ * A block of an arena; data holds size bytes, of which used are handed out.
+ */
+struct ls_arena_block {
+        struct ls_arena_block *next;
+        size_t size;
+        size_t used;
+        char data[];
+};
+
+struct ls_arena {
+        struct ls_arena_block *head;
+};
+
+struct id_name {
+        unsigned int id;
+        const char *name;
+        struct id_name *next;
+};
+
+/**
+ * Names of the user or group ids seen so far, kept in an arena of their own,
+ * and the buffer of buf_size bytes they are looked up in.
+ */
+struct id_cache {
+        struct id_name *buckets[ID_CACHE_BUCKETS];
+        struct ls_arena arena;
+        char *buf;
+        size_t buf_size;
+};
+
+/**
+ * Output waiting to be written to standard output in one go. error is the
+ * errno of the first write that failed.
+ */
+struct ls_output {
+        char *buf;
+        size_t length;
+        int error;
+};
+
+/**
+ * Widths of the columns of the long format, wide enough for every entry of a
+ * sorted listing, or fixed for a listing printed as it is read. The size is
+ * aligned to the right, or to the left if size_left is set, as a listing
+ * printed as it is read always had it.
+ */
+struct ls_widths {
+        size_t links;
+        size_t user;
+        size_t group;
+        size_t size;
+        bool size_left;
+};
+
+/**
+ * A directory entry read into memory, with just the attributes the listing
+ * shows or sorts by. The name lives in the arena of its listing. error is the
+ * errno of a failed attempt to stat the entry.
+ */
+struct ls_entry {
+        const char *name;
+        size_t name_length;
+        mode_t mode;
+        uid_t uid;
+        gid_t gid;
+        nlink_t nlink;
+        off_t size;
+        struct timespec atime;
+        struct timespec mtime;
+        struct timespec ctime;
+        int error;
+};
+
+enum listing_status {
+        LISTING_PENDING,
+        LISTING_READING,
+        LISTING_READY
+};
+
+/**
+ * A directory waiting to be listed. Pending directories are kept on a stack so
+ * that they are listed in the same depth-first order as a recursive walk.
+ *
+ * The directory is looked up relative to the handle of the one it was found in,
+ * parent, when it is read; parent is NULL for the directory listed first.
+ *
+ * A directory is read whole into entries, sorted unless -U was given, before
+ * it is printed; this is done ahead of time by a thread when prefetching.
+ * With -a, the first num_dots entries are . and .., which stay in front.
+ * error then holds the errno of a failure to open it.
+ */
+struct listing {
+        char *path;
+        struct gluster_handle *parent;
+        struct gluster_handle *handle;
+        enum listing_status status;
+        struct ls_entry *entries;
+        size_t num_entries;
+        size_t num_dots;
+        struct ls_arena names;
+        int error;
+        struct listing *next;
+};
+
+/**
+ * State of a (possibly recursive) listing.
+ *
+ * state: Options of the command, for the prefetch threads.
+ * stack: Directories still to be listed, the next one first.
+ * window: How many directories from the top of the stack the prefetch threads
+ *         may read ahead; this bounds the number of buffered listings.
+ * width: Width of the terminal to lay short listings out in columns for, or
+ *        0 to print them on a single line.
+ * done: Set once the walk is over to stop the prefetch threads.
+ */
+struct walk {
+        glfs_t *fs;
+        struct state *state;
+        struct stats *stats;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        struct listing *stack;
+        unsigned int window;
+        size_t width;
+        struct id_cache users;
+        struct id_cache groups;
+        struct ls_output out;
+        bool done;
+};
+
+/**
+ * Hands out memory from blocks that grow as they fill, so that the names in a
+ * listing cost no more than their length and are freed all at once.
+ */
+static void *
+arena_alloc (struct ls_arena *arena, size_t size)
+{
+        struct ls_arena_block *block = arena->head;
+        size_t block_size;
+        void *ptr;
+
+        // Keep everything handed out aligned for any structure.
+        size = (size + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+
+        if (block == NULL || block->size - block->used < size) {
+                block_size = block ? block->size * 2 : ARENA_MIN_BLOCK_SIZE;
+                if (block_size > ARENA_MAX_BLOCK_SIZE) {
+                        block_size = ARENA_MAX_BLOCK_SIZE;
+                }
+
+                if (block_size < size) {
+                        block_size = size;
+                }
+
+                block = malloc (sizeof (*block) + block_size);
+                if (block == NULL) {
+                        return NULL;
+                }
+
+                block->next = arena->head;
+                block->size = block_size;
+                block->used = 0;
+                arena->head = block;
+        }
+
+        ptr = block->data + block->used;
+        block->used += size;
+
+        return ptr;
+}
+
+static char *
+arena_strndup (struct ls_arena *arena, const char *str, size_t length)
+{
+        char *copy = arena_alloc (arena, length + 1);
+
+        if (copy) {
+                memcpy (copy, str, length);
+                copy[length] = '\0';
+        }
+
+        return copy;
+}
+
+static void
+arena_free (struct ls_arena *arena)
+{
+        struct ls_arena_block *block;
+
+        while ((block = arena->head) != NULL) {
+                arena->head = block->next;
+                free (block);
+        }
+}
+
+/**
+ * Returns the name of the user or group id, looking it up only the first time
+ * it is asked for. Ids without a name are shown as UNKNOWN.
+ */
+static const char *
+id_cache_name (struct id_cache *cache, unsigned int id, bool group)
+{
+        struct id_name **bucket = &cache->buckets[id % ID_CACHE_BUCKETS];
+        struct id_name *entry;
+        const char *name;
+
+        for (entry = *bucket; entry; entry = entry->next) {
+                if (entry->id == id) {
+                        return entry->name;
+                }
+        }
+
+        // Reentrant, to keep concurrent batch commands apart.
+        name = lookup_id_name (id, group, &cache->buf, &cache->buf_size);
+        if (name == NULL) {
+                name = "UNKNOWN";
+        }
+
+        entry = arena_alloc (&cache->arena, sizeof (*entry));
+        if (entry == NULL) {
+                return "UNKNOWN";
+        }
+
+        entry->name = arena_strndup (&cache->arena, name, strlen (name));
+        if (entry->name == NULL) {
+                return "UNKNOWN";
+        }
+
+        entry->id = id;
+        entry->next = *bucket;
+        *bucket = entry;
+
+        return entry->name;
+}
+
+/**
+ * Writes out everything buffered with a single write where possible, after
+ * anything already printed through stdio. The first error is kept and any
+ * later output dropped.
  */
 static void
-print_long (const char *ent_name, struct stat *statbuf)
+output_flush (struct ls_output *out)
 {
-        struct timespec time;
-        struct tm *tm;
-        struct passwd *pw_ent;
-        struct group *gr_ent;
-        const char *mode_str;
-        char buf[LONGEST_HUMAN_READABLE + 1];
-        const char *size;
-        unsigned int num_links = (unsigned int) statbuf->st_nlink;
+        size_t done = 0;
+        ssize_t ret;
 
-        pw_ent = getpwuid (statbuf->st_uid);
-        gr_ent = getgrgid (statbuf->st_gid);
-        mode_str = human_access (statbuf);
+        fflush (stdout);
+
+        while (done < out->length && out->error == 0) {
+                ret = write (STDOUT_FILENO, out->buf + done, out->length - done);
+                if (ret == -1 && errno != EINTR) {
+                        out->error = errno;
+                } else if (ret > 0) {
+                        done += ret;
+                }
+        }
 
-        time = get_stat_ctime (statbuf);
-        tm = localtime (&(time.tv_sec));
-        char c_time_str[17];
-        strftime (c_time_str, sizeof c_time_str, "%b %e %T", tm);
+        out->length = 0;
+}
 
-        time = get_stat_mtime (statbuf);
-        tm = localtime (&(time.tv_sec));
-        char m_time_str[17];
-        strftime (m_time_str, sizeof m_time_str, "%b %e %T", tm);
+static void
+output_append (struct ls_output *out, const char *data, size_t length)
+{
+        size_t count;
 
-        time = get_stat_atime (statbuf);
-        tm = localtime (&(time.tv_sec));
-        char a_time_str[17];
-        strftime (a_time_str, sizeof a_time_str, "%b %e %T", tm);
+        while (length) {
+                if (out->length == OUTPUT_BUFFER_SIZE) {
+                        output_flush (out);
+                }
 
-        printf ("%s. ", mode_str);
-        printf ("%i ", num_links);
-        printf ("%-15s ", pw_ent ? pw_ent->pw_name : "UNKNOWN");
-        printf ("%-15s ", gr_ent ? gr_ent->gr_name : "UNKNOWN");
+                count = OUTPUT_BUFFER_SIZE - out->length;
+                if (count > length) {
+                        count = length;
+                }
 
+                memcpy (out->buf + out->length, data, count);
+                out->length += count;
+                data += count;
+                length -= count;
+        }
+}
+
+static void
+output_string (struct ls_output *out, const char *str)
+{
+        output_append (out, str, strlen (str));
+}
+
+static void
+output_spaces (struct ls_output *out, size_t count)
+{
+        static const char spaces[] = "                                ";
+
+        while (count) {
+                size_t length = count < sizeof (spaces) - 1 ? count : sizeof (spaces) - 1;
+
+                output_append (out, spaces, length);
+                count -= length;
+        }
+}
+
+/**
+ * Appends str padded with spaces to width, on the left if right_align is set
+ * and on the right otherwise.
+ */
+static void
+output_padded (struct ls_output *out, const char *str, size_t width, bool right_align)
+{
+        size_t length = strlen (str);
+        size_t padding = length < width ? width - length : 0;
+
+        if (right_align) {
+                output_spaces (out, padding);
+        }
+
+        output_append (out, str, length);
+
+        if (!right_align) {
+                output_spaces (out, padding);
+        }
+}
+
+/**
+ * Formats n in decimal at the end of buf (of LS_NUMBER_SIZE bytes),
+ * returning where it starts.
+ */
+static char *
+format_number (char *buf, uintmax_t n)
+{
+        char *p = buf + LS_NUMBER_SIZE - 1;
+
+        *p = '\0';
+        do {
+                *--p = '0' + n % 10;
+                n /= 10;
+        } while (n);
+
+        return p;
+}
+
+/**
+ * Formats the size of entry for the long format into buf, which holds at
+ * least LONGEST_HUMAN_READABLE + 1 bytes, returning where it starts.
+ */
+static char *
+format_size (const struct ls_entry *entry, char *buf)
+{
         if (state->human_readable) {
-                size = human_readable (
-                                statbuf->st_size,
-                                buf,
-                                human_autoscale | human_floor | human_SI,
-                                1,
-                                1);
-                printf ("%-10s", size);
-        } else {
-                unsigned long size = (unsigned long) statbuf->st_size;
-                printf ("%-10lu ", size);
+                return human_readable (entry->size,
+                                       buf,
+                                       human_autoscale | human_floor | human_SI,
+                                       1,
+                                       1);
+        }
+
+        return format_number (buf + LONGEST_HUMAN_READABLE + 1 - LS_NUMBER_SIZE,
+                              (uintmax_t) entry->size);
+}
+
+static void
+output_time (struct ls_output *out, struct timespec time)
+{
+        struct tm tm;
+        char buf[17];
+        size_t length;
+
+        localtime_r (&time.tv_sec, &tm);
+        length = strftime (buf, sizeof (buf), "%b %e %T", &tm);
+        output_append (out, buf, length);
+        output_append (out, " ", 1);
+}
+
+static void
+entry_set_stat (struct ls_entry *entry, const struct stat *statbuf)
+{
+        entry->mode = statbuf->st_mode;
+        entry->nlink = statbuf->st_nlink;
+        entry->uid = statbuf->st_uid;
+        entry->gid = statbuf->st_gid;
+        entry->size = statbuf->st_size;
+        entry->atime = get_stat_atime (statbuf);
+        entry->mtime = get_stat_mtime (statbuf);
+        entry->ctime = get_stat_ctime (statbuf);
+}
+
+/**
+ * Widens the columns of the long format in widths to fit entry.
+ */
+static void
+fit_long (struct walk *walk, const struct ls_entry *entry, struct ls_widths *widths)
+{
+        char buf[LONGEST_HUMAN_READABLE + 1];
+        size_t length;
+
+        length = strlen (format_number (buf + sizeof (buf) - LS_NUMBER_SIZE, entry->nlink));
+        if (length > widths->links) {
+                widths->links = length;
+        }
+
+        length = strlen (id_cache_name (&walk->users, entry->uid, false));
+        if (length > widths->user) {
+                widths->user = length;
         }
 
+        length = strlen (id_cache_name (&walk->groups, entry->gid, true));
+        if (length > widths->group) {
+                widths->group = length;
+        }
+
+        length = strlen (format_size (entry, buf));
+        if (length > widths->size) {
+                widths->size = length;
+        }
+}
+
+/**
+ * Appends the long form of a directory entry, with its columns as wide as
+ * widths says.
+ */
+static void
+output_long (struct walk *walk, const struct ls_entry *entry, const struct ls_widths *widths)
+{
+        struct stat mode_stat = { .st_mode = entry->mode };
+        char buf[LONGEST_HUMAN_READABLE + 1];
+
+        output_string (&walk->out, human_access (&mode_stat));
+        output_append (&walk->out, ". ", 2);
+        output_padded (&walk->out, format_number (buf + sizeof (buf) - LS_NUMBER_SIZE, entry->nlink),
+                       widths->links, true);
+        output_append (&walk->out, " ", 1);
+        output_padded (&walk->out, id_cache_name (&walk->users, entry->uid, false), widths->user, false);
+        output_append (&walk->out, " ", 1);
+        output_padded (&walk->out, id_cache_name (&walk->groups, entry->gid, true), widths->group, false);
+        output_append (&walk->out, " ", 1);
+        output_padded (&walk->out, format_size (entry, buf), widths->size, !widths->size_left);
+        output_append (&walk->out, " ", 1);
+
         if (state->show_ctime) {
-                printf ("%s ", c_time_str);
+                output_time (&walk->out, entry->ctime);
         }
 
-        printf ("%s ", m_time_str);
+        output_time (&walk->out, entry->mtime);
 
         if (state->show_atime) {
-                printf ("%s ", a_time_str);
+                output_time (&walk->out, entry->atime);
         }
 
-        printf ("%s\n", ent_name);
+        output_append (&walk->out, entry->name, entry->name_length);
+        output_append (&walk->out, "\n", 1);
 }
 
 /**
- * Prints the short form of a directory entry.
+ * Appends the short form of a directory entry, on the line of the others.
  */
 static void
-print_short (const char *ent_name, struct stat *statbuf)
+output_short (struct walk *walk, const struct ls_entry *entry)
 {
-        printf ("%s ", ent_name);
+        output_append (&walk->out, entry->name, entry->name_length);
+        output_append (&walk->out, " ", 1);
 }
 
 /**
- * Perform a list directory with the given gluster connection, path, pattern,
- * and print helper function.
+ * Appends the names of the count entries in columns that fit the width of
+ * the terminal, sorted down each column first as ls does. The last row is
+ * left without a newline, like a line of short entries.
  */
-int
-ls_dir (glfs_t *fs, char *path, char *pattern, void (*print_func)(const char *, struct stat *))
+static void
+output_columns (struct walk *walk, struct ls_entry **entries, size_t count)
 {
-        int ret = -1;
-        glfs_fd_t *fd = NULL;
-        struct stat stat;
-        struct stat statbuf;
+        size_t max_columns = walk->width / MIN_COLUMN_WIDTH;
+        size_t *widths;
+        size_t columns;
+        size_t rows = count;
+        size_t total;
+        size_t column;
+        size_t i;
+
+        if (count == 0) {
+                return;
+        }
+
+        if (max_columns > count) {
+                max_columns = count;
+        }
+
+        if (max_columns == 0) {
+                max_columns = 1;
+        }
+
+        widths = calloc (max_columns, sizeof (*widths));
+        if (widths == NULL) {
+                max_columns = 1;
+        }
+
+        // Take the most columns that fit, falling back to one per line.
+        for (columns = max_columns; widths && columns > 1; columns--) {
+                rows = (count + columns - 1) / columns;
+                memset (widths, 0, sizeof (*widths) * columns);
+
+                for (i = 0; i < count; i++) {
+                        column = i / rows;
+                        if (entries[i]->name_length > widths[column]) {
+                                widths[column] = entries[i]->name_length;
+                        }
+                }
+
+                total = (i - 1) / rows + 1;
+                total = (total - 1) * COLUMN_GAP;
+                for (column = 0; column < columns; column++) {
+                        total += widths[column];
+                }
+
+                if (total <= walk->width) {
+                        break;
+                }
+        }
+
+        if (widths == NULL || columns <= 1) {
+                columns = 1;
+                rows = count;
+        }
+
+        for (size_t row = 0; row < rows; row++) {
+                for (column = 0; column < columns; column++) {
+                        i = column * rows + row;
+                        if (i >= count) {
+                                break;
+                        }
+
+                        output_append (&walk->out, entries[i]->name, entries[i]->name_length);
+
+                        if (i + rows < count) {
+                                output_spaces (&walk->out,
+                                               widths[column] - entries[i]->name_length + COLUMN_GAP);
+                        }
+                }
+
+                if (row + 1 < rows) {
+                        output_append (&walk->out, "\n", 1);
+                }
+        }
+
+        free (widths);
+}
+
+/**
+ * Returns whether the attributes glfs_readdirplus () returned alongside a
+ * directory entry can be used. The server may return an entry without its
+ * attributes (for example when the entry's inode is not yet linked), in which
+ * case the stat is left zeroed.
+ */
+static bool
+is_valid_stat (const struct stat *statbuf)
+{
+        return statbuf->st_mode != 0;
+}
+
+/**
+ * Reads the next entry of a directory along with its attributes.
+ */
+static struct dirent *
+read_entry (glfs_fd_t *fd, struct stat *statbuf)
+{
+        uint64_t start = stats_start ();
         struct dirent *dirent;
-        char *full_path;
 
-        ret = glfs_lstat (fs, path, &stat);
-        if (ret == -1) {
-                error (0, errno, "%s", path);
-                goto out;
+        errno = 0;
+        dirent = glfs_readdirplus (fd, statbuf);
+        stats_end (STATS_READDIR, start, dirent == NULL && errno ? -1 : 0);
+
+        return dirent;
+}
+
+/**
+ * Makes sure statbuf holds what the listing needs to know about an entry
+ * returned by glfs_readdirplus (): all of its attributes for the long format
+ * or to sort by size or time, or just its file type to recurse. Falls back to
+ * looking the entry up in dir only when the listing did not already provide
+ * them.
+ */
+static int
+complete_stat (glfs_t *fs, struct gluster_handle *dir, const struct dirent *dirent,
+               struct stat *statbuf)
+{
+        struct gluster_handle *handle;
+        bool full = state->long_form || state->sort == SORT_SIZE || state->sort == SORT_TIME;
+
+        if (is_valid_stat (statbuf) || !(full || state->recursive)) {
+                return 0;
         }
 
-        fd = glfs_opendir (fs, path);
-        if (fd == NULL) {
-                error (0, errno, "%s", path);
-                goto out;
+        if (!full && dirent->d_type != DT_UNKNOWN) {
+                statbuf->st_mode = DTTOIF (dirent->d_type);
+                return 0;
+        }
+
+        handle = gluster_handle_lookup (fs, dir, dirent->d_name, statbuf, false);
+        if (handle == NULL) {
+                return -1;
+        }
+
+        gluster_handle_unref (handle);
+
+        return 0;
+}
+
+static struct listing *
+listing_new (char *path, struct gluster_handle *parent)
+{
+        struct listing *listing = calloc (1, sizeof (*listing));
+
+        if (listing == NULL) {
+                return NULL;
+        }
+
+        listing->path = path;
+        listing->parent = gluster_handle_ref (parent);
+        listing->status = LISTING_PENDING;
+
+        return listing;
+}
+
+static void
+listing_free (struct listing *listing)
+{
+        gluster_handle_unref (listing->parent);
+        gluster_handle_unref (listing->handle);
+        arena_free (&listing->names);
+        free (listing->entries);
+        free (listing->path);
+        free (listing);
+}
+
+/**
+ * Opens a directory to be listed. A sub-directory is looked up by name in the
+ * directory it was found in, the first one by its path, following a symbolic
+ * link as glfs_opendir () would.
+ */
+static glfs_fd_t *
+open_listing (glfs_t *fs, struct listing *listing)
+{
+        const char *name;
+
+        if (listing->parent) {
+                name = strrchr (listing->path, '/') + 1;
+                listing->handle = gluster_handle_lookup (fs, listing->parent, name, NULL, false);
+
+                gluster_handle_unref (listing->parent);
+                listing->parent = NULL;
+        } else {
+                listing->handle = gluster_handle_lookup (fs, NULL, listing->path, NULL, true);
+        }
+
+        if (listing->handle == NULL) {
+                return NULL;
+        }
+
+        return gluster_handle_opendir (fs, listing->handle);
+}
+
+/**
+ * Fetches the attributes of . and .. for the -a flag.
+ */
+static void
+read_dots (glfs_t *fs, struct listing *listing, struct stat *dot, struct stat *dotdot)
+{
+        struct gluster_handle *handle;
+
+        gluster_handle_stat (fs, listing->handle, dot);
+
+        handle = gluster_handle_lookup (fs, listing->handle, "..", dotdot, false);
+        gluster_handle_unref (handle);
+}
+
+/**
+ * Adds an entry named name to the listing, with the attributes in statbuf
+ * or error if they could not be had. Returns -1 with errno set if it could not
+ * be added.
+ */
+static int
+add_entry (struct listing *listing, size_t *size, const char *name,
+           const struct stat *statbuf, int error)
+{
+        struct ls_entry *entries;
+        struct ls_entry *entry;
+
+        if (listing->num_entries == *size) {
+                *size = *size ? *size * 2 : 64;
+                entries = realloc (listing->entries, sizeof (*entries) * *size);
+                if (entries == NULL) {
+                        return -1;
+                }
+
+                listing->entries = entries;
         }
 
-        if (state->recursive) {
-                printf ("%s:\n", path);
+        entry = &listing->entries[listing->num_entries];
+        entry->name_length = strlen (name);
+        entry->name = arena_strndup (&listing->names, name, entry->name_length);
+        if (entry->name == NULL) {
+                return -1;
+        }
+
+        entry_set_stat (entry, statbuf);
+        entry->error = error;
+        listing->num_entries++;
+
+        return 0;
+}
+
+static int
+compare_timespec (struct timespec a, struct timespec b)
+{
+        if (a.tv_sec != b.tv_sec) {
+                return a.tv_sec < b.tv_sec ? -1 : 1;
+        }
+
+        return a.tv_nsec < b.tv_nsec ? -1 : a.tv_nsec > b.tv_nsec;
+}
+
+/**
+ * Orders entries as the listing prints them: by name, or largest or newest
+ * first with ties by name, and the other way round with -r. Reads the options
+ * of the thread's command, which every thread sorting a listing has.
+ */
+static int
+compare_entries (const void *a, const void *b)
+{
+        const struct ls_entry *x = a;
+        const struct ls_entry *y = b;
+        int ret = 0;
+
+        switch (state->sort) {
+                case SORT_SIZE:
+                        ret = x->size == y->size ? 0 : x->size < y->size ? 1 : -1;
+                        break;
+                case SORT_TIME:
+                        ret = -compare_timespec (x->mtime, y->mtime);
+                        break;
+                default:
+                        break;
+        }
+
+        if (ret == 0) {
+                ret = strcmp (x->name, y->name);
+        }
+
+        return state->reverse ? -ret : ret;
+}
+
+/**
+ * Reads a whole directory into memory, keeping the entries that match
+ * pattern if it is not NULL, and sorts it. Called by the prefetch threads,
+ * which never print anything: errors are recorded and reported when the
+ * listing is printed, so that the output stays in order.
+ */
+static void
+read_listing (glfs_t *fs, struct listing *listing, const char *pattern)
+{
+        glfs_fd_t *fd;
+        struct dirent *dirent;
+        struct stat statbuf;
+        struct stat dotdot;
+        size_t size = 0;
+        int error;
+
+        fd = open_listing (fs, listing);
+        if (fd == NULL) {
+                listing->error = errno;
+                return;
         }
 
         if (state->show_all) {
-                print_func (".", &stat);
+                memset (&statbuf, 0, sizeof (statbuf));
+                memset (&dotdot, 0, sizeof (dotdot));
+                read_dots (fs, listing, &statbuf, &dotdot);
 
-                full_path = append_path (path, "..");
-                glfs_lstat (fs, full_path, &statbuf);
-                print_func ("..", &statbuf);
-                free (full_path);
+                if (add_entry (listing, &size, ".", &statbuf, 0) == -1
+                                || add_entry (listing, &size, "..", &dotdot, 0) == -1) {
+                        listing->error = errno;
+                        goto out;
+                }
+
+                listing->num_dots = 2;
         }
 
-        while ((dirent = glfs_readdirplus (fd, &stat)) != NULL) {
+        memset (&statbuf, 0, sizeof (statbuf));
+        while ((dirent = read_entry (fd, &statbuf)) != NULL) {
                 if (pattern && fnmatch (pattern, dirent->d_name, 0) != 0) {
-                        continue;
+                        goto next;
                 }
 
-                if (strcmp (dirent->d_name, ".") == 0) {
-                        continue;
+                if (strcmp (dirent->d_name, ".") == 0 || strcmp (dirent->d_name, "..") == 0) {
+                        goto next;
                 }
 
-                if (strcmp (dirent->d_name, "..") == 0) {
-                        continue;
+                error = 0;
+                if (complete_stat (fs, listing->handle, dirent, &statbuf) == -1) {
+                        error = errno;
                 }
 
-                full_path = append_path (path, dirent->d_name);
-                if (glfs_lstat (fs, full_path, &statbuf) == -1) {
-                        error (0, errno, "failed to stat %s", path);
-                } else {
-                        print_func (dirent->d_name, &statbuf);
+                if (add_entry (listing, &size, dirent->d_name, &statbuf, error) == -1) {
+                        listing->error = errno;
+                        break;
                 }
 
-                free (full_path);
+next:
+                memset (&statbuf, 0, sizeof (statbuf));
         }
 
-        if (!state->recursive) {
-                goto out;
+        if (state->sort != SORT_NONE) {
+                qsort (listing->entries + listing->num_dots,
+                       listing->num_entries - listing->num_dots,
+                       sizeof (*listing->entries),
+                       compare_entries);
         }
 
-        /**
-         * In order to recurse, we need to loop over the directory entries
-         * again. To do so, close and re-open the directory to force a rewind.
-         */
-        ret = glfs_closedir (fd);
-        fd = glfs_opendir (fs, path);
+out:
+        glfs_closedir (fd);
+}
+
+/**
+ * When listing recursively, queues an entry up to be listed after the current
+ * directory if it is a directory itself.
+ */
+static int
+queue_entry (struct listing *listing, const struct ls_entry *entry,
+             struct listing ***children)
+{
+        struct listing *child;
+        char *full_path;
+
+        if (!state->recursive || !S_ISDIR (entry->mode)) {
+                return 0;
+        }
+
+        full_path = append_path (listing->path, entry->name);
+        if (full_path == NULL) {
+                error (0, errno, "append_path");
+                return -1;
+        }
+
+        child = listing_new (full_path, listing->handle);
+        if (child == NULL) {
+                error (0, errno, "%s", full_path);
+                free (full_path);
+                return -1;
+        }
+
+        **children = child;
+        *children = &child->next;
+
+        return 0;
+}
+
+/**
+ * Lists a directory in a single pass, printing entries as glfs_readdirplus ()
+ * returns them, for -U. The long format then has the columns of fixed widths
+ * it always had.
+ */
+static int
+stream_listing (struct walk *walk, struct listing *listing, const char *pattern,
+                struct listing ***children)
+{
+        static const struct ls_widths widths = {
+                .links = 0,
+                .user = 15,
+                .group = 15,
+                .size = 10,
+                .size_left = true,
+        };
+        glfs_fd_t *fd;
+        struct dirent *dirent;
+        struct stat statbuf;
+        struct stat dotdot;
+        struct ls_entry entry;
+        int ret = 0;
+
+        fd = open_listing (walk->fs, listing);
         if (fd == NULL) {
-                error (0, errno, "failed to open %s", path);
-                goto out;
+                output_flush (&walk->out);
+                error (0, errno, "%s", listing->path);
+                return -1;
         }
 
-        while ((dirent = glfs_readdirplus (fd, &stat)) != NULL) {
+        memset (&statbuf, 0, sizeof (statbuf));
+        if (state->show_all) {
+                memset (&dotdot, 0, sizeof (dotdot));
+                read_dots (walk->fs, listing, &statbuf, &dotdot);
+
+                for (int i = 0; i < 2; i++) {
+                        entry.name = i ? ".." : ".";
+                        entry.name_length = i + 1;
+                        entry_set_stat (&entry, i ? &dotdot : &statbuf);
+
+                        if (state->long_form) {
+                                output_long (walk, &entry, &widths);
+                        } else {
+                                output_short (walk, &entry);
+                        }
+                }
+
+                memset (&statbuf, 0, sizeof (statbuf));
+        }
+
+        while ((dirent = read_entry (fd, &statbuf)) != NULL) {
                 if (pattern && fnmatch (pattern, dirent->d_name, 0) != 0) {
-                        continue;
+                        goto next;
+                }
+
+                if (strcmp (dirent->d_name, ".") == 0 || strcmp (dirent->d_name, "..") == 0) {
+                        goto next;
                 }
 
-                if (strcmp (dirent->d_name, ".") == 0) {
+                if (complete_stat (walk->fs, listing->handle, dirent, &statbuf) == -1) {
+                        output_flush (&walk->out);
+                        error (0, errno, "failed to stat %s/%s", listing->path, dirent->d_name);
+                        ret = -1;
+                        goto next;
+                }
+
+                entry.name = dirent->d_name;
+                entry.name_length = strlen (dirent->d_name);
+                entry_set_stat (&entry, &statbuf);
+
+                if (state->long_form) {
+                        output_long (walk, &entry, &widths);
+                } else {
+                        output_short (walk, &entry);
+                }
+
+                if (queue_entry (listing, &entry, children) == -1) {
+                        ret = -1;
+                        break;
+                }
+
+next:
+                memset (&statbuf, 0, sizeof (statbuf));
+        }
+
+        glfs_closedir (fd);
+
+        return ret;
+}
+
+/**
+ * Prints a directory that has already been read into memory: the long format
+ * with its columns as wide as the widest entry needs, the short one in
+ * columns on a terminal or on a single line otherwise.
+ */
+static int
+print_listing (struct walk *walk, struct listing *listing, struct listing ***children)
+{
+        struct ls_widths widths = { 0 };
+        struct ls_entry **shown = NULL;
+        struct ls_entry *entry;
+        size_t num_shown = 0;
+        int ret = 0;
+
+        if (listing->error && listing->num_entries == 0) {
+                output_flush (&walk->out);
+                error (0, listing->error, "%s", listing->path);
+                return -1;
+        }
+
+        if (state->long_form) {
+                for (size_t i = 0; i < listing->num_entries; i++) {
+                        if (listing->entries[i].error == 0) {
+                                fit_long (walk, &listing->entries[i], &widths);
+                        }
+                }
+        } else if (walk->width) {
+                shown = malloc (sizeof (*shown) * (listing->num_entries ? listing->num_entries : 1));
+                if (shown == NULL) {
+                        error (0, errno, "%s", listing->path);
+                        return -1;
+                }
+        }
+
+        for (size_t i = 0; i < listing->num_entries; i++) {
+                entry = &listing->entries[i];
+                if (entry->error) {
+                        output_flush (&walk->out);
+                        error (0, entry->error, "failed to stat %s/%s", listing->path, entry->name);
+                        ret = -1;
                         continue;
                 }
 
-                if (strcmp (dirent->d_name, "..") == 0) {
+                if (state->long_form) {
+                        output_long (walk, entry, &widths);
+                } else if (shown) {
+                        shown[num_shown++] = entry;
+                } else {
+                        output_short (walk, entry);
+                }
+
+                if (i >= listing->num_dots && queue_entry (listing, entry, children) == -1) {
+                        ret = -1;
+                        break;
+                }
+        }
+
+        if (shown) {
+                output_columns (walk, shown, num_shown);
+                free (shown);
+        }
+
+        if (listing->error) {
+                output_flush (&walk->out);
+                error (0, listing->error, "%s", listing->path);
+                ret = -1;
+        }
+
+        return ret;
+}
+
+/**
+ * Prefetch thread: reads the first pending directory among the next
+ * walk->window directories to be listed.
+ */
+static void *
+prefetch_worker (void *data)
+{
+        struct walk *walk = data;
+        struct listing *listing;
+        unsigned int depth;
+
+        stats_attach (walk->stats);
+        state = walk->state;
+
+        pthread_mutex_lock (&walk->lock);
+
+        while (!walk->done) {
+                for (listing = walk->stack, depth = 0;
+                     listing && depth < walk->window;
+                     listing = listing->next, depth++) {
+                        if (listing->status == LISTING_PENDING) {
+                                break;
+                        }
+                }
+
+                if (listing == NULL || depth == walk->window) {
+                        pthread_cond_wait (&walk->cond, &walk->lock);
                         continue;
                 }
 
-                if (dirent->d_type == DT_DIR) {
-                        full_path = append_path (path, dirent->d_name);
-                        if (full_path == NULL) {
-                                goto out;
+                listing->status = LISTING_READING;
+                pthread_mutex_unlock (&walk->lock);
+
+                read_listing (walk->fs, listing, NULL);
+
+                pthread_mutex_lock (&walk->lock);
+                listing->status = LISTING_READY;
+                pthread_cond_broadcast (&walk->cond);
+        }
+
+        pthread_mutex_unlock (&walk->lock);
+
+        return NULL;
+}
+
+/**
+ * Returns the width to lay short listings out in columns for: that of the
+ * terminal on standard output, or 0 if it is not one.
+ */
+static size_t
+terminal_width ()
+{
+        struct winsize ws;
+        char *columns;
+        long width;
+
+        if (!isatty (STDOUT_FILENO)) {
+                return 0;
+        }
+
+        if (ioctl (STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+                return ws.ws_col;
+        }
+
+        columns = getenv ("COLUMNS");
+        if (columns && (width = strtol (columns, NULL, 10)) > 0) {
+                return width;
+        }
+
+        return DEFAULT_TERMINAL_WIDTH;
+}
+
+/**
+ * Lists the directory at path, printing each entry matching pattern. With -R,
+ * subdirectories are then listed depth first without recursion: each
+ * directory is read once, and its subdirectories are pushed onto an explicit
+ * stack ahead of the directories still pending.
+ *
+ * Each directory is read whole and sorted before it is printed, unless -U
+ * asks for it to be printed as it is read. Output is gathered in a buffer and
+ * written out in large blocks.
+ *
+ * If jobs is greater than one, up to jobs - 1 threads read the directories at
+ * the top of the stack ahead of time while the calling thread prints, so the
+ * output comes out in the same order as a serial listing.
+ */
+static int
+ls_dir (glfs_t *fs, const char *path, const char *pattern, unsigned int jobs)
+{
+        struct walk walk = {
+                .fs = fs,
+                .state = state,
+                .stats = stats_current (),
+                .stack = NULL,
+                .window = jobs > 1 ? jobs - 1 : 0,
+                .width = state->long_form ? 0 : terminal_width (),
+                .done = false,
+        };
+        struct listing *listing;
+        struct listing *children;
+        struct listing **tail;
+        pthread_t *threads = NULL;
+        unsigned int num_threads = 0;
+        char *root_path;
+        bool first = true;
+        int ret = 0;
+
+        walk.out.buf = malloc (OUTPUT_BUFFER_SIZE);
+        if (walk.out.buf == NULL) {
+                error (0, errno, "malloc");
+                return -1;
+        }
+
+        root_path = strdup (path);
+        if (root_path == NULL) {
+                error (0, errno, "strdup");
+                free (walk.out.buf);
+                return -1;
+        }
+
+        walk.stack = listing_new (root_path, NULL);
+        if (walk.stack == NULL) {
+                error (0, errno, "%s", path);
+                free (root_path);
+                free (walk.out.buf);
+                return -1;
+        }
+
+        pthread_mutex_init (&walk.lock, NULL);
+        pthread_cond_init (&walk.cond, NULL);
+
+        // Without any threads, the listing is simply done serially.
+        if (state->recursive && walk.window > 0) {
+                threads = malloc (sizeof (*threads) * walk.window);
+        }
+
+        while (true) {
+                pthread_mutex_lock (&walk.lock);
+                listing = walk.stack;
+                if (listing == NULL) {
+                        pthread_mutex_unlock (&walk.lock);
+                        break;
+                }
+
+                walk.stack = listing->next;
+                listing->next = NULL;
+
+                // Wait for a prefetch thread that is already reading it.
+                while (listing->status == LISTING_READING) {
+                        pthread_cond_wait (&walk.cond, &walk.lock);
+                }
+
+                pthread_mutex_unlock (&walk.lock);
+
+                if (state->recursive) {
+                        if (!first) {
+                                output_string (&walk.out, state->long_form ? "\n" : "\n\n");
                         }
 
-                        if (state->long_form) {
-                                printf ("\n");
-                        } else {
-                                printf ("\n\n");
+                        output_string (&walk.out, listing->path);
+                        output_append (&walk.out, ":\n", 2);
+                }
+
+                children = NULL;
+                tail = &children;
+
+                if (listing->status == LISTING_READY) {
+                        ret |= print_listing (&walk, listing, &tail);
+                } else if (state->sort == SORT_NONE) {
+                        ret |= stream_listing (&walk, listing, first ? pattern : NULL, &tail);
+                } else {
+                        read_listing (fs, listing, first ? pattern : NULL);
+                        ret |= print_listing (&walk, listing, &tail);
+                }
+
+                listing_free (listing);
+
+                // Only start reading ahead once there is something to read.
+                if (first && threads) {
+                        for (; num_threads < walk.window; num_threads++) {
+                                if (pthread_create (&threads[num_threads], NULL, prefetch_worker, &walk) != 0) {
+                                        break;
+                                }
                         }
+                }
+
+                first = false;
 
-                        ls_dir (fs, full_path, "*", print_func);
-                        free (full_path);
+                if (children) {
+                        pthread_mutex_lock (&walk.lock);
+                        *tail = walk.stack;
+                        walk.stack = children;
+                        pthread_cond_broadcast (&walk.cond);
+                        pthread_mutex_unlock (&walk.lock);
                 }
         }
 
-out:
-        if (fd) {
-                ret = glfs_closedir (fd);
+        pthread_mutex_lock (&walk.lock);
+        walk.done = true;
+        pthread_cond_broadcast (&walk.cond);
+        pthread_mutex_unlock (&walk.lock);
+
+        for (unsigned int i = 0; i < num_threads; i++) {
+                pthread_join (threads[i], NULL);
         }
 
-        return ret;
+        if (!state->long_form) {
+                output_append (&walk.out, "\n", 1);
+        }
+
+        output_flush (&walk.out);
+        if (walk.out.error) {
+                error (0, walk.out.error, "write error");
+                ret = -1;
+        }
+
+        pthread_cond_destroy (&walk.cond);
+        pthread_mutex_destroy (&walk.lock);
+        arena_free (&walk.users.arena);
+        arena_free (&walk.groups.arena);
+        free (walk.users.buf);
+        free (walk.groups.buf);
+        free (walk.out.buf);
+        free (threads);
+
+        return ret ? -1 : 0;
 }
 
 static int
@@ -432,7 +1583,7 @@ ls (glfs_t *fs, char *path)
 {
         char *pattern = NULL;
         char *real_path = NULL;
-        int ret;
+        int ret = -1;
         struct stat statbuf;
 
         /**
@@ -457,7 +1608,8 @@ ls (glfs_t *fs, char *path)
 
         pattern = basename (path);
         if (pattern && strchr (pattern, '*') == NULL) {
-                if (glfs_stat (fs, path, &statbuf)) {
+                ret = gluster_stat (fs, path, &statbuf);
+                if (ret) {
                         error (0, errno, "failed to access %s", state->url);
                         goto out;
                 }
@@ -469,14 +1621,7 @@ ls (glfs_t *fs, char *path)
         }
 
 
-        if (state->long_form) {
-                ls_dir (fs, real_path, pattern, print_long);
-        } else {
-                ls_dir (fs, real_path, pattern, print_short);
-                printf ("\n");
-        }
-
-        ret =  0;
+        ret = ls_dir (fs, real_path, pattern, state->jobs);
 
 out:
         free (real_path);
@@ -485,12 +1630,12 @@ out:
 }
 
 static int
-ls_without_context ()
+ls_without_context (struct fs_cache *fs_cache)
 {
         glfs_t *fs = NULL;
         int ret;
 
-        ret = gluster_getfs (&fs, state->gluster_url);
+        ret = gluster_getfs_cached (&fs, fs_cache, state->gluster_url, NULL);
         if (ret == -1) {
                 error (0, errno, "failed to access %s", state->url);
                 goto out;
@@ -508,9 +1653,7 @@ ls_without_context ()
         ret = ls (fs, state->gluster_url->path);
 
 out:
-        if (fs) {
-                glfs_fini (fs);
-        }
+        gluster_putfs (fs_cache, fs);
 
         return ret;
 }
@@ -537,6 +1680,12 @@ do_ls (struct cli_context *ctx)
                         goto out;
                 }
 
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
                 ret = ls (ctx->fs, state->url);
         } else {
                 ret = parse_options (argc, argv, false);
@@ -548,10 +1697,18 @@ do_ls (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = ls_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = ls_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
                 gluster_url_free (state->gluster_url);
                 free (state->url);
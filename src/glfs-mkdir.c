@@ -1,5 +1,5 @@
 /**
- * A utility to create a directory on a remote Gluster volume, with the ability
+ * A utility to create directories on a remote Gluster volume, with the ability
  * to optionally create nested directories as required.
  *
  * Copyright (C) 2015 Facebook Inc.
@@ -21,13 +21,16 @@
 
 #include <config.h>
 
+#include "glfs-handle.h"
 #include "glfs-mkdir.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <glusterfs/api/glfs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -36,31 +39,52 @@
 #include <sys/stat.h>
 
 #define AUTHORS "Written by Craig Cabrey."
+#define DEFAULT_MKDIR_JOBS 8
+
+// Index of the parent of the directories directly below the root.
+#define MKDIR_ROOT SIZE_MAX
+
+/**
+ * A directory supplied by the user.
+ *
+ * gluster_url: The parsed URL, or just the path with a connection.
+ * url: The path as supplied, for messages.
+ */
+struct mkdir_path {
+        struct gluster_url *gluster_url;
+        char *url;
+};
 
 /**
  * Used to store the state of the program, including user supplied options.
  *
- * gluster_url: Struct of the parsed url supplied by the user.
- * url: Full url used to find the remote file (supplied by user).
+ * paths: The directories to create.
+ * num_paths: Number of entries in paths.
+ * jobs: Number of directories created concurrently.
  * debug: Whether to log additional debug information.
  * parents: Whether all parent directories in the path are created.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
-        struct gluster_url *gluster_url;
         struct xlator_option *xlator_options;
-        char *url;
+        struct mkdir_path *paths;
+        int num_paths;
+        unsigned int jobs;
         bool debug;
         bool parents;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
         {"parents", no_argument, NULL, 'r'},
         {"port", required_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'S'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -69,13 +93,18 @@ static struct option const long_options[] =
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n\n"
+        printf ("Usage: %s [OPTION]... URL...\n\n"
+                "  -j, --jobs=N                 create up to N directories concurrently\n"
+                "                               (default %d)\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the \n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
                 "  -r, --parents                no error if existing, make parent\n"
                 "                               directories as needed\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
@@ -85,11 +114,15 @@ usage ()
                 "  gfmkdir -r glfs://localhost/groot/directory/subdirectory\n"
                 "          Recursively create the directory /directory/subdirectory\n"
                 "          on the Gluster volume of groot host localhost.\n"
+                "  gfmkdir -r glfs://localhost/groot/logs/2015/{01..12}/{01..31}\n"
+                "          Create a directory for every day of 2015 below /logs, each\n"
+                "          level of the tree being created in parallel.\n"
                 "  gfcli (localhost/groot)> mkdir /directory\n"
                 "          In the context of a shell with a connection established,\n"
                 "          create a directory on the root of the Gluster volume groot\n"
                 "          on localhost.\n",
-                program_invocation_name);
+                program_invocation_name,
+                DEFAULT_MKDIR_JOBS);
 }
 
 static int
@@ -100,11 +133,14 @@ parse_options (int argc, char *argv[], bool has_connection)
         int opt = 0;
         int option_index = 0;
         struct xlator_option *option;
+        struct mkdir_path *path;
+
+        lock_getopt ();
 
         // Reset getopt since other utilities may have called it already.
         optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "do:p:rvx", long_options,
+                opt = getopt_long (argc, argv, "dj:o:p:rvx", long_options,
                                    &option_index);
 
                 if (opt == -1) {
@@ -114,6 +150,13 @@ parse_options (int argc, char *argv[], bool has_connection)
                 switch (opt) {
                         case 'd':
                                 state->debug = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'o':
                                 option = parse_xlator_option (optarg);
@@ -137,6 +180,13 @@ parse_options (int argc, char *argv[], bool has_connection)
                                 break;
                         case 'r':
                                 state->parents = true;
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -157,56 +207,59 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
-        } else {
-                state->url = strdup (argv[argc - 1]);
-                if (state->url == NULL) {
+        }
+
+        // state->paths is free'd in do_mkdir()
+        state->paths = calloc (argc - optind, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
                         error (0, errno, "strdup");
                         goto out;
                 }
 
                 if (has_connection) {
-                        state->gluster_url = gluster_url_init ();
-                        if (state->gluster_url == NULL) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
                                 error (0, errno, "gluster_url_init");
                                 goto out;
                         }
 
-                        state->gluster_url->path = strdup (argv[argc - 1]);
-                        if (state->gluster_url->path == NULL) {
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
                                 error (0, errno, "strdup");
                                 goto out;
                         }
 
-                        ret = 0;
-                        goto out;
+                        continue;
                 }
 
-                ret = gluster_parse_url (argv[argc - 1], &(state->gluster_url));
-                if (ret == -1) {
-                        error (0, EINVAL, "%s", state->url);
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
                         goto err;
                 }
 
-                state->gluster_url->port = port;
-
-                // gluster_create_path will not create
-                // the last directory in a path if that path does not
-                // include a trailing slash ('/'), so add one if it does not
-                // exist.
-                char *path = state->gluster_url->path;
-                if (path[strlen (path) - 1] != '/') {
-                        strncat (path, "/", strlen (path) + 2);
-                }
+                path->gluster_url->port = port;
         }
 
+        ret = 0;
         goto out;
 
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -220,68 +273,495 @@ init_state ()
         }
 
         state->debug = false;
-        state->gluster_url = NULL;
+        state->jobs = DEFAULT_MKDIR_JOBS;
+        state->num_paths = 0;
         state->parents = false;
-        state->url = NULL;
+        state->paths = NULL;
+        state->stats = STATS_OFF;
         state->xlator_options = NULL;
 
 out:
         return state;
 }
 
+/**
+ * A directory to create, or one that must exist for another to be created.
+ *
+ * path: Canonical path of the directory.
+ * parent: Index of the parent directory in the tree, or MKDIR_ROOT.
+ * depth: Number of components in path.
+ * requested: Whether the directory was supplied by the user, as opposed to
+ *            only leading to one that was.
+ * handle: The directory once created or found, or NULL.
+ * error: errno of the failure to create or find it, or 0.
+ * cached: Whether handle came from the directory cache.
+ */
+struct mkdir_dir {
+        char *path;
+        size_t parent;
+        size_t depth;
+        bool requested;
+        struct gluster_handle *handle;
+        int error;
+        bool cached;
+};
+
+/**
+ * The directories leading up to and including those supplied for a volume,
+ * each once, sorted by depth so that each level can be created in parallel
+ * once the one above it is done. Workers claim the directories of the level
+ * being created by taking the next index.
+ *
+ * parents: Whether missing parents are created, from state, which the
+ *          workers cannot see.
+ * stats: Statistics of the command, for the workers to attach to.
+ */
+struct mkdir_tree {
+        glfs_t *fs;
+        struct gluster_handle *root;
+        struct mkdir_dir *dirs;
+        size_t num_dirs;
+        size_t size;
+        size_t next;
+        size_t level_end;
+        mode_t mode;
+        bool parents;
+        struct stats *stats;
+};
+
 static int
-mkdir_with_fs (glfs_t *fs)
+mkdir_dir_compare (const void *a, const void *b)
 {
-        int ret;
-        mode_t mode = get_default_dir_mode_perm ();
+        const struct mkdir_dir *x = a;
+        const struct mkdir_dir *y = b;
 
-        if (state->parents) {
-                ret = gluster_create_path (fs, state->gluster_url->path, mode);
-        } else {
-                ret = glfs_mkdir (fs, state->gluster_url->path, mode);
+        if (x->depth != y->depth) {
+                return x->depth < y->depth ? -1 : 1;
         }
 
-        if (ret == -1) {
-                error (0, errno, "cannot create directory `%s'", state->url);
-                goto out;
+        return strcmp (x->path, y->path);
+}
+
+/**
+ * Returns the index of the directory at the first length bytes of path, which
+ * has the given depth, or MKDIR_ROOT if it is not in the tree.
+ */
+static size_t
+mkdir_tree_find (struct mkdir_tree *tree, char *path, size_t length, size_t depth)
+{
+        struct mkdir_dir key = { .path = path, .depth = depth };
+        struct mkdir_dir *dir;
+        char saved = path[length];
+
+        path[length] = '\0';
+        dir = bsearch (&key, tree->dirs, tree->num_dirs, sizeof (*tree->dirs), mkdir_dir_compare);
+        path[length] = saved;
+
+        return dir ? (size_t) (dir - tree->dirs) : MKDIR_ROOT;
+}
+
+/**
+ * Adds the directory at the first length bytes of path, which has the given
+ * depth. Returns -1 with errno set on failure.
+ */
+static int
+mkdir_tree_add (struct mkdir_tree *tree, const char *path, size_t length, size_t depth,
+                bool requested)
+{
+        struct mkdir_dir *dirs;
+        struct mkdir_dir *dir;
+
+        if (tree->num_dirs == tree->size) {
+                tree->size = tree->size ? tree->size * 2 : 64;
+                dirs = realloc (tree->dirs, tree->size * sizeof (*dirs));
+                if (dirs == NULL) {
+                        return -1;
+                }
+
+                tree->dirs = dirs;
+        }
+
+        dir = &tree->dirs[tree->num_dirs];
+        dir->path = strndup (path, length);
+        if (dir->path == NULL) {
+                return -1;
+        }
+
+        dir->parent = MKDIR_ROOT;
+        dir->depth = depth;
+        dir->requested = requested;
+        dir->handle = NULL;
+        dir->error = 0;
+        dir->cached = false;
+        tree->num_dirs++;
+
+        return 0;
+}
+
+/**
+ * Adds each canonical path of paths along with the directories leading up to
+ * it, then sorts them and merges those given more than once. Returns -1 with
+ * errno set on failure.
+ */
+static int
+mkdir_tree_build (struct mkdir_tree *tree, char **paths, int count)
+{
+        struct mkdir_dir *dir;
+        size_t depth;
+        size_t kept = 0;
+        const char *end;
+
+        for (int i = 0; i < count; i++) {
+                // The root has no parent to create it in.
+                if (paths[i][1] == '\0') {
+                        continue;
+                }
+
+                depth = 0;
+                end = paths[i];
+                do {
+                        end = strchrnul (end + 1, '/');
+                        depth++;
+                        if (mkdir_tree_add (tree, paths[i], end - paths[i], depth, *end == '\0') == -1) {
+                                return -1;
+                        }
+                } while (*end);
+        }
+
+        if (tree->num_dirs == 0) {
+                return 0;
+        }
+
+        qsort (tree->dirs, tree->num_dirs, sizeof (*tree->dirs), mkdir_dir_compare);
+
+        for (size_t i = 1; i < tree->num_dirs; i++) {
+                dir = &tree->dirs[kept];
+                if (mkdir_dir_compare (dir, &tree->dirs[i]) == 0) {
+                        dir->requested |= tree->dirs[i].requested;
+                        free (tree->dirs[i].path);
+                        continue;
+                }
+
+                tree->dirs[++kept] = tree->dirs[i];
+        }
+
+        tree->num_dirs = kept + 1;
+
+        for (size_t i = 0; i < tree->num_dirs; i++) {
+                dir = &tree->dirs[i];
+                if (dir->depth > 1) {
+                        dir->parent = mkdir_tree_find (tree, dir->path,
+                                                      strrchr (dir->path, '/') - dir->path,
+                                                      dir->depth - 1);
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * Creates or finds a directory once its parent has been. A supplied directory
+ * is created; without --parents it must not exist yet, and those leading up
+ * to it must. Directories known to exist from the directory cache are not
+ * looked at again when they only lead up to a supplied one: creating those
+ * below them finds out if they have since gone, and the tree is retried
+ * without the cache. A supplied directory is always asked of the volume, as
+ * nothing else would notice that another client removed it.
+ */
+static void
+mkdir_dir_create (struct mkdir_tree *tree, struct mkdir_dir *dir)
+{
+        struct gluster_handle *parent = tree->root;
+        const char *name = strrchr (dir->path, '/') + 1;
+        struct stat statbuf;
+        bool exists = false;
+
+        // Done already, before a retry.
+        if (dir->handle || dir->error) {
+                return;
+        }
+
+        if (dir->parent != MKDIR_ROOT) {
+                parent = tree->dirs[dir->parent].handle;
+                if (parent == NULL) {
+                        dir->error = tree->dirs[dir->parent].error;
+                        if (dir->error == EEXIST) {
+                                dir->error = ENOTDIR;
+                        }
+
+                        return;
+                }
+        }
+
+        if (!dir->requested) {
+                dir->handle = gluster_dir_cache_get (tree->fs, dir->path);
+                if (dir->handle) {
+                        dir->cached = true;
+                        return;
+                }
+        }
+
+        if (tree->parents || dir->requested) {
+                dir->handle = gluster_handle_mkdir (tree->fs, parent, name, tree->mode, NULL);
+                if (dir->handle) {
+                        goto out;
+                }
+
+                if (errno != EEXIST && errno != EISDIR) {
+                        dir->error = errno;
+                        return;
+                }
+
+                exists = true;
+        }
+
+        // Look the directory up for those below it, even if it was to be new.
+        dir->handle = gluster_handle_lookup (tree->fs, parent, name, &statbuf, true);
+        if (dir->handle == NULL) {
+                dir->error = errno;
+                return;
+        }
+
+        if (!S_ISDIR (statbuf.st_mode)) {
+                gluster_handle_unref (dir->handle);
+                dir->handle = NULL;
+                dir->error = dir->requested ? EEXIST : ENOTDIR;
+                return;
+        }
+
+        if (exists && dir->requested && !tree->parents) {
+                dir->error = EEXIST;
         }
 
 out:
-        return ret;
+        gluster_dir_cache_put (tree->fs, dir->path, dir->handle);
+}
+
+static void *
+mkdir_worker (void *arg)
+{
+        struct mkdir_tree *tree = arg;
+        size_t i;
+
+        stats_attach (tree->stats);
+
+        while ((i = __atomic_fetch_add (&tree->next, 1, __ATOMIC_RELAXED)) < tree->level_end) {
+                mkdir_dir_create (tree, &tree->dirs[i]);
+        }
+
+        return NULL;
+}
+
+/**
+ * Creates the directories of the tree level by level, each level with up to
+ * jobs threads, the calling one included.
+ */
+static void
+mkdir_tree_create (struct mkdir_tree *tree, unsigned int jobs)
+{
+        pthread_t *workers;
+        unsigned int num_workers;
+        size_t end;
+
+        workers = malloc (sizeof (*workers) * jobs);
+
+        for (size_t begin = 0; begin < tree->num_dirs; begin = end) {
+                for (end = begin; end < tree->num_dirs && tree->dirs[end].depth == tree->dirs[begin].depth; end++);
+
+                tree->next = begin;
+                tree->level_end = end;
+
+                num_workers = 0;
+                while (workers && num_workers + 1 < jobs && num_workers + 1 < end - begin) {
+                        if (pthread_create (&workers[num_workers], NULL, mkdir_worker, tree) != 0) {
+                                break;
+                        }
+
+                        num_workers++;
+                }
+
+                mkdir_worker (tree);
+
+                for (unsigned int i = 0; i < num_workers; i++) {
+                        pthread_join (workers[i], NULL);
+                }
+        }
+
+        free (workers);
+}
+
+/**
+ * Prepares the tree to be created again should a directory have been missing
+ * where the directory cache had one, which happens when some other client
+ * removed it: those directories found in the cache and those that could not
+ * be found are looked at anew. Returns whether there is anything to retry.
+ */
+static bool
+mkdir_tree_reset_stale (struct mkdir_tree *tree)
+{
+        bool cached = false;
+        bool missing = false;
+        struct mkdir_dir *dir;
+
+        for (size_t i = 0; i < tree->num_dirs; i++) {
+                cached |= tree->dirs[i].cached;
+                missing |= tree->dirs[i].error == ENOENT || tree->dirs[i].error == ESTALE;
+        }
+
+        if (!cached || !missing) {
+                return false;
+        }
+
+        for (size_t i = 0; i < tree->num_dirs; i++) {
+                dir = &tree->dirs[i];
+                if (dir->cached || dir->error == ENOENT || dir->error == ESTALE) {
+                        gluster_handle_unref (dir->handle);
+                        dir->handle = NULL;
+                        dir->error = 0;
+                        dir->cached = false;
+                }
+        }
+
+        return true;
+}
+
+static void
+mkdir_tree_free (struct mkdir_tree *tree)
+{
+        for (size_t i = 0; i < tree->num_dirs; i++) {
+                gluster_handle_unref (tree->dirs[i].handle);
+                free (tree->dirs[i].path);
+        }
+
+        free (tree->dirs);
+        gluster_handle_unref (tree->root);
 }
 
+/**
+ * Returns errno of the failure to create the directory at the canonical path,
+ * or 0 if it was created.
+ */
 static int
-mkdir_without_context ()
+mkdir_tree_error (struct mkdir_tree *tree, char *path)
 {
-        glfs_t *fs = NULL;
-        int ret = -1;
+        size_t depth = 0;
 
-        ret = gluster_getfs (&fs, state->gluster_url);
-        if (ret == -1) {
-                error (0, errno, "cannot create directory `%s'", state->url);
-                goto out;
+        // The root always exists.
+        if (path[1] == '\0') {
+                return tree->parents ? 0 : EEXIST;
         }
 
-        ret = apply_xlator_options (fs, &state->xlator_options);
-        if (ret == -1) {
-                error (0, errno, "failed to apply translator options");
-                goto out;
+        for (const char *c = path; *c; c++) {
+                depth += *c == '/';
         }
 
-        if (state->debug) {
-                ret = glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG);
+        return tree->dirs[mkdir_tree_find (tree, path, strlen (path), depth)].error;
+}
 
-                if (ret == -1) {
-                        error (0, errno, "failed to set logging level");
+/**
+ * Creates count of the paths given, which are on the volume of fs, reporting
+ * those that could not be in the order they were given.
+ */
+static int
+mkdir_with_fs (glfs_t *fs, struct mkdir_path *paths, int count)
+{
+        struct mkdir_tree tree = {
+                .fs = fs,
+                .mode = get_default_dir_mode_perm (),
+                .parents = state->parents,
+                .stats = stats_current (),
+        };
+        char **canonical;
+        int error_number;
+        int failure = 0;
+        int ret = 0;
+
+        canonical = calloc (count, sizeof (*canonical));
+        if (canonical == NULL) {
+                failure = errno;
+                goto out;
+        }
+
+        for (int i = 0; i < count; i++) {
+                canonical[i] = canonical_path (paths[i].gluster_url->path);
+                if (canonical[i] == NULL) {
+                        failure = errno;
                         goto out;
                 }
         }
 
-        ret = mkdir_with_fs (fs);
+        if (mkdir_tree_build (&tree, canonical, count) == -1) {
+                failure = errno;
+                goto out;
+        }
+
+        tree.root = gluster_handle_lookup (fs, NULL, "/", NULL, true);
+        if (tree.root == NULL) {
+                failure = errno;
+                goto out;
+        }
+
+        mkdir_tree_create (&tree, state->jobs);
+        if (mkdir_tree_reset_stale (&tree)) {
+                gluster_dir_cache_drop (fs);
+                mkdir_tree_create (&tree, state->jobs);
+        }
 
 out:
-        if (fs) {
-                glfs_fini (fs);
+        for (int i = 0; i < count; i++) {
+                error_number = failure ? failure : mkdir_tree_error (&tree, canonical[i]);
+                if (error_number) {
+                        error (0, error_number, "cannot create directory `%s'", paths[i].url);
+                        ret = -1;
+                }
+        }
+
+        for (int i = 0; canonical && i < count; i++) {
+                free (canonical[i]);
+        }
+
+        free (canonical);
+        mkdir_tree_free (&tree);
+
+        return ret;
+}
+
+static int
+mkdir_without_context (struct fs_cache *fs_cache)
+{
+        struct mkdir_path *paths = state->paths;
+        glfs_t *fs;
+        int next;
+        int ret = 0;
+
+        for (int i = 0; i < state->num_paths; i = next) {
+                next = i + 1;
+
+                fs = NULL;
+                if (gluster_getfs_cached (&fs, fs_cache, paths[i].gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "cannot create directory `%s'", paths[i].url);
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
+                }
+
+                if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
+                        error (0, errno, "failed to set logging level");
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
+                }
+
+                // Later paths on the same volume share the connection.
+                while (next < state->num_paths && gluster_same_volume (paths[i].gluster_url, paths[next].gluster_url)) {
+                        next++;
+                }
+
+                if (mkdir_with_fs (fs, &paths[i], next - i) == -1) {
+                        ret = -1;
+                }
+
+                gluster_putfs (fs_cache, fs);
         }
 
         return ret;
@@ -308,7 +788,13 @@ do_mkdir (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = mkdir_with_fs (ctx->fs);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = mkdir_with_fs (ctx->fs, state->paths, state->num_paths);
         } else {
                 ret = parse_options (argc, argv, false);
                 switch (ret) {
@@ -319,13 +805,25 @@ do_mkdir (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = mkdir_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = mkdir_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
-                gluster_url_free (state->gluster_url);
-                free (state->url);
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
         }
 
         free (state);
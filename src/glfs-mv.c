@@ -0,0 +1,649 @@
+/**
+ * A utility to move (rename) files and directories on remote Gluster volumes,
+ * within a volume or from one volume to another.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-mv.h"
+#include "glfs-attr-cache.h"
+#include "glfs-copy-util.h"
+#include "glfs-handle.h"
+#include "glfs-rm.h"
+#include "glfs-stats.h"
+#include "glfs-util.h"
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glusterfs/api/glfs.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define AUTHORS "Written by Craig Cabrey."
+
+/**
+ * A path supplied by the user.
+ *
+ * gluster_url: The parsed URL, or just the path on the established
+ *              connection.
+ * url: The path as supplied, for messages.
+ * established: Whether the path is on the volume the shell is connected to.
+ */
+struct mv_path {
+        struct gluster_url *gluster_url;
+        char *url;
+        bool established;
+};
+
+/**
+ * Used to store the state of the program, including user supplied options.
+ *
+ * paths: The sources followed by the destination (supplied by user).
+ * num_paths: Number of entries in paths.
+ * jobs: Number of files copied concurrently when moving to another volume.
+ * debug: Whether to log additional debug information.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
+ */
+struct state {
+        struct xlator_option *xlator_options;
+        struct mv_path *paths;
+        int num_paths;
+        unsigned int jobs;
+        bool debug;
+        enum stats_format stats;
+};
+
+static __thread struct state *state;
+
+static struct option const long_options[] =
+{
+        {"debug", no_argument, NULL, 'd'},
+        {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"port", required_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"version", no_argument, NULL, 'v'},
+        {"xlator-option", required_argument, NULL, 'o'},
+        {NULL, no_argument, NULL, 0}
+};
+
+static void
+usage ()
+{
+        printf ("Usage: %s [OPTION]... SOURCE DEST\n"
+                "  or:  %s [OPTION]... SOURCE... DIRECTORY\n"
+                "Rename SOURCE to DEST, or move SOURCE(s) to DIRECTORY, on remote Gluster\n"
+                "volumes. A move within a volume is a rename; a move to another volume\n"
+                "copies each file and removes it once the copy is verified.\n\n"
+                "  -j, --jobs=N                 when moving to another volume, copy up to N\n"
+                "                               files concurrently (default %d)\n"
+                "  -o, --xlator-option=OPTION   specify a translator option for the\n"
+                "                               connection. Multiple options are supported\n"
+                "                               and take the form xlator.key=value.\n"
+                "  -p, --port=PORT              specify the port on which to connect\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
+                "      --help     display this help and exit\n"
+                "      --version  output version information and exit\n\n"
+                "Examples:\n"
+                "  gfmv glfs://localhost/groot/file glfs://localhost/groot/other\n"
+                "       Rename the file /file on the Gluster volume of groot on\n"
+                "       host localhost to /other.\n"
+                "  gfmv -j 16 glfs://localhost/groot/dir glfs://remote/archive/\n"
+                "       Move the directory /dir on the Gluster volume of groot\n"
+                "       on host localhost into the root of the volume archive\n"
+                "       on host remote, 16 files at a time.\n"
+                "  gfcli (localhost/groot)> mv /file /dir\n"
+                "       In the context of a shell with a connection established,\n"
+                "       move the file /file into the directory /dir on the Gluster\n"
+                "       volume groot on localhost.\n",
+                program_invocation_name,
+                program_invocation_name,
+                DEFAULT_TREE_JOBS);
+}
+
+static int
+parse_options (int argc, char *argv[], bool has_connection)
+{
+        uint16_t port = GLUSTER_DEFAULT_PORT;
+        int ret = -1;
+        int opt = 0;
+        int option_index = 0;
+        struct xlator_option *option;
+        struct mv_path *path;
+
+        lock_getopt ();
+
+        // Reset getopt since other utilities may have called it already.
+        optind = 0;
+        while (true) {
+                opt = getopt_long (argc, argv, "j:o:p:", long_options,
+                                   &option_index);
+
+                if (opt == -1) {
+                        break;
+                }
+
+                switch (opt) {
+                        case 'd':
+                                state->debug = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'o':
+                                option = parse_xlator_option (optarg);
+                                if (option == NULL) {
+                                        error (0, errno, "%s", optarg);
+                                        goto err;
+                                }
+
+                                if (append_xlator_option (&state->xlator_options, option) == -1) {
+                                        error (0, errno, "append_xlator_option: %s", optarg);
+                                        goto err;
+                                }
+
+                                break;
+                        case 'p':
+                                port = strtoport (optarg);
+                                if (port == 0) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'v':
+                                printf ("%s (%s) %s\n%s\n%s\n%s\n",
+                                        program_invocation_name,
+                                        PACKAGE_NAME,
+                                        PACKAGE_VERSION,
+                                        COPYRIGHT,
+                                        LICENSE,
+                                        AUTHORS);
+                                ret = -2;
+                                goto out;
+                        case 'x':
+                                usage ();
+                                ret = -2;
+                                goto out;
+                        default:
+                                goto err;
+                }
+        }
+
+        if ((argc - optind) < 1) {
+                error (0, 0, "missing file operand");
+                goto err;
+        }
+
+        if ((argc - optind) < 2) {
+                error (0, 0, "missing destination file operand after `%s'", argv[optind]);
+                goto err;
+        }
+
+        // state->paths is free'd in do_mv()
+        state->paths = calloc (argc - optind, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
+                        error (0, errno, "strdup");
+                        goto out;
+                }
+
+                // In the shell, anything but a URL is on the volume it is
+                // connected to.
+                if (has_connection && strncmp (argv[optind], "glfs://", 7) != 0) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
+                                error (0, errno, "gluster_url_init");
+                                goto out;
+                        }
+
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
+                                error (0, errno, "strdup");
+                                goto out;
+                        }
+
+                        path->established = true;
+                        continue;
+                }
+
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
+                        goto err;
+                }
+
+                path->gluster_url->port = port;
+        }
+
+        ret = 0;
+        goto out;
+
+err:
+        error (0, 0, "Try --help for more information.");
+out:
+        unlock_getopt ();
+
+        return ret;
+}
+
+static struct state*
+init_state ()
+{
+        struct state *state = malloc (sizeof (*state));
+
+        if (state == NULL) {
+                goto out;
+        }
+
+        state->debug = false;
+        state->jobs = DEFAULT_TREE_JOBS;
+        state->num_paths = 0;
+        state->paths = NULL;
+        state->stats = STATS_OFF;
+        state->xlator_options = NULL;
+
+out:
+        return state;
+}
+
+/**
+ * Returns a connection to the volume of path, which is the established one
+ * if the path is on it.
+ */
+static glfs_t *
+mv_getfs (struct cli_context *ctx, const struct mv_path *path)
+{
+        glfs_t *fs = NULL;
+
+        if (path->established || (ctx->fs && gluster_same_volume (path->gluster_url, ctx->url))) {
+                return ctx->fs;
+        }
+
+        if (gluster_getfs_cached (&fs, ctx->fs_cache, path->gluster_url, &state->xlator_options) == -1) {
+                error (0, errno, "failed to connect to `%s'", path->url);
+                gluster_putfs (ctx->fs_cache, fs);
+                return NULL;
+        }
+
+        if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
+                error (0, errno, "failed to set logging level");
+                gluster_putfs (ctx->fs_cache, fs);
+                return NULL;
+        }
+
+        return fs;
+}
+
+static void
+mv_putfs (struct cli_context *ctx, glfs_t *fs)
+{
+        if (fs != ctx->fs) {
+                gluster_putfs (ctx->fs_cache, fs);
+        }
+}
+
+/**
+ * Returns the path a source is moved to: dest_path itself, or the last
+ * component of source_path inside it if dest_path is a directory. It is the
+ * responsibility of the caller to free the return value.
+ */
+static char *
+target_path (const char *source_path, const char *dest_path, bool dest_is_dir)
+{
+        const char *end;
+        const char *name;
+        char *base;
+        char *path;
+
+        if (!dest_is_dir) {
+                return strdup (dest_path);
+        }
+
+        // Ignore trailing slashes, so that "dir/" is moved as "dir".
+        end = source_path + strlen (source_path);
+        while (end > source_path + 1 && end[-1] == '/') {
+                end--;
+        }
+
+        for (name = end; name > source_path && name[-1] != '/'; name--);
+
+        base = strndup (name, end - name);
+        if (base == NULL) {
+                return NULL;
+        }
+
+        path = append_path (dest_path, base);
+        free (base);
+
+        return path;
+}
+
+/**
+ * Moves a regular file to another volume: copies it with the parallel
+ * engine, checks that the copy reads back with the checksum of the data sent
+ * and that the source did not change meanwhile, and only then removes the
+ * source.
+ */
+static int
+move_file (glfs_t *source_fs, const char *source_path, glfs_t *dest_fs,
+           const char *dest_path, const char *name)
+{
+        struct copy_endpoint source = { .glfs_fd = NULL, .fd = -1 };
+        struct copy_endpoint dest = { .glfs_fd = NULL, .fd = -1 };
+        struct stat statbuf;
+        uint64_t start;
+        uint32_t crc = 0;
+        int ret = -1;
+
+        source.glfs_fd = glfs_open (source_fs, source_path, O_RDONLY);
+        if (source.glfs_fd == NULL) {
+                error (0, errno, "cannot open `%s'", name);
+                goto out;
+        }
+
+        if (endpoint_fstat (&source, &statbuf) == -1) {
+                error (0, errno, "cannot stat `%s'", name);
+                goto out;
+        }
+
+        // Read as well as written, to check the copy.
+        dest.glfs_fd = glfs_creat (dest_fs, dest_path, O_RDWR, get_default_file_mode_perm ());
+        if (dest.glfs_fd == NULL) {
+                error (0, errno, "cannot create `%s'", dest_path);
+                goto out;
+        }
+
+        gluster_apply_buffer_size (0, source_fs, &statbuf);
+
+        if (gluster_copy_parallel (&source, &dest, 0, statbuf.st_size, state->jobs, 0, NULL, &crc) == -1) {
+                error (0, errno, "failed to transfer `%s'", name);
+                goto out;
+        }
+
+        if (gluster_copy_check (&source, &dest, 0, statbuf.st_size, crc, state->jobs, 0) == -1
+                        || gluster_copy_verify (&source, &dest, &statbuf) == -1) {
+                error (0, errno, "failed to verify the copy of `%s', not removing it", name);
+                goto out;
+        }
+
+        start = stats_start ();
+        ret = glfs_unlink (source_fs, source_path);
+        stats_end (STATS_UNLINK, start, ret);
+        if (ret == -1) {
+                error (0, errno, "cannot remove `%s'", name);
+        }
+
+out:
+        if (source.glfs_fd) {
+                glfs_close (source.glfs_fd);
+        }
+
+        if (dest.glfs_fd) {
+                glfs_close (dest.glfs_fd);
+        }
+
+        return ret;
+}
+
+static int
+move_symlink (glfs_t *source_fs, const char *source_path, glfs_t *dest_fs,
+              const char *dest_path, const char *name)
+{
+        char target[PATH_MAX];
+        ssize_t length;
+        uint64_t start;
+        int ret;
+
+        length = glfs_readlink (source_fs, source_path, target, sizeof (target) - 1);
+        if (length == -1) {
+                error (0, errno, "cannot read symbolic link `%s'", name);
+                return -1;
+        }
+
+        target[length] = '\0';
+
+        if (glfs_symlink (dest_fs, target, dest_path) == -1) {
+                error (0, errno, "cannot create symbolic link `%s'", dest_path);
+                return -1;
+        }
+
+        start = stats_start ();
+        ret = glfs_unlink (source_fs, source_path);
+        stats_end (STATS_UNLINK, start, ret);
+        if (ret == -1) {
+                error (0, errno, "cannot remove `%s'", name);
+        }
+
+        return ret;
+}
+
+/**
+ * Moves a directory to another volume. The copy removes each file as soon as
+ * its copy is verified, so what remains of the source afterwards is its
+ * directories and symbolic links, which are then removed like gfrm -r would.
+ * Nothing more is removed if any file could not be moved.
+ */
+static int
+move_tree (glfs_t *source_fs, const char *source_path, glfs_t *dest_fs,
+           const char *dest_path, const char *name)
+{
+        char *paths[] = { (char *) source_path };
+        const char *names[] = { name };
+        int ret;
+
+        ret = gluster_copy_tree (source_fs,
+                                 source_path,
+                                 dest_fs,
+                                 dest_path,
+                                 &(struct copy_options) {
+                                         .jobs = state->jobs,
+                                         .remove_source = true,
+                                 });
+        if (ret == -1) {
+                error (0, 0, "not removing `%s', which was not entirely moved", name);
+                return -1;
+        }
+
+        return gluster_rm (source_fs,
+                           paths,
+                           names,
+                           1,
+                           &(struct rm_options) {
+                                   .jobs = state->jobs,
+                                   .recursive = true,
+                                   .keep_files = true,
+                           });
+}
+
+/**
+ * Moves source_path on source_fs to dest_path on another volume.
+ */
+static int
+move_across (glfs_t *source_fs, const char *source_path, glfs_t *dest_fs,
+             const char *dest_path, const char *name)
+{
+        struct stat statbuf;
+        int ret;
+
+        ret = gluster_lstat (source_fs, source_path, &statbuf);
+        if (ret == -1) {
+                error (0, errno, "cannot stat `%s'", name);
+                return -1;
+        }
+
+        if (S_ISDIR (statbuf.st_mode)) {
+                return move_tree (source_fs, source_path, dest_fs, dest_path, name);
+        } else if (S_ISREG (statbuf.st_mode)) {
+                return move_file (source_fs, source_path, dest_fs, dest_path, name);
+        } else if (S_ISLNK (statbuf.st_mode)) {
+                return move_symlink (source_fs, source_path, dest_fs, dest_path, name);
+        }
+
+        error (0, 0, "cannot move special file `%s'", name);
+
+        return -1;
+}
+
+static int
+mv (struct cli_context *ctx)
+{
+        struct mv_path *dest = &state->paths[state->num_paths - 1];
+        struct mv_path *source;
+        struct stat statbuf;
+        glfs_t *dest_fs;
+        glfs_t *source_fs;
+        bool dest_is_dir;
+        char *target;
+        int ret = 0;
+
+        dest_fs = mv_getfs (ctx, dest);
+        if (dest_fs == NULL) {
+                return -1;
+        }
+
+        dest_is_dir = gluster_stat (dest_fs, dest->gluster_url->path, &statbuf) == 0
+                && S_ISDIR (statbuf.st_mode);
+
+        if (state->num_paths > 2 && !dest_is_dir) {
+                error (0, 0, "target `%s' is not a directory", dest->url);
+                ret = -1;
+                goto out;
+        }
+
+        for (int i = 0; i < state->num_paths - 1; i++) {
+                source = &state->paths[i];
+
+                source_fs = mv_getfs (ctx, source);
+                if (source_fs == NULL) {
+                        ret = -1;
+                        continue;
+                }
+
+                target = target_path (source->gluster_url->path, dest->gluster_url->path, dest_is_dir);
+                if (target == NULL) {
+                        error (0, errno, "cannot move `%s'", source->url);
+                        ret = -1;
+                } else if (source_fs == dest_fs) {
+                        // Within a volume, a move is a single rename.
+                        if (glfs_rename (dest_fs, source->gluster_url->path, target) == -1) {
+                                error (0, errno, "cannot move `%s' to `%s'", source->url, target);
+                                ret = -1;
+                        }
+
+                        // Directories may have moved away from, or been
+                        // replaced at, either path.
+                        gluster_dir_cache_forget (dest_fs, source->gluster_url->path);
+                        gluster_dir_cache_forget (dest_fs, target);
+                        gluster_attr_cache_invalidate (dest_fs, source->gluster_url->path);
+                        gluster_attr_cache_invalidate (dest_fs, target);
+                } else {
+                        if (move_across (source_fs, source->gluster_url->path, dest_fs,
+                                         target, source->url) == -1) {
+                                ret = -1;
+                        }
+
+                        gluster_attr_cache_invalidate (source_fs, source->gluster_url->path);
+                        gluster_attr_cache_invalidate (dest_fs, target);
+                }
+
+                free (target);
+                mv_putfs (ctx, source_fs);
+        }
+
+out:
+        mv_putfs (ctx, dest_fs);
+
+        return ret;
+}
+
+int
+do_mv (struct cli_context *ctx)
+{
+        int argc = ctx->argc;
+        char **argv = ctx->argv;
+        int ret = -1;
+
+        state = init_state ();
+        if (state == NULL) {
+                error (0, errno, "failed to initialize state");
+                goto out;
+        }
+
+        state->debug = ctx->options->debug;
+
+        ret = parse_options (argc, argv, ctx->fs != NULL);
+        switch (ret) {
+                case -2:
+                        // Fall through
+                        ret = 0;
+                case -1:
+                        goto out;
+        }
+
+        if (stats_begin (state->stats) == -1) {
+                error (0, errno, "failed to initialize statistics");
+                ret = -1;
+                goto out;
+        }
+
+        ret = mv (ctx);
+
+out:
+        stats_finish ();
+
+        if (state) {
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
+        }
+
+        free (state);
+
+        return ret;
+}
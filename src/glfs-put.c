@@ -21,6 +21,9 @@
 
 #include <config.h>
 
+#include "glfs-attr-cache.h"
+#include "glfs-copy-util.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 
 #include <errno.h>
@@ -33,6 +36,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #define AUTHORS "Written by Craig Cabrey."
 
@@ -44,6 +48,13 @@
  * append: Whether to append to the file instead of replacing it.
  * debug: Whether to log additional debug information.
  * parents: Whether all parent directories in the path are created.
+ * resume: Whether to pick up an interrupted put after the data already in
+ *         the file.
+ * verify: Whether to check what was written against the checksum of the
+ *         input.
+ * buffer_size: Size of the writes, BUFFER_SIZE_AUTO to size them from the
+ *              volume and standard input, or 0 for the default.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
         struct gluster_url *gluster_url;
@@ -53,18 +64,27 @@ struct state {
         bool debug;
         bool overwrite;
         bool parents;
+        bool resume;
+        bool verify;
+        size_t buffer_size;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
         {"append", no_argument, NULL, 'a'},
+        {"buffer-size", required_argument, NULL, 'B'},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'x'},
         {"overwrite", no_argument, NULL, 'f'},
         {"parents", required_argument, NULL, 'r'},
         {"port", required_argument, NULL, 'p'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"resume", no_argument, NULL, 'R'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"verify", no_argument, NULL, 'V'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -76,13 +96,28 @@ usage (const int status)
         printf ("Usage: %s [OPTION]... URL\n"
                 "Put data from standard input on a remote Gluster volume.\n\n"
                 "  -a, --append                 append data to the end of the file\n"
+                "      --buffer-size=SIZE       write the file in blocks of SIZE bytes; with\n"
+                "                               auto, size them from the volume and the\n"
+                "                               input\n"
                 "  -f, --overwrite              overwrite the existing file\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
+                "      --queue-depth=N          keep up to N writes in flight (default 4)\n"
                 "  -r, --parents                no error if existing, make parent\n"
                 "                               directories as needed\n"
+                "      --resume                 continue an interrupted put of the same\n"
+                "                               input after the data already in the file,\n"
+                "                               once its tail has been checked against the\n"
+                "                               input\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
+                "      --verify                 checksum the input as it is written, then\n"
+                "                               read the file back in parallel and check it\n"
+                "                               has the same checksum, which is recorded on\n"
+                "                               the file when it was written in full\n"
                 "      --help       display this help and exit\n"
                 "      --version    output version information and exit\n\n"
                 "Examples:\n"
@@ -101,6 +136,7 @@ void
 parse_options (int argc, char *argv[])
 {
         uint16_t port = GLUSTER_DEFAULT_PORT;
+        unsigned int depth;
         int ret = -1;
         int opt = 0;
         int option_index = 0;
@@ -117,6 +153,13 @@ parse_options (int argc, char *argv[])
                 switch (opt) {
                         case 'a':
                                 state->append = true;
+                                break;
+                        case 'B':
+                                state->buffer_size = strtobuffersize (optarg);
+                                if (state->buffer_size == 0) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'd':
                                 state->debug = true;
@@ -142,9 +185,30 @@ parse_options (int argc, char *argv[])
                                         exit (EXIT_FAILURE);
                                 }
 
+                                break;
+                        case 'q':
+                                depth = strtoqueuedepth (optarg);
+                                if (depth == 0) {
+                                        goto err;
+                                }
+
+                                gluster_set_queue_depth (depth);
                                 break;
                         case 'r':
                                 state->parents = true;
+                                break;
+                        case 'R':
+                                state->resume = true;
+                                break;
+                        case 'V':
+                                state->verify = true;
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -162,7 +226,12 @@ parse_options (int argc, char *argv[])
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if (state->append && state->resume) {
+                error (0, 0, "--append and --resume cannot be used together");
+                goto err;
+        }
+
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
         } else {
@@ -199,16 +268,177 @@ init_state ()
         }
 
         state->append = false;
+        state->buffer_size = 0;
         state->debug = false;
         state->gluster_url = NULL;
         state->overwrite = false;
         state->parents = false;
+        state->resume = false;
+        state->stats = STATS_OFF;
         state->url = NULL;
+        state->verify = false;
+        state->xlator_options = NULL;
 
 out:
         return state;
 }
 
+/**
+ * Reads up to count bytes from standard input, retrying short reads from a
+ * pipe. Returns the number of bytes read, which is only short at the end of
+ * the input, or -1 on error.
+ */
+static ssize_t
+read_full (void *buf, size_t count)
+{
+        size_t total = 0;
+        ssize_t ret;
+
+        while (total < count) {
+                ret = read (STDIN_FILENO, (char *) buf + total, count - total);
+                if (ret == -1) {
+                        return -1;
+                }
+
+                if (ret == 0) {
+                        break;
+                }
+
+                total += ret;
+        }
+
+        return total;
+}
+
+/**
+ * Positions standard input and fd to pick up an interrupted put, given the
+ * size of the data already in fd. The last writes before the interruption
+ * may not all have landed, so as many bytes at the end of the file as the
+ * put may have had in flight, gluster_resume_window (), are compared with the
+ * input a block at a time, and the first block that differs is rewritten.
+ * The input before that window is skipped, or read and discarded if it is a
+ * pipe.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int
+resume_put (glfs_fd_t *fd, off_t end)
+{
+        struct stat statbuf;
+        char *buf = NULL;
+        char *file_buf = NULL;
+        off_t window = gluster_resume_window ();
+        off_t offset;
+        ssize_t num_read;
+        ssize_t file_read;
+        size_t length;
+        uint64_t start;
+        int ret = -1;
+
+        // Input that is shorter than the file cannot be what was put there.
+        if (fstat (STDIN_FILENO, &statbuf) == 0 && S_ISREG (statbuf.st_mode)
+                        && statbuf.st_size - lseek (STDIN_FILENO, 0, SEEK_CUR) < end) {
+                return glfs_ftruncate (fd, 0);
+        }
+
+        buf = alloc_buffer (RESUME_BLOCK_SIZE);
+        file_buf = alloc_buffer (RESUME_BLOCK_SIZE);
+        if (buf == NULL || file_buf == NULL) {
+                goto out;
+        }
+
+        offset = end > window ? end - window : 0;
+
+        if (lseek (STDIN_FILENO, offset, SEEK_CUR) == -1) {
+                if (errno != ESPIPE) {
+                        goto out;
+                }
+
+                for (off_t skipped = 0; skipped < offset; skipped += num_read) {
+                        length = offset - skipped < RESUME_BLOCK_SIZE ? offset - skipped : RESUME_BLOCK_SIZE;
+
+                        num_read = read_full (buf, length);
+                        if (num_read == -1) {
+                                goto out;
+                        }
+
+                        if (num_read < length) {
+                                errno = EINVAL;
+                                error (0, 0, "input ends before the data already put");
+                                goto out;
+                        }
+                }
+        }
+
+        while (offset < end) {
+                length = end - offset < RESUME_BLOCK_SIZE ? end - offset : RESUME_BLOCK_SIZE;
+
+                num_read = read_full (buf, length);
+                if (num_read == -1) {
+                        goto out;
+                }
+
+                for (file_read = 0; file_read < num_read;) {
+                        start = stats_start ();
+                        ret = glfs_pread (fd, &file_buf[file_read], num_read - file_read,
+                                          offset + file_read, 0);
+                        stats_end (STATS_READ, start, ret);
+                        if (ret == -1) {
+                                goto out;
+                        }
+
+                        if (ret == 0) {
+                                break;
+                        }
+
+                        file_read += ret;
+                }
+
+                ret = -1;
+
+                if (num_read == 0 || file_read != num_read
+                                || memcmp (buf, file_buf, num_read) != 0) {
+                        break;
+                }
+
+                offset += num_read;
+        }
+
+        if (offset < end) {
+                // Drop what does not match, then write the block read in its
+                // place so that the input carries on from after it.
+                if (glfs_ftruncate (fd, offset) == -1) {
+                        goto out;
+                }
+
+                for (ssize_t num_written = 0; num_written < num_read;) {
+                        start = stats_start ();
+                        ret = glfs_pwrite (fd, &buf[num_written], num_read - num_written,
+                                           offset + num_written, 0);
+                        stats_end (STATS_WRITE, start, ret);
+                        if (ret == -1) {
+                                goto out;
+                        }
+
+                        num_written += ret;
+                }
+
+                offset += num_read;
+        }
+
+        if (glfs_lseek (fd, offset, SEEK_SET) == -1) {
+                goto out;
+        }
+
+        ret = 0;
+
+out:
+        free (buf);
+        free (file_buf);
+
+        return ret;
+}
+
 int
 gluster_put (glfs_t *fs, struct state *state)
 {
@@ -217,14 +447,21 @@ gluster_put (glfs_t *fs, struct state *state)
         char *filename = state->gluster_url->path;
         char *dir_path = strdup (state->gluster_url->path);
         struct stat statbuf;
+        bool have_stat = false;
+        uint64_t start;
+        uint32_t crc = 0;
+        off_t offset;
+        off_t end;
 
         if (dir_path == NULL) {
                 error (EXIT_FAILURE, errno, "strdup");
                 goto out;
         }
 
+        start = stats_start ();
         ret = glfs_lstat (fs, filename, &statbuf);
-        if (ret != -1 && !state->append && !state->overwrite) {
+        stats_end (STATS_STAT, start, ret);
+        if (ret != -1 && !state->append && !state->overwrite && !state->resume) {
                 errno = EEXIST;
                 ret = -1;
                 goto out;
@@ -244,17 +481,39 @@ gluster_put (glfs_t *fs, struct state *state)
                 goto out;
         }
 
+        gluster_attr_cache_invalidate (fs, filename);
+
         ret = gluster_lock (fd, F_WRLCK, false);
         if (ret == -1) {
                 goto out;
         }
 
+        // Sized before a resume, which checks as much as the writes keep in
+        // flight.
+        if (state->buffer_size == BUFFER_SIZE_AUTO) {
+                have_stat = fstat (STDIN_FILENO, &statbuf) == 0;
+        }
+
+        gluster_apply_buffer_size (state->buffer_size, fs, have_stat ? &statbuf : NULL);
+
         if (state->append) {
                 ret = glfs_lseek (fd, 0, SEEK_END);
                 if (ret == -1) {
                         error (0, errno, "seek error: %s", filename);
                         goto out;
                 }
+        } else if (state->resume) {
+                start = stats_start ();
+                ret = glfs_fstat (fd, &statbuf);
+                stats_end (STATS_STAT, start, ret);
+                if (ret == 0) {
+                        ret = resume_put (fd, statbuf.st_size);
+                }
+
+                if (ret == -1) {
+                        error (0, errno, "resume error: %s", filename);
+                        goto out;
+                }
         } else {
                 ret = glfs_ftruncate (fd, 0);
                 if (ret == -1) {
@@ -263,8 +522,32 @@ gluster_put (glfs_t *fs, struct state *state)
                 }
         }
 
-        if (gluster_write (STDIN_FILENO, fd) == 0) {
+        offset = glfs_lseek (fd, 0, SEEK_CUR);
+        if (offset == -1) {
                 ret = -1;
+                goto out;
+        }
+
+        ret = gluster_write (STDIN_FILENO, fd, state->verify ? &crc : NULL);
+        if (ret == -1 || !state->verify) {
+                goto out;
+        }
+
+        end = glfs_lseek (fd, 0, SEEK_CUR);
+        if (end == -1) {
+                ret = -1;
+                goto out;
+        }
+
+        ret = gluster_copy_check (NULL,
+                                  &(struct copy_endpoint) { .glfs_fd = fd },
+                                  offset,
+                                  end,
+                                  crc,
+                                  DEFAULT_VERIFY_JOBS,
+                                  0);
+        if (ret == -1) {
+                error (0, errno, "verify error: %s", filename);
         }
 
 out:
@@ -280,7 +563,7 @@ out:
 int
 main (int argc, char *argv[])
 {
-        glfs_t *fs;
+        glfs_t *fs = NULL;
         int ret;
 
         program_invocation_name = basename (argv[0]);
@@ -294,6 +577,11 @@ main (int argc, char *argv[])
 
         parse_options (argc, argv);
 
+        if (stats_begin (state->stats) == -1) {
+                error (0, errno, "failed to initialize statistics");
+                goto err;
+        }
+
         ret = gluster_getfs (&fs, state->gluster_url);
         if (ret == -1) {
                 error (0, errno, "%s", state->url);
@@ -327,8 +615,10 @@ main (int argc, char *argv[])
 err:
         ret = EXIT_FAILURE;
 out:
+        stats_finish ();
+
         if (fs) {
-                glfs_fini (fs);
+                gluster_fini (fs);
         }
 
         if (state) {
@@ -20,48 +20,75 @@
 
 #include <config.h>
 
+#include "glfs-handle.h"
 #include "glfs-rm.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
+#include "glfs-work-queue.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <glusterfs/api/glfs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define AUTHORS "Written by Craig Cabrey."
 
+#define DEFAULT_RM_JOBS 8
+#define RM_BATCH_SIZE 16
+#define RM_MAX_RESCANS 3
+
+/**
+ * A path supplied by the user.
+ *
+ * gluster_url: Struct of the parsed url.
+ * url: Full url used to find the remote file or directory.
+ */
+struct rm_path {
+        struct gluster_url *gluster_url;
+        char *url;
+};
+
 /**
  * Used to store the state of the program, including user supplied options.
  *
- * gluster_url: Struct of the parsed url supplied by the user.
- * url: Full url used to find the remote file or directory (supplied by user).
+ * paths: The files or directories to remove (supplied by user).
+ * num_paths: Number of entries in paths.
+ * jobs: Number of threads removing the contents of a directory with -r.
  * debug: Whether to log additional debug information.
- * directory: Whether to allow removal of a directory.
  * force: Whether to ignore non-existent files or directories.
+ * recursive: Whether to remove directories and their contents.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
-        struct gluster_url *gluster_url;
         struct xlator_option *xlator_options;
-        char *url;
+        struct rm_path *paths;
+        int num_paths;
+        unsigned int jobs;
         bool debug;
-        bool directory;
         bool force;
+        bool recursive;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
         {"debug", no_argument, NULL, 'd'},
         {"force", no_argument, NULL, 'f'},
         {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
         {"port", required_argument, NULL, 'p'},
         {"recursive", no_argument, NULL, 'r'},
+        {"stats", optional_argument, NULL, 'S'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -70,14 +97,19 @@ static struct option const long_options[] =
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n"
+        printf ("Usage: %s [OPTION]... URL...\n"
                 "Remove (unlink) the files (or directories) from a remote Gluster volume.\n\n"
                 "  -f, --force                  ignore nonexistent files, never prompt\n"
+                "  -j, --jobs=N                 remove up to N files or directories\n"
+                "                               concurrently (default %d)\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
                 "  -r, --recursive              remove directories and their contents recursively\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
@@ -87,11 +119,12 @@ usage ()
                 "  gfrm -r glfs://localhost/groot/path/to/directory\n"
                 "       Recursively remove the directory /path/to/directory\n"
                 "       on the Gluster volume of groot on host localhost.\n"
-                "  gfcli (localhost/groot)> rm /file\n"
+                "  gfcli (localhost/groot)> rm /file /other\n"
                 "       In the context of a shell with a connection established,\n"
-                "       remove the file on the root of the Gluster volume groot\n"
+                "       remove the files on the root of the Gluster volume groot\n"
                 "       on localhost.\n",
-                program_invocation_name);
+                program_invocation_name,
+                DEFAULT_RM_JOBS);
 }
 
 static int
@@ -101,12 +134,15 @@ parse_options (int argc, char *argv[], bool has_connection)
         int ret = -1;
         int opt = 0;
         int option_index = 0;
+        struct rm_path *path;
         struct xlator_option *option;
 
+        lock_getopt ();
+
         // Reset getopt since other utilities may have called it already.
         optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "fro:p:", long_options,
+                opt = getopt_long (argc, argv, "fj:ro:p:", long_options,
                                    &option_index);
 
                 if (opt == -1) {
@@ -119,6 +155,13 @@ parse_options (int argc, char *argv[], bool has_connection)
                                 break;
                         case 'f':
                                 state->force = true;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto out;
+                                }
+
                                 break;
                         case 'o':
                                 option = parse_xlator_option (optarg);
@@ -141,7 +184,14 @@ parse_options (int argc, char *argv[], bool has_connection)
 
                                 break;
                         case 'r':
-                                state->directory = true;
+                                state->recursive = true;
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -162,49 +212,59 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
-        } else {
-                // state->url is free'd in do_rm()
-                state->url = strdup (argv[argc - 1]);
-                if (state->url == NULL) {
+        }
+
+        // state->paths is free'd in do_rm()
+        state->paths = calloc (argc - optind, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
                         error (0, errno, "strdup");
                         goto out;
                 }
 
-                // state->gluster_url is free'd in do_rm()
                 if (has_connection) {
-                        state->gluster_url = gluster_url_init ();
-                        if (state->gluster_url == NULL) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
                                 error (0, errno, "gluster_url_init");
                                 goto out;
                         }
 
-                        state->gluster_url->path = strdup (argv[argc - 1]);
-                        if (state->gluster_url->path == NULL) {
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
                                 error (0, errno, "strdup");
                                 goto out;
                         }
 
-                        ret = 0;
-                        goto out;
+                        continue;
                 }
 
-                ret = gluster_parse_url (argv[argc - 1], &(state->gluster_url));
-                if (ret == -1) {
-                        error (0, EINVAL, "%s", state->url);
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
                         goto err;
                 }
 
-                state->gluster_url->port = port;
+                path->gluster_url->port = port;
         }
 
+        ret = 0;
         goto out;
 
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -218,73 +278,616 @@ init_state ()
         }
 
         state->debug = false;
-        state->directory = false;
         state->force = false;
-        state->gluster_url = NULL;
-        state->url = NULL;
+        state->jobs = DEFAULT_RM_JOBS;
+        state->num_paths = 0;
+        state->paths = NULL;
+        state->recursive = false;
+        state->stats = STATS_OFF;
         state->xlator_options = NULL;
 
 out:
         return state;
 }
 
+/**
+ * A directory being emptied. It is removed as soon as pending drops to zero,
+ * that is once it has been scanned and everything found in it is gone.
+ *
+ * parent: Directory containing this one, or NULL for a user supplied path.
+ * handle: Handle of the directory once it is scanned, through which its
+ *         entries are removed.
+ * name: User supplied name of the directory for messages, or NULL.
+ * pending: Outstanding scans of and unlink batches from this directory, plus
+ *          one for each sub-directory not yet removed.
+ * rescans: Number of times the directory was scanned again because entries
+ *          were created while it was being emptied.
+ * failed: Whether an entry could not be removed, in which case neither can
+ *         the directory.
+ */
+struct rm_dir {
+        struct rm_dir *parent;
+        struct gluster_handle *handle;
+        char *path;
+        const char *name;
+        size_t pending;
+        unsigned int rescans;
+        bool failed;
+};
+
+/**
+ * A unit of work: either a directory to scan, or a batch of paths to unlink
+ * from dir (NULL for user supplied paths). names holds the user supplied
+ * names of the paths for messages, if any.
+ */
+struct rm_item {
+        struct rm_dir *dir;
+        bool scan;
+        char *paths[RM_BATCH_SIZE];
+        const char *names[RM_BATCH_SIZE];
+        size_t count;
+};
+
+/**
+ * State shared by the threads of a removal.
+ *
+ * max_queued: Number of queued items past which unlink batches are processed
+ *             by the thread that produced them, which bounds the memory used
+ *             by huge directories.
+ */
+struct rm_tree {
+        glfs_t *fs;
+        const struct rm_options *options;
+        struct work_queue queue;
+        pthread_mutex_t lock;
+        size_t max_queued;
+        struct stats *stats;
+        bool failed;
+};
+
+static void
+process_item (struct rm_tree *tree, struct rm_item *item);
+
+static void
+rm_report (struct rm_tree *tree, int errnum, const char *fmt, const char *name)
+{
+        pthread_mutex_lock (&tree->lock);
+        error (0, errnum, fmt, name);
+        tree->failed = true;
+        pthread_mutex_unlock (&tree->lock);
+}
+
+static struct rm_dir *
+rm_dir_new (struct rm_dir *parent, const char *path, const char *name)
+{
+        struct rm_dir *dir = malloc (sizeof (*dir));
+
+        if (dir == NULL) {
+                return NULL;
+        }
+
+        dir->path = strdup (path);
+        if (dir->path == NULL) {
+                free (dir);
+                return NULL;
+        }
+
+        dir->parent = parent;
+        dir->handle = NULL;
+        dir->name = name;
+        dir->pending = 1;
+        dir->rescans = 0;
+        dir->failed = false;
+
+        return dir;
+}
+
+static void
+rm_dir_free (struct rm_dir *dir)
+{
+        gluster_handle_unref (dir->handle);
+        free (dir->path);
+        free (dir);
+}
+
+static struct rm_item *
+rm_item_new (struct rm_dir *dir, bool scan)
+{
+        struct rm_item *item = calloc (1, sizeof (*item));
+
+        if (item != NULL) {
+                item->dir = dir;
+                item->scan = scan;
+        }
+
+        return item;
+}
+
+static void
+rm_item_free (struct rm_item *item)
+{
+        for (size_t i = 0; i < item->count; i++) {
+                free (item->paths[i]);
+        }
+
+        free (item);
+}
+
+/**
+ * Hands an item to the workers. Unlink batches are processed straight away
+ * instead when the queue is long or cannot grow.
+ */
+static void
+rm_dispatch (struct rm_tree *tree, struct rm_item *item)
+{
+        if (!item->scan && work_queue_length (&tree->queue) > tree->max_queued) {
+                process_item (tree, item);
+                return;
+        }
+
+        if (work_queue_push (&tree->queue, item) == -1) {
+                process_item (tree, item);
+        }
+}
+
+/**
+ * Returns the last component of a path built by append_path ().
+ */
+static const char *
+last_component (const char *path)
+{
+        const char *slash = strrchr (path, '/');
+
+        return slash ? slash + 1 : path;
+}
+
+/**
+ * Removes a directory through the handle of its parent, or by path if it was
+ * supplied by the user.
+ */
 static int
-rm (glfs_t *fs)
+remove_dir (struct rm_tree *tree, struct rm_dir *dir)
 {
-        int ret = -1;
+        if (dir->parent == NULL) {
+                return gluster_handle_rmdir (tree->fs, NULL, dir->path);
+        }
 
-        if (state->directory) {
-                ret = glfs_rmdir (fs, state->gluster_url->path);
+        return gluster_handle_rmdir (tree->fs, dir->parent->handle, last_component (dir->path));
+}
+
+/**
+ * Drops a reference to a directory. The last reference removes the directory
+ * and in turn releases its parent, so that directories are removed in
+ * post-order as soon as they drain.
+ */
+static void
+rm_release (struct rm_tree *tree, struct rm_dir *dir, bool failed)
+{
+        struct rm_dir *parent;
+        struct rm_item *item;
+        size_t remaining;
+
+        while (dir != NULL) {
+                pthread_mutex_lock (&tree->lock);
+                if (failed) {
+                        dir->failed = true;
+                }
+
+                remaining = --dir->pending;
+                failed = dir->failed;
+                pthread_mutex_unlock (&tree->lock);
+
+                if (remaining > 0) {
+                        return;
+                }
+
+                if (!failed && remove_dir (tree, dir) == -1) {
+                        if (errno == ENOTEMPTY && dir->rescans < RM_MAX_RESCANS) {
+                                // Entries were created while the directory
+                                // was being emptied, so go over it again.
+                                item = rm_item_new (dir, true);
+                                if (item != NULL) {
+                                        dir->rescans++;
+                                        dir->pending = 1;
+                                        rm_dispatch (tree, item);
+                                        return;
+                                }
+                        }
+
+                        if (!(tree->options->force && errno == ENOENT)) {
+                                rm_report (tree, errno, "failed to remove `%s'",
+                                                dir->name ? dir->name : dir->path);
+                                failed = true;
+                        }
+                }
+
+                parent = dir->parent;
+                rm_dir_free (dir);
+                dir = parent;
+        }
+}
+
+static bool
+is_root (const char *path)
+{
+        return path[strspn (path, "/")] == '\0';
+}
+
+/**
+ * Starts emptying the directory at path, holding a reference to its parent
+ * until it has been removed.
+ */
+static int
+rm_start_dir (struct rm_tree *tree, struct rm_dir *parent, const char *path, const char *name)
+{
+        struct rm_item *item;
+        struct rm_dir *dir;
+
+        if (parent == NULL && is_root (path)) {
+                rm_report (tree, 0, "it is dangerous to operate recursively on `%s'",
+                                name ? name : path);
+                return -1;
+        }
+
+        dir = rm_dir_new (parent, path, name);
+        if (dir == NULL) {
+                rm_report (tree, errno, "failed to remove `%s'", name ? name : path);
+                return -1;
+        }
+
+        item = rm_item_new (dir, true);
+        if (item == NULL) {
+                rm_report (tree, errno, "failed to remove `%s'", name ? name : path);
+                rm_dir_free (dir);
+                return -1;
+        }
+
+        if (parent != NULL) {
+                pthread_mutex_lock (&tree->lock);
+                parent->pending++;
+                pthread_mutex_unlock (&tree->lock);
+        }
+
+        rm_dispatch (tree, item);
+
+        return 0;
+}
+
+static void
+process_unlink (struct rm_tree *tree, struct rm_item *item)
+{
+        const char *name;
+        bool failed = false;
+        int ret;
+
+        for (size_t i = 0; i < item->count; i++) {
+                // Paths found by a scan are unlinked through the handle of
+                // their directory, which is known not to be one of them.
+                if (item->dir) {
+                        ret = gluster_handle_unlink (tree->fs, item->dir->handle,
+                                                     last_component (item->paths[i]));
+                } else {
+                        ret = gluster_handle_unlink (tree->fs, NULL, item->paths[i]);
+                }
+
+                if (ret == 0) {
+                        continue;
+                }
+
+                name = item->names[i] ? item->names[i] : item->paths[i];
+
+                if (tree->options->recursive && errno == EISDIR) {
+                        if (rm_start_dir (tree, item->dir, item->paths[i], item->names[i]) == -1) {
+                                failed = true;
+                        }
+                } else if (!(tree->options->force && errno == ENOENT)) {
+                        rm_report (tree, errno, "failed to remove `%s'", name);
+                        failed = true;
+                }
+        }
+
+        rm_release (tree, item->dir, failed);
+        rm_item_free (item);
+}
+
+/**
+ * Reads a directory, queueing its files in batches to be unlinked and its
+ * sub-directories to be scanned in turn.
+ */
+static void
+process_scan (struct rm_tree *tree, struct rm_item *item)
+{
+        struct rm_dir *dir = item->dir;
+        struct rm_item *batch = NULL;
+        struct gluster_handle *child;
+        struct dirent *entry;
+        struct stat statbuf;
+        uint64_t start;
+        glfs_fd_t *fd;
+        mode_t mode;
+        char *path;
+        bool failed = false;
+
+        rm_item_free (item);
+
+        // The handle is looked up on the first scan only, relative to the
+        // parent so that the lookup costs the same at any depth.
+        if (dir->handle == NULL) {
+                if (dir->parent) {
+                        dir->handle = gluster_handle_lookup (tree->fs, dir->parent->handle,
+                                                             last_component (dir->path),
+                                                             NULL, false);
+                } else {
+                        dir->handle = gluster_handle_lookup (tree->fs, NULL, dir->path, NULL, false);
+                }
+        }
+
+        fd = dir->handle ? gluster_handle_opendir (tree->fs, dir->handle) : NULL;
+        if (fd == NULL) {
+                if (!(tree->options->force && errno == ENOENT)) {
+                        rm_report (tree, errno, "failed to remove `%s'",
+                                        dir->name ? dir->name : dir->path);
+                        failed = true;
+                }
+
+                goto out;
+        }
+
+        while (true) {
+                errno = 0;
+                memset (&statbuf, 0, sizeof (statbuf));
+                start = stats_start ();
+                entry = glfs_readdirplus (fd, &statbuf);
+                stats_end (STATS_READDIR, start, entry == NULL && errno ? -1 : 0);
+                if (entry == NULL) {
+                        break;
+                }
+
+                if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0) {
+                        continue;
+                }
+
+                path = append_path (dir->path, entry->d_name);
+                if (path == NULL) {
+                        rm_report (tree, errno, "failed to remove `%s'", entry->d_name);
+                        failed = true;
+                        continue;
+                }
+
+                // Without attributes, fall back to the entry type, and look
+                // the entry up if that is unknown too: unlinking through a
+                // handle does not tell directories apart.
+                mode = statbuf.st_mode ? statbuf.st_mode : DTTOIF (entry->d_type);
+                if (mode == 0) {
+                        child = gluster_handle_lookup (tree->fs, dir->handle, entry->d_name,
+                                                       &statbuf, false);
+                        if (child) {
+                                mode = statbuf.st_mode;
+                                gluster_handle_unref (child);
+                        }
+                }
+                if (S_ISDIR (mode)) {
+                        if (rm_start_dir (tree, dir, path, NULL) == -1) {
+                                failed = true;
+                        }
+
+                        free (path);
+                        continue;
+                }
+
+                if (tree->options->keep_files && (S_ISREG (mode) || mode == 0)) {
+                        rm_report (tree, 0, "not removing `%s', which was not moved", path);
+                        free (path);
+                        failed = true;
+                        continue;
+                }
+
+                if (batch == NULL) {
+                        batch = rm_item_new (dir, false);
+                        if (batch == NULL) {
+                                rm_report (tree, errno, "failed to remove `%s'", path);
+                                free (path);
+                                failed = true;
+                                continue;
+                        }
+
+                        pthread_mutex_lock (&tree->lock);
+                        dir->pending++;
+                        pthread_mutex_unlock (&tree->lock);
+                }
+
+                batch->paths[batch->count++] = path;
+                if (batch->count == RM_BATCH_SIZE) {
+                        rm_dispatch (tree, batch);
+                        batch = NULL;
+                }
+        }
+
+        if (errno != 0) {
+                rm_report (tree, errno, "failed to read `%s'",
+                                dir->name ? dir->name : dir->path);
+                failed = true;
+        }
+
+        if (batch != NULL) {
+                rm_dispatch (tree, batch);
+        }
+
+        glfs_closedir (fd);
+
+out:
+        rm_release (tree, dir, failed);
+}
+
+static void
+process_item (struct rm_tree *tree, struct rm_item *item)
+{
+        if (item->scan) {
+                process_scan (tree, item);
         } else {
-                ret = glfs_unlink (fs, state->gluster_url->path);
+                process_unlink (tree, item);
         }
+}
 
-        if (ret == -1) {
-                if (state->force && errno == ENOENT) {
-                        ret = 0;
-                        goto out;
+static void *
+rm_worker (void *data)
+{
+        struct rm_tree *tree = data;
+        struct rm_item *item;
+
+        stats_attach (tree->stats);
+
+        while ((item = work_queue_pop (&tree->queue)) != NULL) {
+                process_item (tree, item);
+                work_queue_done (&tree->queue);
+        }
+
+        return NULL;
+}
+
+int
+gluster_rm (glfs_t *fs, char * const *paths, const char * const *names,
+            size_t count, const struct rm_options *options)
+{
+        struct rm_tree tree = {
+                .fs = fs,
+                .options = options,
+                .max_queued = options->jobs * RM_BATCH_SIZE,
+                .stats = stats_current (),
+                .failed = false,
+        };
+        unsigned int num_workers = 0;
+        pthread_t *workers = NULL;
+        struct rm_item *item;
+        size_t pushed = 0;
+
+        if (count == 0) {
+                return 0;
+        }
+
+        if (work_queue_init (&tree.queue, 0) == -1) {
+                error (0, errno, "failed to initialize work queue");
+                return -1;
+        }
+
+        pthread_mutex_init (&tree.lock, NULL);
+
+        // Each user supplied path is a batch of its own, so that they are
+        // spread over the workers.
+        for (size_t i = 0; i < count; i++) {
+                item = rm_item_new (NULL, false);
+                if (item == NULL || (item->paths[0] = strdup (paths[i])) == NULL) {
+                        rm_report (&tree, errno, "failed to remove `%s'",
+                                        names ? names[i] : paths[i]);
+                        free (item);
+                        continue;
                 }
 
-                error (0, errno, "failed to remove `%s'", state->url);
+                item->names[0] = names ? names[i] : NULL;
+                item->count = 1;
+
+                if (work_queue_push (&tree.queue, item) == -1) {
+                        process_item (&tree, item);
+                        continue;
+                }
+
+                pushed++;
+        }
+
+        if (pushed == 0) {
                 goto out;
         }
 
+        if (options->jobs > 1) {
+                workers = malloc (sizeof (*workers) * (options->jobs - 1));
+        }
+
+        for (; workers && num_workers < options->jobs - 1; num_workers++) {
+                if (pthread_create (&workers[num_workers], NULL, rm_worker, &tree) != 0) {
+                        break;
+                }
+        }
+
+        rm_worker (&tree);
+
+        for (unsigned int i = 0; i < num_workers; i++) {
+                pthread_join (workers[i], NULL);
+        }
+
 out:
-        return ret;
+        free (workers);
+        pthread_mutex_destroy (&tree.lock);
+        work_queue_destroy (&tree.queue);
+
+        return tree.failed ? -1 : 0;
 }
 
 static int
-rm_without_context ()
+rm (glfs_t *fs, struct rm_path *paths, int count)
 {
-        glfs_t *fs = NULL;
+        struct rm_options options = {
+                .jobs = state->jobs,
+                .force = state->force,
+                .recursive = state->recursive,
+        };
+        const char **names = malloc (sizeof (*names) * count);
+        char **volume_paths = malloc (sizeof (*volume_paths) * count);
         int ret = -1;
 
-        ret = gluster_getfs (&fs, state->gluster_url);
-        if (ret == -1) {
-                error (0, errno, "failed to connect to `%s'", state->url);
+        if (names == NULL || volume_paths == NULL) {
+                error (0, errno, "malloc");
                 goto out;
         }
 
-        ret = apply_xlator_options (fs, &state->xlator_options);
-        if (ret == -1) {
-                error (0, errno, "failed to apply translator options");
-                goto out;
+        for (int i = 0; i < count; i++) {
+                volume_paths[i] = paths[i].gluster_url->path;
+                names[i] = paths[i].url;
         }
 
-        if (state->debug) {
-                ret = glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG);
+        ret = gluster_rm (fs, volume_paths, names, count, &options);
+
+out:
+        free (volume_paths);
+        free (names);
+
+        return ret;
+}
+
+static int
+rm_without_context (struct fs_cache *fs_cache)
+{
+        struct rm_path *paths = state->paths;
+        glfs_t *fs;
+        int next;
+        int ret = 0;
+
+        for (int i = 0; i < state->num_paths; i = next) {
+                next = i + 1;
+
+                fs = NULL;
+                if (gluster_getfs_cached (&fs, fs_cache, paths[i].gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "failed to connect to `%s'", paths[i].url);
+                        ret = -1;
+                        continue;
+                }
 
-                if (ret == -1) {
+                if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
                         error (0, errno, "failed to set logging level");
-                        goto out;
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
                 }
-        }
 
-        ret = rm (fs);
+                // Later paths on the same volume are removed together.
+                while (next < state->num_paths && gluster_same_volume (paths[i].gluster_url, paths[next].gluster_url)) {
+                        next++;
+                }
 
-out:
-        if (fs) {
-                glfs_fini (fs);
+                if (rm (fs, &paths[i], next - i) == -1) {
+                        ret = -1;
+                }
+
+                gluster_putfs (fs_cache, fs);
         }
 
         return ret;
@@ -312,7 +915,13 @@ do_rm (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = rm (ctx->fs);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = rm (ctx->fs, state->paths, state->num_paths);
         } else {
                 ret = parse_options (argc, argv, false);
                 switch (ret) {
@@ -323,13 +932,25 @@ do_rm (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = rm_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = rm_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
-                gluster_url_free (state->gluster_url);
-                free (state->url);
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
         }
 
         free (state);
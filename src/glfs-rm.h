@@ -21,6 +21,33 @@
 
 #include "glfs-cli.h"
 
+#include <glusterfs/api/glfs.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Options for gluster_rm ().
+ *
+ * jobs: Number of threads removing files and directories concurrently.
+ * force: Whether to ignore paths that do not exist.
+ * recursive: Whether to remove directories and their contents.
+ * keep_files: Whether to leave regular files found inside directories in
+ *             place, and with them the directories holding them. A move
+ *             uses this to clear the source of a tree whose files it has
+ *             already removed one by one, without losing any file that
+ *             turned up since.
+ */
+struct rm_options {
+        unsigned int jobs;
+        bool force;
+        bool recursive;
+        bool keep_files;
+};
+
+int
+gluster_rm (glfs_t *fs, char * const *paths, const char * const *names,
+            size_t count, const struct rm_options *options);
+
 int
 do_rm (struct cli_context *ctx);
 
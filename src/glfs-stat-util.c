@@ -133,7 +133,7 @@ filemodestring (struct stat const *statp, char *str)
 char*
 human_access (struct stat const *stat)
 {
-        static char modebuf[12];
+        static __thread char modebuf[12];
         filemodestring (stat, modebuf);
         modebuf[10] = 0;
         return modebuf;
@@ -175,9 +175,10 @@ get_stat_ctime (struct stat const *stat)
 char*
 human_time (struct timespec const t)
 {
-        static char fmt[64], buf[64];
-        struct tm const *tm = localtime (&t.tv_sec);
-        strftime (fmt, sizeof fmt, "%F %T.%%06u %z", tm);
+        static __thread char fmt[64], buf[64];
+        struct tm tm;
+        localtime_r (&t.tv_sec, &tm);
+        strftime (fmt, sizeof fmt, "%F %T.%%06u %z", &tm);
         snprintf (buf, sizeof buf, fmt, t.tv_nsec);
         return buf;
 }
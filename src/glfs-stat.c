@@ -20,14 +20,18 @@
 
 #include <config.h>
 
+#include "glfs-attr-cache.h"
 #include "glfs-stat.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 #include "glfs-stat-util.h"
+#include "glfs-work-queue.h"
 
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <glusterfs/api/glfs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,23 +39,62 @@
 #include <sys/stat.h>
 
 #define AUTHORS "Written by Craig Cabrey."
+#define DEFAULT_STAT_JOBS 8
 
-struct state {
+// Number of paths per job that may be outstanding behind one still being
+// stat'ed, when printing in input order.
+#define STAT_WINDOW 64
+
+/**
+ * A path supplied by the user.
+ *
+ * gluster_url: The parsed URL, or just the path with a connection.
+ * url: The path as supplied, for messages.
+ */
+struct stat_path {
         struct gluster_url *gluster_url;
-        struct xlator_option *xlator_options;
         char *url;
+};
+
+/**
+ * Used to store the state of the program, including user supplied options.
+ *
+ * paths: The paths to stat, or with files0_from the directory the paths
+ *        read are relative to.
+ * num_paths: Number of entries in paths.
+ * files0_from: File the NUL terminated paths to stat are read from, "-" for
+ *              standard input, or NULL to stat the paths given.
+ * jobs: Number of paths stat'ed concurrently.
+ * debug: Whether to log additional debug information.
+ * dereference: Whether to follow symbolic links.
+ * unordered: Whether to print each status as soon as it is known rather than
+ *            in the order of the paths.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
+ */
+struct state {
+        struct xlator_option *xlator_options;
+        struct stat_path *paths;
+        int num_paths;
+        char *files0_from;
+        unsigned int jobs;
         bool debug;
         bool dereference;
+        bool unordered;
+        enum stats_format stats;
 };
 
-struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
         {"debug", no_argument, NULL, 'd'},
         {"dereference", no_argument, NULL, 'L'},
+        {"files0-from", required_argument, NULL, 'F'},
         {"help", no_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
         {"port", no_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"unordered", no_argument, NULL, 'U'},
         {"version", no_argument, NULL, 'v'},
         {"xlator-option", required_argument, NULL, 'o'},
         {NULL, no_argument, NULL, 0}
@@ -60,24 +103,40 @@ static struct option const long_options[] =
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n"
+        printf ("Usage: %s [OPTION]... URL...\n"
+                "  or:  %s [OPTION]... --files0-from=F [URL]\n"
                 "Display file status from a remote Gluster volume.\n\n"
                 "  -L, --dereference            follow links\n"
+                "      --files0-from=F          stat the paths relative to URL named in the\n"
+                "                               local file F, each terminated by a NUL\n"
+                "                               character; if F is - read them from standard\n"
+                "                               input\n"
+                "  -j, --jobs=N                 stat up to N paths concurrently (default %d)\n"
                 "  -o, --xlator-option=OPTION   specify a translator option for the\n"
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
+                "      --unordered              print each status as soon as it is known\n"
+                "                               instead of in the order of the paths\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
                 "  gfstat glfs://host/volume/path/to/file\n"
                 "         Stat the file /path/to/file on the Gluster volume\n"
                 "         of groot on host localhost to standard output.\n"
+                "  find . -print0 | gfstat -j 32 --files0-from=- glfs://localhost/groot/dir\n"
+                "         Stat the paths found under the current directory\n"
+                "         beneath /dir on the Gluster volume groot, 32 at a time.\n"
                 "  gfcli (localhost/groot)> stat /file\n"
                 "         In the context of a shell with a connection established,\n"
                 "         stat a file on the root of the Gluster volume groot\n"
                 "         on localhost.\n",
-                program_invocation_name);
+                program_invocation_name,
+                program_invocation_name,
+                DEFAULT_STAT_JOBS);
 }
 
 static int
@@ -88,9 +147,14 @@ parse_options (int argc, char *argv[], bool has_connection)
         int opt = 0;
         int option_index = 0;
         struct xlator_option *option;
+        struct stat_path *path;
 
+        lock_getopt ();
+
+        // Reset getopt since other utilities may have called it already.
+        optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "Lo:p:", long_options,
+                opt = getopt_long (argc, argv, "j:Lo:p:", long_options,
                                 &option_index);
 
                 if (opt == -1) {
@@ -100,6 +164,16 @@ parse_options (int argc, char *argv[], bool has_connection)
                 switch (opt) {
                         case 'd':
                                 state->debug = true;
+                                break;
+                        case 'F':
+                                state->files0_from = optarg;
+                                break;
+                        case 'j':
+                                state->jobs = strtojobs (optarg);
+                                if (state->jobs == 0) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'L':
                                 state->dereference = true;
@@ -123,6 +197,16 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto out;
                                 }
 
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
+                                break;
+                        case 'U':
+                                state->unordered = true;
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -143,47 +227,65 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if (state->files0_from && (argc - optind) > 1) {
+                error (0, 0, "extra operand `%s'", argv[optind + 1]);
+                error (0, 0, "file operands cannot be combined with --files0-from");
+                goto err;
+        }
+
+        if ((argc - optind) < 1 && !(state->files0_from && has_connection)) {
                 error (0, 0, "missing operand");
                 goto err;
-        } else {
-                state->url = strdup (argv[argc - 1]);
-                if (state->url == NULL) {
+        }
+
+        // state->paths is free'd in do_stat()
+        state->paths = calloc (argc - optind + 1, sizeof (*state->paths));
+        if (state->paths == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                path = &state->paths[state->num_paths++];
+
+                path->url = strdup (argv[optind]);
+                if (path->url == NULL) {
                         error (0, errno, "strdup");
                         goto out;
                 }
 
                 if (has_connection) {
-                        state->gluster_url = gluster_url_init ();
-                        if (state->gluster_url == NULL) {
+                        path->gluster_url = gluster_url_init ();
+                        if (path->gluster_url == NULL) {
                                 error (0, errno, "gluster_url_init");
                                 goto out;
                         }
 
-                        state->gluster_url->path = strdup (argv[argc - 1]);
-                        if (state->gluster_url->path == NULL) {
+                        path->gluster_url->path = strdup (argv[optind]);
+                        if (path->gluster_url->path == NULL) {
                                 error (0, errno, "strdup");
                                 goto out;
                         }
 
-                        ret = 0;
-                        goto out;
+                        continue;
                 }
 
-                ret = gluster_parse_url (argv[argc - 1], &(state->gluster_url));
-                if (ret == -1) {
-                        error (0, EINVAL, "%s", state->url);
+                if (gluster_parse_url (argv[optind], &path->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", path->url);
                         goto err;
                 }
 
-                state->gluster_url->port = port;
+                path->gluster_url->port = port;
         }
 
+        ret = 0;
         goto out;
 
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -198,8 +300,12 @@ init_state ()
 
         state->debug = false;
         state->dereference = false;
-        state->gluster_url = NULL;
-        state->url = NULL;
+        state->files0_from = NULL;
+        state->jobs = DEFAULT_STAT_JOBS;
+        state->num_paths = 0;
+        state->paths = NULL;
+        state->stats = STATS_OFF;
+        state->unordered = false;
         state->xlator_options = NULL;
 
 out:
@@ -207,14 +313,8 @@ out:
 }
 
 static void
-print_stat (char *path, struct stat stat)
+print_stat (char *path, struct stat stat, const char *user, const char *group)
 {
-        struct passwd *pw_ent;
-        struct group *gw_ent;
-
-        pw_ent = getpwuid (stat.st_uid);
-        gw_ent = getgrgid (stat.st_gid);
-
         long unsigned int mode = stat.st_mode & CHMOD_MODE_BITS;
         long unsigned int uid = stat.st_uid;
         long unsigned int gid = stat.st_gid;
@@ -234,69 +334,472 @@ print_stat (char *path, struct stat stat)
                         mode,
                         human_access (&stat),
                         uid,
-                        pw_ent ? pw_ent->pw_name : "UNKNOWN",
+                        user,
                         gid,
-                        gw_ent ? gw_ent->gr_name : "UNKNOWN");
+                        group);
         printf ("Access: %s\n", human_time (get_stat_atime (&stat)));
         printf ("Modify: %s\n", human_time (get_stat_mtime (&stat)));
         printf ("Change: %s\n", human_time (get_stat_ctime (&stat)));
 }
 
-static int
-stat_with_fs (glfs_t *fs)
+/**
+ * A path being stat'ed.
+ *
+ * name: The path as supplied, for messages.
+ * path: The path on the volume.
+ * statbuf: Its status, once done.
+ * error: errno of the failed stat, or 0.
+ * done: Whether the stat has completed, under the lock of the pool.
+ */
+struct stat_job {
+        char *name;
+        char *path;
+        struct stat statbuf;
+        int error;
+        bool done;
+};
+
+/**
+ * Paths being stat'ed concurrently by a pool of workers sharing a connection.
+ * To print in input order, the jobs not yet printed are kept in order in
+ * window, a ring of window_size entries, and whichever worker completes the
+ * oldest of them prints it along with any completed ones that follow.
+ *
+ * submitted: Number of jobs submitted.
+ * printed: Number of jobs printed, the oldest being window[printed %
+ *          window_size].
+ * room: Signalled as jobs are printed, for the submitter to wait on when the
+ *       window is full.
+ * dereference: Whether to follow symbolic links, from state, which the
+ *              workers cannot see.
+ * stats: Statistics of the command, for the workers to attach to.
+ * failed: Whether any path could not be stat'ed.
+ * user_id, user: The last owner printed and its name, NULL before the first,
+ *                as the same few tend to own everything under a directory.
+ * group_id, group: Likewise for the group.
+ * id_buf, id_size: Buffer for looking up the names.
+ */
+struct stat_pool {
+        glfs_t *fs;
+        struct work_queue queue;
+        pthread_mutex_t lock;
+        pthread_cond_t room;
+        struct stat_job **window;
+        size_t window_size;
+        size_t submitted;
+        size_t printed;
+        pthread_t *workers;
+        unsigned int num_workers;
+        bool dereference;
+        struct stats *stats;
+        bool failed;
+        uid_t user_id;
+        char *user;
+        gid_t group_id;
+        char *group;
+        char *id_buf;
+        size_t id_size;
+};
+
+static void
+stat_job_free (struct stat_job *job)
+{
+        free (job->name);
+        free (job->path);
+        free (job);
+}
+
+static void
+stat_job_run (struct stat_pool *pool, struct stat_job *job)
 {
         int ret;
-        struct stat statbuf;
 
-        if (state->dereference) {
-                ret = glfs_stat (fs, state->gluster_url->path, &statbuf);
+        if (pool->dereference) {
+                ret = gluster_stat (pool->fs, job->path, &job->statbuf);
+        } else {
+                ret = gluster_lstat (pool->fs, job->path, &job->statbuf);
+        }
+
+        job->error = ret == -1 ? errno : 0;
+}
+
+/**
+ * Returns the name of the user id, or of the group id if group is set, from
+ * the last one printed when it is the same, or "UNKNOWN" if it has none.
+ * The name is kept in the pool, not in the lookup buffer, so that looking up
+ * the group does not overwrite the user's.
+ */
+static const char *
+stat_pool_name (struct stat_pool *pool, unsigned int id, bool group)
+{
+        char **cached = group ? &pool->group : &pool->user;
+        const char *name;
+
+        if (*cached && id == (group ? pool->group_id : pool->user_id)) {
+                return *cached;
+        }
+
+        name = lookup_id_name (id, group, &pool->id_buf, &pool->id_size);
+        if (name == NULL) {
+                return "UNKNOWN";
+        }
+
+        free (*cached);
+        *cached = strdup (name);
+        if (*cached == NULL) {
+                return "UNKNOWN";
+        }
+
+        if (group) {
+                pool->group_id = id;
         } else {
-                ret = glfs_lstat (fs, state->gluster_url->path, &statbuf);
+                pool->user_id = id;
+        }
+
+        return *cached;
+}
+
+/**
+ * Prints the status of a completed job, or why it could not be had. Called
+ * with the pool locked, if any, so that the output of jobs is not mixed.
+ */
+static void
+stat_job_print (struct stat_pool *pool, struct stat_job *job)
+{
+        const char *user;
+        const char *group;
+
+        if (job->error) {
+                error (0, job->error, "cannot stat `%s'", job->name);
+                pool->failed = true;
+                return;
+        }
+
+        user = stat_pool_name (pool, job->statbuf.st_uid, false);
+        group = stat_pool_name (pool, job->statbuf.st_gid, true);
+
+        print_stat (job->path, job->statbuf, user, group);
+}
+
+static void *
+stat_worker (void *arg)
+{
+        struct stat_pool *pool = arg;
+        struct stat_job *job;
+
+        stats_attach (pool->stats);
+
+        while ((job = work_queue_pop (&pool->queue)) != NULL) {
+                stat_job_run (pool, job);
+
+                pthread_mutex_lock (&pool->lock);
+
+                job->done = true;
+
+                if (pool->window == NULL) {
+                        stat_job_print (pool, job);
+                        stat_job_free (job);
+                } else {
+                        while (pool->printed < pool->submitted) {
+                                job = pool->window[pool->printed % pool->window_size];
+                                if (!job->done) {
+                                        break;
+                                }
+
+                                stat_job_print (pool, job);
+                                stat_job_free (job);
+                                pool->printed++;
+                        }
+
+                        pthread_cond_signal (&pool->room);
+                }
+
+                pthread_mutex_unlock (&pool->lock);
+        }
+
+        return NULL;
+}
+
+/**
+ * Starts the workers of a pool stat'ing paths on fs. With a single job, or if
+ * no worker can be started, the paths are stat'ed as they are submitted.
+ * Returns -1 with errno set on failure.
+ */
+static int
+stat_pool_init (struct stat_pool *pool, glfs_t *fs)
+{
+        pool->fs = fs;
+        pool->window = NULL;
+        pool->window_size = state->jobs * STAT_WINDOW;
+        pool->submitted = 0;
+        pool->printed = 0;
+        pool->workers = NULL;
+        pool->num_workers = 0;
+        pool->dereference = state->dereference;
+        pool->stats = stats_current ();
+        pool->failed = false;
+        pool->user = NULL;
+        pool->group = NULL;
+        pool->id_buf = NULL;
+        pool->id_size = 0;
+
+        if (work_queue_init (&pool->queue, state->jobs * 4) == -1) {
+                return -1;
+        }
+
+        pthread_mutex_init (&pool->lock, NULL);
+        pthread_cond_init (&pool->room, NULL);
+
+        if (state->jobs == 1) {
+                return 0;
+        }
+
+        if (!state->unordered) {
+                pool->window = calloc (pool->window_size, sizeof (*pool->window));
+                if (pool->window == NULL) {
+                        goto err;
+                }
+        }
+
+        pool->workers = malloc (sizeof (*pool->workers) * state->jobs);
+        if (pool->workers == NULL) {
+                goto err;
+        }
+
+        for (; pool->num_workers < state->jobs; pool->num_workers++) {
+                if (pthread_create (&pool->workers[pool->num_workers], NULL,
+                                        stat_worker, pool) != 0) {
+                        break;
+                }
+        }
+
+        return 0;
+
+err:
+        free (pool->window);
+        pthread_cond_destroy (&pool->room);
+        pthread_mutex_destroy (&pool->lock);
+        work_queue_destroy (&pool->queue);
+
+        return -1;
+}
+
+/**
+ * Stats a path, taking ownership of name and path. In input order, blocks
+ * while the window of jobs not yet printed is full.
+ */
+static void
+stat_pool_submit (struct stat_pool *pool, char *name, char *path)
+{
+        struct stat_job *job = malloc (sizeof (*job));
+
+        if (job == NULL) {
+                error (0, errno, "cannot stat `%s'", name);
+                pool->failed = true;
+                free (name);
+                free (path);
+                return;
+        }
+
+        job->name = name;
+        job->path = path;
+        job->error = 0;
+        job->done = false;
+
+        if (pool->num_workers == 0) {
+                stat_job_run (pool, job);
+                stat_job_print (pool, job);
+                stat_job_free (job);
+                return;
+        }
+
+        if (pool->window) {
+                pthread_mutex_lock (&pool->lock);
+
+                while (pool->submitted - pool->printed == pool->window_size) {
+                        pthread_cond_wait (&pool->room, &pool->lock);
+                }
+
+                pool->window[pool->submitted++ % pool->window_size] = job;
+
+                pthread_mutex_unlock (&pool->lock);
+        }
+
+        work_queue_push (&pool->queue, job);
+}
+
+/**
+ * Waits for the paths submitted to be stat'ed and printed, and stops the
+ * workers. Returns 0 if all of them could be stat'ed, or -1 otherwise.
+ */
+static int
+stat_pool_finish (struct stat_pool *pool)
+{
+        work_queue_close (&pool->queue);
+
+        for (unsigned int i = 0; i < pool->num_workers; i++) {
+                pthread_join (pool->workers[i], NULL);
+        }
+
+        free (pool->workers);
+        free (pool->window);
+        free (pool->user);
+        free (pool->group);
+        free (pool->id_buf);
+        pthread_cond_destroy (&pool->room);
+        pthread_mutex_destroy (&pool->lock);
+        work_queue_destroy (&pool->queue);
+
+        return pool->failed ? -1 : 0;
+}
+
+/**
+ * Submits the paths read from state->files0_from, relative to the path of
+ * base. Returns -1 if they could not all be read.
+ */
+static int
+submit_files0 (struct stat_pool *pool, const struct stat_path *base)
+{
+        const char *base_path = base ? base->gluster_url->path : "/";
+        FILE *stream = stdin;
+        char *input = NULL;
+        char *name;
+        char *path;
+        size_t size = 0;
+        size_t number = 0;
+        ssize_t length;
+        int ret = -1;
+
+        if (strcmp (state->files0_from, "-") != 0) {
+                stream = fopen (state->files0_from, "r");
+                if (stream == NULL) {
+                        error (0, errno, "cannot open `%s' for reading", state->files0_from);
+                        return -1;
+                }
+        }
+
+        while ((length = getdelim (&input, &size, '\0', stream)) != -1) {
+                number++;
+
+                if (length > 0 && input[length - 1] == '\0') {
+                        length--;
+                }
+
+                if (length == 0) {
+                        error (0, 0, "%s:%zu: invalid zero-length file name",
+                                        state->files0_from, number);
+                        pool->failed = true;
+                        continue;
+                }
+
+                // Paths read are relative to the base even if absolute, like
+                // those given to the shell.
+                name = strndup (input, length);
+                path = name ? append_path (base_path, name + (name[0] == '/')) : NULL;
+                if (path == NULL) {
+                        error (0, errno, "cannot stat `%s'", name ? name : input);
+                        pool->failed = true;
+                        free (name);
+                        continue;
+                }
+
+                stat_pool_submit (pool, name, path);
         }
 
-        if (ret == -1) {
-                error (0, errno, "cannot stat `%s'", state->url);
+        if (ferror (stream)) {
+                error (0, errno, "%s", state->files0_from);
                 goto out;
         }
 
-        print_stat (state->gluster_url->path, statbuf);
+        ret = 0;
 
 out:
+        free (input);
+
+        if (stream != stdin) {
+                fclose (stream);
+        }
+
         return ret;
 }
 
+/**
+ * Stats count of the paths given, or with --files0-from those read relative
+ * to the first of them, if any. The paths are on the volume of fs.
+ */
 static int
-stat_without_context ()
+stat_with_fs (glfs_t *fs, struct stat_path *paths, int count)
 {
-        glfs_t *fs = NULL;
-        int ret;
+        struct stat_pool pool;
+        char *name;
+        char *path;
+        int ret = 0;
+
+        if (stat_pool_init (&pool, fs) == -1) {
+                error (0, errno, "failed to start workers");
+                return -1;
+        }
 
-        ret = gluster_getfs (&fs, state->gluster_url);
-        if (ret == -1) {
-                error (0, errno, "failed to connect to `%s'", state->url);
-                goto out;
+        if (state->files0_from) {
+                ret = submit_files0 (&pool, count > 0 ? &paths[0] : NULL);
+        } else {
+                for (int i = 0; i < count; i++) {
+                        name = strdup (paths[i].url);
+                        path = strdup (paths[i].gluster_url->path);
+                        if (name == NULL || path == NULL) {
+                                error (0, errno, "cannot stat `%s'", paths[i].url);
+                                free (name);
+                                free (path);
+                                ret = -1;
+                                continue;
+                        }
+
+                        stat_pool_submit (&pool, name, path);
+                }
         }
 
-        ret = apply_xlator_options (fs, &state->xlator_options);
-        if (ret == -1) {
-                error (0, errno, "failed to apply translator options");
-                goto out;
+        if (stat_pool_finish (&pool) == -1) {
+                ret = -1;
         }
 
-        if (state->debug) {
-                ret = glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG);
+        return ret;
+}
 
-                if (ret == -1) {
+static int
+stat_without_context (struct fs_cache *fs_cache)
+{
+        struct stat_path *paths = state->paths;
+        glfs_t *fs;
+        int next;
+        int ret = 0;
+
+        for (int i = 0; i < state->num_paths; i = next) {
+                next = i + 1;
+
+                fs = NULL;
+                if (gluster_getfs_cached (&fs, fs_cache, paths[i].gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "failed to connect to `%s'", paths[i].url);
+                        ret = -1;
+                        continue;
+                }
+
+                if (state->debug && glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
                         error (0, errno, "failed to set logging level");
-                        goto out;
+                        gluster_putfs (fs_cache, fs);
+                        ret = -1;
+                        continue;
                 }
-        }
 
-        ret = stat_with_fs (fs);
+                // Later paths on the same volume share the connection.
+                while (next < state->num_paths && gluster_same_volume (paths[i].gluster_url, paths[next].gluster_url)) {
+                        next++;
+                }
 
-out:
-        if (fs) {
-                glfs_fini (fs);
+                if (stat_with_fs (fs, &paths[i], next - i) == -1) {
+                        ret = -1;
+                }
+
+                gluster_putfs (fs_cache, fs);
         }
 
         return ret;
@@ -323,7 +826,13 @@ do_stat (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = stat_with_fs (ctx->fs);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = stat_with_fs (ctx->fs, state->paths, state->num_paths);
         } else {
                 ret = parse_options (argc, argv, false);
                 switch (ret) {
@@ -334,13 +843,25 @@ do_stat (struct cli_context *ctx)
                                 goto out;
                 }
 
-                ret = stat_without_context ();
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                ret = stat_without_context (ctx->fs_cache);
         }
 
 out:
+        stats_finish ();
+
         if (state) {
-                gluster_url_free (state->gluster_url);
-                free (state->url);
+                for (int i = 0; i < state->num_paths; i++) {
+                        gluster_url_free (state->paths[i].gluster_url);
+                        free (state->paths[i].url);
+                }
+
+                free (state->paths);
         }
 
         free (state);
@@ -0,0 +1,345 @@
+/**
+ * Counts and times the calls the utilities make to the volume, so that a
+ * slow transfer can be told apart as client, network or brick bound.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-stats.h"
+
+#include <errno.h>
+#include <error.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// Latency buckets: bucket 0 holds calls under a microsecond and bucket n
+// those under 2^n microseconds, with the last open ended.
+#define STATS_BUCKETS 32
+
+static const char *op_names[STATS_NUM_OPS] = {
+        [STATS_READ] = "read",
+        [STATS_WRITE] = "write",
+        [STATS_STAT] = "stat",
+        [STATS_READDIR] = "readdir",
+        [STATS_UNLINK] = "unlink",
+        [STATS_LOOKUP] = "lookup",
+        [STATS_MKDIR] = "mkdir",
+};
+
+/**
+ * Totals for one kind of call. They are updated with atomic operations as
+ * calls complete on worker threads and in gfapi callbacks.
+ */
+struct stats_counter {
+        uint64_t count;
+        uint64_t errors;
+        uint64_t bytes;
+        uint64_t total_ns;
+        uint64_t max_ns;
+        uint64_t histogram[STATS_BUCKETS];
+};
+
+struct stats {
+        enum stats_format format;
+        uint64_t start;
+        struct stats_counter ops[STATS_NUM_OPS];
+};
+
+/**
+ * The statistics calls made on this thread are recorded in, if any. Worker
+ * threads attach to the statistics of the command they work for.
+ */
+static __thread struct stats *current;
+
+static uint64_t
+now_ns ()
+{
+        struct timespec ts;
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Starts collecting statistics for the command running on this thread, unless
+ * format is STATS_OFF. Returns -1 with errno set on failure.
+ */
+int
+stats_begin (enum stats_format format)
+{
+        struct stats *stats;
+
+        current = NULL;
+
+        if (format == STATS_OFF) {
+                return 0;
+        }
+
+        stats = calloc (1, sizeof (*stats));
+        if (stats == NULL) {
+                return -1;
+        }
+
+        stats->format = format;
+        stats->start = now_ns ();
+        current = stats;
+
+        return 0;
+}
+
+struct stats *
+stats_current ()
+{
+        return current;
+}
+
+void
+stats_attach (struct stats *stats)
+{
+        current = stats;
+}
+
+/**
+ * Returns the time at which a call is being made, to be handed back to
+ * stats_end (), or 0 if statistics are not being collected on this thread.
+ */
+uint64_t
+stats_start ()
+{
+        return current ? now_ns () : 0;
+}
+
+/**
+ * Records a call made at start on this thread, which returned ret: the number
+ * of bytes transferred for reads and writes, or -1 on failure.
+ */
+void
+stats_end (enum stats_op op, uint64_t start, ssize_t ret)
+{
+        stats_record (current, op, start, ret);
+}
+
+/**
+ * Records a call into the given statistics, for calls that complete on a
+ * thread other than the one they were made on.
+ */
+void
+stats_record (struct stats *stats, enum stats_op op, uint64_t start, ssize_t ret)
+{
+        struct stats_counter *counter;
+        uint64_t elapsed;
+        uint64_t max;
+        uint64_t us;
+        unsigned int bucket;
+
+        if (stats == NULL || start == 0) {
+                return;
+        }
+
+        counter = &stats->ops[op];
+        elapsed = now_ns () - start;
+
+        us = elapsed / 1000;
+        bucket = us ? 64 - __builtin_clzll (us) : 0;
+        if (bucket >= STATS_BUCKETS) {
+                bucket = STATS_BUCKETS - 1;
+        }
+
+        __atomic_fetch_add (&counter->count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&counter->total_ns, elapsed, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&counter->histogram[bucket], 1, __ATOMIC_RELAXED);
+
+        if (ret == -1) {
+                __atomic_fetch_add (&counter->errors, 1, __ATOMIC_RELAXED);
+        } else if (op == STATS_READ || op == STATS_WRITE) {
+                __atomic_fetch_add (&counter->bytes, ret, __ATOMIC_RELAXED);
+        }
+
+        max = __atomic_load_n (&counter->max_ns, __ATOMIC_RELAXED);
+        while (elapsed > max
+                        && !__atomic_compare_exchange_n (&counter->max_ns, &max, elapsed, true,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Returns the latency in microseconds under which the given percentage of the
+ * calls completed, to the resolution of the histogram.
+ */
+static uint64_t
+percentile (const struct stats_counter *counter, unsigned int percent)
+{
+        uint64_t target = (counter->count * percent + 99) / 100;
+        uint64_t seen = 0;
+        uint64_t max_us = counter->max_ns / 1000;
+
+        for (unsigned int i = 0; i < STATS_BUCKETS - 1; i++) {
+                seen += counter->histogram[i];
+                if (seen >= target) {
+                        return (1ULL << i) < max_us ? (1ULL << i) : max_us;
+                }
+        }
+
+        return max_us;
+}
+
+static void
+print_text (const struct stats *stats, double elapsed)
+{
+        const struct stats_counter *counter;
+
+        fprintf (stderr, "%s: %.3f s elapsed\n", program_invocation_name, elapsed);
+        fprintf (stderr, "%-8s %10s %7s %14s %10s %10s %9s %9s %9s %9s %9s\n",
+                 "op", "count", "errors", "bytes", "bytes/op", "MB/s",
+                 "avg us", "p50 us", "p90 us", "p99 us", "max us");
+
+        for (unsigned int op = 0; op < STATS_NUM_OPS; op++) {
+                counter = &stats->ops[op];
+                if (counter->count == 0) {
+                        continue;
+                }
+
+                fprintf (stderr,
+                         "%-8s %10" PRIu64 " %7" PRIu64 " %14" PRIu64 " %10" PRIu64
+                         " %10.2f %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64
+                         " %9" PRIu64 "\n",
+                         op_names[op],
+                         counter->count,
+                         counter->errors,
+                         counter->bytes,
+                         counter->bytes / counter->count,
+                         elapsed > 0 ? counter->bytes / elapsed / 1e6 : 0,
+                         counter->total_ns / counter->count / 1000,
+                         percentile (counter, 50),
+                         percentile (counter, 90),
+                         percentile (counter, 99),
+                         counter->max_ns / 1000);
+        }
+}
+
+static void
+print_json (const struct stats *stats, double elapsed)
+{
+        const struct stats_counter *counter;
+        const char *separator = "";
+
+        fprintf (stderr, "{\"command\":\"%s\",\"elapsed_s\":%.6f,\"ops\":{",
+                 program_invocation_name, elapsed);
+
+        for (unsigned int op = 0; op < STATS_NUM_OPS; op++) {
+                counter = &stats->ops[op];
+                if (counter->count == 0) {
+                        continue;
+                }
+
+                fprintf (stderr,
+                         "%s\"%s\":{\"count\":%" PRIu64 ",\"errors\":%" PRIu64
+                         ",\"bytes\":%" PRIu64 ",\"bytes_per_op\":%" PRIu64
+                         ",\"bytes_per_sec\":%.0f,\"latency_us\":{\"avg\":%" PRIu64
+                         ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+                         ",\"max\":%" PRIu64 ",\"histogram\":[",
+                         separator,
+                         op_names[op],
+                         counter->count,
+                         counter->errors,
+                         counter->bytes,
+                         counter->bytes / counter->count,
+                         elapsed > 0 ? counter->bytes / elapsed : 0,
+                         counter->total_ns / counter->count / 1000,
+                         percentile (counter, 50),
+                         percentile (counter, 90),
+                         percentile (counter, 99),
+                         counter->max_ns / 1000);
+
+                // Each bucket is given as [upper bound in us, calls], with a
+                // null bound for the last.
+                for (unsigned int i = 0, first = 1; i < STATS_BUCKETS; i++) {
+                        if (counter->histogram[i] == 0) {
+                                continue;
+                        }
+
+                        if (i < STATS_BUCKETS - 1) {
+                                fprintf (stderr, "%s[%llu,%" PRIu64 "]", first ? "" : ",",
+                                         1ULL << i, counter->histogram[i]);
+                        } else {
+                                fprintf (stderr, "%s[null,%" PRIu64 "]", first ? "" : ",",
+                                         counter->histogram[i]);
+                        }
+
+                        first = 0;
+                }
+
+                fprintf (stderr, "]}}");
+                separator = ",";
+        }
+
+        fprintf (stderr, "}}\n");
+}
+
+/**
+ * Prints the statistics collected for the command running on this thread to
+ * standard error, in the format asked for, and stops collecting them. Any
+ * worker threads attached to them must have finished.
+ */
+void
+stats_finish ()
+{
+        double elapsed;
+
+        if (current == NULL) {
+                return;
+        }
+
+        elapsed = (now_ns () - current->start) / 1e9;
+
+        if (current->format == STATS_JSON) {
+                print_json (current, elapsed);
+        } else {
+                print_text (current, elapsed);
+        }
+
+        free (current);
+        current = NULL;
+}
+
+/**
+ * Converts the argument of --stats, which is optional, into a format. Returns
+ * STATS_OFF on failure.
+ */
+enum stats_format
+strtostatsformat (const char *str)
+{
+        if (str == NULL || strcasecmp (str, "text") == 0) {
+                return STATS_TEXT;
+        }
+
+        if (strcasecmp (str, "json") == 0) {
+                return STATS_JSON;
+        }
+
+        error (0, 0, "invalid stats format: \"%s\"", str);
+
+        return STATS_OFF;
+}
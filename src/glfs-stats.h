@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_STATS_H
+#define GLFS_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * The calls to the volume that are timed. Reads and writes include their
+ * asynchronous forms, timed from submission to completion. stat covers
+ * stat, lstat and fstat, unlink covers unlink and rmdir, and lookup covers
+ * the lookups of handles relative to their parent.
+ */
+enum stats_op {
+        STATS_READ,
+        STATS_WRITE,
+        STATS_STAT,
+        STATS_READDIR,
+        STATS_UNLINK,
+        STATS_LOOKUP,
+        STATS_MKDIR,
+        STATS_NUM_OPS
+};
+
+enum stats_format {
+        STATS_OFF,
+        STATS_TEXT,
+        STATS_JSON
+};
+
+struct stats;
+
+int
+stats_begin (enum stats_format format);
+
+void
+stats_finish ();
+
+struct stats *
+stats_current ();
+
+void
+stats_attach (struct stats *stats);
+
+uint64_t
+stats_start ();
+
+void
+stats_end (enum stats_op op, uint64_t start, ssize_t ret);
+
+void
+stats_record (struct stats *stats, enum stats_op op, uint64_t start, ssize_t ret);
+
+enum stats_format
+strtostatsformat (const char *str);
+
+#endif /* GLFS_STATS_H */
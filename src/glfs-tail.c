@@ -21,14 +21,21 @@
 
 #include <config.h>
 
+#include "glfs-attr-cache.h"
+#include "glfs-stats.h"
 #include "glfs-tail.h"
 #include "glfs-util.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <glusterfs/api/glfs.h>
+#include <glusterfs/api/glfs-handles.h>
 #include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -37,10 +44,26 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #define AUTHORS "Written by Craig Cabrey."
 
+// While following, the poll interval doubles each time the file is found
+// unchanged, up to this many times the sleep interval.
+#define MAX_BACKOFF 16
+
+// Longest uninterrupted wait, so that an interrupt is noticed promptly.
+#define WAIT_SLICE 100000
+
+// Windows read backwards by tail -n start at the buffer size and grow up to
+// this size.
+#define MAX_WINDOW_SIZE 16*1024*1024
+
+// Past this much, the windows read by tail -n are no longer kept in memory to
+// print the lines from.
+#define MAX_RETAINED_SIZE 64*1024*1024
+
 static volatile int keep_running = 1;
 
 static void
@@ -56,33 +79,76 @@ enum tail_mode
 };
 
 /**
- * Used to store the state of the program, including user supplied options.
+ * A file being tailed.
  *
  * gluster_url: Struct of the parsed url supplied by the user.
- * url: Full url used to find the remote file.
+ * url: Full url used to find the remote file, also used in headers.
+ * fs: Connection to the volume of the file, shared with the other files on
+ *     the same volume.
+ * fd: The open file, or NULL once it can no longer be followed.
+ * size: Size of the file as of the last read.
+ * handle: GFID of the file, compared against the inode of each cache
+ *         invalidation.
+ * registered: Whether upcalls were registered for fs with this file.
+ * changed: Whether a notification arrived since the file was last stat'ed.
+ * notified: Whether any notification arrived for the file at all, i.e.
+ *           whether its volume sends upcalls.
+ * interval: Current poll interval in microseconds.
+ * next_poll: Time of the next poll, in microseconds of the monotonic clock.
+ */
+struct tail_file {
+        struct gluster_url *gluster_url;
+        char *url;
+        glfs_t *fs;
+        glfs_fd_t *fd;
+        long long size;
+        unsigned char handle[GFAPI_HANDLE_LENGTH];
+        bool has_handle;
+        bool registered;
+        bool changed;
+        bool notified;
+        unsigned long int interval;
+        uint64_t next_poll;
+};
+
+/**
+ * Used to store the state of the program, including user supplied options.
+ *
+ * files: The files to tail (supplied by user).
+ * num_files: Number of entries in files.
  * bytes: Number of bytes to print from the end of the file.
  * debug: Whether to log additional debug information.
  * follow: Whether to continue tailing the output of the file as new data appears.
  * lines: Number of lines to print from the end of the file.
- * sleep_interval: Length of time to sleep in between polling the file for changes.
+ * sleep_interval: Length of time to sleep in between polling the file for
+ *                 changes, right after it changed. The interval backs off
+ *                 while the file is idle.
  * mode: The mode the application is in (bytes vs lines).
+ * quiet: Whether to never print headers giving file names.
+ * buffer_size: Size of the reads, BUFFER_SIZE_AUTO to size them from the
+ *              volume and each file, or 0 for the default.
+ * stats: Format of the statistics printed on exit, or STATS_OFF.
  */
 struct state {
-        struct gluster_url *gluster_url;
         struct xlator_option *xlator_options;
-        char *url;
+        struct tail_file *files;
+        int num_files;
         unsigned int bytes;
         bool debug;
         bool follow;
+        bool quiet;
         unsigned int lines;
         unsigned long int sleep_interval;
         enum tail_mode mode;
+        size_t buffer_size;
+        enum stats_format stats;
 };
 
-static struct state *state;
+static __thread struct state *state;
 
 static struct option const long_options[] =
 {
+        {"buffer-size", required_argument, NULL, 'B'},
         {"bytes", required_argument, NULL, 'c'},
         {"debug", no_argument, NULL, 'd'},
         {"follow", no_argument, NULL, 'f'},
@@ -90,7 +156,11 @@ static struct option const long_options[] =
         {"lines", required_argument, NULL, 'n'},
         {"xlator-option", required_argument, NULL, 'o'},
         {"port", required_argument, NULL, 'p'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"silent", no_argument, NULL, 'q'},
         {"sleep-internal", required_argument, NULL, 's'},
+        {"sleep-interval", required_argument, NULL, 's'},
+        {"stats", optional_argument, NULL, 'S'},
         {"version", no_argument, NULL, 'v'},
         {NULL, no_argument, NULL, 0}
 };
@@ -101,8 +171,11 @@ static struct option const long_options[] =
 static void
 usage ()
 {
-        printf ("Usage: %s [OPTION]... URL\n"
-                "Print the last 10 lines (default) of the file to standard output.\n\n"
+        printf ("Usage: %s [OPTION]... URL...\n"
+                "Print the last 10 lines (default) of each file to standard output.\n"
+                "With more than one file, precede each with a header giving the file name.\n\n"
+                "      --buffer-size=SIZE       read the files in blocks of SIZE bytes; with\n"
+                "                               auto, size them from the volume and each file\n"
                 "  -c, --bytes=K                output the last K bytes\n"
                 "  -f, --follow                 output appended data as the file grows\n"
                 "  -n, --lines=K                output the last K lines, instead of the last 10\n"
@@ -110,8 +183,16 @@ usage ()
                 "                               connection. Multiple options are supported\n"
                 "                               and take the form xlator.key=value.\n"
                 "  -p, --port=PORT              specify the port on which to connect\n"
-                "  -s, --sleep-internal=N       with -f, sleep for approximately N \n"
-                "                               microseconds (default is 50,000)\n"
+                "  -q, --quiet, --silent        never output headers giving file names\n"
+                "  -s, --sleep-interval=N       with -f, poll for changes approximately\n"
+                "                               every N microseconds (default is\n"
+                "                               500,000), backing off up to %d times\n"
+                "                               longer while the file is idle. When the\n"
+                "                               volume sends cache invalidation upcalls,\n"
+                "                               changes are picked up without waiting.\n"
+                "      --stats[=FORMAT]         print the number and latency of the calls made\n"
+                "                               to the volume on exit; FORMAT is text (the\n"
+                "                               default) or json\n"
                 "      --help     display this help and exit\n"
                 "      --version  output version information and exit\n\n"
                 "Examples:\n"
@@ -125,11 +206,15 @@ usage ()
                 "         Tail the last 10 lines of the file /file on the Gluster\n"
                 "         volume groot on host localhost, following the file\n"
                 "         until an interrupt is received.\n"
+                "  gftail -f glfs://localhost/groot/a glfs://localhost/groot/b\n"
+                "         Follow the files /a and /b on the Gluster volume groot\n"
+                "         over a single connection.\n"
                 "  gfcli (localhost/groot)> tail /example\n"
                 "        In the context of a shell with a connection established,\n"
                 "        tail the file example on the root of the Gluster volume\n"
                 "        groot on localhost.\n",
-                program_invocation_name);
+                program_invocation_name,
+                MAX_BACKOFF);
 }
 
 /**
@@ -168,18 +253,28 @@ parse_options (int argc, char *argv[], bool has_connection)
         int ret = -1;
         int opt = 0;
         int option_index = 0;
+        struct tail_file *file;
         struct xlator_option *option;
 
+        lock_getopt ();
+
         // Reset getopt since other utilities may have called it already.
         optind = 0;
         while (true) {
-                opt = getopt_long (argc, argv, "c:dfl:n:o:p:s:", long_options, &option_index);
+                opt = getopt_long (argc, argv, "c:dfl:n:o:p:qs:", long_options, &option_index);
 
                 if (opt == -1) {
                         break;
                 }
 
                 switch (opt) {
+                        case 'B':
+                                state->buffer_size = strtobuffersize (optarg);
+                                if (state->buffer_size == 0) {
+                                        goto err;
+                                }
+
+                                break;
                         case 'c':
                                 state->bytes = strtoint (optarg);
                                 if (state->bytes == -1) {
@@ -223,6 +318,9 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto err;
                                 }
 
+                                break;
+                        case 'q':
+                                state->quiet = true;
                                 break;
                         case 's':
                                 state->sleep_interval = strtoul (optarg, NULL, 10);
@@ -231,6 +329,13 @@ parse_options (int argc, char *argv[], bool has_connection)
                                         goto out;
                                 }
 
+                                break;
+                        case 'S':
+                                state->stats = strtostatsformat (optarg);
+                                if (state->stats == STATS_OFF) {
+                                        goto err;
+                                }
+
                                 break;
                         case 'v':
                                 printf ("%s (%s) %s\n%s\n%s\n%s\n",
@@ -251,37 +356,59 @@ parse_options (int argc, char *argv[], bool has_connection)
                 }
         }
 
-        if ((argc - option_index) < 2) {
+        if ((argc - optind) < 1) {
                 error (0, 0, "missing operand");
                 goto err;
-        } else {
-                state->url = strdup (argv[argc - 1]);
-                if (state->url == NULL) {
+        }
+
+        // state->files is free'd in do_tail()
+        state->files = calloc (argc - optind, sizeof (*state->files));
+        if (state->files == NULL) {
+                error (0, errno, "calloc");
+                goto out;
+        }
+
+        for (; optind < argc; optind++) {
+                file = &state->files[state->num_files++];
+
+                file->url = strdup (argv[optind]);
+                if (file->url == NULL) {
                         error (0, errno, "strdup");
                         goto out;
                 }
 
                 if (has_connection) {
-                        state->gluster_url = gluster_url_init ();
-                        state->gluster_url->path = strdup (argv[argc -1]);
-                        ret = 0;
-                        goto out;
+                        file->gluster_url = gluster_url_init ();
+                        if (file->gluster_url == NULL) {
+                                error (0, errno, "gluster_url_init");
+                                goto out;
+                        }
+
+                        file->gluster_url->path = strdup (argv[optind]);
+                        if (file->gluster_url->path == NULL) {
+                                error (0, errno, "strdup");
+                                goto out;
+                        }
+
+                        continue;
                 }
 
-                ret = gluster_parse_url (argv[argc - 1], &(state->gluster_url));
-                if (ret == -1) {
-                        error (0, EINVAL, "%s", state->url);
+                if (gluster_parse_url (argv[optind], &file->gluster_url) == -1) {
+                        error (0, EINVAL, "%s", file->url);
                         goto err;
                 }
 
-                state->gluster_url->port = port;
+                file->gluster_url->port = port;
         }
 
+        ret = 0;
         goto out;
 
 err:
         error (0, 0, "Try --help for more information.");
 out:
+        unlock_getopt ();
+
         return ret;
 }
 
@@ -297,16 +424,22 @@ init_state ()
                 goto out;
         }
 
+        state->buffer_size = 0;
         state->bytes = 0;
         state->debug = false;
+        state->files = NULL;
         state->follow = false;
-        state->gluster_url = NULL;
         state->lines = 10;
         state->mode = LINES;
+        state->num_files = 0;
+        state->quiet = false;
         state->sleep_interval = 500000;
-        state->url = NULL;
+        state->stats = STATS_OFF;
         state->xlator_options = NULL;
 
+        // The buffer size may have been changed by an earlier command.
+        gluster_set_buffer_size (0);
+
 out:
         return state;
 }
@@ -334,127 +467,629 @@ tail_bytes (glfs_fd_t *fd, struct stat *statbuf)
 }
 
 /**
- * Sets the offset of the fd object based on the number of newlines.
+ * Looks for the count'th newline from the end of buf. Returns a pointer to
+ * it, or NULL after subtracting the number of newlines in buf from count.
+ *
+ * With SSE2, newlines are counted sixteen bytes at a time with a compare and
+ * a movemask, and only the block holding the wanted newline is searched bit by
+ * bit. The remaining head of the buffer, or all of it without SSE2, is left to
+ * memrchr.
+ */
+static const char *
+find_newline_reverse (const char *buf, size_t length, size_t *count)
+{
+        const char *newline;
+#ifdef __SSE2__
+        const __m128i newlines = _mm_set1_epi8 ('\n');
+        unsigned int found;
+        unsigned int mask;
+        __m128i block;
+
+        for (; length >= 16; length -= 16) {
+                block = _mm_loadu_si128 ((const __m128i *) (buf + length - 16));
+                mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, newlines));
+                found = __builtin_popcount (mask);
+
+                if (found < *count) {
+                        *count -= found;
+                        continue;
+                }
+
+                // The highest set bits are the last newlines of the block.
+                for (; *count > 1; (*count)--) {
+                        mask &= ~(1u << (31 - __builtin_clz (mask)));
+                }
+
+                *count = 0;
+                return buf + length - 16 + (31 - __builtin_clz (mask));
+        }
+#endif
+
+        while ((newline = memrchr (buf, '\n', length)) != NULL) {
+                if (--(*count) == 0) {
+                        return newline;
+                }
+
+                length = newline - buf;
+        }
+
+        return NULL;
+}
+
+/**
+ * A block of the file read while looking for the start of the last lines.
+ * Blocks are kept in file order so that the lines can be printed from them.
+ */
+struct window {
+        struct window *next;
+        off_t offset;
+        size_t length;
+        char data[];
+};
+
+static void
+free_windows (struct window *windows)
+{
+        struct window *next;
+
+        for (; windows; windows = next) {
+                next = windows->next;
+                free (windows);
+        }
+}
+
+static ssize_t
+pread_full (glfs_fd_t *fd, char *buf, size_t count, off_t offset)
+{
+        size_t total = 0;
+        ssize_t num_read;
+        uint64_t start;
+
+        while (total < count) {
+                start = stats_start ();
+                num_read = glfs_pread (fd, buf + total, count - total, offset + total, 0);
+                stats_end (STATS_READ, start, num_read);
+                if (num_read == -1) {
+                        return -1;
+                }
+
+                if (num_read == 0) {
+                        break;
+                }
+
+                total += num_read;
+        }
+
+        return total;
+}
+
+static int
+write_full (int fd, const char *buf, size_t count)
+{
+        ssize_t written;
+
+        while (count > 0) {
+                written = write (fd, buf, count);
+                if (written == -1) {
+                        return -1;
+                }
+
+                buf += written;
+                count -= written;
+        }
+
+        return 0;
+}
+
+/**
+ * Prints the last lines of the file. The file is read backwards in windows
+ * that start at the buffer size (BUFSIZE by default) and grow, both by
+ * doubling and from the line length seen so far, so a large -n needs few
+ * round trips. The lines are printed from the windows once their start is
+ * found, and the offset of fd is left at the end of what was printed.
+ *
+ * If the windows would take more than MAX_RETAINED_SIZE, they are dropped as
+ * they are scanned, and the offset of fd is left at the start of the lines
+ * for gluster_read () to print them instead.
  */
 static int
 tail_lines (glfs_fd_t *fd, struct stat *statbuf)
 {
-        int ret = 0;
-        int newline_count = 0;
+        struct window *windows = NULL;
+        struct window *window;
+        size_t needed = state->lines;
+        size_t window_size = gluster_get_buffer_size (BUFSIZE);
+        size_t scan_length;
+        size_t estimate;
+        size_t retained = 0;
+        size_t skip;
+        off_t size = statbuf->st_size;
+        off_t offset = size;
+        off_t start = 0;
+        off_t end = size;
+        const char *newline;
+        bool retain = true;
         ssize_t num_read;
-        char buffer[BUFSIZE];
-        long long offset;
-        long long size = (long long) statbuf->st_size;
+        int ret = -1;
 
-        offset = size - BUFSIZE;
-        if (offset < 0) {
-                offset = 0;
+        if (needed == 0) {
+                start = size;
+                retain = false;
+                goto seek;
         }
 
-        if (state->lines == 0) {
-                offset = size;
-                goto finished;
-        }
+        while (offset > 0) {
+                if ((off_t) window_size > offset) {
+                        window_size = offset;
+                }
 
-        while (true) {
-                ret = glfs_lseek (fd, offset, SEEK_SET);
-                if (ret == -1) {
-                        error (0, errno, "seek error");
-                        goto err;
+                offset -= window_size;
+
+                window = malloc (sizeof (*window) + window_size);
+                if (window == NULL) {
+                        error (0, errno, "malloc");
+                        goto out;
                 }
 
-                num_read = glfs_read (fd, &buffer, BUFSIZE, 0);
+                num_read = pread_full (fd, window->data, window_size, offset);
                 if (num_read == -1) {
                         error (0, errno, "read error");
-                        goto err;
+                        free (window);
+                        goto out;
                 }
 
-                for (int i = num_read - 1; i >= 0; i--) {
-                        if (buffer[i] == '\n') {
-                                newline_count++;
-                        }
+                window->offset = offset;
+                window->length = num_read;
+                window->next = windows;
 
-                        if (newline_count == (state->lines + 1)) {
-                                offset += i + 1;
-                                goto finished;
-                        }
+                // A newline ending the file terminates the last line rather
+                // than starting another one.
+                scan_length = window->length;
+                if (offset + (off_t) window->length == size && scan_length > 0
+                                && window->data[scan_length - 1] == '\n') {
+                        scan_length--;
                 }
 
-                if ((offset - BUFSIZE) < 0) {
-                        offset -= num_read;
-                        break;
+                newline = find_newline_reverse (window->data, scan_length, &needed);
+                if (newline) {
+                        start = offset + (newline - window->data) + 1;
+                }
+
+                if (retain) {
+                        windows = window;
+                        retained += window->length;
                 } else {
-                        offset -= BUFSIZE;
+                        free (window);
                 }
-        }
 
-        num_read = glfs_read (fd, &buffer, BUFSIZE, 0);
-        if (num_read == -1) {
-                error (0, errno, "read error");
-                goto err;
-        }
+                if (newline) {
+                        break;
+                }
 
-        for (int i = num_read - 1; i >= 0; i--) {
-                if (buffer[i] == '\n') {
-                        newline_count++;
+                if (retain && retained > MAX_RETAINED_SIZE) {
+                        free_windows (windows);
+                        windows = NULL;
+                        retain = false;
                 }
 
-                if (newline_count == (state->lines + 1)) {
-                        offset += i + 1;
-                        goto finished;
+                // Size the next window from the average line length so far,
+                // but at least double it.
+                estimate = window_size * 2;
+                if (needed < state->lines) {
+                        estimate = (size - offset) / (state->lines - needed) * needed;
+                        estimate += estimate / 4;
+                        if (estimate < window_size * 2) {
+                                estimate = window_size * 2;
+                        }
                 }
+
+                window_size = estimate < MAX_WINDOW_SIZE ? estimate : MAX_WINDOW_SIZE;
         }
 
-        if (newline_count < state->lines) {
-                offset = 0;
+        if (!retain) {
+                goto seek;
         }
 
-        if (offset < 0) {
-                offset = 0;
+        end = start;
+        for (window = windows; window; window = window->next) {
+                end = window->offset + window->length;
+                if (end <= start) {
+                        continue;
+                }
+
+                skip = start > window->offset ? start - window->offset : 0;
+                if (write_full (STDOUT_FILENO, window->data + skip, window->length - skip) == -1) {
+                        error (0, errno, "write error");
+                        goto out;
+                }
         }
 
-finished:
-        ret = glfs_lseek (fd, offset, SEEK_SET);
-        if (ret == -1) {
+        start = end;
+
+seek:
+        if (glfs_lseek (fd, start, SEEK_SET) == -1) {
                 error (0, errno, "seek error");
+                goto out;
         }
 
-        goto out;
+        ret = 0;
 
-err:
-        ret = -1;
 out:
+        free_windows (windows);
+
         return ret;
 }
 
+/**
+ * Used to wake up the follow loop when any of the followed files changes.
+ * Upcalls arrive on threads of gfapi, so the files are reached from here
+ * rather than through the thread-local state.
+ *
+ * changed: Whether a notification arrived since the last wait.
+ */
+struct follow {
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        struct tail_file *files;
+        int num_files;
+        bool changed;
+};
+
+static uint64_t
+now_us ()
+{
+        struct timespec now;
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+
+        return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#ifdef HAVE_GLFS_UPCALL_REGISTER
+static void
+upcall_cbk (struct glfs_upcall *upcall, void *data)
+{
+        struct follow *follow = data;
+        struct glfs_upcall_inode *event;
+        struct glfs_object *object = NULL;
+        struct tail_file *files = follow->files;
+        unsigned char handle[GFAPI_HANDLE_LENGTH];
+        bool has_handle = false;
+        glfs_t *fs;
+
+        if (glfs_upcall_get_reason (upcall) != GLFS_UPCALL_INODE_INVALIDATE) {
+                goto out;
+        }
+
+        fs = glfs_upcall_get_fs (upcall);
+
+        // Only one callback can be registered, so pass the news on.
+        gluster_attr_cache_clear (fs);
+
+        event = glfs_upcall_get_event (upcall);
+        if (event) {
+                object = glfs_upcall_inode_get_object (event);
+        }
+
+        if (object) {
+                has_handle = glfs_h_extract_handle (object, handle, GFAPI_HANDLE_LENGTH) == GFAPI_HANDLE_LENGTH;
+        }
+
+        pthread_mutex_lock (&follow->lock);
+        for (int i = 0; i < follow->num_files; i++) {
+                if (files[i].fs != fs || files[i].fd == NULL) {
+                        continue;
+                }
+
+                // Without handles to compare, any invalidation may be ours.
+                if (has_handle && files[i].has_handle
+                                && memcmp (handle, files[i].handle, GFAPI_HANDLE_LENGTH) != 0) {
+                        continue;
+                }
+
+                files[i].changed = true;
+                files[i].notified = true;
+                follow->changed = true;
+        }
+
+        if (follow->changed) {
+                pthread_cond_signal (&follow->cond);
+        }
+
+        pthread_mutex_unlock (&follow->lock);
+
+out:
+        glfs_free (upcall);
+}
+#endif
+
+/**
+ * Asks for cache invalidation upcalls on the followed files, once for each
+ * volume. Files whose upcalls cannot be registered rely on polling alone.
+ */
+static void
+follow_register (struct follow *follow)
+{
+#ifdef HAVE_GLFS_UPCALL_REGISTER
+        struct tail_file *file;
+        struct glfs_object *object;
+        bool registered;
+
+        for (int i = 0; i < state->num_files; i++) {
+                file = &state->files[i];
+                if (file->fd == NULL) {
+                        continue;
+                }
+
+                object = glfs_h_lookupat (file->fs, NULL, file->gluster_url->path, NULL, 1);
+                if (object) {
+                        file->has_handle = glfs_h_extract_handle (object,
+                                        file->handle,
+                                        GFAPI_HANDLE_LENGTH) == GFAPI_HANDLE_LENGTH;
+                        glfs_h_close (object);
+                }
+
+                registered = false;
+                for (int j = 0; j < i; j++) {
+                        registered |= state->files[j].registered && state->files[j].fs == file->fs;
+                }
+
+                if (!registered) {
+                        file->registered = glfs_upcall_register (file->fs,
+                                        GLFS_EVENT_INODE_INVALIDATE,
+                                        upcall_cbk,
+                                        follow) > 0;
+                }
+        }
+#endif
+}
+
+static void
+follow_unregister ()
+{
+#ifdef HAVE_GLFS_UPCALL_REGISTER
+        for (int i = 0; i < state->num_files; i++) {
+                if (state->files[i].registered) {
+                        glfs_upcall_unregister (state->files[i].fs, GLFS_EVENT_INODE_INVALIDATE);
+                        gluster_attr_cache_upcalls (state->files[i].fs);
+                }
+        }
+#endif
+}
+
+/**
+ * Waits until the given time, or less if a notification arrives or an
+ * interrupt is received.
+ */
+static void
+follow_wait (struct follow *follow, uint64_t deadline)
+{
+        struct timespec timeout;
+        uint64_t now;
+        uint64_t until;
+
+        pthread_mutex_lock (&follow->lock);
+        while (keep_running && !follow->changed) {
+                now = now_us ();
+                if (now >= deadline) {
+                        break;
+                }
+
+                until = deadline - now > WAIT_SLICE ? now + WAIT_SLICE : deadline;
+                timeout.tv_sec = until / 1000000;
+                timeout.tv_nsec = (until % 1000000) * 1000;
+
+                pthread_cond_timedwait (&follow->cond, &follow->lock, &timeout);
+        }
+
+        follow->changed = false;
+        pthread_mutex_unlock (&follow->lock);
+}
+
+/**
+ * Prints a header giving the name of the file, if headers are shown and the
+ * previous output came from another file.
+ */
+static void
+print_header (struct tail_file *file, struct tail_file **last)
+{
+        if (*last == file) {
+                return;
+        }
+
+        if (!state->quiet && state->num_files > 1) {
+                printf ("%s==> %s <==\n", *last ? "\n" : "", file->url);
+                fflush (stdout);
+        }
+
+        *last = file;
+}
+
+static void
+close_file (struct tail_file *file)
+{
+        if (glfs_close (file->fd) == -1) {
+                error (0, errno, "failed to close file");
+        }
+
+        file->fd = NULL;
+}
+
+/**
+ * Checks a followed file for new data, printing it if there is any. The poll
+ * interval of the file is reset after a change, and backs off while it stays
+ * idle; once its volume is known to send upcalls, polling is only a safety
+ * net at the longest interval.
+ */
 static int
-tail (glfs_t *fs)
+poll_file (struct tail_file *file, struct tail_file **last)
 {
-        glfs_fd_t *fd = NULL;
+        unsigned long int max_interval = state->sleep_interval * MAX_BACKOFF;
+        struct stat statbuf;
+        uint64_t start = stats_start ();
         int ret;
+
+        ret = glfs_stat (file->fs, file->gluster_url->path, &statbuf);
+        stats_end (STATS_STAT, start, ret);
+        if (ret == -1) {
+                error (0, errno, "cannot open `%s' for reading", file->url);
+                close_file (file);
+                return -1;
+        }
+
+        if (statbuf.st_size == file->size) {
+                if (file->notified) {
+                        file->interval = max_interval;
+                } else if (file->interval < max_interval) {
+                        file->interval *= 2;
+                }
+
+                return 0;
+        }
+
+        file->interval = file->notified ? max_interval : state->sleep_interval;
+
+        if (statbuf.st_size < file->size) {
+                error (0, 0, "file truncated: %s", file->gluster_url->path);
+                glfs_lseek (file->fd, 0, SEEK_SET);
+        }
+
+        file->size = statbuf.st_size;
+
+        print_header (file, last);
+        if (gluster_read (file->fd, STDOUT_FILENO, NULL) == -1) {
+                error (0, errno, "read error: %s", file->gluster_url->path);
+                close_file (file);
+                return -1;
+        }
+
+        return 0;
+}
+
+/**
+ * Prints data appended to the files until an interrupt is received or none
+ * of them can be followed any longer. The files share one loop, which stats
+ * a file when it is invalidated or when its poll interval elapses.
+ */
+static int
+follow_files (struct tail_file *last)
+{
+        struct follow follow_ctx = {
+                .files = state->files,
+                .num_files = state->num_files,
+                .changed = false,
+        };
+        struct follow *follow = &follow_ctx;
+        pthread_condattr_t attr;
+        struct tail_file *file;
+        uint64_t deadline;
+        uint64_t now;
+        bool changed;
+        bool remaining;
+        int ret = 0;
+
+        pthread_mutex_init (&follow->lock, NULL);
+        pthread_condattr_init (&attr);
+        pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+        pthread_cond_init (&follow->cond, &attr);
+        pthread_condattr_destroy (&attr);
+
+        now = now_us ();
+        for (int i = 0; i < state->num_files; i++) {
+                state->files[i].interval = state->sleep_interval;
+                state->files[i].next_poll = now + state->sleep_interval;
+        }
+
+        follow_register (follow);
+
+        while (keep_running) {
+                remaining = false;
+                deadline = UINT64_MAX;
+                for (int i = 0; i < state->num_files; i++) {
+                        file = &state->files[i];
+                        if (file->fd) {
+                                remaining = true;
+                                if (file->next_poll < deadline) {
+                                        deadline = file->next_poll;
+                                }
+                        }
+                }
+
+                if (!remaining) {
+                        error (0, 0, "no files remaining");
+                        ret = -1;
+                        break;
+                }
+
+                follow_wait (follow, deadline);
+                if (!keep_running) {
+                        break;
+                }
+
+                now = now_us ();
+                for (int i = 0; i < state->num_files; i++) {
+                        file = &state->files[i];
+
+                        pthread_mutex_lock (&follow->lock);
+                        changed = file->changed;
+                        file->changed = false;
+                        pthread_mutex_unlock (&follow->lock);
+
+                        if (file->fd == NULL || (!changed && now < file->next_poll)) {
+                                continue;
+                        }
+
+                        if (poll_file (file, &last) == -1) {
+                                ret = -1;
+                                continue;
+                        }
+
+                        file->next_poll = now + file->interval;
+                }
+        }
+
+        follow_unregister ();
+
+        pthread_cond_destroy (&follow->cond);
+        pthread_mutex_destroy (&follow->lock);
+
+        return ret;
+}
+
+/**
+ * Prints the end of a file, leaving it open at its end if it is to be
+ * followed.
+ */
+static int
+tail_file (struct tail_file *file, struct tail_file **last)
+{
         struct stat statbuf;
-        long long size;
+        uint64_t start = stats_start ();
+        int ret;
 
-        ret = glfs_stat (fs, state->gluster_url->path, &statbuf);
+        ret = glfs_stat (file->fs, file->gluster_url->path, &statbuf);
+        stats_end (STATS_STAT, start, ret);
         if (ret == -1) {
-                error (0, errno, "cannot open `%s' for reading", state->url);
+                error (0, errno, "cannot open `%s' for reading", file->url);
                 goto err;
         }
 
-        fd = glfs_open (fs, state->gluster_url->path, O_RDONLY);
-        if (fd == NULL) {
-                error (0, errno, "error reading `%s'", state->url);
+        file->fd = glfs_open (file->fs, file->gluster_url->path, O_RDONLY);
+        if (file->fd == NULL) {
+                error (0, errno, "error reading `%s'", file->url);
                 goto err;
         }
 
-        size = (long long) statbuf.st_size;
+        gluster_apply_buffer_size (state->buffer_size, file->fs, &statbuf);
+
+        print_header (file, last);
 
         switch (state->mode) {
                 case BYTES:
-                        ret = tail_bytes (fd, &statbuf);
+                        ret = tail_bytes (file->fd, &statbuf);
                         break;
                 case LINES:
-                        ret = tail_lines (fd, &statbuf);
+                        ret = tail_lines (file->fd, &statbuf);
                         break;
                 default:
                         error (0, 0, "unknown error");
@@ -465,95 +1100,94 @@ tail (glfs_t *fs)
                 goto err;
         }
 
-        ret = gluster_read (fd, STDOUT_FILENO);
+        file->size = (long long) statbuf.st_size;
+
+        ret = gluster_read (file->fd, STDOUT_FILENO, NULL);
         if (ret == -1) {
                 error (0, errno, "write error");
                 goto err;
         }
 
-        if (state->follow) {
-                // Use our SIGINT handler to break out of follow functionality
-                signal (SIGINT, int_handler);
+        if (!state->follow) {
+                close_file (file);
+        }
 
-                while (keep_running) {
-                        usleep (state->sleep_interval);
+        return 0;
 
-                        ret = glfs_stat (fs, state->gluster_url->path, &statbuf);
-                        if (ret == -1) {
-                                error (0, errno, "cannot open `%s' for reading", state->url);
-                                goto err;
-                        }
+err:
+        if (file->fd) {
+                close_file (file);
+        }
 
-                        if (statbuf.st_size == size) {
-                                continue;
-                        }
+        return -1;
+}
 
-                        if (statbuf.st_size < size) {
-                                error (0, 0, "file truncated: %s",
-                                                state->gluster_url->path);
-                                size = statbuf.st_size;
-                                glfs_lseek (fd, 0, SEEK_SET);
-                        }
+static int
+tail ()
+{
+        struct tail_file *last = NULL;
+        int ret = 0;
 
-                        ret = gluster_read (fd, STDOUT_FILENO);
-                        if (ret == -1) {
-                                error (0, errno, "read error: %s",
-                                                state->gluster_url->path);
-                                goto err;
-                        }
+        for (int i = 0; i < state->num_files; i++) {
+                if (state->files[i].fs == NULL || tail_file (&state->files[i], &last) == -1) {
+                        ret = -1;
                 }
         }
 
-        goto out;
-err:
-        ret = -1;
-out:
-        // Disable our signal handler
-        // FIXME: This clobbers gfcli's signal handler.
-        signal (SIGINT, SIG_DFL);
+        if (state->follow) {
+                // Use our SIGINT handler to break out of follow functionality
+                keep_running = 1;
+                signal (SIGINT, int_handler);
 
-        if (fd) {
-                if (glfs_close (fd) == -1) {
-                        error (0, errno, "failed to close file");
+                if (follow_files (last) == -1) {
                         ret = -1;
                 }
+
+                // Disable our signal handler
+                // FIXME: This clobbers gfcli's signal handler.
+                signal (SIGINT, SIG_DFL);
+        }
+
+        for (int i = 0; i < state->num_files; i++) {
+                if (state->files[i].fd) {
+                        close_file (&state->files[i]);
+                }
         }
 
         return ret;
 }
 
+/**
+ * Connects to the volume of each file. Files on the same volume share a
+ * connection through the cache.
+ */
 static int
-do_tail_without_context ()
+do_tail_without_context (struct fs_cache *fs_cache)
 {
-        glfs_t *fs = NULL;
-        int ret;
-
-        ret = gluster_getfs (&fs, state->gluster_url);
-        if (ret == -1) {
-                error (0, errno, "%s", state->url);
-                goto out;
-        }
+        struct tail_file *file;
+        int ret = 0;
 
-        ret = apply_xlator_options (fs, &state->xlator_options);
-        if (ret == -1) {
-                error (0, errno, "failed to apply xlator options");
-                goto out;
-        }
+        for (int i = 0; i < state->num_files; i++) {
+                file = &state->files[i];
 
-        if (state->debug) {
-                ret = glfs_set_logging (fs, "/dev/stderr", GF_LOG_DEBUG);
+                if (gluster_getfs_cached (&file->fs, fs_cache, file->gluster_url, &state->xlator_options) == -1) {
+                        error (0, errno, "%s", file->url);
+                        ret = -1;
+                        continue;
+                }
 
-                if (ret == -1) {
+                if (state->debug && glfs_set_logging (file->fs, "/dev/stderr", GF_LOG_DEBUG) == -1) {
                         error (0, errno, "failed to set logging level");
-                        goto out;
+                        ret = -1;
                 }
         }
 
-        ret = tail (fs);
+        if (tail () == -1) {
+                ret = -1;
+        }
 
-out:
-        if (fs) {
-                glfs_fini (fs);
+        for (int i = 0; i < state->num_files; i++) {
+                gluster_putfs (fs_cache, state->files[i].fs);
         }
 
         return ret;
@@ -567,12 +1201,12 @@ do_tail (struct cli_context *ctx)
 {
         int argc = ctx->argc;
         char **argv = ctx->argv;
-        int ret;
+        int ret = -1;
 
         state = init_state ();
         if (state == NULL) {
                 error (0, errno, "failed to initialize state");
-                goto err;
+                goto out;
         }
 
         if (ctx->fs) {
@@ -581,7 +1215,17 @@ do_tail (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = tail (ctx->fs);
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
+
+                for (int i = 0; i < state->num_files; i++) {
+                        state->files[i].fs = ctx->fs;
+                }
+
+                ret = tail ();
         } else {
                 ret = parse_options (argc, argv, false);
                 if (ret == -1) {
@@ -595,18 +1239,25 @@ do_tail (struct cli_context *ctx)
                         goto out;
                 }
 
-                ret = do_tail_without_context ();
-        }
+                if (stats_begin (state->stats) == -1) {
+                        error (0, errno, "failed to initialize statistics");
+                        ret = -1;
+                        goto out;
+                }
 
-        ret = EXIT_SUCCESS;
-        goto out;
+                ret = do_tail_without_context (ctx->fs_cache);
+        }
 
-err:
-        ret = EXIT_FAILURE;
 out:
+        stats_finish ();
+
         if (state) {
-                gluster_url_free (state->gluster_url);
-                free (state->url);
+                for (int i = 0; i < state->num_files; i++) {
+                        gluster_url_free (state->files[i].gluster_url);
+                        free (state->files[i].url);
+                }
+
+                free (state->files);
         }
 
         free (state);
@@ -20,21 +20,34 @@
 
 #include <config.h>
 
+#include "glfs-attr-cache.h"
+#include "glfs-checksum.h"
+#include "glfs-handle.h"
+#include "glfs-stats.h"
 #include "glfs-util.h"
 
-#include <assert.h>
 #include <errno.h>
 #include <error.h>
 #include <glusterfs/api/glfs.h>
+#include <grp.h>
+#include <limits.h>
+#include <pthread.h>
+#include <pwd.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #define GLFS_MIN_URL_LENGTH 11
 #define LOG_EVERY_SECS 30
+#define ID_NAME_BUFFER_SIZE 1024
+#define MAP_RELEASE_SIZE 64*1024*1024
 
 int
 append_xlator_option (struct xlator_option **options, struct xlator_option *option)
@@ -176,6 +189,69 @@ get_default_file_mode_perm ()
                 & ~umask (0);
 }
 
+/**
+ * Looks up the name of the user id, or of the group id if group is set. The
+ * entry is read into *buf, of *size bytes, which may start out NULL and is
+ * grown until the entry fits; it is kept for later lookups and released by
+ * the caller with free ().
+ *
+ * Returns the name, which lives in *buf until the next lookup, or NULL with
+ * errno set if it could not be had: 0 if the id simply has no name.
+ */
+const char *
+lookup_id_name (unsigned int id, bool group, char **buf, size_t *size)
+{
+        struct passwd pw;
+        struct passwd *pw_ent = NULL;
+        struct group gr;
+        struct group *gr_ent = NULL;
+        char *larger;
+        long initial;
+        int ret;
+
+        if (*buf == NULL) {
+                initial = sysconf (group ? _SC_GETGR_R_SIZE_MAX : _SC_GETPW_R_SIZE_MAX);
+                *size = initial > 0 ? (size_t) initial : ID_NAME_BUFFER_SIZE;
+                *buf = malloc (*size);
+                if (*buf == NULL) {
+                        return NULL;
+                }
+        }
+
+        while (true) {
+                if (group) {
+                        ret = getgrgid_r (id, &gr, *buf, *size, &gr_ent);
+                } else {
+                        ret = getpwuid_r (id, &pw, *buf, *size, &pw_ent);
+                }
+
+                if (ret != ERANGE) {
+                        break;
+                }
+
+                // Groups with many members can take a lot more than the hint.
+                larger = realloc (*buf, *size * 2);
+                if (larger == NULL) {
+                        return NULL;
+                }
+
+                *buf = larger;
+                *size *= 2;
+        }
+
+        if (ret != 0) {
+                errno = ret;
+                return NULL;
+        }
+
+        if (group ? gr_ent == NULL : pw_ent == NULL) {
+                errno = 0;
+                return NULL;
+        }
+
+        return group ? gr_ent->gr_name : pw_ent->pw_name;
+}
+
 struct gluster_url*
 gluster_url_init ()
 {
@@ -275,55 +351,199 @@ out:
         return ret;
 }
 
+/**
+ * Returns whether two URLs name the same volume, and so can be served by the
+ * same connection.
+ */
+bool
+gluster_same_volume (const struct gluster_url *a, const struct gluster_url *b)
+{
+        return a->port == b->port
+                && strcmp (a->host, b->host) == 0
+                && strcmp (a->volume, b->volume) == 0;
+}
+
+/**
+ * Returns path with a leading slash, without a trailing one and with runs of
+ * slashes squeezed, so that "a//b/" and "/a/b" are cached once. Returns NULL
+ * if memory could not be allocated.
+ */
+char *
+canonical_path (const char *path)
+{
+        char *canonical = malloc (strlen (path) + 2);
+        char *end = canonical;
+
+        if (canonical == NULL) {
+                return NULL;
+        }
+
+        for (*end++ = '/'; *path; path++) {
+                if (*path != '/' || end[-1] != '/') {
+                        *end++ = *path;
+                }
+        }
+
+        if (end - canonical > 1 && end[-1] == '/') {
+                end--;
+        }
+
+        *end = '\0';
+
+        return canonical;
+}
+
+/**
+ * Returns the canonical form of the directory part of path, everything before
+ * its last slash, or NULL with errno set if memory could not be allocated.
+ */
+static char *
+directory_prefix (const char *path)
+{
+        const char *dir_end = strrchr (path, '/');
+        char *prefix;
+        char *canonical;
+
+        prefix = strndup (path, dir_end ? (size_t) (dir_end - path) : 0);
+        if (prefix == NULL) {
+                return NULL;
+        }
+
+        canonical = canonical_path (prefix);
+        free (prefix);
+
+        return canonical;
+}
+
+/**
+ * Finds the deepest directory of prefix in the directory cache. Returns its
+ * handle and sets *length to the length of its path, or returns NULL.
+ */
+static struct gluster_handle *
+cached_prefix (glfs_t *fs, char *prefix, size_t *length)
+{
+        struct gluster_handle *handle = NULL;
+        size_t cut = strlen (prefix);
+        char saved;
+
+        while (cut > 1) {
+                saved = prefix[cut];
+                prefix[cut] = '\0';
+                handle = gluster_dir_cache_get (fs, prefix);
+                prefix[cut] = saved;
+                if (handle) {
+                        *length = cut;
+                        break;
+                }
+
+                while (prefix[--cut] != '/');
+        }
+
+        return handle;
+}
+
+/**
+ * Creates the directories leading up to the last component of path, the way
+ * mkdir -p does, so that a path ending in a slash is created entirely. Each
+ * directory is created or looked up relative to the one before it, so the
+ * cost of a step does not grow with the depth of the path.
+ *
+ * Directories created or found are kept in the directory cache, and the walk
+ * starts from the deepest one cached; should that turn out to have vanished,
+ * the walk is retried once from the root.
+ */
 int
 gluster_create_path (glfs_t *fs, char *path, mode_t omode)
 {
+        struct gluster_handle *parent = NULL;
+        struct gluster_handle *child;
         struct stat sb;
-        int is_last = 0;
-        int ret = EXIT_SUCCESS;
-        char *dir_end = NULL;
-        char *next = path;
-
-        if (*next == '/') {
-                next++;
+        bool cached = false;
+        bool is_last = false;
+        int ret = -1;
+        char *prefix;
+        char *name;
+        char *next;
+        char saved;
+        size_t length = 1;
+
+        prefix = directory_prefix (path);
+        if (prefix == NULL) {
+                goto out;
         }
 
-        dir_end = strrchr (next, '/');
-        if (dir_end == NULL) {
+        // There is nothing to create below the root.
+        if (prefix[1] == '\0') {
+                ret = 0;
                 goto out;
         }
 
-        do {
-                next = strchr (next, '/');
-                assert (next != NULL);
-                is_last = next == dir_end;
-                *next = '\0';
+        parent = cached_prefix (fs, prefix, &length);
+        cached = parent != NULL;
+
+retry:
+        if (parent == NULL) {
+                length = 1;
+                parent = gluster_handle_lookup (fs, NULL, "/", NULL, true);
+                if (parent == NULL) {
+                        goto out;
+                }
+        }
 
-                ret = glfs_mkdir (fs, path, omode);
+        next = prefix + length;
+        while (*next) {
+                name = next + (*next == '/');
+                next = strchrnul (name, '/');
+                is_last = *next == '\0';
+                *next = '\0';
 
-                if (ret != EXIT_SUCCESS) {
-                        if (errno != EEXIST && errno != EISDIR) {
-                                goto out;
+                child = gluster_handle_mkdir (fs, parent, name, omode, NULL);
+                if (child == NULL && (errno == EEXIST || errno == EISDIR)) {
+                        child = gluster_handle_lookup (fs, parent, name, &sb, true);
+                        if (child && !S_ISDIR (sb.st_mode)) {
+                                gluster_handle_unref (child);
+                                child = NULL;
+                                errno = is_last ? EEXIST : ENOTDIR;
                         }
+                }
 
-                        ret = glfs_stat (fs, path, &sb);
-                        if (ret != EXIT_SUCCESS) {
-                                goto out;
+                if (child == NULL) {
+                        if (!is_last) {
+                                *next = '/';
                         }
 
-                        if (!S_ISDIR (sb.st_mode)) {
-                                errno = is_last ? EEXIST : ENOTDIR;
-                                goto out;
+                        if (cached && (errno == ENOENT || errno == ESTALE)) {
+                                // A cached directory was removed behind our
+                                // back; forget it and start over.
+                                saved = prefix[length];
+                                prefix[length] = '\0';
+                                gluster_dir_cache_forget (fs, prefix);
+                                prefix[length] = saved;
+
+                                gluster_handle_unref (parent);
+                                parent = NULL;
+                                cached = false;
+                                goto retry;
                         }
+
+                        goto out;
                 }
 
+                gluster_dir_cache_put (fs, prefix, child);
                 if (!is_last) {
                         *next = '/';
-                        ++next;
                 }
-        } while (!is_last);
+
+                gluster_handle_unref (parent);
+                parent = child;
+        }
+
+        ret = 0;
 
 out:
+        gluster_handle_unref (parent);
+        free (prefix);
+
         return ret;
 }
 
@@ -340,213 +560,1564 @@ gluster_lock (glfs_fd_t *fd, short type, bool block) {
     return glfs_posix_lock (fd, block ? F_SETLKW : F_SETLK, &flck);
 }
 
-int
-gluster_write (int src, glfs_fd_t *fd) {
-        char buffer[BUFSIZE];
-        size_t num_read = 0;
-        size_t num_written = 0;
-        size_t ret = 0;
-        size_t total_written = 0;
-        time_t time_start = time (NULL);
-        time_t time_last = time_start;
-        time_t time_cur = time_start;
+/**
+ * A ring of buffers used to keep up to depth asynchronous reads or writes in
+ * flight against a Gluster file. Completion callbacks run on a gfapi thread,
+ * so slot state is protected by the pipeline lock.
+ *
+ * When borrowed is set, the slots have no buffers of their own and point into
+ * a mapping of the local file owned by the caller instead.
+ */
+struct pipeline_slot {
+        struct pipeline *pipeline;
+        char *buf;
+        off_t offset;
+        size_t count;
+        ssize_t ret;
+        int error;
+        bool busy;
+        struct stats *stats;
+        enum stats_op op;
+        uint64_t start;
+};
+
+struct pipeline {
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        struct pipeline_slot *slots;
+        bool borrowed;
+        unsigned int depth;
+        unsigned int in_flight;
+};
+
+// Per thread, as commands may run concurrently in batch mode.
+static __thread unsigned int queue_depth = DEFAULT_QUEUE_DEPTH;
+
+// Per thread as well; 0 leaves each transfer at its own default.
+static __thread size_t buffer_size = 0;
 
-        while (true) {
-                num_read = read (src, buffer, BUFSIZE);
-                if (num_read == -1) {
-                        ret = -1;
-                        goto out;
-                }
+void
+gluster_set_queue_depth (unsigned int depth)
+{
+        queue_depth = depth ? depth : 1;
+}
 
-                if (num_read == 0) {
-                        goto out;
-                }
+void
+gluster_set_buffer_size (size_t size)
+{
+        buffer_size = size;
+}
 
-                for (num_written = 0; num_written < num_read;) {
-                        ret = glfs_write (fd,
-                                          &buffer[num_written],
-                                          num_read - num_written, 0);
-                        if (ret == -1) {
-                                goto out;
-                        }
+/**
+ * Returns the buffer size set for transfers on this thread, or fallback if
+ * none was set.
+ */
+size_t
+gluster_get_buffer_size (size_t fallback)
+{
+        return buffer_size ? buffer_size : fallback;
+}
 
-                        num_written += ret;
-                        total_written += ret;
+/**
+ * Returns how far back from the end of its destination a transfer on this
+ * thread may have writes that did not land when it is interrupted: as much as
+ * the pipeline keeps in flight, and no less than RESUME_VERIFY_SIZE. A resume
+ * is expected to run with the queue depth and buffer size of the transfer it
+ * picks up.
+ */
+off_t
+gluster_resume_window ()
+{
+        off_t window = (off_t) queue_depth * gluster_get_buffer_size (BUFSIZE);
 
-                        time_cur = time (NULL);
-                        if (time_cur - time_last > LOG_EVERY_SECS) {
-                                time_last = time_cur;
-                                fprintf (stderr,
-                                         "Wrote: %zu. Time: %zu\n",
-                                         total_written,
-                                         time_cur - time_start);
-                        }
-                }
-        }
+        return window > RESUME_VERIFY_SIZE ? window : RESUME_VERIFY_SIZE;
+}
 
-out:
-        return ret;
+static size_t
+page_size ()
+{
+        long size = sysconf (_SC_PAGESIZE);
+
+        return size > 0 ? (size_t) size : 4096;
 }
 
-int
-gluster_read (glfs_fd_t *fd, int dst) {
-        char buffer[BUFSIZE];
-        size_t num_read = 0;
-        size_t num_written = 0;
-        size_t ret = 0;
-        size_t total_written = 0;
-        time_t time_start = time (NULL);
-        time_t time_last = time_start;
-        time_t time_cur = time_start;
+static size_t
+round_up (size_t size, size_t multiple)
+{
+        return (size + multiple - 1) / multiple * multiple;
+}
 
-        while (true) {
-                num_read = glfs_read (fd, buffer, BUFSIZE, 0);
-                if (num_read == -1) {
-                        goto out;
-                }
+/**
+ * Allocates a buffer aligned to the page size, so that it may be used with
+ * O_DIRECT. The buffer is released with free ().
+ */
+void *
+alloc_buffer (size_t size)
+{
+        void *buf;
+        int ret;
 
-                if (num_read == 0) {
-                        goto out;
-                }
+        ret = posix_memalign (&buf, page_size (), size ? size : 1);
+        if (ret != 0) {
+                errno = ret;
+                return NULL;
+        }
 
-                for (num_written = 0; num_written < num_read;) {
-                        ret = write (dst,
-                                     &buffer[num_written],
-                                     num_read - num_written);
-                        if (ret != (num_read - num_written)) {
-                                goto err;
-                        }
+        return buf;
+}
 
-                        num_written += ret;
-                        total_written += ret;
+#ifdef HAVE_GLFS_GET_VOLFILE
+/**
+ * Parses a size from a volume file, such as "64MB" or "131072".
+ */
+static size_t
+parse_volfile_size (const char *str)
+{
+        unsigned long long size;
+        char *end;
 
-                        time_cur = time (NULL);
-                        if (time_cur - time_last > LOG_EVERY_SECS) {
-                                time_last = time_cur;
-                                fprintf (stderr,
-                                         "Read: %zu. Time: %zu\n",
-                                         total_written,
-                                         time_cur - time_start);
-                        }
-                }
+        errno = 0;
+        size = strtoull (str, &end, 10);
+        if (str == end || errno == ERANGE) {
+                return 0;
         }
 
-err:
-        ret = -1;
-out:
-        return ret;
+        switch (*end) {
+                case 'k':
+                case 'K':
+                        size <<= 10;
+                        break;
+                case 'm':
+                case 'M':
+                        size <<= 20;
+                        break;
+                case 'g':
+                case 'G':
+                        size <<= 30;
+                        break;
+        }
+
+        return size > SIZE_MAX ? 0 : (size_t) size;
 }
 
-int
-gluster_getfs (glfs_t **fs, const struct gluster_url *gluster_url) {
-        int ret = 0;
+/**
+ * Looks through the client graph of the volume for the shard or stripe block
+ * size and the io-cache page size.
+ */
+static void
+volume_block_sizes (glfs_t *fs, size_t *block_size, size_t *cache_page_size)
+{
+        char *volfile = NULL;
+        char *line;
+        char *save = NULL;
+        char type[64] = "";
+        char key[64];
+        char value[64];
+        ssize_t length;
+
+        length = glfs_get_volfile (fs, NULL, 0);
+        if (length >= 0) {
+                return;
+        }
 
-        *fs = glfs_new (gluster_url->volume);
-        if (fs == NULL) {
-                goto out;
+        volfile = malloc (-length + 1);
+        if (volfile == NULL) {
+                return;
         }
 
-        ret = glfs_set_volfile_server (*fs,
-                        "tcp",
-                        gluster_url->host,
-                        gluster_url->port);
-        if (ret == -1) {
+        length = glfs_get_volfile (fs, volfile, -length);
+        if (length <= 0) {
                 goto out;
         }
 
-        ret = glfs_init (*fs);
+        volfile[length] = '\0';
+
+        for (line = strtok_r (volfile, "\n", &save); line; line = strtok_r (NULL, "\n", &save)) {
+                if (sscanf (line, " type %63s", type) == 1) {
+                        continue;
+                }
+
+                if (sscanf (line, " option %63s %63s", key, value) != 2) {
+                        continue;
+                }
+
+                if ((strcmp (type, "features/shard") == 0 && strcmp (key, "shard-block-size") == 0)
+                                || (strcmp (type, "cluster/stripe") == 0 && strcmp (key, "block-size") == 0)) {
+                        *block_size = parse_volfile_size (value);
+                } else if (strcmp (type, "performance/io-cache") == 0 && strcmp (key, "page-size") == 0) {
+                        *cache_page_size = parse_volfile_size (value);
+                }
+        }
 
 out:
-        return ret;
+        free (volfile);
 }
+#endif
 
-struct xlator_option *
-parse_xlator_option (const char *optarg)
+/**
+ * Sets the buffer size of transfers on this thread, working it out from the
+ * volume and the attributes of the file being transferred (either of which
+ * may be NULL) when size is BUFFER_SIZE_AUTO.
+ */
+void
+gluster_apply_buffer_size (size_t size, glfs_t *fs, const struct stat *statbuf)
 {
-        char *pos;
-        char *key;
-        char *value;
-        char *xlator;
-        struct xlator_option *option = NULL;
-
-        char *opt_string = strdup (optarg);
-        if (opt_string == NULL) {
-                goto err;
+        if (size == BUFFER_SIZE_AUTO) {
+                size = gluster_auto_buffer_size (fs, statbuf);
         }
 
-        if ((xlator = strtok_r (opt_string, ".", &pos)) == NULL) {
-                errno = EINVAL;
-                goto err;
-        }
+        gluster_set_buffer_size (size);
+}
 
-        if ((key = strtok_r (NULL, "=", &pos)) == NULL) {
-                errno = EINVAL;
-                goto err;
-        }
+/**
+ * Picks a buffer size for transferring a file, given its attributes if they
+ * are known. Sharded and striped volumes get a whole block per request, and
+ * otherwise the default size is rounded to the io-cache page size and to the
+ * preferred I/O size of the file. Small files get a buffer just large enough
+ * to hold them.
+ */
+size_t
+gluster_auto_buffer_size (glfs_t *fs, const struct stat *statbuf)
+{
+        size_t block_size = 0;
+        size_t cache_page_size = 0;
+        size_t size = BUFSIZE;
 
-        value = pos;
-        if (value == NULL || *value == '\0') {
-                errno = EINVAL;
-                goto err;
+#ifdef HAVE_GLFS_GET_VOLFILE
+        if (fs) {
+                volume_block_sizes (fs, &block_size, &cache_page_size);
         }
+#endif
 
-        option = malloc (sizeof (*option));
-        if (option == NULL) {
-                goto err;
-        }
+        if (block_size) {
+                size = block_size;
+        } else {
+                if (cache_page_size) {
+                        size = round_up (size, cache_page_size);
+                }
 
-        option->xlator = xlator;
-        option->key = key;
-        option->opt_string = opt_string;
-        option->value = value;
+                if (statbuf && statbuf->st_blksize > 0) {
+                        size = round_up (size, statbuf->st_blksize);
+                }
+        }
 
-        option->next = NULL;
+        if (statbuf && S_ISREG (statbuf->st_mode) && (size_t) statbuf->st_size < size) {
+                size = statbuf->st_size;
+        }
 
-        goto out;
+        if (size > MAX_AUTO_BUFFER_SIZE) {
+                size = MAX_AUTO_BUFFER_SIZE;
+        }
 
-err:
-        free (opt_string);
-        free (option);
-out:
-        return option;
+        return round_up (size ? size : 1, page_size ());
 }
 
-void
-print_xlator_options (struct xlator_option **options)
+static void
+pipeline_cbk (glfs_fd_t *fd, ssize_t ret, void *data)
 {
-        struct xlator_option *next = *options;
+        struct pipeline_slot *slot = data;
+        struct pipeline *pipeline = slot->pipeline;
+
+        pthread_mutex_lock (&pipeline->lock);
+        slot->ret = ret;
+        slot->error = ret == -1 ? errno : 0;
+        stats_record (slot->stats, slot->op, slot->start, ret);
+        slot->busy = false;
+        pipeline->in_flight--;
+        pthread_cond_broadcast (&pipeline->cond);
+        pthread_mutex_unlock (&pipeline->lock);
+}
 
-        while (next) {
-                printf ("%s: %s => %s\n", next->xlator, next->key, next->value);
+static void
+pipeline_free (struct pipeline *pipeline)
+{
+        if (pipeline == NULL) {
+                return;
+        }
 
-                next = next->next;
+        if (pipeline->slots) {
+                for (unsigned int i = 0; i < pipeline->depth; i++) {
+                        if (!pipeline->borrowed) {
+                                free (pipeline->slots[i].buf);
+                        }
+                }
         }
+
+        pthread_cond_destroy (&pipeline->cond);
+        pthread_mutex_destroy (&pipeline->lock);
+        free (pipeline->slots);
+        free (pipeline);
 }
 
-uint16_t
-strtoport (const char *str)
+static struct pipeline *
+pipeline_init (unsigned int depth, size_t size, bool borrowed)
 {
-        long raw_port;
-        uint16_t port = 0;
-        char *end;
+        struct pipeline *pipeline = calloc (1, sizeof (*pipeline));
 
-        raw_port = strtol (str, &end, 10);
-
-        if (str == end) {
+        if (pipeline == NULL) {
                 goto err;
         }
 
-        // Port ranges from 1 - 65535
-        if (raw_port < 1 || raw_port > UINT16_MAX) {
+        pthread_mutex_init (&pipeline->lock, NULL);
+        pthread_cond_init (&pipeline->cond, NULL);
+        pipeline->borrowed = borrowed;
+        pipeline->depth = depth;
+
+        pipeline->slots = calloc (depth, sizeof (*pipeline->slots));
+        if (pipeline->slots == NULL) {
                 goto err;
         }
 
-        port = (uint16_t) raw_port;
+        for (unsigned int i = 0; i < depth; i++) {
+                pipeline->slots[i].pipeline = pipeline;
 
-        goto out;
+                if (borrowed) {
+                        continue;
+                }
 
-err:
-        error (0, 0, "invalid port number: \"%s\"", str);
-out:
+                pipeline->slots[i].buf = alloc_buffer (size);
+                if (pipeline->slots[i].buf == NULL) {
+                        goto err;
+                }
+        }
+
+        return pipeline;
+
+err:
+        pipeline_free (pipeline);
+        return NULL;
+}
+
+/**
+ * Blocks until the given slot has no request in flight.
+ */
+static void
+pipeline_wait (struct pipeline *pipeline, struct pipeline_slot *slot)
+{
+        pthread_mutex_lock (&pipeline->lock);
+        while (slot->busy) {
+                pthread_cond_wait (&pipeline->cond, &pipeline->lock);
+        }
+        pthread_mutex_unlock (&pipeline->lock);
+}
+
+/**
+ * Blocks until every request in flight has completed. Buffers must not be
+ * released before this returns, as gfapi may still be using them.
+ */
+static void
+pipeline_drain (struct pipeline *pipeline)
+{
+        pthread_mutex_lock (&pipeline->lock);
+        while (pipeline->in_flight > 0) {
+                pthread_cond_wait (&pipeline->cond, &pipeline->lock);
+        }
+        pthread_mutex_unlock (&pipeline->lock);
+}
+
+static int
+pipeline_submit (struct pipeline *pipeline, struct pipeline_slot *slot,
+                 glfs_fd_t *fd, bool write, off_t offset, size_t count)
+{
+        int ret;
+
+        slot->offset = offset;
+        slot->count = count;
+
+        // The request completes on a gfapi thread, which records it.
+        slot->stats = stats_current ();
+        slot->op = write ? STATS_WRITE : STATS_READ;
+        slot->start = stats_start ();
+
+        pthread_mutex_lock (&pipeline->lock);
+        slot->busy = true;
+        pipeline->in_flight++;
+        pthread_mutex_unlock (&pipeline->lock);
+
+        if (write) {
+                ret = glfs_pwrite_async (fd, slot->buf, count, offset, 0,
+                                         pipeline_cbk, slot);
+        } else {
+                ret = glfs_pread_async (fd, slot->buf, count, offset, 0,
+                                        pipeline_cbk, slot);
+        }
+
+        if (ret == -1) {
+                pthread_mutex_lock (&pipeline->lock);
+                slot->busy = false;
+                pipeline->in_flight--;
+                pthread_mutex_unlock (&pipeline->lock);
+        }
+
+        return ret;
+}
+
+/**
+ * Checks the outcome of a completed write, finishing a short write
+ * synchronously. Returns -1 with errno set on failure.
+ */
+static int
+pipeline_complete_write (glfs_fd_t *fd, struct pipeline_slot *slot)
+{
+        ssize_t ret = slot->ret;
+        size_t num_written;
+
+        if (ret == -1) {
+                errno = slot->error;
+                return -1;
+        }
+
+        for (num_written = ret; num_written < slot->count;) {
+                uint64_t start = stats_start ();
+
+                ret = glfs_pwrite (fd,
+                                   &slot->buf[num_written],
+                                   slot->count - num_written,
+                                   slot->offset + num_written, 0);
+                stats_end (STATS_WRITE, start, ret);
+                if (ret == -1) {
+                        return -1;
+                }
+
+                num_written += ret;
+        }
+
+        slot->count = 0;
+
+        return 0;
+}
+
+/**
+ * A read-only mapping of the rest of a local regular file, from its offset
+ * when it was mapped. data and remaining track what has not been consumed.
+ */
+struct local_map {
+        char *addr;
+        size_t length;
+        char *data;
+        size_t remaining;
+        size_t released;
+        off_t end;
+};
+
+/**
+ * Maps src from its current offset to its end if it is a regular file, so
+ * that writes can be issued straight from the page cache instead of copying
+ * the data into a buffer with read (). As with any mapping, a file that is
+ * truncated while it is being read raises SIGBUS, and data appended after it
+ * was mapped is not seen. Returns -1 if src cannot be mapped, in which case
+ * the caller reads it instead.
+ */
+static int
+local_map_init (int src, struct local_map *map)
+{
+        struct stat statbuf;
+        off_t offset;
+        off_t start;
+
+        map->addr = NULL;
+
+        if (fstat (src, &statbuf) == -1 || !S_ISREG (statbuf.st_mode)) {
+                return -1;
+        }
+
+        offset = lseek (src, 0, SEEK_CUR);
+        if (offset == -1 || offset >= statbuf.st_size) {
+                return -1;
+        }
+
+        // Mappings start on a page boundary.
+        start = offset / page_size () * page_size ();
+
+        map->length = statbuf.st_size - start;
+        map->addr = mmap (NULL, map->length, PROT_READ, MAP_SHARED, src, start);
+        if (map->addr == MAP_FAILED) {
+                map->addr = NULL;
+                return -1;
+        }
+
+        madvise (map->addr, map->length, MADV_SEQUENTIAL);
+
+        map->data = map->addr + (offset - start);
+        map->remaining = statbuf.st_size - offset;
+        map->released = 0;
+        map->end = statbuf.st_size;
+
+        return 0;
+}
+
+/**
+ * Takes up to count bytes off the front of the mapping, storing where they
+ * start in data. The pages are faulted in with a single call where the kernel
+ * supports it, rather than one at a time as they are first touched.
+ */
+static size_t
+local_map_take (struct local_map *map, size_t count, char **data)
+{
+        if (count > map->remaining) {
+                count = map->remaining;
+        }
+
+        *data = map->data;
+        map->data += count;
+        map->remaining -= count;
+
+#ifdef MADV_POPULATE_READ
+        char *start = map->addr + (*data - map->addr) / page_size () * page_size ();
+
+        madvise (start, *data + count - start, MADV_POPULATE_READ);
+#endif
+
+        return count;
+}
+
+/**
+ * Notes that everything in the mapping before end has been written out. The
+ * pages behind are dropped from the mapping every MAP_RELEASE_SIZE bytes, so
+ * that it does not keep the whole file resident as it goes.
+ */
+static void
+local_map_release (struct local_map *map, char *end)
+{
+        size_t last = (end - map->addr) / page_size () * page_size ();
+
+        if (last - map->released >= MAP_RELEASE_SIZE) {
+                madvise (map->addr + map->released, last - map->released, MADV_DONTNEED);
+                map->released = last;
+        }
+}
+
+/**
+ * Releases the mapping, leaving the offset of src past the data consumed.
+ */
+static void
+local_map_destroy (int src, struct local_map *map)
+{
+        if (map->addr == NULL) {
+                return;
+        }
+
+        lseek (src, map->end - map->remaining, SEEK_SET);
+        munmap (map->addr, map->length);
+}
+
+/**
+ * A reader thread filling a ring of buffers from a local file descriptor that
+ * cannot be mapped, such as a pipe, so that the producer on the other end can
+ * carry on while the writes of earlier data are in flight. Each buffer is
+ * filled completely, short reads from a pipe included, so that the writes are
+ * as large as those from a file. Buffers are taken and released in order.
+ *
+ * filled: Number of buffers read and not yet taken, starting at tail.
+ * taken: Number of buffers taken and not yet released.
+ * error: errno of the failed read, reported once the data before it has been
+ *        taken.
+ * stop: Set to have the reader exit early.
+ */
+struct read_ahead {
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        pthread_t reader;
+        int src;
+        char **bufs;
+        size_t *counts;
+        size_t io_size;
+        unsigned int size;
+        unsigned int head;
+        unsigned int tail;
+        unsigned int filled;
+        unsigned int taken;
+        int error;
+        bool eof;
+        bool stop;
+};
+
+static void *
+read_ahead_reader (void *arg)
+{
+        struct read_ahead *ahead = arg;
+        unsigned int head;
+        size_t count;
+        ssize_t ret = 0;
+        int saved_errno = 0;
+
+        // Only a blocking read () may be cancelled, never with the lock held.
+        pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+
+        pthread_mutex_lock (&ahead->lock);
+        while (!ahead->stop) {
+                while (!ahead->stop && ahead->filled + ahead->taken == ahead->size) {
+                        pthread_cond_wait (&ahead->cond, &ahead->lock);
+                }
+
+                if (ahead->stop) {
+                        break;
+                }
+
+                head = ahead->head;
+                pthread_mutex_unlock (&ahead->lock);
+
+                for (count = 0; count < ahead->io_size; count += ret) {
+                        pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+                        ret = read (ahead->src, ahead->bufs[head] + count, ahead->io_size - count);
+                        saved_errno = errno;
+                        pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+
+                        if (ret == -1 && saved_errno == EINTR) {
+                                ret = 0;
+                                continue;
+                        }
+
+                        if (ret <= 0) {
+                                break;
+                        }
+                }
+
+                pthread_mutex_lock (&ahead->lock);
+
+                if (count > 0) {
+                        ahead->counts[head] = count;
+                        ahead->head = (head + 1) % ahead->size;
+                        ahead->filled++;
+                }
+
+                if (ret == -1) {
+                        ahead->error = saved_errno;
+                } else if (ret == 0) {
+                        ahead->eof = true;
+                }
+
+                pthread_cond_broadcast (&ahead->cond);
+
+                if (ahead->error || ahead->eof) {
+                        break;
+                }
+        }
+        pthread_mutex_unlock (&ahead->lock);
+
+        return NULL;
+}
+
+/**
+ * Stops the reader and releases the buffers, which must no longer be in use
+ * by any request in flight.
+ */
+static void
+read_ahead_free (struct read_ahead *ahead)
+{
+        if (ahead == NULL) {
+                return;
+        }
+
+        pthread_mutex_lock (&ahead->lock);
+        ahead->stop = true;
+        pthread_cond_broadcast (&ahead->cond);
+        pthread_mutex_unlock (&ahead->lock);
+
+        // The reader may be blocked reading from a producer that has stalled.
+        pthread_cancel (ahead->reader);
+        pthread_join (ahead->reader, NULL);
+
+        for (unsigned int i = 0; i < ahead->size; i++) {
+                free (ahead->bufs[i]);
+        }
+
+        pthread_cond_destroy (&ahead->cond);
+        pthread_mutex_destroy (&ahead->lock);
+        free (ahead->bufs);
+        free (ahead->counts);
+        free (ahead);
+}
+
+/**
+ * Starts reading src ahead into a ring of size buffers of io_size bytes.
+ * Returns NULL if the buffers or the reader could not be had, in which case
+ * the caller reads src itself.
+ */
+static struct read_ahead *
+read_ahead_init (int src, size_t io_size, unsigned int size)
+{
+        struct read_ahead *ahead = calloc (1, sizeof (*ahead));
+
+        if (ahead == NULL) {
+                return NULL;
+        }
+
+        ahead->src = src;
+        ahead->io_size = io_size;
+        ahead->size = size;
+        ahead->bufs = calloc (size, sizeof (*ahead->bufs));
+        ahead->counts = calloc (size, sizeof (*ahead->counts));
+        if (ahead->bufs == NULL || ahead->counts == NULL) {
+                goto err;
+        }
+
+        for (unsigned int i = 0; i < size; i++) {
+                ahead->bufs[i] = alloc_buffer (io_size);
+                if (ahead->bufs[i] == NULL) {
+                        goto err;
+                }
+        }
+
+        pthread_mutex_init (&ahead->lock, NULL);
+        pthread_cond_init (&ahead->cond, NULL);
+
+        if (pthread_create (&ahead->reader, NULL, read_ahead_reader, ahead) != 0) {
+                pthread_cond_destroy (&ahead->cond);
+                pthread_mutex_destroy (&ahead->lock);
+                goto err;
+        }
+
+        return ahead;
+
+err:
+        for (unsigned int i = 0; ahead->bufs && i < size; i++) {
+                free (ahead->bufs[i]);
+        }
+
+        free (ahead->bufs);
+        free (ahead->counts);
+        free (ahead);
+
+        return NULL;
+}
+
+/**
+ * Takes the next buffer read, storing where it starts in data. Returns the
+ * number of bytes in it, 0 at the end of the input, or -1 with errno set if
+ * it could not be read.
+ */
+static ssize_t
+read_ahead_take (struct read_ahead *ahead, char **data)
+{
+        ssize_t ret;
+
+        pthread_mutex_lock (&ahead->lock);
+        while (ahead->filled == 0 && !ahead->eof && !ahead->error) {
+                pthread_cond_wait (&ahead->cond, &ahead->lock);
+        }
+
+        if (ahead->filled > 0) {
+                *data = ahead->bufs[ahead->tail];
+                ret = ahead->counts[ahead->tail];
+                ahead->tail = (ahead->tail + 1) % ahead->size;
+                ahead->filled--;
+                ahead->taken++;
+        } else if (ahead->error) {
+                errno = ahead->error;
+                ret = -1;
+        } else {
+                ret = 0;
+        }
+        pthread_mutex_unlock (&ahead->lock);
+
+        return ret;
+}
+
+/**
+ * Hands the oldest buffer taken back to the reader once its data has been
+ * written out.
+ */
+static void
+read_ahead_release (struct read_ahead *ahead)
+{
+        pthread_mutex_lock (&ahead->lock);
+        ahead->taken--;
+        pthread_cond_broadcast (&ahead->cond);
+        pthread_mutex_unlock (&ahead->lock);
+}
+
+/**
+ * Streams data from the local file descriptor src to the current offset of
+ * fd, with up to the configured queue depth of asynchronous writes in flight.
+ * A regular file is mapped and the writes are issued from the mapping; any
+ * other source is read by a thread of its own into a ring of twice as many
+ * buffers, so that a producer writing into a pipe is not held up by the
+ * volume until the ring is full. On return the offset of fd is moved past the
+ * data that was written. If crc is not NULL, the data is added to the
+ * checksum it holds on the way through.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int
+gluster_write (int src, glfs_fd_t *fd, uint32_t *crc) {
+        size_t io_size = gluster_get_buffer_size (BUFSIZE);
+        struct pipeline *pipeline = NULL;
+        struct pipeline_slot *slot;
+        struct local_map map = { .addr = NULL };
+        struct read_ahead *ahead = NULL;
+        unsigned int head = 0;
+        ssize_t num_read = 0;
+        size_t count;
+        int ret = -1;
+        int saved_errno = 0;
+        off_t offset;
+        size_t total_written = 0;
+        time_t time_start = time (NULL);
+        time_t time_last = time_start;
+        time_t time_cur = time_start;
+
+        offset = glfs_lseek (fd, 0, SEEK_CUR);
+        if (offset == -1) {
+                goto out;
+        }
+
+        if (local_map_init (src, &map) == -1) {
+                ahead = read_ahead_init (src, io_size, queue_depth * 2);
+        }
+
+        pipeline = pipeline_init (queue_depth, io_size, map.addr || ahead);
+        if (pipeline == NULL) {
+                goto out;
+        }
+
+        while (true) {
+                slot = &pipeline->slots[head];
+                pipeline_wait (pipeline, slot);
+
+                if (slot->count) {
+                        count = slot->count;
+
+                        if (pipeline_complete_write (fd, slot) == -1) {
+                                goto drain;
+                        }
+
+                        if (map.addr) {
+                                local_map_release (&map, slot->buf + count);
+                        } else if (ahead) {
+                                read_ahead_release (ahead);
+                        }
+                }
+
+                if (map.addr) {
+                        num_read = local_map_take (&map, io_size, &slot->buf);
+                } else if (ahead) {
+                        num_read = read_ahead_take (ahead, &slot->buf);
+                        if (num_read == -1) {
+                                goto drain;
+                        }
+                } else {
+                        num_read = read (src, slot->buf, io_size);
+                        if (num_read == -1) {
+                                goto drain;
+                        }
+                }
+
+                if (num_read == 0) {
+                        break;
+                }
+
+                if (crc) {
+                        *crc = crc32c (*crc, slot->buf, num_read);
+                }
+
+                if (pipeline_submit (pipeline, slot, fd, true, offset, num_read) == -1) {
+                        goto drain;
+                }
+
+                offset += num_read;
+                total_written += num_read;
+                head = (head + 1) % pipeline->depth;
+
+                time_cur = time (NULL);
+                if (time_cur - time_last > LOG_EVERY_SECS) {
+                        time_last = time_cur;
+                        fprintf (stderr,
+                                 "Wrote: %zu. Time: %zu\n",
+                                 total_written,
+                                 time_cur - time_start);
+                }
+        }
+
+        pipeline_drain (pipeline);
+
+        for (unsigned int i = 0; i < pipeline->depth; i++) {
+                slot = &pipeline->slots[i];
+                if (slot->count && pipeline_complete_write (fd, slot) == -1) {
+                        goto out;
+                }
+        }
+
+        if (glfs_lseek (fd, offset, SEEK_SET) == -1) {
+                goto out;
+        }
+
+        ret = 0;
+        goto out;
+
+drain:
+        saved_errno = errno;
+        pipeline_drain (pipeline);
+        errno = saved_errno;
+out:
+        pipeline_free (pipeline);
+        saved_errno = errno;
+        read_ahead_free (ahead);
+        errno = saved_errno;
+        local_map_destroy (src, &map);
+
+        return ret;
+}
+
+/**
+ * Streams the data of fd from *offset up to end, or up to the end of the file
+ * if end is negative, to the local file descriptor dst. Up to the configured
+ * queue depth of asynchronous reads are kept in flight ahead of the data
+ * currently being written out, overlapping the remote fetch with the local
+ * write. *offset is moved past the data that was written, and the data is
+ * added to the checksum at crc if it is not NULL.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int
+read_until (glfs_fd_t *fd, int dst, off_t *offset, off_t end, uint32_t *crc)
+{
+        size_t io_size = gluster_get_buffer_size (BUFSIZE);
+        struct pipeline *pipeline = NULL;
+        struct pipeline_slot *slot;
+        unsigned int head = 0;
+        size_t num_written = 0;
+        size_t count;
+        ssize_t written;
+        int ret = -1;
+        int saved_errno = 0;
+        off_t next_offset;
+        size_t total_written = 0;
+        time_t time_start = time (NULL);
+        time_t time_last = time_start;
+        time_t time_cur = time_start;
+
+        if (end >= 0 && *offset >= end) {
+                return 0;
+        }
+
+        pipeline = pipeline_init (queue_depth, io_size, false);
+        if (pipeline == NULL) {
+                goto out;
+        }
+
+        next_offset = *offset;
+        for (unsigned int i = 0; i < pipeline->depth; i++) {
+                if (end >= 0 && next_offset >= end) {
+                        break;
+                }
+
+                count = end >= 0 && end - next_offset < (off_t) io_size ? (size_t) (end - next_offset) : io_size;
+                if (pipeline_submit (pipeline, &pipeline->slots[i], fd, false,
+                                     next_offset, count) == -1) {
+                        goto drain;
+                }
+
+                next_offset += count;
+        }
+
+        while (end < 0 || *offset < end) {
+                slot = &pipeline->slots[head];
+                pipeline_wait (pipeline, slot);
+
+                if (slot->ret == -1) {
+                        errno = slot->error;
+                        goto drain;
+                }
+
+                // Only a read that returns nothing marks the end of the file;
+                // anything the requests queued behind it return is discarded
+                // and will be read again by the next call.
+                if (slot->ret == 0) {
+                        break;
+                }
+
+                for (num_written = 0; num_written < slot->ret;) {
+                        written = write (dst,
+                                         &slot->buf[num_written],
+                                         slot->ret - num_written);
+                        if (written == -1) {
+                                goto drain;
+                        }
+
+                        num_written += written;
+                }
+
+                if (crc) {
+                        *crc = crc32c (*crc, slot->buf, slot->ret);
+                }
+
+                *offset += slot->ret;
+                total_written += slot->ret;
+
+                time_cur = time (NULL);
+                if (time_cur - time_last > LOG_EVERY_SECS) {
+                        time_last = time_cur;
+                        fprintf (stderr,
+                                 "Read: %zu. Time: %zu\n",
+                                 total_written,
+                                 time_cur - time_start);
+                }
+
+                // The rest of a short read is read again into the same slot,
+                // which stays the next to be written out.
+                if (slot->ret < slot->count) {
+                        if (pipeline_submit (pipeline, slot, fd, false, slot->offset + slot->ret,
+                                             slot->count - slot->ret) == -1) {
+                                goto drain;
+                        }
+
+                        continue;
+                }
+
+                if (end < 0 || next_offset < end) {
+                        count = end >= 0 && end - next_offset < (off_t) io_size ? (size_t) (end - next_offset) : io_size;
+                        if (pipeline_submit (pipeline, slot, fd, false, next_offset,
+                                             count) == -1) {
+                                goto drain;
+                        }
+
+                        next_offset += count;
+                }
+
+                head = (head + 1) % pipeline->depth;
+        }
+
+        pipeline_drain (pipeline);
+
+        ret = 0;
+        goto out;
+
+drain:
+        saved_errno = errno;
+        pipeline_drain (pipeline);
+        errno = saved_errno;
+out:
+        pipeline_free (pipeline);
+
+        return ret;
+}
+
+/**
+ * Streams data from the current offset of fd until the end of the file to the
+ * local file descriptor dst, reading ahead as read_until () does. On return
+ * the offset of fd is moved past the data that was written, so that it can be
+ * called again to pick up data appended in the meantime. If crc is not NULL,
+ * the data is added to the checksum it holds.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int
+gluster_read (glfs_fd_t *fd, int dst, uint32_t *crc) {
+        off_t offset;
+
+        offset = glfs_lseek (fd, 0, SEEK_CUR);
+        if (offset == -1) {
+                return -1;
+        }
+
+        if (read_until (fd, dst, &offset, -1, crc) == -1) {
+                return -1;
+        }
+
+        return glfs_lseek (fd, offset, SEEK_SET) == -1 ? -1 : 0;
+}
+
+/**
+ * Streams length bytes of fd from offset, or up to the end of the file if
+ * length is negative or runs past it, to the local file descriptor dst. The
+ * offset of fd is left alone.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int
+gluster_read_range (glfs_fd_t *fd, int dst, off_t offset, off_t length)
+{
+        off_t end = -1;
+
+        if (length >= 0) {
+                end = length > INT64_MAX - offset ? INT64_MAX : offset + length;
+        }
+
+        return read_until (fd, dst, &offset, end, NULL);
+}
+
+static pthread_mutex_t getopt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * getopt () keeps its state in globals, so utilities that may run
+ * concurrently (see gfcli --batch) take turns parsing their options.
+ */
+void
+lock_getopt ()
+{
+        pthread_mutex_lock (&getopt_lock);
+}
+
+void
+unlock_getopt ()
+{
+        pthread_mutex_unlock (&getopt_lock);
+}
+
+int
+gluster_getfs (glfs_t **fs, const struct gluster_url *gluster_url) {
+        int ret = -1;
+
+        *fs = glfs_new (gluster_url->volume);
+        if (*fs == NULL) {
+                goto out;
+        }
+
+        ret = glfs_set_volfile_server (*fs,
+                        "tcp",
+                        gluster_url->host,
+                        gluster_url->port);
+        if (ret == -1) {
+                goto out;
+        }
+
+        ret = glfs_init (*fs);
+
+out:
+        return ret;
+}
+
+/**
+ * Closes a connection obtained from gluster_getfs (), first forgetting the
+ * directories and attributes cached for it.
+ */
+int
+gluster_fini (glfs_t *fs)
+{
+        gluster_dir_cache_drop (fs);
+        gluster_attr_cache_disable (fs);
+
+        return glfs_fini (fs);
+}
+
+/**
+ * Builds the string identifying a connection in an fs_cache.
+ */
+static char *
+fs_cache_key (const struct gluster_url *gluster_url, struct xlator_option **options)
+{
+        struct xlator_option *option;
+        size_t length = strlen (gluster_url->host) + strlen (gluster_url->volume) + 8;
+        size_t offset;
+        char *key;
+
+        for (option = options ? *options : NULL; option; option = option->next) {
+                length += strlen (option->xlator) + strlen (option->key) + strlen (option->value) + 3;
+        }
+
+        key = malloc (length);
+        if (key == NULL) {
+                return NULL;
+        }
+
+        // A port of 0 means the default port.
+        offset = snprintf (key, length, "%s:%u/%s",
+                        gluster_url->host,
+                        gluster_url->port ? gluster_url->port : GLUSTER_DEFAULT_PORT,
+                        gluster_url->volume);
+
+        for (option = options ? *options : NULL; option; option = option->next) {
+                offset += snprintf (key + offset, length - offset, "\n%s.%s=%s",
+                                option->xlator, option->key, option->value);
+        }
+
+        return key;
+}
+
+struct fs_cache *
+fs_cache_init ()
+{
+        struct fs_cache *cache = malloc (sizeof (*cache));
+
+        if (cache == NULL) {
+                return NULL;
+        }
+
+        pthread_mutex_init (&cache->lock, NULL);
+        cache->entries = NULL;
+
+        return cache;
+}
+
+void
+fs_cache_free (struct fs_cache *cache)
+{
+        struct fs_cache_entry *entry;
+
+        if (cache == NULL) {
+                return;
+        }
+
+        while ((entry = cache->entries) != NULL) {
+                cache->entries = entry->next;
+                gluster_fini (entry->fs);
+                free (entry->key);
+                free (entry);
+        }
+
+        pthread_mutex_destroy (&cache->lock);
+        free (cache);
+}
+
+/**
+ * Returns a connection to the volume described by gluster_url with the given
+ * translator options applied, reusing one from the cache if possible. Without
+ * a cache, a new connection is made every time.
+ *
+ * The connection must be released with gluster_putfs () rather than
+ * glfs_fini (). Returns 0 on success, or -1 with errno set, in which case *fs
+ * may still need to be released.
+ */
+int
+gluster_getfs_cached (glfs_t **fs, struct fs_cache *cache,
+                      const struct gluster_url *gluster_url,
+                      struct xlator_option **options)
+{
+        struct fs_cache_entry *entry = NULL;
+        char *key = NULL;
+        int saved_errno;
+        int ret = -1;
+
+        *fs = NULL;
+
+        if (cache == NULL) {
+                ret = gluster_getfs (fs, gluster_url);
+                if (ret == 0 && options) {
+                        ret = apply_xlator_options (*fs, options);
+                }
+
+                return ret;
+        }
+
+        key = fs_cache_key (gluster_url, options);
+        if (key == NULL) {
+                return -1;
+        }
+
+        // Connecting under the lock keeps two commands from racing to set up
+        // the same connection.
+        pthread_mutex_lock (&cache->lock);
+
+        for (entry = cache->entries; entry; entry = entry->next) {
+                if (strcmp (entry->key, key) == 0) {
+                        *fs = entry->fs;
+                        ret = 0;
+                        goto out;
+                }
+        }
+
+        entry = malloc (sizeof (*entry));
+        if (entry == NULL) {
+                goto out;
+        }
+
+        ret = gluster_getfs (fs, gluster_url);
+        if (ret == 0 && options) {
+                ret = apply_xlator_options (*fs, options);
+        }
+
+        if (ret == -1) {
+                saved_errno = errno;
+                if (*fs) {
+                        gluster_fini (*fs);
+                        *fs = NULL;
+                }
+
+                free (entry);
+                errno = saved_errno;
+                goto out;
+        }
+
+        entry->key = key;
+        entry->fs = *fs;
+        entry->next = cache->entries;
+        cache->entries = entry;
+        key = NULL;
+
+out:
+        pthread_mutex_unlock (&cache->lock);
+        free (key);
+
+        return ret;
+}
+
+/**
+ * Releases a connection obtained from gluster_getfs_cached (). Connections
+ * held by the cache stay open; any other connection is closed.
+ */
+void
+gluster_putfs (struct fs_cache *cache, glfs_t *fs)
+{
+        struct fs_cache_entry *entry = NULL;
+
+        if (fs == NULL) {
+                return;
+        }
+
+        if (cache) {
+                pthread_mutex_lock (&cache->lock);
+                for (entry = cache->entries; entry; entry = entry->next) {
+                        if (entry->fs == fs) {
+                                break;
+                        }
+                }
+
+                pthread_mutex_unlock (&cache->lock);
+        }
+
+        if (entry == NULL) {
+                gluster_fini (fs);
+        }
+}
+
+struct xlator_option *
+parse_xlator_option (const char *optarg)
+{
+        char *pos;
+        char *key;
+        char *value;
+        char *xlator;
+        struct xlator_option *option = NULL;
+
+        char *opt_string = strdup (optarg);
+        if (opt_string == NULL) {
+                goto err;
+        }
+
+        if ((xlator = strtok_r (opt_string, ".", &pos)) == NULL) {
+                errno = EINVAL;
+                goto err;
+        }
+
+        if ((key = strtok_r (NULL, "=", &pos)) == NULL) {
+                errno = EINVAL;
+                goto err;
+        }
+
+        value = pos;
+        if (value == NULL || *value == '\0') {
+                errno = EINVAL;
+                goto err;
+        }
+
+        option = malloc (sizeof (*option));
+        if (option == NULL) {
+                goto err;
+        }
+
+        option->xlator = xlator;
+        option->key = key;
+        option->opt_string = opt_string;
+        option->value = value;
+
+        option->next = NULL;
+
+        goto out;
+
+err:
+        free (opt_string);
+        free (option);
+out:
+        return option;
+}
+
+void
+print_xlator_options (struct xlator_option **options)
+{
+        struct xlator_option *next = *options;
+
+        while (next) {
+                printf ("%s: %s => %s\n", next->xlator, next->key, next->value);
+
+                next = next->next;
+        }
+}
+
+uint16_t
+strtoport (const char *str)
+{
+        long raw_port;
+        uint16_t port = 0;
+        char *end;
+
+        raw_port = strtol (str, &end, 10);
+
+        if (str == end) {
+                goto err;
+        }
+
+        // Port ranges from 1 - 65535
+        if (raw_port < 1 || raw_port > UINT16_MAX) {
+                goto err;
+        }
+
+        port = (uint16_t) raw_port;
+
+        goto out;
+
+err:
+        error (0, 0, "invalid port number: \"%s\"", str);
+out:
         return port;
 }
+
+static unsigned int
+strtobounded (const char *str, long max, const char *what)
+{
+        long raw_value;
+        unsigned int value = 0;
+        char *end;
+
+        raw_value = strtol (str, &end, 10);
+
+        if (str == end || *end != '\0') {
+                goto err;
+        }
+
+        if (raw_value < 1 || raw_value > max) {
+                goto err;
+        }
+
+        value = (unsigned int) raw_value;
+
+        goto out;
+
+err:
+        error (0, 0, "invalid %s: \"%s\"", what, str);
+out:
+        return value;
+}
+
+unsigned int
+strtojobs (const char *str)
+{
+        return strtobounded (str, MAX_JOBS, "number of jobs");
+}
+
+unsigned int
+strtoqueuedepth (const char *str)
+{
+        return strtobounded (str, MAX_QUEUE_DEPTH, "queue depth");
+}
+
+unsigned int
+strtoattrtimeout (const char *str)
+{
+        return strtobounded (str, MAX_ATTR_TIMEOUT, "attribute timeout");
+}
+
+/**
+ * Converts the argument of --buffer-size into a number of bytes, rounded up
+ * to a multiple of the page size, or BUFFER_SIZE_AUTO for "auto". Returns 0
+ * on failure.
+ */
+size_t
+strtobuffersize (const char *str)
+{
+        size_t size;
+
+        if (strcasecmp (str, "auto") == 0) {
+                return BUFFER_SIZE_AUTO;
+        }
+
+        size = strtosize (str);
+        if (size == 0) {
+                return 0;
+        }
+
+        if (size > MAX_BUFFER_SIZE) {
+                error (0, 0, "buffer size too large: \"%s\"", str);
+                return 0;
+        }
+
+        return round_up (size, page_size ());
+}
+
+/**
+ * Converts a number of bytes such as "512", "64K", "4M" or "1G", suffixes
+ * being powers of 1024, storing it in bytes. Returns -1 if str is not one.
+ */
+static int
+parse_size (const char *str, unsigned long long *bytes)
+{
+        unsigned long long raw_size;
+        unsigned long long multiplier = 1;
+        char *end;
+
+        errno = 0;
+        raw_size = strtoull (str, &end, 10);
+
+        if (str == end || errno == ERANGE || *str == '-') {
+                return -1;
+        }
+
+        switch (*end) {
+                case '\0':
+                        break;
+                case 'k':
+                case 'K':
+                        multiplier = 1ULL << 10;
+                        break;
+                case 'm':
+                case 'M':
+                        multiplier = 1ULL << 20;
+                        break;
+                case 'g':
+                case 'G':
+                        multiplier = 1ULL << 30;
+                        break;
+                case 't':
+                case 'T':
+                        multiplier = 1ULL << 40;
+                        break;
+                default:
+                        return -1;
+        }
+
+        if (*end != '\0' && *(end + 1) != '\0') {
+                return -1;
+        }
+
+        if (raw_size > ULLONG_MAX / multiplier) {
+                return -1;
+        }
+
+        *bytes = raw_size * multiplier;
+
+        return 0;
+}
+
+/**
+ * Converts a size such as "512", "64K", "4M" or "1G" into a number of bytes.
+ * Suffixes are powers of 1024. Returns 0 on failure.
+ */
+size_t
+strtosize (const char *str)
+{
+        unsigned long long bytes;
+
+        if (parse_size (str, &bytes) == -1 || bytes == 0 || bytes > SIZE_MAX) {
+                error (0, 0, "invalid size: \"%s\"", str);
+                return 0;
+        }
+
+        return (size_t) bytes;
+}
+
+/**
+ * Converts an offset or length into a file, taking the same suffixes as
+ * strtosize () but allowing zero. Returns -1 on failure.
+ */
+off_t
+strtooffset (const char *str)
+{
+        unsigned long long bytes;
+
+        if (parse_size (str, &bytes) == -1 || bytes > INT64_MAX) {
+                error (0, 0, "invalid offset: \"%s\"", str);
+                return -1;
+        }
+
+        return (off_t) bytes;
+}
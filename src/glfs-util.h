@@ -24,10 +24,26 @@
 
 #define BUFSIZE 256*1024
 #define GLUSTER_DEFAULT_PORT 24007
+#define MAX_JOBS 256
+#define DEFAULT_QUEUE_DEPTH 4
+#define MAX_QUEUE_DEPTH 64
+#define MAX_ATTR_TIMEOUT 3600
+#define MAX_BUFFER_SIZE 1024*1024*1024
+#define MAX_AUTO_BUFFER_SIZE 64*1024*1024
+
+// Blocks compared when resuming a transfer, and how far back from the end of
+// the destination they are compared at least.
+#define RESUME_BLOCK_SIZE 1024*1024
+#define RESUME_VERIFY_SIZE 16*1024*1024
+
+// Buffer size requested with --buffer-size=auto
+#define BUFFER_SIZE_AUTO SIZE_MAX
 
 #include <glusterfs/api/glfs.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 struct gluster_url {
         char *host;
@@ -44,12 +60,35 @@ struct xlator_option {
         char *xlator;
 };
 
+/**
+ * A cache of initialized connections, so that commands operating on the same
+ * volume do not each have to fetch the volfile and build the graph anew.
+ * Connections are keyed by host, port, volume and translator options, and stay
+ * open until the cache is freed.
+ */
+struct fs_cache_entry {
+        struct fs_cache_entry *next;
+        char *key;
+        glfs_t *fs;
+};
+
+struct fs_cache {
+        pthread_mutex_t lock;
+        struct fs_cache_entry *entries;
+};
+
+void *
+alloc_buffer (size_t size);
+
 int
 append_xlator_option (struct xlator_option **options, struct xlator_option *option);
 
 char *
 append_path (const char *base_path, const char *hanging_path);
 
+char *
+canonical_path (const char *path);
+
 int
 apply_xlator_options (glfs_t *fs, struct xlator_option **options);
 
@@ -59,6 +98,12 @@ close_stdout ();
 void
 free_xlator_options (struct xlator_option **options);
 
+struct fs_cache *
+fs_cache_init ();
+
+void
+fs_cache_free (struct fs_cache *cache);
+
 void
 gluster_url_free (struct gluster_url *gluster_url);
 
@@ -68,27 +113,71 @@ get_default_dir_mode_perm ();
 mode_t
 get_default_file_mode_perm ();
 
+const char *
+lookup_id_name (unsigned int id, bool group, char **buf, size_t *size);
+
 int
 gluster_create_path (glfs_t *fs, char *path, mode_t omode);
 
 int
 gluster_lock (glfs_fd_t *fd, short type, bool block);
 
+void
+gluster_apply_buffer_size (size_t size, glfs_t *fs, const struct stat *statbuf);
+
+size_t
+gluster_auto_buffer_size (glfs_t *fs, const struct stat *statbuf);
+
+size_t
+gluster_get_buffer_size (size_t fallback);
+
+void
+gluster_set_buffer_size (size_t size);
+
+void
+gluster_set_queue_depth (unsigned int depth);
+
+off_t
+gluster_resume_window ();
+
 int
-gluster_write (int src, glfs_fd_t *fd);
+gluster_write (int src, glfs_fd_t *fd, uint32_t *crc);
 
 int
-gluster_read (glfs_fd_t *fd, int dst);
+gluster_read (glfs_fd_t *fd, int dst, uint32_t *crc);
+
+int
+gluster_read_range (glfs_fd_t *fd, int dst, off_t offset, off_t length);
 
 int
 gluster_getfs (glfs_t **fs, const struct gluster_url *gluster_url);
 
+int
+gluster_fini (glfs_t *fs);
+
+int
+gluster_getfs_cached (glfs_t **fs, struct fs_cache *cache,
+                      const struct gluster_url *gluster_url,
+                      struct xlator_option **options);
+
+void
+gluster_putfs (struct fs_cache *cache, glfs_t *fs);
+
 int
 gluster_parse_url (char *url, struct gluster_url **gluster_url);
 
 struct gluster_url*
 gluster_url_init ();
 
+bool
+gluster_same_volume (const struct gluster_url *a, const struct gluster_url *b);
+
+void
+lock_getopt ();
+
+void
+unlock_getopt ();
+
 struct xlator_option *
 parse_xlator_option (const char *optarg);
 
@@ -98,4 +187,22 @@ print_xlator_options (struct xlator_option **options);
 uint16_t
 strtoport (const char *str);
 
+unsigned int
+strtojobs (const char *str);
+
+unsigned int
+strtoqueuedepth (const char *str);
+
+unsigned int
+strtoattrtimeout (const char *str);
+
+size_t
+strtobuffersize (const char *str);
+
+size_t
+strtosize (const char *str);
+
+off_t
+strtooffset (const char *str);
+
 #endif
@@ -0,0 +1,206 @@
+/**
+ * A small blocking work queue used to hand work between the threads of the
+ * parallel utilities.
+ *
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "glfs-work-queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_QUEUE_SIZE 64
+
+int
+work_queue_init (struct work_queue *queue, size_t capacity)
+{
+        queue->capacity = capacity;
+        queue->size = capacity ? capacity : INITIAL_QUEUE_SIZE;
+        queue->head = 0;
+        queue->count = 0;
+        queue->pending = 0;
+        queue->closed = false;
+
+        queue->items = malloc (sizeof (*queue->items) * queue->size);
+        if (queue->items == NULL) {
+                return -1;
+        }
+
+        pthread_mutex_init (&queue->lock, NULL);
+        pthread_cond_init (&queue->not_empty, NULL);
+        pthread_cond_init (&queue->not_full, NULL);
+
+        return 0;
+}
+
+void
+work_queue_destroy (struct work_queue *queue)
+{
+        pthread_cond_destroy (&queue->not_full);
+        pthread_cond_destroy (&queue->not_empty);
+        pthread_mutex_destroy (&queue->lock);
+        free (queue->items);
+        queue->items = NULL;
+}
+
+/**
+ * Doubles the storage of an unbounded queue, unwrapping the ring so that the
+ * queued items start at index 0. Must be called with the lock held.
+ */
+static int
+work_queue_grow (struct work_queue *queue)
+{
+        size_t new_size = queue->size * 2;
+        void **items = malloc (sizeof (*items) * new_size);
+        size_t first;
+
+        if (items == NULL) {
+                return -1;
+        }
+
+        first = queue->size - queue->head;
+        if (first > queue->count) {
+                first = queue->count;
+        }
+
+        memcpy (items, &queue->items[queue->head], sizeof (*items) * first);
+        memcpy (&items[first], queue->items, sizeof (*items) * (queue->count - first));
+
+        free (queue->items);
+        queue->items = items;
+        queue->size = new_size;
+        queue->head = 0;
+
+        return 0;
+}
+
+/**
+ * Appends an item to the queue, blocking while a bounded queue is full.
+ * Returns -1 with errno set if the queue has been closed or cannot grow.
+ */
+int
+work_queue_push (struct work_queue *queue, void *item)
+{
+        int ret = -1;
+
+        pthread_mutex_lock (&queue->lock);
+
+        while (queue->capacity && queue->count == queue->capacity && !queue->closed) {
+                pthread_cond_wait (&queue->not_full, &queue->lock);
+        }
+
+        if (queue->closed) {
+                errno = ECANCELED;
+                goto out;
+        }
+
+        if (queue->count == queue->size && work_queue_grow (queue) == -1) {
+                goto out;
+        }
+
+        queue->items[(queue->head + queue->count) % queue->size] = item;
+        queue->count++;
+        queue->pending++;
+        pthread_cond_signal (&queue->not_empty);
+
+        ret = 0;
+
+out:
+        pthread_mutex_unlock (&queue->lock);
+
+        return ret;
+}
+
+/**
+ * Removes the oldest item from the queue, blocking while it is empty. Returns
+ * NULL once the queue has been closed and drained.
+ */
+void *
+work_queue_pop (struct work_queue *queue)
+{
+        void *item = NULL;
+
+        pthread_mutex_lock (&queue->lock);
+
+        while (queue->count == 0 && !queue->closed) {
+                pthread_cond_wait (&queue->not_empty, &queue->lock);
+        }
+
+        if (queue->count > 0) {
+                item = queue->items[queue->head];
+                queue->head = (queue->head + 1) % queue->size;
+                queue->count--;
+                pthread_cond_signal (&queue->not_full);
+        }
+
+        pthread_mutex_unlock (&queue->lock);
+
+        return item;
+}
+
+/**
+ * Returns the number of items currently queued.
+ */
+size_t
+work_queue_length (struct work_queue *queue)
+{
+        size_t count;
+
+        pthread_mutex_lock (&queue->lock);
+        count = queue->count;
+        pthread_mutex_unlock (&queue->lock);
+
+        return count;
+}
+
+/**
+ * Marks one previously pushed item as fully processed. Closes the queue once
+ * every pushed item has been processed.
+ */
+void
+work_queue_done (struct work_queue *queue)
+{
+        pthread_mutex_lock (&queue->lock);
+
+        if (queue->pending > 0 && --queue->pending == 0) {
+                queue->closed = true;
+                pthread_cond_broadcast (&queue->not_empty);
+                pthread_cond_broadcast (&queue->not_full);
+        }
+
+        pthread_mutex_unlock (&queue->lock);
+}
+
+/**
+ * Closes the queue: pending and future pushes fail, and consumers return NULL
+ * once the remaining items have been popped.
+ */
+void
+work_queue_close (struct work_queue *queue)
+{
+        pthread_mutex_lock (&queue->lock);
+        queue->closed = true;
+        pthread_cond_broadcast (&queue->not_empty);
+        pthread_cond_broadcast (&queue->not_full);
+        pthread_mutex_unlock (&queue->lock);
+}
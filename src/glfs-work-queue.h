@@ -0,0 +1,71 @@
+/**
+ * Copyright (C) 2015 Facebook Inc.
+ *
+ *      This program is free software: you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 3 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GLFS_WORK_QUEUE_H
+#define GLFS_WORK_QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A thread-safe FIFO of opaque items shared between producer and consumer
+ * threads.
+ *
+ * capacity: Maximum number of queued items; push blocks while the queue is
+ *           full. A capacity of 0 makes the queue unbounded.
+ * pending: Number of items pushed that have not yet been marked done with
+ *          work_queue_done (). When it drops to zero the queue closes itself,
+ *          which lets consumers that also produce work (e.g. tree walkers)
+ *          detect that the whole traversal has finished.
+ */
+struct work_queue {
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+        void **items;
+        size_t capacity;
+        size_t size;
+        size_t head;
+        size_t count;
+        size_t pending;
+        bool closed;
+};
+
+int
+work_queue_init (struct work_queue *queue, size_t capacity);
+
+void
+work_queue_destroy (struct work_queue *queue);
+
+int
+work_queue_push (struct work_queue *queue, void *item);
+
+void *
+work_queue_pop (struct work_queue *queue);
+
+size_t
+work_queue_length (struct work_queue *queue);
+
+void
+work_queue_done (struct work_queue *queue);
+
+void
+work_queue_close (struct work_queue *queue);
+
+#endif /* GLFS_WORK_QUEUE_H */
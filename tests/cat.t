@@ -132,3 +132,85 @@ teardown() {
         [ "$status" -eq 1 ]
         [ "$output" == "gfcat: glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/no_such_file: No such file or directory" ]
 }
+
+@test "cat medium file with buffer size" {
+        result=$($CMD "--buffer-size=64K" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$TEST_FILE_MEDIUM_HASH" ]
+}
+
+@test "cat medium file with automatic buffer size" {
+        result=$($CMD "--buffer-size=auto" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$TEST_FILE_MEDIUM_HASH" ]
+}
+
+@test "invalid buffer size" {
+        run $CMD "--buffer-size=test" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcat: invalid size: \"test\"" ]
+}
+
+@test "cat medium file with json stats" {
+        stats=$($CMD "--stats=json" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" 2>&1 >/dev/null)
+
+        [[ "$stats" == "{\"command\":\"gfcat\","* ]]
+        [[ "$stats" == *"\"read\":{\"count\":"* ]]
+}
+
+@test "invalid stats format" {
+        run $CMD "--stats=test" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcat: invalid stats format: \"test\"" ]
+}
+
+@test "cat byte range" {
+        result=$($CMD "--offset=1K" "--length=64K" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+        expected=$(tail -c +1025 "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_MEDIUM" | head -c 65536 | md5sum | awk '{print $1}')
+
+        [ "$result" == "$expected" ]
+}
+
+@test "cat offset past end of file" {
+        run $CMD "--offset=1T" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 0 ]
+        [ "$output" == "" ]
+}
+
+@test "invalid offset" {
+        run $CMD "--offset=-1" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcat: invalid offset: \"-1\"" ]
+}
+
+@test "cat many files" {
+        result=$($CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+        expected=$(cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_SMALL" "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$expected" ]
+}
+
+@test "cat many files with one that does not exist" {
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_CAT_DIR/does_not_exist" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcat: glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_CAT_DIR/does_not_exist: No such file or directory" ]
+}
+
+@test "cat the same file concurrently" {
+        $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" > /dev/null &
+        result=$($CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" | md5sum | awk '{print $1}')
+        wait $!
+
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cat without lock" {
+        result=$($CMD "--no-lock" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$TEST_FILE_MEDIUM_HASH" ]
+}
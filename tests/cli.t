@@ -47,3 +47,53 @@ USAGE="Usage: gfcli [-p|--port PORT] [-h|--help] [-v|--version] [glfs://<host>/<
 
         [ $? -eq 0 ]
 }
+
+@test "remote commands reuse connection" {
+        URL="glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR"
+        echo -e "cp $URL/$TEST_FILE_SMALL $URL/gfcli_test1\ndisconnect\ncp $URL/$TEST_FILE_SMALL $URL/gfcli_test2\nquit" | $CMD
+        first=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_test1" | awk '{print $1}')
+        second=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_test2" | awk '{print $1}')
+        rm -f "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_test1" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_test2"
+
+        [ "$first" == "$TEST_FILE_SMALL_HASH" ]
+        [ "$second" == "$TEST_FILE_SMALL_HASH" ]
+}
+
+@test "batch of commands" {
+        URL="glfs://$HOST/$GLUSTER_VOLUME"
+        printf "cp $ROOT_DIR/$TEST_FILE_SMALL $ROOT_DIR/gfcli_batch1\ncp $ROOT_DIR/$TEST_FILE_SMALL $ROOT_DIR/gfcli_batch2\n" | $CMD --batch=- -j 2 $URL
+        ret=$?
+        first=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_batch1" | awk '{print $1}')
+        second=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_batch2" | awk '{print $1}')
+        rm -f "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_batch1" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_batch2"
+
+        [ "$ret" -eq 0 ]
+        [ "$first" == "$TEST_FILE_SMALL_HASH" ]
+        [ "$second" == "$TEST_FILE_SMALL_HASH" ]
+}
+
+@test "batch with failing command" {
+        URL="glfs://$HOST/$GLUSTER_VOLUME"
+        run bash -c "printf 'stat $ROOT_DIR/$TEST_FILE_SMALL\nstat $ROOT_DIR/nonexistent\n' | $CMD --batch=- $URL"
+
+        [ "$status" -eq 1 ]
+        [[ "${lines[${#lines[@]} - 1]}" =~ "-:2: 'stat $ROOT_DIR/nonexistent' exited with status 1" ]]
+}
+
+@test "attribute cache forgets what commands change" {
+        URL="glfs://$HOST/$GLUSTER_VOLUME"
+        run bash -c "printf 'stat $ROOT_DIR/gfcli_attr\ncp $ROOT_DIR/$TEST_FILE_SMALL $ROOT_DIR/gfcli_attr\nstat $ROOT_DIR/gfcli_attr\nrm $ROOT_DIR/gfcli_attr\nstat $ROOT_DIR/gfcli_attr\n' | $CMD --attr-timeout=60 --batch=- $URL"
+        rm -f "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcli_attr"
+
+        [ "$status" -eq 1 ]
+        [[ "${output}" =~ "-:1: 'stat $ROOT_DIR/gfcli_attr' exited with status 1" ]]
+        [[ ! "${output}" =~ "-:3:" ]]
+        [[ "${output}" =~ "-:5: 'stat $ROOT_DIR/gfcli_attr' exited with status 1" ]]
+}
+
+@test "invalid attribute timeout" {
+        run $CMD --attr-timeout=0 "glfs://$HOST/$GLUSTER_VOLUME"
+
+        [ "$status" -eq 1 ]
+        [ "$output" = "gfcli: invalid attribute timeout: \"0\"" ]
+}
@@ -120,6 +120,26 @@ teardown() {
         [ "$result" == "$TEST_FILE_LARGE_HASH" ]
 }
 
+@test "cp large local file to remote destination with verify" {
+        run $CMD "--verify" "-j" "4" "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test"
+        result=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cp with verify fails against a stale recorded checksum" {
+        cp "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_SMALL" "$GLUSTER_MOUNT_DIR$ROOT_DIR/gfcp_test"
+        size=$(stat -c %s "$GLUSTER_MOUNT_DIR$ROOT_DIR/gfcp_test")
+        mtime=$(stat -c %.9Y "$GLUSTER_MOUNT_DIR$ROOT_DIR/gfcp_test")
+        setfattr -n user.glusterfs-coreutils.crc32c -v "crc32c:00000000 $size $mtime" "$GLUSTER_MOUNT_DIR$ROOT_DIR/gfcp_test"
+
+        run $CMD "--verify" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test" "$TEMP_FILE"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfcp: failed to verify $TEMP_FILE: Bad message" ]
+}
+
 @test "cp small remote file to local destination" {
         run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL" "$TEMP_FILE"
         result=$(md5sum "$TEMP_FILE" | awk '{print $1}')
@@ -167,3 +187,131 @@ teardown() {
         [ "$status" -eq 0 ]
         [ "$result" == "$TEST_FILE_LARGE_HASH" ]
 }
+
+@test "cp large local file to remote destination with parallel jobs" {
+        run $CMD "-j" "4" "--chunk-size=1M" "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test"
+        result=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cp large remote file to local destination with parallel jobs" {
+        run $CMD "-j" "4" "--chunk-size=1M" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" "$TEMP_FILE"
+        result=$(md5sum "$TEMP_FILE" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cp large remote file to remote destination with parallel jobs" {
+        run $CMD "-j" "4" "--chunk-size=1M" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test"
+        result=$(md5sum "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cp resume interrupted remote file to local destination" {
+        head -c 1M "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" > "$TEMP_FILE"
+        echo "garbage" >> "$TEMP_FILE"
+
+        run $CMD "--resume" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" "$TEMP_FILE"
+        result=$(md5sum "$TEMP_FILE" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "cp resume with parallel jobs and journal" {
+        journal=$(mktemp -u)
+        head -c 1M "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" > "$TEMP_FILE"
+
+        run $CMD "--resume" "-j" "4" "--journal=$journal" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" "$TEMP_FILE"
+        result=$(md5sum "$TEMP_FILE" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+        [ ! -e "$journal" ]
+}
+
+@test "cp resume with parallel jobs and no journal" {
+        run $CMD "--resume" "-j" "4" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_LARGE" "$TEMP_FILE"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcp: --resume with -j requires --journal" ]
+}
+
+@test "cp sparse remote file to local destination" {
+        truncate -s 64M "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_sparse"
+        echo "data" | dd of="$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_sparse" bs=1M seek=32 conv=notrunc 2>/dev/null
+
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_sparse" "$TEMP_FILE"
+        cmp "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_sparse" "$TEMP_FILE"
+        result=$?
+        blocks=$(stat -c %b "$TEMP_FILE")
+        rm -f "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_sparse"
+
+        [ "$status" -eq 0 ]
+        [ "$result" -eq 0 ]
+        [ "$blocks" -lt 131072 ]
+}
+
+@test "invalid jobs flag" {
+        run $CMD "-j" "0" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL" "$TEMP_FILE"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcp: invalid number of jobs: \"0\"" ]
+}
+
+@test "cp local directory to remote destination recursively" {
+        source_dir=$(mktemp -d)
+        mkdir -p "$source_dir/a/b"
+        cp "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_SMALL" "$source_dir/small"
+        cp "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" "$source_dir/a/b/large"
+        ln -s small "$source_dir/a/link"
+
+        run $CMD "-r" "$source_dir" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test"
+        diff -r "$source_dir" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test"
+        result=$?
+        rm -rf "$source_dir"
+
+        [ "$status" -eq 0 ]
+        [ "$result" -eq 0 ]
+}
+
+@test "cp remote directory to local destination recursively" {
+        mkdir -p "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test/a"
+        cp "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_MEDIUM" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test/a/medium"
+        dest_dir=$(mktemp -d)
+
+        run $CMD "-r" "--meta-jobs=2" "-j" "2" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test" "$dest_dir"
+        diff -r "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test" "$dest_dir/gfcp_test"
+        result=$?
+        rm -rf "$dest_dir"
+
+        [ "$status" -eq 0 ]
+        [ "$result" -eq 0 ]
+}
+
+@test "cp remote directory to remote destination recursively" {
+        mkdir -p "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test/a"
+        cp "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_LARGE" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test/a/large"
+        cp "$GLUSTER_BRICK_DIR$ROOT_DIR/$TEST_FILE_SMALL" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test/small"
+
+        run $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test_copy"
+        diff -r "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test" "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test_copy"
+        result=$?
+        rm -rf "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test_copy"
+
+        [ "$status" -eq 0 ]
+        [ "$result" -eq 0 ]
+}
+
+@test "cp directory without recursive flag" {
+        mkdir -p "$GLUSTER_BRICK_DIR$ROOT_DIR/gfcp_test"
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfcp_test" "$TEMP_FILE"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfcp: -r not specified; omitting directory '$ROOT_DIR/gfcp_test'" ]
+}
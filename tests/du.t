@@ -0,0 +1,89 @@
+#!/usr/bin/env bats
+
+CMD="$CMD_PREFIX $BUILD_DIR/bin/gfdu"
+
+setup() {
+        TEST_DU_DIR=$(mktemp -d --tmpdir="$GLUSTER_MOUNT_DIR$ROOT_DIR")
+        dd if=/dev/zero of="$TEST_DU_DIR/file" bs=1024 count=8 &> /dev/null
+        ln "$TEST_DU_DIR/file" "$TEST_DU_DIR/link"
+        mkdir "$TEST_DU_DIR/sub"
+        dd if=/dev/zero of="$TEST_DU_DIR/sub/file" bs=1024 count=4 &> /dev/null
+        TEST_DU_DIR=$(basename "$TEST_DU_DIR")
+}
+
+teardown() {
+        rm -rf "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_DU_DIR"
+}
+
+@test "no arguments" {
+        run $CMD
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfdu: missing operand" ]
+}
+
+@test "long help flag" {
+        run $CMD "--help"
+
+        [ "$status" -eq 0 ]
+        [ "${lines[0]}" == "Usage: gfdu [OPTION]... URL..." ]
+}
+
+@test "invalid port flag" {
+        run $CMD "-p" "test"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfdu: invalid port number: \"test\"" ]
+}
+
+@test "invalid max depth flag" {
+        run $CMD "--max-depth=test" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfdu: invalid maximum depth: \"test\"" ]
+}
+
+@test "summarize in bytes counts hard links once" {
+        run $CMD "-sb" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR"
+
+        expected=$(du -sb "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_DU_DIR" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "$(echo "$output" | awk '{print $1}')" == "$expected" ]
+}
+
+@test "max depth of zero" {
+        run $CMD "-b" "-d" "0" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR"
+
+        [ "$status" -eq 0 ]
+        [ "${#lines[@]}" -eq 1 ]
+}
+
+@test "directories come after their sub-directories" {
+        run $CMD "-b" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR"
+
+        [ "$status" -eq 0 ]
+        [ "${#lines[@]}" -eq 2 ]
+        [[ "${lines[0]}" == *"/$TEST_DU_DIR/sub" ]]
+        [[ "${lines[1]}" == *"/$TEST_DU_DIR" ]]
+}
+
+@test "paths are counted in the order given" {
+        url="glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR"
+        run $CMD "-sb" "$url/sub" "$url" "$url/file"
+
+        expected=$(cd "$GLUSTER_MOUNT_DIR$ROOT_DIR" && du -sb "$TEST_DU_DIR/sub" "$TEST_DU_DIR" "$TEST_DU_DIR/file" | awk '{print $1}')
+
+        [ "$status" -eq 0 ]
+        [ "${#lines[@]}" -eq 2 ]
+        [[ "${lines[0]}" == *"/$TEST_DU_DIR/sub" ]]
+        [[ "${lines[1]}" == *"/$TEST_DU_DIR" ]]
+        [ "$(echo "$output" | awk '{print $1}')" == "$expected" ]
+}
+
+@test "non-existent path" {
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DU_DIR/missing"
+
+        [ "$status" -eq 1 ]
+        [[ "$output" == *"No such file or directory" ]]
+}
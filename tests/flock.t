@@ -69,3 +69,20 @@ teardown() {
         [ "$output" == "$GLUSTER_PROMPT $GLUSTER_PROMPT " ]
 
 }
+
+@test "Lock and unlock many files in one command" {
+        SECOND_LOCK_FILE=$(basename $(mktemp --tmpdir="$GLUSTER_MOUNT_DIR/$ROOT_DIR"))
+        run bash -c "printf 'flock $ROOT_DIR/$TEST_LOCK_FILE $ROOT_DIR/$SECOND_LOCK_FILE\nflock -u $ROOT_DIR/$TEST_LOCK_FILE $ROOT_DIR/$SECOND_LOCK_FILE\n' | $GLUSTER_SHELL_CMD"
+        rm -f "$GLUSTER_MOUNT_DIR/$ROOT_DIR/$SECOND_LOCK_FILE"
+
+        [ "$output" == "$GLUSTER_PROMPT $GLUSTER_PROMPT $GLUSTER_PROMPT " ]
+}
+
+@test "Try conflicting write lock on one of many files" {
+        SECOND_LOCK_FILE=$(basename $(mktemp --tmpdir="$GLUSTER_MOUNT_DIR/$ROOT_DIR"))
+        run bash -c "exec 3>$GLUSTER_MOUNT_DIR/$ROOT_DIR/$SECOND_LOCK_FILE; flock -s 3; echo \"flock -n -e $ROOT_DIR/$TEST_LOCK_FILE $ROOT_DIR/$SECOND_LOCK_FILE\" | $GLUSTER_SHELL_CMD; exec 3>&-"
+        rm -f "$GLUSTER_MOUNT_DIR/$ROOT_DIR/$SECOND_LOCK_FILE"
+
+        [[ "$output" =~ "failed to lock $ROOT_DIR/$SECOND_LOCK_FILE: Resource temporarily unavailable" ]]
+        [[ ! "$output" =~ "failed to lock $ROOT_DIR/$TEST_LOCK_FILE" ]]
+}
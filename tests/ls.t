@@ -110,3 +110,38 @@ teardown() {
         [ "$status" -eq 1 ]
         [ "$output" == "gfls: cannot access glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/no_such_directory: No such file or directory" ]
 }
+
+@test "ls sub-directory recursively" {
+        run $CMD "-R" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first"
+
+        [ "$status" -eq 0 ]
+        [ "${lines[0]}" == "$ROOT_DIR/first:" ]
+        [ "${lines[2]}" == "$ROOT_DIR/first/second:" ]
+        [ "${lines[4]}" == "$ROOT_DIR/first/second/third:" ]
+}
+
+@test "ls sub-directory recursively with jobs flag" {
+        expected=$($CMD "-Rl" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first")
+        run $CMD "-Rl" "-j" "4" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first"
+
+        [ "$status" -eq 0 ]
+        [ "$output" == "$expected" ]
+}
+
+@test "ls sorts entries" {
+        touch "$GLUSTER_MOUNT_DIR$ROOT_DIR/first/b" "$GLUSTER_MOUNT_DIR$ROOT_DIR/first/a"
+        echo "data" > "$GLUSTER_MOUNT_DIR$ROOT_DIR/first/c"
+
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first"
+        [ "$status" -eq 0 ]
+        [ "$output" == "a b c second " ]
+
+        run $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first"
+        [ "$status" -eq 0 ]
+        [ "$output" == "second c b a " ]
+
+        run $CMD "-lS" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/first"
+        [ "$status" -eq 0 ]
+        [[ "${lines[0]}" == *" second" ]]
+        [[ "${lines[1]}" == *" c" ]]
+}
@@ -122,3 +122,20 @@ teardown() {
         [ "$status" -eq 1 ]
         [ "$output" == "gfmkdir: cannot create directory \`glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DIR': File exists" ]
 }
+
+@test "mkdir many nested directories with parents flag" {
+        run $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/test_dir/a/1" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/test_dir/a/2" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/test_dir/b/1"
+
+        [ "$status" -eq 0 ]
+        [ -d "$GLUSTER_MOUNT_DIR$ROOT_DIR/test_dir/a/1" ]
+        [ -d "$GLUSTER_MOUNT_DIR$ROOT_DIR/test_dir/a/2" ]
+        [ -d "$GLUSTER_MOUNT_DIR$ROOT_DIR/test_dir/b/1" ]
+}
+
+@test "mkdir many directories with one that already exists" {
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DIR" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/test_dir"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfmkdir: cannot create directory \`glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DIR': File exists" ]
+        [ -d "$GLUSTER_MOUNT_DIR$ROOT_DIR/test_dir" ]
+}
@@ -0,0 +1,104 @@
+#!/usr/bin/env bats
+
+CMD="$CMD_PREFIX $BUILD_DIR/bin/gfmv"
+URL="glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR"
+
+setup() {
+        TEST_MV_FILE=$(mktemp --tmpdir="$GLUSTER_MOUNT_DIR$ROOT_DIR")
+        TEST_MV_FILE=$(basename "$TEST_MV_FILE")
+        echo "moved" > "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE"
+
+        TEST_MV_DIR=$(mktemp -d --tmpdir="$GLUSTER_MOUNT_DIR$ROOT_DIR")
+        TEST_MV_DIR=$(basename "$TEST_MV_DIR")
+}
+
+teardown() {
+        rm -f "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE" "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE.moved"
+        rm -rf "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR"
+}
+
+@test "no arguments" {
+        run $CMD
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfmv: missing file operand" ]
+}
+
+@test "missing destination" {
+        run $CMD "$URL/$TEST_MV_FILE"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfmv: missing destination file operand after \`$URL/$TEST_MV_FILE'" ]
+}
+
+@test "rename file" {
+        run $CMD "$URL/$TEST_MV_FILE" "$URL/$TEST_MV_FILE.moved"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE" ]
+        [ "$(cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE.moved")" == "moved" ]
+}
+
+@test "move file into directory" {
+        run $CMD "$URL/$TEST_MV_FILE" "$URL/$TEST_MV_DIR"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE" ]
+        [ -f "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/$TEST_MV_FILE" ]
+}
+
+@test "move non-existant path" {
+        run $CMD "$URL/does_not_exist" "$URL/$TEST_MV_DIR"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfmv: cannot move \`$URL/does_not_exist' to \`$ROOT_DIR/$TEST_MV_DIR/does_not_exist': No such file or directory" ]
+}
+
+@test "move file to another volume" {
+        # The same volume through another host name is a connection of its
+        # own, which moves by copying and removing instead of renaming.
+        alt_host=$(getent ahostsv4 "$HOST" | awk 'NR == 1 { print $1 }')
+        if [ -z "$alt_host" ] || [ "$alt_host" == "$HOST" ]; then
+                skip "no other name for $HOST"
+        fi
+
+        run $CMD "$URL/$TEST_MV_FILE" "glfs://$alt_host/$GLUSTER_VOLUME$ROOT_DIR/$TEST_MV_DIR"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE" ]
+        [ "$(cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/$TEST_MV_FILE")" == "moved" ]
+}
+
+@test "move directory to another volume" {
+        alt_host=$(getent ahostsv4 "$HOST" | awk 'NR == 1 { print $1 }')
+        if [ -z "$alt_host" ] || [ "$alt_host" == "$HOST" ]; then
+                skip "no other name for $HOST"
+        fi
+
+        mkdir -p "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/source/sub"
+        echo "nested" > "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/source/sub/file"
+
+        run $CMD "$URL/$TEST_MV_DIR/source" "glfs://$alt_host/$GLUSTER_VOLUME$ROOT_DIR/$TEST_MV_DIR/dest"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/source" ]
+        [ "$(cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_DIR/dest/sub/file")" == "nested" ]
+}
+
+@test "move file to another volume keeps a source that does not check out" {
+        alt_host=$(getent ahostsv4 "$HOST" | awk 'NR == 1 { print $1 }')
+        if [ -z "$alt_host" ] || [ "$alt_host" == "$HOST" ]; then
+                skip "no other name for $HOST"
+        fi
+
+        # A checksum recorded for the current source that the data does not
+        # have makes the copy look corrupt.
+        file="$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_MV_FILE"
+        setfattr -n user.glusterfs-coreutils.crc32c -v "crc32c:00000000 $(stat -c %s "$file") $(stat -c %.9Y "$file")" "$file"
+
+        run $CMD "$URL/$TEST_MV_FILE" "glfs://$alt_host/$GLUSTER_VOLUME$ROOT_DIR/$TEST_MV_DIR"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfmv: failed to verify the copy of \`$URL/$TEST_MV_FILE', not removing it: Bad message" ]
+        [ "$(cat "$file")" == "moved" ]
+}
@@ -117,6 +117,30 @@ teardown() {
         [ "$result" == "$TEST_FILE_LARGE_HASH" ]
 }
 
+@test "put large file with verify" {
+        cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_LARGE" | $CMD "--verify" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfput_test";
+        result=$(md5sum $GLUSTER_MOUNT_DIR$ROOT_DIR/gfput_test | awk '{print $1}')
+        stored=$(getfattr --only-values -n user.glusterfs-coreutils.crc32c $GLUSTER_MOUNT_DIR$ROOT_DIR/gfput_test)
+
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+        [[ "$stored" == "crc32c:"* ]]
+}
+
+@test "put large file from a slow pipe with a deep queue" {
+        (head -c 1M "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_LARGE"; sleep 1; tail -c +1048577 "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_LARGE") | $CMD "--queue-depth=16" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfput_test";
+        result=$(md5sum $GLUSTER_MOUNT_DIR$ROOT_DIR/gfput_test | awk '{print $1}')
+
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
+@test "put resume interrupted large file" {
+        head -c 1M "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_LARGE" > "$GLUSTER_MOUNT_DIR$ROOT_DIR/gfput_test"
+        cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_LARGE" | $CMD "--resume" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/gfput_test";
+        result=$(md5sum $GLUSTER_MOUNT_DIR$ROOT_DIR/gfput_test | awk '{print $1}')
+
+        [ "$result" == "$TEST_FILE_LARGE_HASH" ]
+}
+
 @test "put file into subdir that does not exist with parent flag" {
         cat "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_SMALL" | $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_DIR/gfput_test";
         result=$(md5sum $GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_DIR/gfput_test | awk '{print $1}')
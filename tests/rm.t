@@ -102,8 +102,19 @@ teardown() {
 @test "rm a file with recursive flag" {
         run $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_FILE"
 
-        [ "$status" -eq 1 ]
-        [ "$output" == "gfrm: cannot remove \`glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_FILE': Not a directory" ]
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_FILE" ]
+}
+
+@test "rm multiple files" {
+        touch "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/a" "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/b"
+        run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_FILE" \
+                "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_DIR/a" \
+                "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_DIR/b"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_FILE" ]
+        [ -z "$(ls -A "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR")" ]
 }
 
 @test "rm a directory" {
@@ -119,6 +130,23 @@ teardown() {
         [ "$status" -eq 0 ]
 }
 
+@test "rm a non-empty directory with recursive flag" {
+        mkdir -p "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/sub/subsub"
+        touch "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/a" "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/sub/b"
+        ln -s a "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR/sub/link"
+        run $CMD "-r" "-j" "4" "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_RM_DIR"
+
+        [ "$status" -eq 0 ]
+        [ ! -e "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_RM_DIR" ]
+}
+
+@test "rm the volume root with recursive flag" {
+        run $CMD "-r" "glfs://$HOST/$GLUSTER_VOLUME/"
+
+        [ "$status" -eq 1 ]
+        [ "$output" == "gfrm: it is dangerous to operate recursively on \`glfs://$HOST/$GLUSTER_VOLUME/'" ]
+}
+
 @test "rm a path that does not exist" {
         run $CMD "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/no_such_file"
 
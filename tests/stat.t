@@ -78,3 +78,31 @@ USAGE="Usage: gfstat [-L|--deference] [-p|--port PORT] [-h|--help] [-v|--version
         [ "$status" -eq 1 ]
         [ "$output" == "gfstat: cannot stat \`glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/does_not_exist': No such file or directory" ]
 }
+
+@test "stat multiple paths in order" {
+        run $CMD -j 4 "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_SMALL" \
+                "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/does_not_exist" \
+                "glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/$TEST_FILE_MEDIUM"
+
+        [ "$status" -eq 1 ]
+        [ "$(echo "$output" | grep "File:" | head -n 1)" == "  File: \`$ROOT_DIR/$TEST_FILE_SMALL'" ]
+        [ "$(echo "$output" | grep -c "File:")" -eq 2 ]
+        echo "$output" | grep -q "cannot stat \`glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR/does_not_exist'"
+}
+
+@test "stat paths from standard input" {
+        paths=$(printf "$TEST_FILE_SMALL\0$TEST_FILE_MEDIUM\0$TEST_FILE_LARGE\0" | tr '\0' '\n')
+
+        run bash -c "printf '$TEST_FILE_SMALL\0$TEST_FILE_MEDIUM\0$TEST_FILE_LARGE\0' \
+                | $CMD -j 2 --files0-from=- glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR"
+
+        [ "$status" -eq 0 ]
+        [ "$(echo "$output" | grep "File:" | sed -e "s|.*$ROOT_DIR/||" -e "s|'$||")" == "$paths" ]
+}
+
+@test "stat paths from standard input with extra operand" {
+        run $CMD --files0-from=- "glfs://$HOST/$GLUSTER_VOLUME" "glfs://$HOST/$GLUSTER_VOLUME"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gfstat: extra operand \`glfs://$HOST/$GLUSTER_VOLUME'" ]
+}
@@ -142,3 +142,50 @@ BASE_URL="glfs://$HOST/$GLUSTER_VOLUME$ROOT_DIR"
 
         [ "$status" -eq 0 ]
 }
+
+@test "tail many lines" {
+        result=$($CMD -n 100000 "$BASE_URL/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+        expected_result=$(tail -n 100000 "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$expected_result" ]
+}
+
+@test "tail multiple files" {
+        result=$($CMD -n 2 "$BASE_URL/$TEST_FILE_SMALL" "$BASE_URL/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+        expected_result=$(cd "$GLUSTER_MOUNT_DIR$ROOT_DIR" && tail -n 2 "$TEST_FILE_SMALL" "$TEST_FILE_MEDIUM" \
+                | sed "s|^==> \(.*\) <==$|==> $BASE_URL/\1 <==|" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$expected_result" ]
+}
+
+@test "tail multiple files quietly" {
+        result=$($CMD -q -n 2 "$BASE_URL/$TEST_FILE_SMALL" "$BASE_URL/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+        expected_result=$(tail -q -n 2 "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_SMALL" "$GLUSTER_MOUNT_DIR$ROOT_DIR/$TEST_FILE_MEDIUM" | md5sum | awk '{print $1}')
+
+        [ "$result" == "$expected_result" ]
+}
+
+@test "tail multiple files with one missing" {
+        run $CMD -q -n 1 "$BASE_URL/does_not_exist" "$BASE_URL/$TEST_FILE_SMALL"
+
+        [ "$status" -eq 1 ]
+        [ "${lines[0]}" == "gftail: cannot open \`$BASE_URL/does_not_exist' for reading: No such file or directory" ]
+}
+
+@test "follow appended data" {
+        TEST_TAIL_FILE=$(mktemp --tmpdir="$GLUSTER_MOUNT_DIR$ROOT_DIR")
+        echo "first" > "$TEST_TAIL_FILE"
+
+        $CMD -f -s 10000 "$BASE_URL/$(basename "$TEST_TAIL_FILE")" > "$TEST_TAIL_FILE.out" &
+        pid=$!
+        sleep 2
+        echo "second" >> "$TEST_TAIL_FILE"
+        sleep 2
+        kill -INT "$pid"
+        wait "$pid"
+
+        result=$(cat "$TEST_TAIL_FILE.out")
+        rm -f "$TEST_TAIL_FILE" "$TEST_TAIL_FILE.out"
+
+        [ "$result" == "$(printf 'first\nsecond')" ]
+}